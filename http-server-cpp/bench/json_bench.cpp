@@ -0,0 +1,254 @@
+// JSON validation microbenchmark: JsonValidator with each scanner kernel vs.
+// the is_valid_json first/last-character check it replaced.
+//
+//   cmake --build build --target json_bench
+//   ./build/json_bench [samples_dir] [seconds_per_case]
+//
+// Documents are the uploads in samples_dir (default
+// http-server-cpp/resources/uploads) plus synthetic multi-MB ones. Reports
+// MB/s per kernel, whole-buffer and fed in 16 KB reads as the server does,
+// and how many malformed inputs each validator lets through.
+
+#include "json_validator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// The validator HTTPServer used before JsonValidator, kept verbatim for comparison
+bool legacy_is_valid_json(std::string_view json_str) {
+    // Simple JSON validation - check for basic structure
+    if (json_str.empty()) {
+        return false;
+    }
+
+    // Remove whitespace
+    std::string trimmed(json_str);
+    trimmed.erase(std::remove_if(trimmed.begin(), trimmed.end(), ::isspace), trimmed.end());
+
+    // Check if it starts and ends with braces or brackets
+    if ((trimmed.front() == '{' && trimmed.back() == '}') ||
+        (trimmed.front() == '[' && trimmed.back() == ']')) {
+        return true;
+    }
+
+    // Check for quoted strings (simple validation)
+    if (trimmed.front() == '"' && trimmed.back() == '"') {
+        return true;
+    }
+
+    // Check for numbers
+    try {
+        std::stod(trimmed);
+        return true;
+    } catch (...) {
+        // Not a number
+    }
+
+    // Check for boolean values
+    if (trimmed == "true" || trimmed == "false" || trimmed == "null") {
+        return true;
+    }
+
+    return false;
+}
+
+constexpr size_t READ_SIZE = 16 * 1024;
+constexpr size_t TARGET_BYTES = 4 * 1024 * 1024;
+
+struct Document {
+    std::string name;
+    std::string text;
+};
+
+// Deterministic filler so runs are comparable
+uint32_t next_random(uint32_t& state) {
+    state = state * 1664525 + 1013904223;
+    return state >> 8;
+}
+
+std::string records(bool pretty) {
+    const char* nl = pretty ? "\n" : "";
+    const char* in1 = pretty ? "  " : "";
+    const char* in2 = pretty ? "    " : "";
+    const char* sep = pretty ? " " : "";
+    uint32_t seed = 1;
+    std::string out = std::string("[") + nl;
+    for (int i = 0; out.size() < TARGET_BYTES; i++) {
+        if (i > 0) {
+            out += std::string(",") + nl;
+        }
+        char line[512];
+        snprintf(line, sizeof(line),
+                 "%s{%s%s\"id\":%s%d,%s%s\"name\":%s\"user %u\",%s%s\"email\":%s\"user%u@example.com\",%s"
+                 "%s\"score\":%s%u.%02ue-3,%s%s\"active\":%s%s,%s%s\"tags\":%s[\"alpha\",%s\"beta\"],%s"
+                 "%s\"bio\":%s\"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor\"%s%s}",
+                 in1, nl, in2, sep, i, nl, in2, sep, next_random(seed) % 100000, nl, in2, sep,
+                 next_random(seed) % 100000, nl, in2, sep, next_random(seed) % 1000, next_random(seed) % 100, nl, in2,
+                 sep, i % 3 ? "true" : "false", nl, in2, sep, sep, nl, in2, sep, nl, in1);
+        out += line;
+    }
+    return out + nl + "]";
+}
+
+std::string strings_utf8() {
+    static const char* pieces[] = {"plain ascii words and more words ", "caf\xc3\xa9 ", "\xe6\xbc\xa2\xe5\xad\x97 ",
+                                   "\xf0\x9f\x98\x80 ", "tab\\tnewline\\n ", "\\u00e9 ", "quote\\\" "};
+    uint32_t seed = 2;
+    std::string out = "[";
+    while (out.size() < TARGET_BYTES) {
+        out += out.size() > 1 ? ",\"" : "\"";
+        for (int j = 0; j < 40; j++) {
+            uint32_t r = next_random(seed) % 16;
+            out += pieces[r < 10 ? 0 : r - 9];
+        }
+        out += "\"";
+    }
+    return out + "]";
+}
+
+std::string numbers() {
+    uint32_t seed = 3;
+    std::string out = "[";
+    char number[48];
+    while (out.size() < TARGET_BYTES) {
+        snprintf(number, sizeof(number), "%s%u.%06u,-%ue%u", out.size() > 1 ? "," : "", next_random(seed),
+                 next_random(seed) % 1000000, next_random(seed) % 1000, next_random(seed) % 30);
+        out += number;
+    }
+    return out + "]";
+}
+
+std::string nested() {
+    std::string out = "[";
+    while (out.size() < TARGET_BYTES) {
+        out += out.size() > 1 ? "," : "";
+        for (int depth = 0; depth < 100; depth++) {
+            out += "{\"k\":[";
+        }
+        out += "0";
+        for (int depth = 0; depth < 100; depth++) {
+            out += "]}";
+        }
+    }
+    return out + "]";
+}
+
+std::vector<Document> load_samples(const std::string& dir) {
+    std::vector<Document> samples;
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        return samples;
+    }
+    while (dirent* entry = readdir(handle)) {
+        std::string name = entry->d_name;
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0) {
+            std::ifstream file(dir + "/" + name, std::ios::binary);
+            std::ostringstream text;
+            text << file.rdbuf();
+            samples.push_back({name, text.str()});
+        }
+    }
+    closedir(handle);
+    std::sort(samples.begin(), samples.end(), [](const Document& a, const Document& b) { return a.name < b.name; });
+    return samples;
+}
+
+bool validate(JsonValidator& validator, const std::string& text, size_t read_size) {
+    validator.reset();
+    for (size_t pos = 0; pos < text.size(); pos += read_size) {
+        if (!validator.feed(text.data() + pos, std::min(read_size, text.size() - pos))) {
+            return false;
+        }
+    }
+    return validator.finish();
+}
+
+// MB/s, repeating until `seconds` have passed
+template <typename Fn>
+double measure(const std::string& text, double seconds, Fn&& run) {
+    volatile bool sink = false;
+    size_t iterations = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        sink = run(text);
+        iterations++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < seconds);
+    (void)sink;
+    return static_cast<double>(text.size()) * iterations / elapsed / (1024 * 1024);
+}
+
+const char* MALFORMED[] = {
+    "{garbage}", "[1,]", "{\"a\" 1}", "[1 2]", "{\"a\":1}}{", "[\"unterminated]", "{\"a\":tru}", "[01]",
+    "[\"\\x\"]", "[\"\xc3\x28\"]", "{\"a\":1,}", "[-]", "\"\x01\"", "[1.]", "{1:2}",
+};
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string samples_dir = argc > 1 ? argv[1] : "http-server-cpp/resources/uploads";
+    double seconds = argc > 2 ? std::atof(argv[2]) : 0.3;
+
+    std::vector<Document> documents = load_samples(samples_dir);
+    documents.push_back({"records (pretty)", records(true)});
+    documents.push_back({"records (minified)", records(false)});
+    documents.push_back({"strings (utf-8)", strings_utf8()});
+    documents.push_back({"numbers", numbers()});
+    documents.push_back({"nested (depth 100)", nested()});
+
+    std::vector<JsonValidator::Kernel> kernels;
+    for (JsonValidator::Kernel kernel :
+         {JsonValidator::Kernel::SCALAR, JsonValidator::Kernel::SSE2, JsonValidator::Kernel::AVX2}) {
+        if (JsonValidator::use_kernel(kernel)) {
+            kernels.push_back(kernel);
+        }
+    }
+    JsonValidator::Kernel best = kernels.back();
+
+    std::printf("%-34s %10s %10s", "document", "bytes", "legacy");
+    for (JsonValidator::Kernel kernel : kernels) {
+        std::printf(" %10s", JsonValidator::kernel_name(kernel));
+    }
+    std::printf(" %10s   (MB/s)\n", "16k reads");
+
+    JsonValidator validator;
+    for (const Document& document : documents) {
+        std::printf("%-34s %10zu", document.name.c_str(), document.text.size());
+        std::printf(" %10.0f", measure(document.text, seconds, legacy_is_valid_json));
+
+        bool valid = true;
+        for (JsonValidator::Kernel kernel : kernels) {
+            JsonValidator::use_kernel(kernel);
+            valid = validate(validator, document.text, document.text.size());
+            std::printf(" %10.0f", measure(document.text, seconds, [&](const std::string& text) {
+                return validate(validator, text, text.size());
+            }));
+        }
+        JsonValidator::use_kernel(best);
+        std::printf(" %10.0f", measure(document.text, seconds, [&](const std::string& text) {
+            return validate(validator, text, READ_SIZE);
+        }));
+        std::printf("%s\n", valid ? "" : "   INVALID");
+    }
+
+    int legacy_accepted = 0;
+    int accepted = 0;
+    for (const char* input : MALFORMED) {
+        legacy_accepted += legacy_is_valid_json(input);
+        accepted += validate(validator, input, READ_SIZE);
+    }
+    std::printf("\nmalformed inputs accepted: legacy %d/%zu, JsonValidator %d/%zu\n", legacy_accepted,
+                std::size(MALFORMED), accepted, std::size(MALFORMED));
+    std::printf("kernel selected at startup on this CPU: %s\n", JsonValidator::kernel_name(best));
+    return 0;
+}
@@ -0,0 +1,1129 @@
+// Reproducible load generator. For every scenario it starts the server
+// binary on a free loopback port, inside a scratch directory that links the
+// real resources (so uploads never land in the tree), drives it with
+// non-blocking keep-alive or close-per-request clients (or HTTP/2 clients
+// multiplexing streams over one connection) and appends one JSON object per
+// scenario to the results file:
+//
+//   cmake --build build --target bench       # full matrix -> build/bench-results.jsonl
+//   ./build/loadgen --server ./build/server [--root .] [--out FILE]
+//       [--duration 5] [--warmup 2] [--threads N] [--scenario NAME]...
+//       [--server-args "4 --io=epoll --log-level=warn"] [--label TEXT] [--syscalls]
+//   ./build/loadgen --compare old.jsonl new.jsonl
+//
+// Reported per scenario: throughput, p50/p99/p999/max latency (send of a
+// request to the last byte of its response), and server CPU per request
+// from the child's utime+stime. 503 responses (load shedding) are counted
+// apart and left out of throughput and latency, which describe the requests
+// the server admitted. --compare prints the change of each of those
+// between two result files, so runs from two commits can be diffed.
+//
+// --syscalls also counts the server's system calls per request by tracing
+// it with ptrace during the measured window. Every system call stops the
+// server twice, so throughput, latency and CPU from such a run are not
+// comparable with untraced runs; measure those separately.
+//
+// A server built with -DALLOC_STATS=ON also gets its heap allocations per
+// request reported, read from /metrics at both ends of the measured window.
+
+#include "metrics.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Scenario {
+    const char* name;
+    const char* method;
+    const char* path;
+    int connections;
+    int pipeline;       // requests written back to back per connection (HTTP/2: concurrent streams)
+    bool keep_alive;
+    bool http2 = false; // h2c with prior knowledge
+    const char* server_args = "";   // appended to --server-args
+};
+
+// The fixed matrix. Names are the join key for --compare, so never reuse one
+// for a different shape.
+constexpr Scenario SCENARIOS[] = {
+    {"html_keepalive_c10", "GET", "/index.html", 10, 1, true},
+    {"html_close_c10", "GET", "/index.html", 10, 1, false},
+    {"binary_keepalive_c10", "GET", "/ronaldo.png", 10, 1, true},
+    {"json_post_keepalive_c10", "POST", "/upload", 10, 1, true},
+    {"html_pipelined16_c10", "GET", "/index.html", 10, 16, true},
+    {"html_keepalive_c1k", "GET", "/index.html", 1000, 1, true},
+    {"html_keepalive_c10k", "GET", "/index.html", 10000, 1, true},
+    {"html_h2_c10", "GET", "/index.html", 10, 1, true, true},
+    {"html_h2_streams16_c10", "GET", "/index.html", 10, 16, true, true},
+    {"binary_h2_c10", "GET", "/ronaldo.png", 10, 1, true, true},
+    // More connecting clients than the thread pool can take: exercises load shedding
+    {"html_close_c1k_threads", "GET", "/index.html", 1000, 1, false, false, "--io=threads"},
+};
+
+constexpr size_t READ_CHUNK = 64 * 1024;
+constexpr size_t MAX_RESPONSE_HEAD = 16 * 1024;
+
+// HTTP/2: the client preface, SETTINGS raising the stream window to 1 GiB
+// and a WINDOW_UPDATE doing the same for the connection, so flow control
+// never holds the server back; the connection window is topped up as
+// DATA arrives
+constexpr char H2_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr uint32_t H2_WINDOW = 1u << 30;
+constexpr uint8_t H2_DATA = 0x0;
+constexpr uint8_t H2_HEADERS = 0x1;
+constexpr uint8_t H2_RST_STREAM = 0x3;
+constexpr uint8_t H2_SETTINGS = 0x4;
+constexpr uint8_t H2_GOAWAY = 0x7;
+constexpr uint8_t H2_WINDOW_UPDATE = 0x8;
+constexpr uint8_t H2_END_STREAM = 0x1;
+constexpr uint8_t H2_ACK = 0x1;
+constexpr uint8_t H2_END_HEADERS = 0x4;
+
+constexpr char JSON_BODY[] =
+    "{\"player\": \"Steven Gerrard\", \"club\": \"Liverpool\", \"position\": \"midfielder\", "
+    "\"appearances\": 710, \"goals\": 186, \"honours\": [\"Champions League\", \"UEFA Cup\", "
+    "\"FA Cup\", \"League Cup\"]}";
+
+struct Options {
+    std::string server;
+    std::string root = ".";
+    std::string out = "bench-results.jsonl";
+    std::string server_args = "4 --io=epoll --log-level=warn";
+    std::string label;
+    std::vector<std::string> only;
+    double duration = 5.0;
+    double warmup = 2.0;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    bool syscalls = false;
+};
+
+struct Stats {
+    uint64_t requests = 0;
+    uint64_t errors = 0;        // non-2xx responses but 503, malformed responses, failed connects
+    uint64_t shed = 0;          // 503 responses
+    uint64_t reconnects = 0;    // keep-alive connections the server closed under us
+    uint64_t bytes = 0;
+    LatencyHistogram latency;
+    uint64_t max_latency_ns = 0;
+};
+
+struct ClientConn {
+    int fd = -1;
+    bool connected = false;
+    bool watching_output = true;    // registered with EPOLLOUT to see the connect finish
+    size_t send_offset = 0;
+    int in_flight = 0;
+    uint64_t sent_at = 0;       // the batch goes out in one write
+    std::string head;
+    uint64_t body_remaining = 0;
+    uint64_t response_bytes = 0;
+    bool in_body = false;
+    int status = 0;
+
+    // HTTP/2: `head` buffers partial frames instead
+    std::string out;            // this batch's frames (the preface first on a new connection)
+    uint32_t next_stream = 1;
+    uint64_t unacked = 0;       // DATA bytes not yet returned to the connection window
+};
+
+struct Window {
+    uint64_t measure_start;
+    uint64_t end;
+};
+
+void append_h2_frame_header(std::string& out, size_t length, uint8_t type, uint8_t flags, uint32_t stream) {
+    char header[9] = {char(length >> 16), char(length >> 8), char(length), char(type), char(flags),
+                      char(stream >> 24), char(stream >> 16), char(stream >> 8), char(stream)};
+    out.append(header, sizeof(header));
+}
+
+void append_h2_window_update(std::string& out, uint32_t stream, uint32_t increment) {
+    append_h2_frame_header(out, 4, H2_WINDOW_UPDATE, 0, stream);
+    char bytes[4] = {char(increment >> 24), char(increment >> 16), char(increment >> 8), char(increment)};
+    out.append(bytes, sizeof(bytes));
+}
+
+int open_client(const sockaddr_in& addr) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+class Worker {
+public:
+    Worker(const Scenario& scenario, const sockaddr_in& addr, int connections, const std::string& batch,
+           Window window)
+        : scenario(scenario), addr(addr), batch(batch), window(window), conns(connections) {}
+
+    void run() {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) {
+            stats.errors += conns.size();
+            return;
+        }
+        for (size_t i = 0; i < conns.size(); i++) {
+            reconnect(i, false);
+        }
+
+        std::vector<epoll_event> events(1024);
+        std::vector<char> buffer(READ_CHUNK);
+        while (Metrics::now_ns() < window.end) {
+            int n = epoll_wait(epfd, events.data(), static_cast<int>(events.size()), 50);
+            for (int i = 0; i < n; i++) {
+                size_t index = events[i].data.u64;
+                if (events[i].events & EPOLLOUT) {
+                    on_writable(index);
+                }
+                if (conns[index].fd >= 0 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                    on_readable(index, buffer);
+                }
+            }
+        }
+
+        for (ClientConn& conn : conns) {
+            if (conn.fd >= 0) {
+                close(conn.fd);
+            }
+        }
+        close(epfd);
+    }
+
+    Stats stats;
+
+private:
+    const Scenario& scenario;
+    const sockaddr_in addr;
+    const std::string& batch;
+    const Window window;
+    std::vector<ClientConn> conns;
+    int epfd = -1;
+
+    bool measuring(uint64_t now) const {
+        return now >= window.measure_start && now < window.end;
+    }
+
+    void reconnect(size_t index, bool server_closed) {
+        ClientConn& conn = conns[index];
+        if (conn.fd >= 0) {
+            close(conn.fd);
+        }
+        if (server_closed && measuring(Metrics::now_ns())) {
+            stats.reconnects++;
+        }
+        conn = ClientConn{};
+        conn.fd = open_client(addr);
+        if (conn.fd < 0) {
+            if (measuring(Metrics::now_ns())) {
+                stats.errors++;
+            }
+            return;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+        ev.data.u64 = index;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, conn.fd, &ev);
+    }
+
+    void watch_output(ClientConn& conn, size_t index, bool want) {
+        if (conn.watching_output == want) {
+            return;
+        }
+        conn.watching_output = want;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | (want ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        ev.data.u64 = index;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, conn.fd, &ev);
+    }
+
+    void start_batch(size_t index) {
+        ClientConn& conn = conns[index];
+        conn.send_offset = 0;
+        conn.in_flight = scenario.pipeline;
+        conn.sent_at = Metrics::now_ns();
+        if (scenario.http2) {
+            // `batch` is the request's header block; each stream gets a new id
+            conn.out.clear();
+            if (conn.next_stream == 1) {
+                conn.out.append(H2_PREFACE, sizeof(H2_PREFACE) - 1);
+                append_h2_frame_header(conn.out, 6, H2_SETTINGS, 0, 0);
+                const char setting[6] = {0, 4, char(H2_WINDOW >> 24), char(H2_WINDOW >> 16), char(H2_WINDOW >> 8),
+                                         char(H2_WINDOW)};
+                conn.out.append(setting, sizeof(setting));
+                append_h2_window_update(conn.out, 0, H2_WINDOW - 65535);
+            }
+            for (int i = 0; i < scenario.pipeline; i++) {
+                append_h2_frame_header(conn.out, batch.size(), H2_HEADERS, H2_END_STREAM | H2_END_HEADERS,
+                                       conn.next_stream);
+                conn.out += batch;
+                conn.next_stream += 2;
+            }
+        }
+        send_pending(index);
+    }
+
+    void send_pending(size_t index) {
+        ClientConn& conn = conns[index];
+        const std::string& data = scenario.http2 ? conn.out : batch;
+        while (conn.send_offset < data.size()) {
+            ssize_t sent = send(conn.fd, data.data() + conn.send_offset, data.size() - conn.send_offset,
+                                MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    watch_output(conn, index, true);
+                } else {
+                    reconnect(index, true);
+                }
+                return;
+            }
+            conn.send_offset += static_cast<size_t>(sent);
+        }
+        watch_output(conn, index, false);
+    }
+
+    void on_writable(size_t index) {
+        ClientConn& conn = conns[index];
+        if (!conn.connected) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+            if (error != 0) {
+                // Refused or reset during the connect storm; try again
+                if (measuring(Metrics::now_ns())) {
+                    stats.errors++;
+                }
+                reconnect(index, false);
+                return;
+            }
+            conn.connected = true;
+            start_batch(index);
+            return;
+        }
+        send_pending(index);
+    }
+
+    void on_readable(size_t index, std::vector<char>& buffer) {
+        ClientConn& conn = conns[index];
+        if (!conn.connected) {
+            return;
+        }
+        while (true) {
+            ssize_t n = recv(conn.fd, buffer.data(), buffer.size(), 0);
+            if (n > 0) {
+                if (!consume(index, buffer.data(), static_cast<size_t>(n))) {
+                    return;   // connection was recycled
+                }
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            // EOF or error: expected after Connection: close, otherwise the
+            // server hit its per-connection request cap or dropped us
+            reconnect(index, scenario.keep_alive || conn.in_flight > 0);
+            return;
+        }
+    }
+
+    // Returns false once the connection has been replaced
+    bool consume(size_t index, const char* data, size_t length) {
+        ClientConn& conn = conns[index];
+        if (scenario.http2) {
+            return consume_h2(index, data, length);
+        }
+        while (length > 0) {
+            if (!conn.in_body) {
+                size_t old_size = conn.head.size();
+                conn.head.append(data, length);
+                size_t search_from = old_size >= 3 ? old_size - 3 : 0;
+                size_t end = conn.head.find("\r\n\r\n", search_from);
+                if (end == std::string::npos) {
+                    if (conn.head.size() > MAX_RESPONSE_HEAD) {
+                        stats.errors++;
+                        reconnect(index, false);
+                        return false;
+                    }
+                    return true;
+                }
+                size_t head_length = end + 4;
+                size_t used = head_length - old_size;
+                if (!parse_head(conn, head_length)) {
+                    stats.errors++;
+                    reconnect(index, false);
+                    return false;
+                }
+                data += used;
+                length -= used;
+                conn.in_body = true;
+            }
+
+            size_t take = static_cast<size_t>(std::min<uint64_t>(conn.body_remaining, length));
+            conn.body_remaining -= take;
+            data += take;
+            length -= take;
+            if (conn.body_remaining == 0 && !complete_response(index)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Frames in, responses counted at END_STREAM. Only status 200 is
+    // expected: the server encodes it as static table index 8
+    bool consume_h2(size_t index, const char* data, size_t length) {
+        ClientConn& conn = conns[index];
+        conn.head.append(data, length);
+        size_t pos = 0;
+        std::string control;
+        while (conn.head.size() - pos >= 9) {
+            const uint8_t* frame = reinterpret_cast<const uint8_t*>(conn.head.data() + pos);
+            size_t frame_length = (size_t(frame[0]) << 16) | (size_t(frame[1]) << 8) | frame[2];
+            if (conn.head.size() - pos < 9 + frame_length) {
+                break;
+            }
+            uint8_t type = frame[3];
+            uint8_t flags = frame[4];
+            pos += 9 + frame_length;
+            if (measuring(Metrics::now_ns())) {
+                stats.bytes += 9 + frame_length;
+            }
+
+            if (type == H2_SETTINGS && !(flags & H2_ACK)) {
+                append_h2_frame_header(control, 0, H2_SETTINGS, H2_ACK, 0);
+            } else if (type == H2_GOAWAY) {
+                reconnect(index, true);
+                return false;
+            } else if (type == H2_DATA) {
+                conn.unacked += frame_length;
+                if (conn.unacked >= H2_WINDOW / 2) {
+                    append_h2_window_update(control, 0, static_cast<uint32_t>(conn.unacked));
+                    conn.unacked = 0;
+                }
+            }
+
+            // Streams interleave, so a failure is counted when it is seen
+            // and complete_response() only counts the stream as done
+            bool failed = type == H2_RST_STREAM || (type == H2_HEADERS && (frame_length == 0 || frame[9] != 0x88));
+            if (failed && measuring(Metrics::now_ns())) {
+                stats.errors++;
+            }
+            if (type == H2_RST_STREAM || ((type == H2_HEADERS || type == H2_DATA) && (flags & H2_END_STREAM))) {
+                int fd = conn.fd;
+                conn.status = 200;
+                if (!complete_response(index) || conns[index].fd != fd) {
+                    return false;
+                }
+            }
+        }
+        conn.head.erase(0, pos);
+        // Control frames are tiny; a full socket buffer here means the run is broken anyway
+        if (!control.empty() && send(conn.fd, control.data(), control.size(), MSG_NOSIGNAL) < 0 &&
+            errno != EAGAIN) {
+            reconnect(index, true);
+            return false;
+        }
+        return true;
+    }
+
+    bool parse_head(ClientConn& conn, size_t head_length) {
+        std::string_view head(conn.head.data(), head_length);
+        if (head.size() < 12 || head.compare(0, 5, "HTTP/") != 0) {
+            return false;
+        }
+        conn.status = std::atoi(conn.head.c_str() + 9);
+        conn.body_remaining = 0;
+        size_t pos = 0;
+        while ((pos = head.find("\r\n", pos)) != std::string_view::npos && pos + 2 < head.size()) {
+            pos += 2;
+            if (strncasecmp(head.data() + pos, "content-length:", 15) == 0) {
+                conn.body_remaining = std::strtoull(head.data() + pos + 15, nullptr, 10);
+            }
+        }
+        conn.response_bytes = head_length + conn.body_remaining;
+        return true;
+    }
+
+    bool complete_response(size_t index) {
+        ClientConn& conn = conns[index];
+        uint64_t now = Metrics::now_ns();
+        if (measuring(now) && conn.status == 503) {
+            stats.shed++;
+        } else if (measuring(now)) {
+            uint64_t latency = now - conn.sent_at;
+            stats.requests++;
+            stats.bytes += conn.response_bytes;
+            stats.latency.record(latency);
+            stats.max_latency_ns = std::max(stats.max_latency_ns, latency);
+            if (conn.status < 200 || conn.status >= 300) {
+                stats.errors++;
+            }
+        }
+
+        // Bytes past the head were handed back to consume(), so drop them all
+        if (!scenario.http2) {
+            conn.head.clear();
+        }
+        conn.in_body = false;
+        conn.in_flight--;
+        if (conn.in_flight > 0) {
+            return true;
+        }
+        if (!scenario.keep_alive) {
+            reconnect(index, false);
+            return false;
+        }
+        int fd = conn.fd;
+        start_batch(index);
+        return conns[index].fd == fd;
+    }
+};
+
+// Counts system call entries of every server thread over the measured
+// window. Seizes the threads listed in /proc/<pid>/task (and, through
+// PTRACE_O_TRACECLONE, any they start), stops each at every syscall entry
+// and exit, and detaches them all when the window ends.
+class SyscallCounter {
+public:
+    SyscallCounter(pid_t pid, Window window) : pid(pid), window(window) {}
+
+    void run() {
+        uint64_t now = Metrics::now_ns();
+        if (now < window.measure_start) {
+            usleep(static_cast<useconds_t>((window.measure_start - now) / 1000));
+        }
+        attach_all();
+        while (Metrics::now_ns() < window.end && !tracees.empty()) {
+            int status;
+            pid_t tid = waitpid(-1, &status, __WALL | WNOHANG);
+            if (tid == 0) {
+                usleep(100);
+                continue;
+            }
+            if (tid < 0) {
+                break;
+            }
+            on_stop(tid, status);
+        }
+        detach_all();
+    }
+
+    uint64_t calls = 0;
+
+private:
+    struct Tracee {
+        bool running = true;
+        bool in_syscall = false;    // last syscall stop was an entry
+        int signal = 0;             // to deliver when it resumes or is detached
+    };
+
+    const pid_t pid;
+    const Window window;
+    std::map<pid_t, Tracee> tracees;
+
+    void attach_all() {
+        std::string path = "/proc/" + std::to_string(pid) + "/task";
+        DIR* dir = opendir(path.c_str());
+        if (!dir) {
+            return;
+        }
+        while (dirent* entry = readdir(dir)) {
+            pid_t tid = static_cast<pid_t>(std::atoi(entry->d_name));
+            if (tid > 0 && ptrace(PTRACE_SEIZE, tid, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE) == 0) {
+                tracees[tid];
+                // Syscall stops only start once the thread is resumed with
+                // PTRACE_SYSCALL, which needs it stopped first
+                ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr);
+            }
+        }
+        closedir(dir);
+    }
+
+    void on_stop(pid_t tid, int status) {
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            tracees.erase(tid);
+            return;
+        }
+        if (!WIFSTOPPED(status)) {
+            return;
+        }
+        // A new thread can report its first stop before its creator's clone event
+        Tracee& tracee = tracees[tid];
+        tracee.running = false;
+        int signal = WSTOPSIG(status);
+        int event = status >> 16;
+        if (signal == (SIGTRAP | 0x80)) {
+            if (!tracee.in_syscall) {
+                calls++;
+            }
+            tracee.in_syscall = !tracee.in_syscall;
+        } else if (event == PTRACE_EVENT_CLONE) {
+            unsigned long child = 0;
+            ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &child);
+            tracees[static_cast<pid_t>(child)];
+        } else if (event == 0) {
+            // Signal delivery: pass it on
+            tracee.signal = signal;
+        }
+        resume(tid, tracee);
+    }
+
+    void resume(pid_t tid, Tracee& tracee) {
+        if (Metrics::now_ns() >= window.end) {
+            return;   // left stopped for detach_all()
+        }
+        ptrace(PTRACE_SYSCALL, tid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(tracee.signal)));
+        tracee.signal = 0;
+        tracee.running = true;
+    }
+
+    void detach_all() {
+        for (auto& [tid, tracee] : tracees) {
+            if (tracee.running) {
+                ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr);
+            }
+        }
+        while (std::any_of(tracees.begin(), tracees.end(), [](const auto& entry) { return entry.second.running; })) {
+            int status;
+            pid_t tid = waitpid(-1, &status, __WALL);
+            if (tid < 0) {
+                break;
+            }
+            on_stop(tid, status);
+        }
+        for (auto& [tid, tracee] : tracees) {
+            ptrace(PTRACE_DETACH, tid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(tracee.signal)));
+        }
+        tracees.clear();
+    }
+};
+
+// HTTP/2 header block: :method GET and :scheme http from the static table,
+// :path, :authority and user-agent as literals never added to the dynamic
+// table, so every stream can send the same bytes
+std::string build_h2_request(const Scenario& scenario, int port) {
+    std::string authority = "localhost:" + std::to_string(port);
+    std::string block = "\x82\x86";
+    block += '\x04';
+    block += static_cast<char>(std::strlen(scenario.path));
+    block += scenario.path;
+    block += '\x01';
+    block += static_cast<char>(authority.size());
+    block += authority;
+    block += "\x0f\x2b\x07loadgen";
+    return block;
+}
+
+std::string build_request(const Scenario& scenario, int port) {
+    if (scenario.http2) {
+        return build_h2_request(scenario, port);
+    }
+    std::string request;
+    request += scenario.method;
+    request += " ";
+    request += scenario.path;
+    request += " HTTP/1.1\r\nHost: localhost:" + std::to_string(port) + "\r\n";
+    request += "User-Agent: loadgen\r\n";
+    if (!scenario.keep_alive) {
+        request += "Connection: close\r\n";
+    }
+    if (std::strcmp(scenario.method, "POST") == 0) {
+        request += "Content-Type: application/json\r\n";
+        request += "Content-Length: " + std::to_string(sizeof(JSON_BODY) - 1) + "\r\n\r\n";
+        request += JSON_BODY;
+    } else {
+        request += "\r\n";
+    }
+    std::string batch;
+    for (int i = 0; i < scenario.pipeline; i++) {
+        batch += request;
+    }
+    return batch;
+}
+
+// Scratch working directory mirroring <root>/http-server-cpp/resources with
+// symlinks and an empty uploads directory
+bool make_sandbox(const std::string& root, std::string& sandbox) {
+    char pattern[] = "/tmp/loadgen.XXXXXX";
+    if (!mkdtemp(pattern)) {
+        return false;
+    }
+    sandbox = pattern;
+    fs::path source = fs::absolute(fs::path(root) / "http-server-cpp" / "resources");
+    fs::path target = fs::path(sandbox) / "http-server-cpp" / "resources";
+    std::error_code ec;
+    fs::create_directories(target / "uploads", ec);
+    if (ec || !fs::is_directory(source)) {
+        return false;
+    }
+    for (const auto& entry : fs::directory_iterator(source, ec)) {
+        if (entry.path().filename() == "uploads") {
+            continue;
+        }
+        fs::create_symlink(entry.path(), target / entry.path().filename(), ec);
+        if (ec) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int pick_port() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+pid_t start_server(const Options& options, const Scenario& scenario, const std::string& sandbox, int port) {
+    std::vector<std::string> args = {options.server, std::to_string(port), "127.0.0.1"};
+    std::istringstream extra(options.server_args + " " + scenario.server_args);
+    for (std::string arg; extra >> arg;) {
+        args.push_back(arg);
+    }
+
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+    if (chdir(sandbox.c_str()) < 0) {
+        _exit(127);
+    }
+    int log = open("server.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log >= 0) {
+        dup2(log, STDOUT_FILENO);
+        dup2(log, STDERR_FILENO);
+        close(log);
+    }
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+}
+
+bool wait_for_port(const sockaddr_in& addr, pid_t pid) {
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) {
+            close(fd);
+            return true;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (waitpid(pid, nullptr, WNOHANG) == pid) {
+            return false;
+        }
+        usleep(50 * 1000);
+    }
+    return false;
+}
+
+void stop_server(pid_t pid) {
+    kill(pid, SIGTERM);
+    for (int attempt = 0; attempt < 50; attempt++) {
+        if (waitpid(pid, nullptr, WNOHANG) == pid) {
+            return;
+        }
+        usleep(100 * 1000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+// Value of an unlabelled sample on the server's /metrics page; -1 if the
+// page or the sample is missing (a server built without ALLOC_STATS)
+double scrape_metric(const sockaddr_in& addr, int port, const char* name) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    timeval timeout{2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    std::string page;
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) {
+        std::string request = "GET /metrics HTTP/1.1\r\nHost: localhost:" + std::to_string(port) +
+                              "\r\nConnection: close\r\n\r\n";
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+            char buffer[16384];
+            ssize_t n;
+            while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+                page.append(buffer, static_cast<size_t>(n));
+            }
+        }
+    }
+    close(fd);
+
+    std::string key = std::string("\n") + name + " ";
+    size_t at = page.find(key);
+    return at == std::string::npos ? -1 : std::strtod(page.c_str() + at + key.size(), nullptr);
+}
+
+// utime + stime of a process, in seconds
+double process_cpu_seconds(pid_t pid) {
+    std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    size_t paren = stat.rfind(')');
+    if (paren == std::string::npos) {
+        return 0.0;
+    }
+    // Fields after the command name start at field 3 (state); utime is 14
+    std::istringstream fields(stat.substr(paren + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for (int index = 3; fields >> field; index++) {
+        if (index == 14) {
+            utime = std::strtoull(field.c_str(), nullptr, 10);
+        } else if (index == 15) {
+            stime = std::strtoull(field.c_str(), nullptr, 10);
+            break;
+        }
+    }
+    return static_cast<double>(utime + stime) / static_cast<double>(sysconf(_SC_CLK_TCK));
+}
+
+double self_cpu_seconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+void raise_fd_limit(size_t wanted) {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0) {
+        return;
+    }
+    if (limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (limit.rlim_cur < wanted) {
+        std::fprintf(stderr, "warning: RLIMIT_NOFILE is %llu, the 10k scenario needs about %zu\n",
+                     static_cast<unsigned long long>(limit.rlim_cur), wanted);
+    }
+}
+
+bool run_scenario(const Scenario& scenario, const Options& options, const std::string& sandbox,
+                  std::ofstream& out) {
+    int port = pick_port();
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    pid_t pid = port > 0 ? start_server(options, scenario, sandbox, port) : -1;
+    if (pid < 0 || !wait_for_port(addr, pid)) {
+        std::fprintf(stderr, "%s: server did not come up (see %s/server.log)\n", scenario.name, sandbox.c_str());
+        if (pid > 0) {
+            stop_server(pid);
+        }
+        return false;
+    }
+
+    std::string batch = build_request(scenario, port);
+    uint64_t start = Metrics::now_ns();
+    Window window{start + static_cast<uint64_t>(options.warmup * 1e9),
+                  start + static_cast<uint64_t>((options.warmup + options.duration) * 1e9)};
+
+    int thread_count = std::min(options.threads, scenario.connections);
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int t = 0; t < thread_count; t++) {
+        int share = scenario.connections / thread_count + (t < scenario.connections % thread_count ? 1 : 0);
+        workers.push_back(std::make_unique<Worker>(scenario, addr, share, batch, window));
+    }
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&worker] { worker->run(); });
+    }
+    SyscallCounter syscalls(pid, window);
+    std::thread tracer;
+    if (options.syscalls) {
+        tracer = std::thread([&syscalls] { syscalls.run(); });
+    }
+
+    // CPU is sampled over the measured window only
+    uint64_t now = Metrics::now_ns();
+    if (now < window.measure_start) {
+        usleep(static_cast<useconds_t>((window.measure_start - now) / 1000));
+    }
+    double server_cpu_start = process_cpu_seconds(pid);
+    double client_cpu_start = self_cpu_seconds();
+    double allocations_start = scrape_metric(addr, port, "process_allocations_total");
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (tracer.joinable()) {
+        tracer.join();
+    }
+    double server_cpu = process_cpu_seconds(pid) - server_cpu_start;
+    double client_cpu = self_cpu_seconds() - client_cpu_start;
+    double allocations_end = allocations_start >= 0 ? scrape_metric(addr, port, "process_allocations_total") : -1;
+    stop_server(pid);
+
+    Stats total;
+    uint64_t buckets[LatencyHistogram::BUCKETS] = {};
+    uint64_t count = 0, sum_ns = 0;
+    for (auto& worker : workers) {
+        total.requests += worker->stats.requests;
+        total.errors += worker->stats.errors;
+        total.shed += worker->stats.shed;
+        total.reconnects += worker->stats.reconnects;
+        total.bytes += worker->stats.bytes;
+        total.max_latency_ns = std::max(total.max_latency_ns, worker->stats.max_latency_ns);
+        worker->stats.latency.merge_into(buckets, count, sum_ns);
+    }
+
+    double requests = static_cast<double>(std::max<uint64_t>(total.requests, 1));
+    double p50 = LatencyHistogram::quantile(buckets, count, 0.5) / 1e3;
+    double p99 = LatencyHistogram::quantile(buckets, count, 0.99) / 1e3;
+    double p999 = LatencyHistogram::quantile(buckets, count, 0.999) / 1e3;
+    double rps = total.requests / options.duration;
+
+    char syscall_field[64] = "";
+    if (options.syscalls) {
+        std::snprintf(syscall_field, sizeof(syscall_field), ", \"server_syscalls_per_request\": %.2f",
+                      static_cast<double>(syscalls.calls) / requests);
+    }
+    bool allocations_known = allocations_start >= 0 && allocations_end >= 0;
+    double allocations = (allocations_end - allocations_start) / requests;
+    char allocation_field[64] = "";
+    if (allocations_known) {
+        std::snprintf(allocation_field, sizeof(allocation_field), ", \"server_allocations_per_request\": %.3f",
+                      allocations);
+    }
+
+    char line[1024];
+    std::snprintf(line, sizeof(line),
+                  "{\"scenario\": \"%s\", \"label\": \"%s\", \"method\": \"%s\", \"path\": \"%s\", "
+                  "\"connections\": %d, \"pipeline\": %d, \"keep_alive\": %s, \"http2\": %s, \"duration_s\": %.2f, "
+                  "\"requests\": %llu, \"errors\": %llu, \"shed\": %llu, \"reconnects\": %llu, "
+                  "\"throughput_rps\": %.1f, \"mbytes_per_s\": %.2f, "
+                  "\"latency_p50_us\": %.1f, \"latency_p99_us\": %.1f, \"latency_p999_us\": %.1f, "
+                  "\"latency_max_us\": %.1f, \"server_cpu_us_per_request\": %.2f, "
+                  "\"client_cpu_us_per_request\": %.2f%s%s}",
+                  scenario.name, options.label.c_str(), scenario.method, scenario.path, scenario.connections,
+                  scenario.pipeline, scenario.keep_alive ? "true" : "false", scenario.http2 ? "true" : "false", options.duration,
+                  static_cast<unsigned long long>(total.requests), static_cast<unsigned long long>(total.errors),
+                  static_cast<unsigned long long>(total.shed), static_cast<unsigned long long>(total.reconnects), rps,
+                  total.bytes / options.duration / (1024.0 * 1024.0), p50, p99, p999,
+                  total.max_latency_ns / 1e3, server_cpu * 1e6 / requests, client_cpu * 1e6 / requests, syscall_field,
+                  allocation_field);
+    out << line << "\n";
+    out.flush();
+
+    std::printf("%-26s %10.0f %9.1f %9.1f %9.1f %9.2f %8llu\n", scenario.name, rps, p50, p99, p999,
+                server_cpu * 1e6 / requests, static_cast<unsigned long long>(total.errors));
+    if (total.shed > 0) {
+        std::printf("%-26s %10.0f shed/s (503)\n", "", total.shed / options.duration);
+    }
+    if (options.syscalls) {
+        std::printf("%-26s %10.2f syscalls/request\n", "", static_cast<double>(syscalls.calls) / requests);
+    }
+    if (allocations_known) {
+        std::printf("%-26s %10.3f allocations/request\n", "", allocations);
+    }
+    std::fflush(stdout);
+    return true;
+}
+
+// Results files are one flat JSON object per line; pull out numeric fields
+std::map<std::string, std::map<std::string, double>> load_results(const std::string& path) {
+    std::map<std::string, std::map<std::string, double>> results;
+    std::ifstream file(path);
+    for (std::string line; std::getline(file, line);) {
+        std::map<std::string, double> fields;
+        std::string scenario;
+        size_t pos = 0;
+        while ((pos = line.find('"', pos)) != std::string::npos) {
+            size_t key_end = line.find('"', pos + 1);
+            if (key_end == std::string::npos || line.compare(key_end + 1, 2, ": ") != 0) {
+                break;
+            }
+            std::string key = line.substr(pos + 1, key_end - pos - 1);
+            size_t value = key_end + 3;
+            if (line[value] == '"') {
+                size_t value_end = line.find('"', value + 1);
+                if (key == "scenario") {
+                    scenario = line.substr(value + 1, value_end - value - 1);
+                }
+                pos = value_end + 1;
+            } else {
+                fields[key] = std::strtod(line.c_str() + value, nullptr);
+                pos = line.find_first_of(",}", value);
+            }
+        }
+        if (!scenario.empty()) {
+            results[scenario] = fields;
+        }
+    }
+    return results;
+}
+
+int compare(const std::string& before_path, const std::string& after_path) {
+    auto before = load_results(before_path);
+    auto after = load_results(after_path);
+    if (before.empty() || after.empty()) {
+        std::fprintf(stderr, "could not read results from %s or %s\n", before_path.c_str(), after_path.c_str());
+        return 1;
+    }
+    const char* keys[] = {"throughput_rps", "latency_p50_us", "latency_p99_us", "latency_p999_us",
+                          "server_cpu_us_per_request", "server_syscalls_per_request",
+                          "server_allocations_per_request"};
+    std::printf("%-26s %-26s %12s %12s %9s\n", "scenario", "metric", "before", "after", "change");
+    for (const auto& [scenario, fields] : after) {
+        auto old = before.find(scenario);
+        if (old == before.end()) {
+            continue;
+        }
+        for (const char* key : keys) {
+            if (!old->second.count(key) && !fields.count(key)) {
+                continue;
+            }
+            double was = old->second.count(key) ? old->second.at(key) : 0.0;
+            double now = fields.count(key) ? fields.at(key) : 0.0;
+            double change = was != 0.0 ? (now - was) / was * 100.0 : 0.0;
+            std::printf("%-26s %-26s %12.2f %12.2f %+8.1f%%\n", scenario.c_str(), key, was, now, change);
+        }
+    }
+    return 0;
+}
+
+void usage(const char* program) {
+    std::fprintf(stderr,
+                 "usage: %s --server PATH [--root DIR] [--out FILE] [--duration S] [--warmup S]\n"
+                 "          [--threads N] [--scenario NAME]... [--server-args ARGS] [--label TEXT]\n"
+                 "          [--syscalls]\n"
+                 "       %s --compare BEFORE.jsonl AFTER.jsonl\n\nscenarios:",
+                 program, program);
+    for (const Scenario& scenario : SCENARIOS) {
+        std::fprintf(stderr, " %s", scenario.name);
+    }
+    std::fprintf(stderr, "\n");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--compare" && i + 2 < argc) {
+            return compare(argv[i + 1], argv[i + 2]);
+        } else if (arg == "--server" && has_value) {
+            options.server = argv[++i];
+        } else if (arg == "--root" && has_value) {
+            options.root = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            options.out = argv[++i];
+        } else if (arg == "--duration" && has_value) {
+            options.duration = std::atof(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            options.warmup = std::atof(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--scenario" && has_value) {
+            options.only.push_back(argv[++i]);
+        } else if (arg == "--server-args" && has_value) {
+            options.server_args = argv[++i];
+        } else if (arg == "--label" && has_value) {
+            options.label = argv[++i];
+        } else if (arg == "--syscalls") {
+            options.syscalls = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.server.empty() || options.duration <= 0.0) {
+        usage(argv[0]);
+        return 1;
+    }
+    options.server = fs::absolute(options.server).string();
+
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit(10000 + 64);   // per process; the server child inherits it
+
+    std::string sandbox;
+    if (!make_sandbox(options.root, sandbox)) {
+        std::fprintf(stderr, "could not mirror %s/http-server-cpp/resources into a scratch directory\n",
+                     options.root.c_str());
+        return 1;
+    }
+
+    std::ofstream out(options.out, std::ios::trunc);
+    if (!out) {
+        std::fprintf(stderr, "could not open %s\n", options.out.c_str());
+        return 1;
+    }
+
+    std::printf("%-26s %10s %9s %9s %9s %9s %8s\n", "scenario", "req/s", "p50 us", "p99 us", "p999 us",
+                "cpu us/req", "errors");
+    int failures = 0;
+    for (const Scenario& scenario : SCENARIOS) {
+        if (!options.only.empty() &&
+            std::find(options.only.begin(), options.only.end(), scenario.name) == options.only.end()) {
+            continue;
+        }
+        if (!run_scenario(scenario, options, sandbox, out)) {
+            failures++;
+        }
+        // Uploads from the POST scenario are not worth keeping
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(fs::path(sandbox) / "http-server-cpp/resources/uploads", ec)) {
+            fs::remove(entry.path(), ec);
+        }
+    }
+
+    std::error_code ec;
+    fs::remove_all(sandbox, ec);   // symlinks are removed, not followed
+    std::printf("results written to %s\n", options.out.c_str());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+// Request parser microbenchmark: HTTPParser vs. the original
+// istringstream/std::map parse_request it replaced.
+//
+//   cmake --build build --target parser_bench
+//   ./build/parser_bench [iterations]
+//
+// Reports requests/sec and heap allocations per request for each parser.
+
+#include "http_parser.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+// The parser HTTPServer used before HTTPParser, kept verbatim for comparison
+struct LegacyRequest {
+    std::string method;
+    std::string path;
+    std::string version;
+    std::map<std::string, std::string> headers;
+    std::string body;
+};
+
+LegacyRequest legacy_parse_request(const std::string& request_data) {
+    LegacyRequest request;
+    std::istringstream stream(request_data);
+    std::string line;
+
+    if (std::getline(stream, line)) {
+        std::istringstream request_line(line);
+        request_line >> request.method >> request.path >> request.version;
+        if (!request.version.empty() && request.version.back() == '\r') {
+            request.version.pop_back();
+        }
+    }
+
+    while (std::getline(stream, line) && line != "\r" && !line.empty()) {
+        size_t colon_pos = line.find(':');
+        if (colon_pos != std::string::npos) {
+            std::string key = line.substr(0, colon_pos);
+            std::string value = line.substr(colon_pos + 1);
+            key.erase(0, key.find_first_not_of(" \t\r"));
+            key.erase(key.find_last_not_of(" \t\r") + 1);
+            value.erase(0, value.find_first_not_of(" \t\r"));
+            value.erase(value.find_last_not_of(" \t\r") + 1);
+            std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+            request.headers[key] = value;
+        }
+    }
+
+    std::string body;
+    while (std::getline(stream, line)) {
+        body += line + "\n";
+    }
+    if (!body.empty()) {
+        body.pop_back();
+    }
+    request.body = body;
+    return request;
+}
+
+const char* SAMPLES[] = {
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+
+    "GET /ronaldo.png HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/*,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-GB,en;q=0.9\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://localhost:8080/index.html\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "\r\n",
+
+    "POST /upload HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 64\r\n"
+    "\r\n"
+    "{\"club\":\"Real Madrid\",\"player\":\"Cristiano Ronaldo\",\"minute\":64}",
+};
+
+struct Result {
+    double requests_per_sec;
+    double allocations_per_request;
+};
+
+template <typename Fn>
+Result measure(const std::vector<std::string>& inputs, long iterations, Fn&& parse_one) {
+    uint64_t allocations_before = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+
+    for (long i = 0; i < iterations; i++) {
+        parse_one(inputs[i % inputs.size()]);
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocations = g_allocations.load() - allocations_before;
+    return Result{iterations / elapsed, static_cast<double>(allocations) / iterations};
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+
+    // Inputs are prepared outside the timed region for both parsers
+    std::vector<std::string> inputs(std::begin(SAMPLES), std::end(SAMPLES));
+    volatile size_t sink = 0;
+
+    Result legacy = measure(inputs, iterations, [&](const std::string& input) {
+        LegacyRequest request = legacy_parse_request(input);
+        sink = sink + request.headers.size();
+    });
+
+    HTTPParser parser;
+    ParsedRequest request;
+    Result incremental = measure(inputs, iterations, [&](const std::string& input) {
+        parser.reset();
+        if (parser.parse(input.data(), input.size(), request) == HTTPParser::Result::COMPLETE) {
+            sink = sink + request.header_count;
+        }
+    });
+
+    std::printf("%-14s %14s %16s\n", "parser", "requests/sec", "allocs/request");
+    std::printf("%-14s %14.0f %16.2f\n", "legacy", legacy.requests_per_sec, legacy.allocations_per_request);
+    std::printf("%-14s %14.0f %16.2f\n", "HTTPParser", incremental.requests_per_sec, incremental.allocations_per_request);
+    std::printf("speedup: %.1fx\n", incremental.requests_per_sec / legacy.requests_per_sec);
+    return 0;
+}
@@ -0,0 +1,160 @@
+// Keep-alive pipelining load test. Each connection writes `depth` GETs in
+// one send, then reads until all `depth` responses are back, and repeats.
+// Run it against a live server at several depths to see how much batching
+// the responses into fewer syscalls and packets buys.
+//
+//   cmake --build build --target pipeline_load
+//   ./build/pipeline_load [port] [path] [connections] [seconds] [depth...]
+//
+// Defaults: 8080 /index.html 4 5 1 4 16. The Host header is localhost:port.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Totals {
+    std::atomic<uint64_t> responses{0};
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+int connect_to(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Number of complete responses at the front of buf; consumed bytes are erased
+int take_responses(std::string& buf) {
+    int complete = 0;
+    while (true) {
+        size_t head_end = buf.find("\r\n\r\n");
+        if (head_end == std::string::npos) {
+            return complete;
+        }
+        size_t length = 0;
+        size_t cl = buf.find("Content-Length:");
+        if (cl != std::string::npos && cl < head_end) {
+            length = std::strtoul(buf.c_str() + cl + 15, nullptr, 10);
+        }
+        size_t total = head_end + 4 + length;
+        if (buf.size() < total) {
+            return complete;
+        }
+        buf.erase(0, total);
+        complete++;
+    }
+}
+
+void run_connection(int port, const std::string& batch, int depth,
+                    const std::atomic<bool>& stop, Totals& totals) {
+    int fd = connect_to(port);
+    if (fd < 0) {
+        totals.errors++;
+        return;
+    }
+
+    std::string buf;
+    char chunk[65536];
+    while (!stop) {
+        if (send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(batch.size())) {
+            totals.errors++;
+            break;
+        }
+        int outstanding = depth;
+        while (outstanding > 0) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                break;
+            }
+            totals.reads++;
+            buf.append(chunk, n);
+            int done = take_responses(buf);
+            outstanding -= done;
+            totals.responses += done;
+        }
+        if (outstanding > 0) {
+            // Server closed (e.g. per-connection request limit): reconnect
+            close(fd);
+            buf.clear();
+            fd = connect_to(port);
+            if (fd < 0) {
+                totals.errors++;
+                return;
+            }
+        }
+    }
+    close(fd);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int port = argc > 1 ? std::atoi(argv[1]) : 8080;
+    std::string path = argc > 2 ? argv[2] : "/index.html";
+    int connections = argc > 3 ? std::atoi(argv[3]) : 4;
+    int seconds = argc > 4 ? std::atoi(argv[4]) : 5;
+    std::vector<int> depths;
+    for (int i = 5; i < argc; i++) {
+        depths.push_back(std::atoi(argv[i]));
+    }
+    if (depths.empty()) {
+        depths = {1, 4, 16};
+    }
+
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost:" + std::to_string(port) + "\r\n\r\n";
+
+    std::printf("%-6s %14s %16s %10s\n", "depth", "requests/sec", "responses/read", "errors");
+    for (int depth : depths) {
+        std::string batch;
+        for (int i = 0; i < depth; i++) {
+            batch += request;
+        }
+
+        Totals totals;
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < connections; i++) {
+            threads.emplace_back(run_connection, port, std::cref(batch), depth, std::cref(stop), std::ref(totals));
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        stop = true;
+        for (auto& t : threads) {
+            t.join();
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t responses = totals.responses.load();
+        uint64_t reads = totals.reads.load();
+        std::printf("%-6d %14.0f %16.2f %10llu\n", depth, responses / elapsed,
+                    reads ? static_cast<double>(responses) / reads : 0.0,
+                    static_cast<unsigned long long>(totals.errors.load()));
+    }
+    return 0;
+}
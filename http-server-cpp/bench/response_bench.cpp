@@ -0,0 +1,170 @@
+// Response construction microbenchmark: the ostringstream build_response
+// HTTPServer used to have vs. appending into a reused buffer with the
+// helpers from response.hpp.
+//
+//   cmake --build build --target response_bench
+//   ./build/response_bench [iterations]
+//
+// Reports responses/sec and heap allocations per response for three shapes:
+// a small JSON error, a cached file head (prebuilt header block) and a file
+// head built from scratch.
+
+#include "response.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <string>
+
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+// The builders HTTPServer used before response.hpp, kept for comparison
+std::string legacy_current_time() {
+    auto now = std::chrono::system_clock::now();
+    auto time_t = std::chrono::system_clock::to_time_t(now);
+    auto tm = *std::localtime(&time_t);
+
+    std::ostringstream oss;
+    oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
+    return oss.str();
+}
+
+std::string legacy_entity_headers(const std::string& content_type, size_t content_length,
+                                  const std::string& filename) {
+    std::ostringstream headers;
+    headers << "Content-Type: " << content_type << "\r\n";
+    headers << "Content-Length: " << content_length << "\r\n";
+    headers << "Server: Multi-threaded HTTP Server\r\n";
+    if (!filename.empty() && content_type == "application/octet-stream") {
+        headers << "Content-Disposition: attachment; filename=\"" << filename << "\"\r\n";
+    }
+    return headers.str();
+}
+
+std::string legacy_response_header(int status_code, const std::string& entity_headers) {
+    std::ostringstream response;
+    std::string status_text;
+    switch (status_code) {
+        case 200: status_text = "OK"; break;
+        case 404: status_text = "Not Found"; break;
+        default: status_text = "Unknown"; break;
+    }
+    response << "HTTP/1.1 " << status_code << " " << status_text << "\r\n";
+    response << "Date: " << legacy_current_time() << "\r\n";
+    response << entity_headers;
+    response << "Connection: keep-alive\r\n";
+    response << "Keep-Alive: timeout=30, max=100\r\n";
+    response << "\r\n";
+    return response.str();
+}
+
+std::string legacy_response(int status_code, const std::string& content_type, const std::string& body) {
+    return legacy_response_header(status_code, legacy_entity_headers(content_type, body.length(), "")) + body;
+}
+
+struct Result {
+    double responses_per_sec;
+    double allocations_per_response;
+};
+
+template <typename Fn>
+Result measure(long iterations, Fn&& build_one) {
+    uint64_t allocations_before = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+
+    for (long i = 0; i < iterations; i++) {
+        build_one();
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocations = g_allocations.load() - allocations_before;
+    return Result{iterations / elapsed, static_cast<double>(allocations) / iterations};
+}
+
+void report(const char* shape, const Result& legacy, const Result& current) {
+    std::printf("%-12s %-10s %14.0f %18.2f\n", shape, "legacy", legacy.responses_per_sec,
+                legacy.allocations_per_response);
+    std::printf("%-12s %-10s %14.0f %18.2f   (%.1fx)\n", shape, "append", current.responses_per_sec,
+                current.allocations_per_response, current.responses_per_sec / legacy.responses_per_sec);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+    volatile size_t sink = 0;
+
+    // Stands in for the connection's output buffer, drained after each response
+    std::string out;
+    out.reserve(4096);
+
+    const std::string error_body = "{\"error\": \"Not Found\"}";
+    const std::string content_type = "text/html; charset=utf-8";
+    const std::string cached_header = legacy_entity_headers(content_type, 3425, "") +
+                                      "ETag: \"11e021-186d88962fca7000-d61\"\r\n" +
+                                      std::string(connection_headers());
+    const std::string legacy_cached_entity = legacy_entity_headers(content_type, 3425, "") +
+                                             "ETag: \"11e021-186d88962fca7000-d61\"\r\n";
+
+    std::printf("%-12s %-10s %14s %18s\n", "shape", "builder", "responses/sec", "allocs/response");
+
+    Result legacy = measure(iterations, [&] {
+        std::string response = legacy_response(404, "application/json", error_body);
+        sink = sink + response.size();
+    });
+    Result current = measure(iterations, [&] {
+        out.clear();
+        append_response_header(out, 404, "application/json", error_body.size());
+        out += error_body;
+        sink = sink + out.size();
+    });
+    report("error", legacy, current);
+
+    legacy = measure(iterations, [&] {
+        std::string header = legacy_response_header(200, legacy_cached_entity);
+        sink = sink + header.size();
+    });
+    current = measure(iterations, [&] {
+        out.clear();
+        append_status_line(out, 200);
+        out += date_header();
+        out += cached_header;
+        sink = sink + out.size();
+    });
+    report("cached-head", legacy, current);
+
+    legacy = measure(iterations, [&] {
+        std::string header = legacy_response_header(200, legacy_entity_headers("application/octet-stream",
+                                                                               1891168, "ronaldo.png"));
+        sink = sink + header.size();
+    });
+    current = measure(iterations, [&] {
+        out.clear();
+        append_response_header(out, 200, "application/octet-stream", 1891168, "ronaldo.png");
+        sink = sink + out.size();
+    });
+    report("file-head", legacy, current);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef ALLOC_STATS_HPP
+#define ALLOC_STATS_HPP
+
+#include <cstdint>
+
+// Heap allocation counters for checking that the request path stays off
+// malloc. Only built with -DALLOC_STATS=ON, which interposes malloc and
+// friends (src/alloc_stats.cpp); otherwise every counter reads 0.
+class AllocStats {
+public:
+#ifdef ALLOC_STATS
+    static constexpr bool enabled = true;
+    // Calls made by the current thread / by the whole process so far
+    static uint64_t thread_allocations();
+    static uint64_t total_allocations();
+#else
+    static constexpr bool enabled = false;
+    static uint64_t thread_allocations() { return 0; }
+    static uint64_t total_allocations() { return 0; }
+#endif
+};
+
+#endif // ALLOC_STATS_HPP
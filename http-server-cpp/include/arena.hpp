@@ -0,0 +1,55 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+
+// Bump allocator for data that lives as long as one request: resolved file
+// paths, validators, log lines. Memory comes in BufferPool blocks (larger
+// requests get a block of their own) and all of it goes back on reset(), so
+// the requests of a keep-alive connection reuse the same buffers and an
+// idle connection holds none. Nothing is destroyed: only put trivially
+// destructible data here.
+class Arena {
+public:
+    Arena() = default;
+    ~Arena() { reset(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        uintptr_t at = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t(align) - 1);
+        if (cursor && at + size <= reinterpret_cast<uintptr_t>(limit)) {
+            cursor = reinterpret_cast<char*>(at + size);
+            return reinterpret_cast<void*>(at);
+        }
+        return allocate_slow(size, align);
+    }
+
+    // NUL-terminated, so the result can go to open() and friends; valid
+    // until reset()
+    std::string_view copy(std::string_view text) { return join({text}); }
+    std::string_view join(std::initializer_list<std::string_view> parts);
+    // Decimal digits of value
+    std::string_view number(uint64_t value);
+
+    // Returns every block; views handed out before are dead
+    void reset();
+
+private:
+    struct Block {
+        Block* next;
+        bool pooled;
+    };
+
+    Block* blocks = nullptr;
+    char* cursor = nullptr;    // free space in the newest pooled block
+    char* limit = nullptr;
+
+    void* allocate_slow(size_t size, size_t align);
+};
+
+#endif // ARENA_HPP
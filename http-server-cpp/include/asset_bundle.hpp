@@ -0,0 +1,102 @@
+#ifndef ASSET_BUNDLE_HPP
+#define ASSET_BUNDLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "compression.hpp"
+#include "mime.hpp"
+
+// Static files packed into one read-only file: every body, its encoded
+// variants and the response header block of each, behind a hash index.
+// The server maps it at startup, so serving a bundled file is one probe of
+// the index and a gather write straight out of the mapping; no open(),
+// stat() or copy per request. The pages belong to the page cache, so every
+// process serving the same bundle shares them and a restart finds them warm.
+//
+// A bundle is a snapshot. Files changed on disk are not seen until it is
+// rebuilt with bundle_pack and the server restarted or handed over (SIGHUP).
+//
+// Layout, in host byte order (a bundle is built where it is served):
+//   header | slots[slot_count] | records[asset_count] | paths, headers, bodies
+// Slots are an open-addressing table of record numbers kept at most half
+// full; records hold offsets into the file.
+class AssetBundle {
+public:
+    // One way of sending a file
+    struct Representation {
+        std::string_view body;
+        std::string_view header;   // Content-Type, Content-Length, ETag, ... up to the connection headers
+        std::string_view etag;
+    };
+
+    struct Asset {
+        std::string_view path;     // below the resource root, e.g. "/index.html"
+        time_t mtime = 0;
+        bool compressible = false;
+        Representation identity;
+        Representation encoded[ENCODING_COUNT];   // by Encoding; empty body: not offered
+    };
+
+    // Maps the bundle at path and checks every offset in it once, so lookups
+    // can trust them; nullptr (and why, in error) if it is unusable
+    static std::shared_ptr<const AssetBundle> open(const std::string& path, std::string& error);
+    ~AssetBundle();
+
+    AssetBundle(const AssetBundle&) = delete;
+    AssetBundle& operator=(const AssetBundle&) = delete;
+
+    // Views into the mapping, valid while the bundle is
+    bool find(std::string_view path, Asset& asset) const;
+
+    size_t size() const { return asset_count; }
+    size_t bytes() const { return length; }
+
+private:
+    const char* base;
+    size_t length;
+    const uint32_t* slots;
+    size_t slot_mask;
+    const void* records;
+    size_t asset_count;
+
+    AssetBundle(const char* base, size_t length);
+    void read(size_t index, Asset& asset) const;
+};
+
+// Builds a bundle. Header blocks and ETags (from the content, so an
+// unchanged file keeps its tag across rebuilds) are worked out here.
+class BundleWriter {
+public:
+    // encoded: variants by Encoding, empty if not worth offering
+    void add(std::string_view path, std::string body, time_t mtime, const MimeType& mime,
+             std::string_view filename, std::string (&encoded)[ENCODING_COUNT]);
+
+    // Written next to output and renamed over it, so a server still mapping
+    // the previous bundle keeps serving it
+    bool write(const std::string& output, std::string& error) const;
+
+    size_t size() const { return assets.size(); }
+
+private:
+    struct Form {
+        std::string body;
+        std::string header;
+        std::string etag;
+    };
+
+    struct Entry {
+        std::string path;
+        time_t mtime;
+        bool compressible;
+        Form forms[1 + ENCODING_COUNT];   // identity, then by Encoding
+    };
+
+    std::vector<Entry> assets;
+};
+
+#endif // ASSET_BUNDLE_HPP
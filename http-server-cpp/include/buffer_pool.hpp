@@ -0,0 +1,23 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Process-wide pool of fixed-size I/O buffers (receive buffers, request
+// arenas). A released buffer goes to a small per-thread cache first and to
+// a bounded global free list after that, so steady traffic keeps recycling
+// the same buffers without touching malloc; the surplus after a burst is
+// freed once the free list is full.
+class BufferPool {
+public:
+    static constexpr size_t BUFFER_SIZE = 16 * 1024;
+
+    static char* acquire();
+    static void release(char* buffer);
+
+    // Buffers currently allocated, in use or idle in a cache
+    static uint64_t live();
+};
+
+#endif // BUFFER_POOL_HPP
@@ -0,0 +1,35 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Content codings the server can send, in order of preference
+enum class Encoding : uint8_t {
+    BROTLI,
+    GZIP,
+    COUNT
+};
+
+constexpr size_t ENCODING_COUNT = static_cast<size_t>(Encoding::COUNT);
+
+// Bit per Encoding the client accepts (q > 0) in an Accept-Encoding value
+uint8_t accepted_encodings(std::string_view accept_encoding);
+
+inline bool accepts(uint8_t accepted, Encoding encoding) {
+    return accepted & (1u << static_cast<unsigned>(encoding));
+}
+
+// Content-Encoding token ("br", "gzip") and precompressed sibling suffix
+std::string_view encoding_token(Encoding encoding);
+std::string_view encoding_suffix(Encoding encoding);
+
+// True if this build can compress with it (zlib / libbrotlienc found)
+bool can_compress(Encoding encoding);
+
+// Compresses `in` at the highest level that is still quick for files of
+// cache-entry size; false if unsupported or the library failed
+bool compress(Encoding encoding, std::string_view in, std::string& out);
+
+#endif // COMPRESSION_HPP
@@ -0,0 +1,41 @@
+#ifndef CONDITIONAL_HPP
+#define CONDITIONAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string_view>
+
+// Request-side helpers for conditional and range requests (RFC 9110 13, 14).
+// Nothing here allocates.
+
+// IMF-fixdate, plus the obsolete RFC 850 and asctime forms; false if none fits
+bool parse_http_date(std::string_view value, time_t& out);
+
+// If-None-Match: "*" or a list of entity tags, compared weakly (W/ ignored)
+bool etag_list_matches(std::string_view if_none_match, std::string_view etag);
+
+// If-Range: true if the Range header may be honoured, i.e. the validator is
+// this strong ETag or exactly the Last-Modified date
+bool if_range_holds(std::string_view if_range, std::string_view etag, time_t modified);
+
+struct ByteRange {
+    uint64_t first;
+    uint64_t length;
+};
+
+enum class RangeResult {
+    IGNORE,          // absent, not "bytes", malformed or too many: send 200
+    SATISFIABLE,     // ranges[0..count) to send as 206
+    UNSATISFIABLE    // well-formed but nothing overlaps the body: 416
+};
+
+// Beyond this many ranges the header is ignored and the whole body sent
+constexpr size_t MAX_RANGES = 16;
+
+// Parses "bytes=0-99,200-,-50" against a body of `size` bytes. Unsatisfiable
+// specs are dropped; overlapping ranges are merged (in ascending order) so a
+// client cannot make the server send the same bytes many times over.
+RangeResult parse_ranges(std::string_view range, uint64_t size, ByteRange (&ranges)[MAX_RANGES], size_t& count);
+
+#endif // CONDITIONAL_HPP
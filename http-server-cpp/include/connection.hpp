@@ -0,0 +1,236 @@
+#ifndef CONNECTION_HPP
+#define CONNECTION_HPP
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "arena.hpp"
+#include "http_parser.hpp"
+#include "input_buffer.hpp"
+#include "timer_wheel.hpp"
+#include "upload.hpp"
+
+class H2Session;
+
+// One queued piece of response output: in-memory bytes (status line,
+// headers, small bodies) optionally followed by a file range that is
+// streamed with sendfile() and never copied into user space. The memory
+// part is either owned or borrowed from a shared owner such as a cache
+// entry, which stays alive until the chunk is sent.
+struct OutputChunk {
+    std::string data;
+    std::shared_ptr<const void> owner;
+    const char* borrowed = nullptr;
+    size_t borrowed_size = 0;
+    size_t sent = 0;           // bytes of the memory part already sent
+
+    int file_fd = -1;          // owned (closed once the range is sent) unless file_shared
+    off_t file_offset = 0;
+    size_t file_remaining = 0;
+    bool file_shared = false;  // file_fd is kept open by owner, for ranges of one file in many chunks
+
+    const char* bytes() const { return borrowed ? borrowed : data.data(); }
+    size_t size() const { return borrowed ? borrowed_size : data.size(); }
+};
+
+// FIFO of output chunks on a ring that only ever grows. A std::deque frees
+// and reallocates a node every few chunks; this queue stops allocating once
+// it has seen the connection's deepest backlog, and each slot keeps its
+// data buffer, so a batch of pipelined responses reuses the last batch's.
+// Chunks never move, so a chunk an in-flight write or splice refers to
+// stays valid while more are queued behind it. Their data strings still
+// reallocate when appended to; see Connection::pinned_chunks.
+class OutputQueue {
+public:
+    template <typename Chunk, typename Queue>
+    class Iterator {
+    public:
+        Iterator(Queue* queue, size_t index) : queue(queue), index(index) {}
+        Chunk& operator*() const { return *queue->slots[index & queue->mask]; }
+        Iterator& operator++() {
+            index++;
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const { return index != other.index; }
+
+    private:
+        Queue* queue;
+        size_t index;
+    };
+
+    bool empty() const { return head == tail; }
+    size_t size() const { return tail - head; }
+    OutputChunk& front() { return *slots[head & mask]; }
+    OutputChunk& back() { return *slots[(tail - 1) & mask]; }
+
+    // Appends an empty chunk (its data may have capacity left from earlier use)
+    OutputChunk& emplace_back() {
+        if (tail - head == capacity) {
+            grow();
+        }
+        return *slots[tail++ & mask];
+    }
+
+    // The slot is reset for reuse, keeping the data buffer's capacity
+    void pop_front() {
+        OutputChunk& chunk = *slots[head++ & mask];
+        std::string data = std::move(chunk.data);
+        data.clear();
+        chunk = OutputChunk();
+        chunk.data = std::move(data);
+    }
+
+    Iterator<OutputChunk, OutputQueue> begin() { return {this, head}; }
+    Iterator<OutputChunk, OutputQueue> end() { return {this, tail}; }
+    Iterator<const OutputChunk, const OutputQueue> begin() const { return {this, head}; }
+    Iterator<const OutputChunk, const OutputQueue> end() const { return {this, tail}; }
+
+private:
+    std::unique_ptr<std::unique_ptr<OutputChunk>[]> slots;
+    size_t capacity = 0;    // a power of two
+    size_t mask = 0;
+    size_t head = 0;
+    size_t tail = 0;
+
+    void grow() {
+        size_t new_capacity = capacity ? capacity * 2 : 4;
+        std::unique_ptr<std::unique_ptr<OutputChunk>[]> grown(new std::unique_ptr<OutputChunk>[new_capacity]);
+        for (size_t i = 0; i < capacity; i++) {
+            grown[i] = std::move(slots[(head + i) & mask]);
+        }
+        for (size_t i = capacity; i < new_capacity; i++) {
+            grown[i] = std::make_unique<OutputChunk>();
+        }
+        tail -= head;
+        head = 0;
+        slots = std::move(grown);
+        capacity = new_capacity;
+        mask = new_capacity - 1;
+    }
+};
+
+// Read/write deadlines in milliseconds; 0 disables one
+struct ConnectionTimeouts {
+    uint64_t idle_ms = 30000;     // between requests, or while the peer is not reading our output
+    uint64_t header_ms = 10000;   // first byte of a request until its head is complete
+    uint64_t body_ms = 60000;     // head complete until the whole body has arrived
+};
+
+// Per-connection state shared by every I/O model. The I/O layer appends
+// received bytes to `in` and drains `out`; the handler consumes complete
+// requests from `in` and queues responses on `out`.
+struct Connection {
+    enum class State {
+        READING,   // waiting for (more of) a request
+        WRITING,   // response bytes pending, socket not writable yet
+        CLOSING    // flush what is queued, then close
+    };
+
+    enum class FlushResult {
+        DONE,         // everything queued has been sent
+        WOULD_BLOCK,  // non-blocking socket is full, retry when writable
+        FAILED        // peer gone or socket error
+    };
+
+    // Which deadline applies; the handler moves this along as a request arrives
+    enum class Phase {
+        IDLE,      // nothing of the next request received yet
+        HEADER,    // request head partially received
+        BODY       // head complete, body partially received
+    };
+
+    int fd = -1;
+    uint32_t peer_address = 0;   // client IPv4 address (network order), 0 if unknown
+    State state = State::READING;
+
+    InputBuffer in;
+    HTTPParser parser;         // resumes where the last read left off
+    ChunkedDecoder chunked;    // body framing for Transfer-Encoding: chunked
+    bool continue_sent = false;
+    std::unique_ptr<UploadStream> upload;   // request body being streamed to disk
+    std::unique_ptr<H2Session> h2;          // set once the connection speaks HTTP/2
+    bool h2_stream = false;    // private connection replaying one HTTP/2 stream as HTTP/1.1
+    OutputQueue out;
+    // Front chunks an in-flight asynchronous send reads from (io_uring):
+    // their buffers must not be appended to until it completes
+    size_t pinned_chunks = 0;
+    Arena arena;               // request-lifetime scratch, reset after every request
+
+    int request_count = 0;
+    bool close_after_write = false;
+
+    // Per-request bookkeeping for metrics
+    uint64_t parse_ns = 0;     // parse time so far, across partial reads
+    int response_status = 0;   // status of the response being built
+
+    // Timeouts
+    Phase phase = Phase::IDLE;
+    uint64_t phase_started_ms = 0;     // when HEADER / BODY began
+    uint64_t last_activity_ms = 0;     // last read or write progress, kept by the I/O layer
+    TimerWheel::Timer timer;           // event loops only
+
+    explicit Connection(int fd);
+    ~Connection();
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    bool has_pending_output() const { return !out.empty(); }
+
+    void enter_phase(Phase next);
+    // Absolute deadline (TimerWheel::now_ms() clock) for the current state,
+    // 0 if none applies; `kind` tells which one it is. Unsent output is
+    // governed by the idle timeout whatever the phase.
+    uint64_t deadline(const ConnectionTimeouts& timeouts, Phase& kind) const;
+    size_t pending_bytes() const;
+
+    // Owned buffer at the tail of the queue to append response bytes to,
+    // in a new chunk if the tail is pinned. Its capacity is recycled from
+    // chunks that were already sent.
+    std::string& output_buffer();
+
+    // Complete response with a body from memory (status line, standard
+    // headers, body), recorded as response_status
+    void respond(int status_code, std::string_view content_type, std::string_view body);
+
+    // Queue bytes / a file range (takes ownership of file_fd) for sending
+    void queue(std::string_view data);
+    void queue_shared(std::shared_ptr<const void> owner, const char* data, size_t length);
+    void queue_file(int file_fd, off_t offset, size_t length);
+    // A range of a descriptor that `owner` keeps open (and closes)
+    void queue_shared_file(std::shared_ptr<const void> owner, int file_fd, off_t offset, size_t length);
+
+    // Send as much as the socket accepts; handles short writes. Consecutive
+    // memory chunks (pipelined responses) are gathered into one sendmsg()
+    FlushResult flush();
+
+    // Pending memory parts up to the first file range, as iovecs. `more`:
+    // output remains after them; `file`: the chunk whose file range comes
+    // right after them, if they reach it
+    int gather(struct iovec* iov, int max_iov, bool& more, OutputChunk** file = nullptr);
+    // Credits `bytes` of memory parts as sent, dropping finished chunks
+    // (a chunk with a file range goes once that range is done too)
+    void consume_sent(size_t bytes);
+};
+
+// Implemented by HTTPServer. I/O engines call process_input() whenever new
+// bytes were appended to conn.in.
+class ConnectionHandler {
+public:
+    virtual ~ConnectionHandler() = default;
+    virtual void on_connection_opened(Connection& conn) = 0;
+    virtual void process_input(Connection& conn) = 0;
+    virtual void on_connection_closed(Connection& conn) = 0;
+    // A deadline passed; queue a final response if any, the I/O engine
+    // flushes what it can and closes
+    virtual void on_timeout(Connection& conn, Connection::Phase kind) = 0;
+    // The server is draining: wind the connection down without cutting off a
+    // request. Sets close_after_write if it may close once output is flushed
+    virtual void on_drain(Connection& conn) = 0;
+};
+
+#endif // CONNECTION_HPP
@@ -0,0 +1,63 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include "connection.hpp"
+#include "io_loop.hpp"
+#include "timer_wheel.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Edge-triggered epoll reactor. Each loop runs on its own thread and owns
+// every connection handed to it; sockets never migrate between loops.
+// A loop started with its own listening socket (SO_REUSEPORT shard) also
+// accepts, so shards share no state at all. Connection deadlines live in a
+// per-loop timer wheel, so idle connections cost nothing until they expire.
+class EventLoop : public IOLoop {
+private:
+    ConnectionHandler& handler;
+    const ConnectionTimeouts timeouts;
+    int epoll_fd;
+    int wake_fd;
+    int listen_fd;
+    int reserve_fd;              // spare descriptor, given up to drain the backlog when out of them
+    uint64_t accept_retry_ms;    // accepting failed for lack of resources: try again then, 0: no retry
+    int cpu;
+    std::atomic<bool> running;
+    std::atomic<bool> draining;
+    bool drain_started;
+    std::thread loop_thread;
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    TimerWheel timers;
+
+    // Sockets accepted on another thread, waiting to be registered
+    std::mutex pending_mutex;
+    std::vector<PendingSocket> pending_fds;
+
+    void run_loop();
+    void register_pending();
+    void register_connection(int fd, uint32_t peer_address);
+    void accept_pending();
+    void on_event(Connection& conn, uint32_t events);
+    bool read_available(Connection& conn);
+    void process(Connection& conn);
+    void arm_timer(Connection& conn);
+    void on_timer(Connection& conn);
+    void close_connection(Connection& conn);
+    void wind_down();
+
+public:
+    EventLoop(ConnectionHandler& handler, const ConnectionTimeouts& timeouts);
+    ~EventLoop() override;
+
+    bool start(int listen_fd = -1, int cpu = -1) override;
+    void stop() override;
+    void add_connection(int client_socket, uint32_t peer_address) override;
+    void drain() override;
+};
+
+#endif // EVENT_LOOP_HPP
@@ -0,0 +1,107 @@
+#ifndef FILE_CACHE_HPP
+#define FILE_CACHE_HPP
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#include "compression.hpp"
+
+// A compressed representation of a cached file, from a precompressed .br/.gz
+// sibling or compressed when the file was loaded, with its own header block
+// (Content-Encoding, Vary, a per-coding ETag)
+struct CachedVariant {
+    std::string body;
+    std::string header;
+    std::string etag;
+};
+
+// A cached static file: body bytes plus the response header block that goes
+// with them, built once when the file is loaded. Serving it only adds the
+// status line, the current Date and the connection headers, which change
+// when the server starts draining.
+struct CachedFile {
+    std::string path;
+    std::string body;
+    std::string header;     // Content-Type, Content-Length, ETag, ... up to the connection headers
+    std::string etag;
+    CachedVariant encoded[ENCODING_COUNT];   // by Encoding; empty body: not offered
+    time_t mtime = 0;
+    long mtime_nsec = 0;
+    off_t size = 0;
+    ino_t inode = 0;
+};
+
+using CachedFilePtr = std::shared_ptr<const CachedFile>;
+
+// Bounded, sharded LRU cache of static files keyed by path. Entries are
+// revalidated with stat() at most once per second and dropped when the
+// file's inode, size or mtime changed. Eviction is LRU by byte budget.
+class FileCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t invalidations;
+        uint64_t entries;
+        uint64_t bytes;
+    };
+
+    FileCache(size_t capacity_bytes, size_t max_entry_bytes);
+
+    bool enabled() const { return capacity_bytes > 0; }
+    bool fits(size_t file_size) const { return enabled() && file_size <= max_entry_bytes; }
+    size_t capacity() const { return capacity_bytes; }
+
+    // Returns the entry if present and still matching the file on disk
+    CachedFilePtr lookup(std::string_view path);
+    void insert(CachedFilePtr entry);
+
+    Stats get_stats() const;
+
+    // True while file_stat still describes the cached file
+    static bool matches(const CachedFile& file, const struct stat& file_stat);
+    // Strong validator derived from inode, mtime and size
+    static std::string make_etag(const struct stat& file_stat);
+    // Same, written to out (MAX_ETAG bytes) without allocating; returns its length
+    static constexpr size_t MAX_ETAG = 64;
+    static size_t format_etag(const struct stat& file_stat, char* out);
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+    static constexpr int REVALIDATE_INTERVAL_MS = 1000;
+
+    struct Entry {
+        CachedFilePtr file;
+        int64_t checked_ms;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;   // front = most recently used
+        // Keys view the entries' own path, so lookups never build a string
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> evictions{0};
+        std::atomic<uint64_t> invalidations{0};
+    };
+
+    size_t capacity_bytes;
+    size_t max_entry_bytes;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    Shard& shard_for(std::string_view path);
+    void erase_if_same(Shard& shard, const CachedFilePtr& file);
+    static size_t entry_cost(const CachedFile& file);
+};
+
+#endif // FILE_CACHE_HPP
@@ -0,0 +1,149 @@
+#ifndef H2_SESSION_HPP
+#define H2_SESSION_HPP
+
+#include "connection.hpp"
+#include "hpack.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// HTTP/2 error codes (RFC 9113 7), in wire order
+enum class H2Error : uint32_t {
+    NONE,
+    PROTOCOL,
+    INTERNAL,
+    FLOW_CONTROL,
+    SETTINGS_TIMEOUT,
+    STREAM_CLOSED,
+    FRAME_SIZE,
+    REFUSED_STREAM,
+    CANCEL,
+    COMPRESSION,
+    CONNECT,
+    ENHANCE_YOUR_CALM
+};
+
+// Cleartext HTTP/2 (h2c, RFC 9113) on one connection, by prior knowledge or
+// Upgrade: h2c. The session is an adapter in front of the HTTP/1.1 handler:
+// a complete stream is replayed as an HTTP/1.1 request on a private
+// Connection, and the response queued there is re-framed as HEADERS +
+// DATA on the real one. Everything behind the handler (routing, cache,
+// conditional and range requests, uploads, metrics) is shared with
+// HTTP/1.1, and bodies keep their zero-copy path: a DATA frame's payload
+// is a slice of the cache entry or a range of the file, sent with
+// sendfile()/splice, never a copy.
+//
+// Streams that have DATA to send are served round-robin one frame at a
+// time, within the peer's connection and stream windows.
+class H2Session {
+public:
+    static constexpr std::string_view PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+    struct Limits {
+        size_t max_header_bytes;    // decoded request header list
+        size_t max_body_bytes;      // request body, else 413
+        uint32_t max_streams;       // concurrent streams
+    };
+
+    H2Session(ConnectionHandler& handler, const Limits& limits);
+    ~H2Session();
+
+    H2Session(const H2Session&) = delete;
+    H2Session& operator=(const H2Session&) = delete;
+
+    // Prior knowledge: queues the server preface; the client's is read by on_input()
+    void start(Connection& conn);
+    // Upgrade: h2c. Applies the client's HTTP2-Settings, queues the 101 and
+    // the server preface, and answers `request`, the upgrade request itself,
+    // as stream 1. False if the settings are malformed (nothing was queued)
+    bool start_upgraded(Connection& conn, std::string_view request, std::string_view settings);
+
+    // Consumes complete frames from conn.in, answers finished streams and
+    // queues whatever DATA the flow-control windows allow
+    void on_input(Connection& conn);
+
+    // GOAWAY: no new streams; the connection closes once output is flushed.
+    // Also how connection errors end the session
+    void shutdown(Connection& conn, H2Error error = H2Error::NONE);
+    // Graceful GOAWAY: open streams are still answered, new ones refused;
+    // the connection closes after the last one
+    void drain(Connection& conn);
+
+private:
+    struct Segment {
+        std::shared_ptr<const void> owner;    // keeps borrowed bytes / a shared file alive
+        const char* bytes = nullptr;          // borrowed; with no file either, bytes of Stream::data
+        int file_fd = -1;
+        off_t offset = 0;                     // into the bytes or the file
+        size_t length = 0;                    // still to send
+    };
+
+    // Recycled once closed, so a busy connection stops allocating per stream
+    struct Stream {
+        uint32_t id = 0;
+        bool receiving = true;      // END_STREAM not seen yet
+        bool too_large = false;     // body over the limit: answered with 413
+        std::string head;           // HTTP/1.1 request head, without the blank line
+        std::string data;           // request body, then the response bytes the handler wrote
+        int64_t recv_window = 0;
+        int64_t send_window = 0;
+        std::vector<Segment> response;   // DATA to send, from next_segment on
+        size_t next_segment = 0;
+    };
+
+    ConnectionHandler& handler;
+    const Limits limits;
+    Connection replay;       // the handler answers each stream here
+    HpackDecoder decoder;
+    HpackEncoder encoder;
+
+    bool preface_seen = false;
+    bool going_away = false;
+    uint32_t last_stream = 0;           // highest stream id the client opened
+    uint32_t continuation_stream = 0;   // header block still open on this stream
+    bool continuation_end_stream = false;
+    std::string header_block;
+
+    // Peer's settings and our send window
+    uint32_t peer_max_frame = 16384;
+    int64_t peer_initial_window = 65535;
+    int64_t send_window = 65535;
+
+    // Our receive window, topped up as bodies are read
+    int64_t recv_window = 65535;
+    size_t buffered_body = 0;           // across all streams
+
+    std::vector<std::unique_ptr<Stream>> streams;       // open; few enough to search linearly
+    std::vector<std::unique_ptr<Stream>> idle_streams;  // closed, kept for their buffers
+    std::vector<Stream*> sending;       // streams with DATA left, in round-robin order
+    size_t receiving_streams = 0;
+
+    // Scratch reused across streams
+    std::string request_head;
+    std::string fields;
+    std::string pseudo[4];              // :method, :path, :scheme, :authority
+    std::string block;                  // response header block
+    std::string name;
+
+    bool handle_frame(Connection& conn, uint8_t type, uint8_t flags, uint32_t id, std::string_view payload);
+    bool on_headers(Connection& conn, uint32_t id, bool end_stream);
+    bool on_data(Connection& conn, uint8_t flags, uint32_t id, std::string_view payload);
+    bool on_settings(Connection& conn, uint8_t flags, uint32_t id, std::string_view payload);
+    bool apply_settings(std::string_view payload, H2Error& error);
+    bool on_window_update(Connection& conn, uint32_t id, std::string_view payload);
+    HpackDecoder::Result decode_request(bool& malformed);
+
+    Stream* find(uint32_t id);
+    Stream& open_stream(uint32_t id);
+    void finish_request(Connection& conn, Stream& stream);
+    void respond(Connection& conn, Stream& stream, std::string_view head, std::string_view body);
+    void write_data(Connection& conn);
+    void close_stream(Stream& stream);
+    void reset_stream(Connection& conn, uint32_t id, H2Error error);
+    void update_phase(Connection& conn, bool partial);
+};
+
+#endif // H2_SESSION_HPP
@@ -0,0 +1,32 @@
+#ifndef HANDOFF_HPP
+#define HANDOFF_HPP
+
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// Zero-downtime restarts. The running server starts its successor with one
+// end of a Unix socket pair, passes its listening sockets over it
+// (SCM_RIGHTS) and keeps serving until the successor writes back that it
+// is ready. The listeners themselves are never closed, so there is no
+// moment without a socket to connect to, and connections waiting in the
+// accept queue are picked up by whichever process accepts next.
+
+// Names the successor's end of the channel in its environment
+constexpr const char* HANDOFF_ENV = "HTTP_SERVER_HANDOFF_FD";
+// Written by the successor once it serves
+constexpr char HANDOFF_READY = 'R';
+
+// Starts `path` with `args` (args[0] included) as a successor; -1 on
+// failure. channel: this process's end of the pair
+pid_t spawn_successor(const std::string& path, const std::vector<std::string>& args, int& channel);
+
+// Successor side: the channel named by HANDOFF_ENV, which is removed from
+// the environment; -1 when started normally
+int take_handoff_channel();
+
+bool send_sockets(int channel, const std::vector<int>& sockets);
+// Waits up to timeout_ms for the predecessor's sockets (close-on-exec)
+bool receive_sockets(int channel, std::vector<int>& sockets, int timeout_ms);
+
+#endif // HANDOFF_HPP
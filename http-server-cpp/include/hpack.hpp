@@ -0,0 +1,115 @@
+#ifndef HPACK_HPP
+#define HPACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+
+// HPACK (RFC 7541) header compression for HTTP/2: the static table, a
+// dynamic table per direction and the canonical Huffman code.
+
+// Dynamic table: newest entry first, sized as the RFC counts it (32 bytes
+// of overhead per entry)
+class HpackTable {
+public:
+    struct Entry {
+        std::string name;
+        std::string value;
+    };
+
+    static constexpr size_t STATIC_ENTRIES = 61;
+    static constexpr size_t ENTRY_OVERHEAD = 32;
+
+    // Static and dynamic entries share one index space starting at 1
+    bool get(size_t index, std::string_view& name, std::string_view& value) const;
+    void add(std::string_view name, std::string_view value);
+    void set_max_size(size_t size);
+    size_t max_size() const { return limit; }
+    size_t count() const { return entries.size(); }
+    const Entry& dynamic_entry(size_t i) const { return entries[i]; }
+
+private:
+    std::deque<Entry> entries;
+    size_t size = 0;
+    size_t limit = 4096;
+
+    void evict(size_t room);
+};
+
+class HpackDecoder {
+public:
+    // Upper bound the peer may pick for our table (SETTINGS_HEADER_TABLE_SIZE)
+    explicit HpackDecoder(size_t max_table_size = 4096) : max_table_size(max_table_size) {}
+
+    enum class Result {
+        OK,
+        TOO_LARGE,   // decoded list over max_list_size; the rest was decoded but not passed on
+        ERROR        // malformed block: a connection error, the table is out of sync from here on
+    };
+
+    // Decodes one complete header block, calling fn(name, value) per field;
+    // the views are valid during the call only. An oversized list is still
+    // decoded to the end so the dynamic table stays in sync.
+    template <typename Fn>
+    Result decode(std::string_view block, size_t max_list_size, Fn&& fn) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(block.data());
+        const uint8_t* end = p + block.size();
+        size_t list_size = 0;
+        header_seen = false;
+        while (p < end) {
+            std::string_view name;
+            std::string_view value;
+            Field field = next_field(p, end, name, value);
+            if (field == Field::ERROR) {
+                return Result::ERROR;
+            }
+            if (field == Field::TABLE_UPDATE) {
+                continue;
+            }
+            list_size += name.size() + value.size() + HpackTable::ENTRY_OVERHEAD;
+            if (list_size <= max_list_size) {
+                fn(name, value);
+            }
+        }
+        return list_size > max_list_size ? Result::TOO_LARGE : Result::OK;
+    }
+
+private:
+    enum class Field { HEADER, TABLE_UPDATE, ERROR };
+
+    HpackTable table;
+    size_t max_table_size;
+    bool header_seen = false;     // size updates are only allowed before the first field
+    std::string name_buffer;      // Huffman-decoded or copied-out strings
+    std::string value_buffer;
+
+    Field next_field(const uint8_t*& p, const uint8_t* end, std::string_view& name, std::string_view& value);
+    bool read_string(const uint8_t*& p, const uint8_t* end, std::string& buffer, std::string_view& out);
+};
+
+class HpackEncoder {
+public:
+    // The peer's SETTINGS_HEADER_TABLE_SIZE; the change is signalled at the
+    // start of the next block
+    void set_max_table_size(size_t size);
+
+    // Appends one field: an index if the table has it, otherwise a literal
+    // (Huffman-coded when shorter) that is added to the dynamic table when
+    // `index` is set. Values that change every response should not be.
+    void encode(std::string& out, std::string_view name, std::string_view value, bool index = true);
+
+private:
+    HpackTable table;
+    size_t pending_update = SIZE_MAX;   // table size to announce, if any
+};
+
+// Integer with an N-bit prefix (RFC 7541 5.1); `first` holds the other bits
+void hpack_encode_integer(std::string& out, uint8_t first, int prefix_bits, uint64_t value);
+// String literal (5.2), Huffman-coded if that is shorter
+void hpack_encode_string(std::string& out, std::string_view text);
+// False on invalid padding or an EOS symbol in the data
+bool huffman_decode(std::string_view in, std::string& out);
+
+#endif // HPACK_HPP
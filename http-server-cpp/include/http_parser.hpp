@@ -0,0 +1,153 @@
+#ifndef HTTP_PARSER_HPP
+#define HTTP_PARSER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Request methods the server tells apart, interned once by the parser so
+// dispatch compares a byte instead of strings
+enum class HttpMethod : uint8_t {
+    GET,
+    HEAD,
+    POST,
+    PUT,
+    DELETE,
+    PATCH,
+    OPTIONS,
+    OTHER,    // anything else, including extension methods
+    COUNT
+};
+
+HttpMethod intern_method(std::string_view method);
+
+struct HeaderField {
+    std::string_view name;
+    std::string_view value;
+};
+
+// A parsed HTTP/1.x request. Every view points into the connection's input
+// buffer and is only valid until that buffer is consumed or grows.
+struct ParsedRequest {
+    static constexpr size_t MAX_HEADERS = 64;
+
+    std::string_view method;
+    HttpMethod method_id = HttpMethod::OTHER;
+    std::string_view path;
+    std::string_view version;
+    HeaderField headers[MAX_HEADERS];
+    size_t header_count = 0;
+    std::string_view body;
+
+    size_t header_length = 0;     // request line + headers + blank line
+    size_t content_length = 0;
+    bool has_content_length = false;
+    bool chunked = false;
+
+    // Case-insensitive lookup; empty view if absent
+    std::string_view header(std::string_view name) const;
+    bool has_header(std::string_view name) const;
+};
+
+// Resumable request-head parser. Feed it the whole buffered input each time
+// more bytes arrive; lines that were already parsed are not scanned again.
+// State is kept as offsets so the buffer may be reallocated between calls.
+class HTTPParser {
+public:
+    enum class Result {
+        COMPLETE,      // request head parsed, request filled in
+        INCOMPLETE,    // need more data
+        ERROR          // malformed; see error()
+    };
+
+    enum class Error {
+        NONE,
+        BAD_REQUEST,
+        TOO_MANY_HEADERS,
+        BAD_FRAMING        // Transfer-Encoding not ending in chunked, or with Content-Length
+    };
+
+    HTTPParser() { reset(); }
+
+    Result parse(const char* data, size_t length, ParsedRequest& request);
+    void reset();
+    Error error() const { return parse_error; }
+
+    // SIMD byte scanners (AVX2/SSE2, scalar tail); nullptr if not found
+    static const char* find_line_end(const char* begin, const char* end);
+    static const char* find_byte(const char* begin, const char* end, char byte);
+
+private:
+    enum class Stage { REQUEST_LINE, HEADERS, COMPLETE };
+
+    struct Span {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    Stage stage;
+    size_t pos;             // start of the first line not yet parsed
+    Error parse_error;
+
+    Span method;
+    HttpMethod method_id;
+    Span path;
+    Span version;
+    Span names[ParsedRequest::MAX_HEADERS];
+    Span values[ParsedRequest::MAX_HEADERS];
+    size_t header_count;
+
+    size_t content_length;
+    bool has_content_length;
+    bool has_transfer_encoding;
+    bool chunked;              // the final transfer coding is chunked
+
+    Result fail(Error error);
+    void fill(const char* data, ParsedRequest& request) const;
+    bool parse_request_line(const char* data, size_t begin, size_t end);
+    bool parse_header_line(const char* data, size_t begin, size_t end);
+};
+
+// Resumable decoder for a Transfer-Encoding: chunked body. It works in place:
+// chunk payloads are moved down over the framing so the decoded body ends up
+// contiguous right after the request head, without a second buffer. Offsets
+// are relative to the start of the request, like HTTPParser's.
+class ChunkedDecoder {
+public:
+    enum class Result {
+        COMPLETE,      // last chunk and trailers received
+        INCOMPLETE,    // need more data
+        ERROR,         // malformed framing
+        TOO_LARGE      // decoded body exceeds the limit
+    };
+
+    ChunkedDecoder() { reset(); }
+
+    Result decode(char* data, size_t length, size_t body_offset, size_t max_body);
+    void reset();
+
+    size_t body_length() const { return write_pos - body_begin; }
+    // Bytes of input the whole request occupied, head included
+    size_t consumed() const { return read_pos; }
+
+    // Streaming: the caller has taken the decoded body and dropped the first
+    // consumed() bytes of its buffer; decoding resumes at offset 0. The body
+    // limit still counts everything released so far.
+    void release();
+
+private:
+    enum class Stage { SIZE_LINE, DATA, DATA_END, TRAILERS, COMPLETE };
+
+    // Longest chunk-size or trailer line we are willing to buffer
+    static constexpr size_t MAX_LINE = 4096;
+
+    Stage stage;
+    bool started;
+    size_t body_begin;
+    size_t read_pos;          // next framing byte to look at
+    size_t write_pos;         // end of the decoded body so far
+    size_t chunk_remaining;
+    size_t released;          // decoded bytes handed out by release()
+};
+
+#endif // HTTP_PARSER_HPP
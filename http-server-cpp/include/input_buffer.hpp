@@ -0,0 +1,118 @@
+#ifndef INPUT_BUFFER_HPP
+#define INPUT_BUFFER_HPP
+
+#include "buffer_pool.hpp"
+#include <cstddef>
+#include <cstring>
+
+// Growable receive buffer. Bytes are read straight into the free tail and
+// consumed from the front by moving an offset, so pipelined requests never
+// trigger a memmove per request; the unread part is compacted only when the
+// tail runs out of room. The first block is a pooled buffer that goes back
+// to the BufferPool whenever everything has been consumed, so idle
+// keep-alive connections hold no receive memory.
+class InputBuffer {
+public:
+    static constexpr size_t MIN_READ = 4096;
+
+    InputBuffer() = default;
+    ~InputBuffer() { release(); }
+
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
+    char* data() { return storage + start; }
+    const char* data() const { return storage + start; }
+    size_t size() const { return end - start; }
+    bool empty() const { return start == end; }
+    size_t writable() const { return capacity - end; }
+
+    // Returns room for at least `bytes` more bytes at the end; readers should
+    // fill writable() bytes, which may be more (e.g. after reserve())
+    char* prepare(size_t bytes) {
+        if (capacity - end < bytes) {
+            make_room(bytes);
+        }
+        return storage + end;
+    }
+
+    void commit(size_t bytes) { end += bytes; }
+
+    void consume(size_t bytes) {
+        start += bytes;
+        if (start == end) {
+            trim();
+        }
+    }
+
+    // Gives the storage back while nothing is buffered: pooled buffers
+    // always, and anything a large upload grew it to
+    void trim() {
+        if (start != end) {
+            return;
+        }
+        start = end = 0;
+        if (pooled || capacity > RETAIN_LIMIT) {
+            release();
+        }
+    }
+
+    // Ensure size() can reach `total` without another reallocation, with a
+    // minimum read's worth of headroom so the final read doesn't grow it
+    void reserve(size_t total) {
+        if (total > size()) {
+            prepare(total - size() + MIN_READ);
+        }
+    }
+
+    void append(const char* bytes, size_t length) {
+        std::memcpy(prepare(length), bytes, length);
+        commit(length);
+    }
+
+private:
+    static constexpr size_t RETAIN_LIMIT = 64 * 1024;
+
+    char* storage = nullptr;
+    size_t capacity = 0;
+    size_t start = 0;
+    size_t end = 0;
+    bool pooled = false;    // storage is a BufferPool buffer
+
+    void release() {
+        if (pooled) {
+            BufferPool::release(storage);
+        } else {
+            delete[] storage;
+        }
+        storage = nullptr;
+        capacity = 0;
+        pooled = false;
+    }
+
+    void make_room(size_t bytes) {
+        size_t used = size();
+        if (start > 0 && capacity - used >= bytes && used <= capacity / 2) {
+            // Enough space overall: slide the unread bytes to the front
+            std::memmove(storage, storage + start, used);
+        } else {
+            size_t new_capacity = capacity ? capacity * 2 : BufferPool::BUFFER_SIZE;
+            while (new_capacity - used < bytes) {
+                new_capacity *= 2;
+            }
+            bool from_pool = new_capacity == BufferPool::BUFFER_SIZE;
+            char* grown = from_pool ? BufferPool::acquire() : new char[new_capacity];
+            if (used > 0) {
+                std::memcpy(grown, storage + start, used);
+            }
+            release();
+            storage = grown;
+            capacity = new_capacity;
+            pooled = from_pool;
+        }
+        start = 0;
+        end = used;
+    }
+};
+
+#endif // INPUT_BUFFER_HPP
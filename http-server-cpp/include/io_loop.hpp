@@ -0,0 +1,46 @@
+#ifndef IO_LOOP_HPP
+#define IO_LOOP_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// An I/O engine thread serving connections for a ConnectionHandler:
+// EventLoop (epoll) or UringLoop (io_uring). HTTPServer only starts, feeds
+// and stops them.
+class IOLoop {
+public:
+    // Written only by the loop thread, read by anyone
+    struct Stats {
+        std::atomic<uint64_t> accepted{0};
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> active{0};
+    };
+
+    virtual ~IOLoop() = default;
+
+    // listen_fd >= 0: accept on it (loop takes ownership); cpu >= 0: pin thread
+    virtual bool start(int listen_fd = -1, int cpu = -1) = 0;
+    virtual void stop() = 0;
+    // Thread-safe: hand an accepted, non-blocking socket to this loop.
+    // peer_address: the client's IPv4 address (network order), 0 if unknown
+    virtual void add_connection(int client_socket, uint32_t peer_address) = 0;
+    // Thread-safe: stop accepting (the listener is closed) and let every
+    // connection finish its current request, then close
+    virtual void drain() = 0;
+
+    const Stats& get_stats() const { return stats; }
+    // After drain(): true once the loop's last connection has closed
+    bool drained() const { return drain_complete.load(std::memory_order_acquire); }
+
+protected:
+    // A socket accepted on another thread, waiting to be registered
+    struct PendingSocket {
+        int fd;
+        uint32_t peer_address;
+    };
+
+    Stats stats;
+    std::atomic<bool> drain_complete{false};
+};
+
+#endif // IO_LOOP_HPP
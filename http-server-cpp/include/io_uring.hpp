@@ -0,0 +1,79 @@
+#ifndef IO_URING_HPP
+#define IO_URING_HPP
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+
+// Minimal io_uring on the raw syscalls (no liburing): ring setup and
+// mapping, SQE allocation, batched submit-and-wait with a timeout, and the
+// registrations UringLoop uses. Single-threaded: one thread submits and
+// reaps.
+class IoUring {
+public:
+    IoUring() = default;
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // True if the kernel has everything UringLoop relies on (6.1 or newer:
+    // multishot accept/recv, provided buffer rings, sparse fixed files,
+    // cancel-by-fixed-fd, EXT_ARG timeouts)
+    static bool supported();
+
+    // Rings start disabled; the thread that calls enable() becomes the only
+    // one allowed to submit
+    bool init(unsigned entries, unsigned cq_entries);
+    bool enable();
+    void destroy();
+
+    // Next free SQE, zeroed. Submits what is queued first if the ring is full
+    io_uring_sqe* get_sqe();
+    // Submits queued SQEs and waits for one completion or timeout_ms (< 0:
+    // no limit). False on a hard error; EINTR and ETIME are not errors
+    bool submit_and_wait(int timeout_ms);
+
+    // Calls fn(const io_uring_cqe&) for every completion ready, then frees them
+    template <typename Fn>
+    unsigned drain(Fn&& fn) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned seen = 0;
+        for (; head != tail; head++, seen++) {
+            fn(cqes[head & cq_mask]);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return seen;
+    }
+
+    // Empty fixed-file table that direct accept / FILES_UPDATE allocate from
+    bool register_sparse_files(unsigned count);
+    bool register_buffer_ring(io_uring_buf_ring* ring, unsigned entries, uint16_t group);
+
+private:
+    int ring_fd = -1;
+    void* sq_map = nullptr;
+    size_t sq_map_size = 0;
+    void* cq_map = nullptr;
+    size_t cq_map_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    unsigned local_tail = 0;    // SQEs handed out, published on submit
+    unsigned to_submit = 0;
+
+    int enter(unsigned submit, unsigned wait, unsigned flags, void* arg, size_t arg_size);
+    bool submit_pending();
+};
+
+#endif // IO_URING_HPP
@@ -0,0 +1,106 @@
+#ifndef JSON_VALIDATOR_HPP
+#define JSON_VALIDATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Incremental JSON (RFC 8259) validator. Feed the document in whatever
+// pieces it arrives in; all state carries over between calls, so nothing is
+// buffered and memory is constant apart from the fixed nesting stack.
+// Strings are checked for control characters, escapes and UTF-8.
+//
+// Runs of plain string bytes and of whitespace are skipped with SIMD
+// scanners (AVX2 or SSE2, chosen at startup from what the CPU supports);
+// everything else goes through the byte-at-a-time state machine.
+class JsonValidator {
+public:
+    // Nesting the bracket stack can hold; set_limits() can only go lower
+    static constexpr size_t MAX_DEPTH = 1024;
+    static constexpr size_t DEFAULT_DEPTH = 512;
+
+    enum class Error : uint8_t {
+        NONE,
+        SYNTAX,
+        TOO_DEEP,    // more than max_depth open brackets
+        TOO_LARGE    // more than max_bytes fed
+    };
+
+    enum class Kernel : uint8_t {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    // Scanner used by every validator in the process
+    static Kernel kernel();
+    // Switches scanners (benchmarks); false if the CPU lacks the kernel
+    static bool use_kernel(Kernel kernel);
+    static const char* kernel_name(Kernel kernel);
+
+    JsonValidator() { reset(); }
+
+    // max_bytes 0 means unlimited. Limits survive reset()
+    void set_limits(size_t max_depth, size_t max_bytes);
+
+    void reset();
+
+    // False as soon as the bytes seen so far cannot start a valid document
+    bool feed(const char* data, size_t length);
+
+    // True if everything fed is exactly one complete document
+    bool finish();
+
+    bool failed() const { return state == State::ERROR; }
+    Error error() const { return error_code; }
+
+private:
+    enum class State : uint8_t {
+        // Between tokens, where whitespace is skipped
+        VALUE,             // a value must follow
+        FIRST_KEY_OR_END,  // just after '{'
+        KEY,               // after ',' in an object
+        COLON,
+        FIRST_VALUE_OR_END, // just after '['
+        AFTER_VALUE,       // ',' or the closing bracket
+        DONE,              // top-level value complete, whitespace only
+        // Inside a token
+        STRING,
+        ESCAPE,
+        UNICODE,           // \uXXXX hex digits
+        UTF8,              // continuation bytes of a multi-byte sequence
+        MINUS,
+        ZERO,
+        INTEGER,
+        DOT,
+        FRACTION,
+        EXPONENT,
+        EXPONENT_SIGN,
+        EXPONENT_DIGITS,
+        LITERAL,           // true / false / null
+        ERROR
+    };
+
+    State state;
+    Error error_code;
+    bool string_is_key;
+    uint8_t hex_remaining;
+    uint8_t utf8_remaining;
+    uint8_t utf8_lower;        // allowed range of the next continuation byte
+    uint8_t utf8_upper;
+    const char* literal;
+    uint8_t literal_pos;
+    size_t depth;
+    size_t fed;
+    size_t max_depth = DEFAULT_DEPTH;
+    size_t max_bytes = 0;
+    uint64_t objects[MAX_DEPTH / 64];   // bit per open level: 1 for '{', 0 for '['
+
+    bool fail(Error error);
+    bool in_object() const { return (objects[(depth - 1) / 64] >> ((depth - 1) % 64)) & 1; }
+    bool begin_value(char c);
+    void end_value();
+    bool close_container(char c);
+    bool start_utf8(unsigned char c);
+};
+
+#endif // JSON_VALIDATOR_HPP
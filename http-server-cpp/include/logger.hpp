@@ -0,0 +1,88 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class LogLevel {
+    DEBUG,    // per-request chatter
+    INFO,     // lifecycle, client errors
+    WARN,     // security violations, overload
+    ERROR,    // server-side failures
+    OFF
+};
+
+// Asynchronous line logger. Each producing thread formats into its own
+// single-producer/single-consumer byte ring without taking a lock; a
+// background writer drains all rings and writes them out in batches. When a
+// ring is full the line is dropped and counted; the last part of each ring
+// is kept for ERROR lines, so they still get in while other levels are
+// being dropped. Logging never waits for the writer.
+class Logger {
+public:
+    struct Stats {
+        uint64_t logged;
+        uint64_t dropped;
+    };
+
+    Logger();
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // Empty path logs to stdout; otherwise the file is appended to
+    bool open(const std::string& path);
+    void set_level(LogLevel level) { min_level.store(level, std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const { return level >= min_level.load(std::memory_order_relaxed); }
+
+    // "[time] [tag] message"; the tag is omitted when empty
+    void log(LogLevel level, std::string_view tag, std::string_view message);
+
+    // Write out everything logged so far; also done on destruction
+    void flush();
+
+    // Summed over the threads' rings
+    Stats get_stats() const;
+
+    static bool parse_level(const std::string& name, LogLevel& level);
+
+private:
+    struct Ring;
+    struct ThreadSlot;
+
+    static constexpr size_t RING_BYTES = 64 * 1024;
+
+    const uint64_t id;                  // tells apart loggers in thread-local slots
+    std::atomic<LogLevel> min_level;
+    int out_fd;
+    bool owns_fd;
+
+    mutable std::mutex rings_mutex;     // guards rings; taken once per producer thread
+    std::vector<std::shared_ptr<Ring>> rings;
+    Stats retired;                      // counts of rings whose thread has exited
+
+    std::mutex writer_mutex;
+    std::condition_variable writer_cv;
+    bool stopping;
+    uint64_t flush_requests;
+    uint64_t flushes_done;
+    std::thread writer;
+
+    uint64_t reported_drops;
+
+    Ring& local_ring();
+    void writer_loop();
+    size_t drain(std::string& batch);
+    void write_out(const std::string& batch);
+};
+
+#endif // LOGGER_HPP
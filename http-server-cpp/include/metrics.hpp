@@ -0,0 +1,92 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "http_parser.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Log-linear latency histogram in the style of HdrHistogram: 16 linear
+// sub-buckets per power of two, so any recorded value is reported within
+// 1/16 (6.25%) of its true value. Covers 1 ns to ~137 s.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 37;
+    static constexpr int BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    // Single writer (the owning thread); readers may run concurrently
+    void record(uint64_t value_ns);
+
+    // Accumulate into plain arrays for reporting
+    void merge_into(uint64_t* buckets, uint64_t& count, uint64_t& sum_ns) const;
+
+    static int bucket_of(uint64_t value_ns);
+    static uint64_t bucket_upper_bound(int bucket);
+    // Value at quantile q (0..1) of merged buckets, in ns
+    static uint64_t quantile(const uint64_t* buckets, uint64_t count, double q);
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+};
+
+// Request metrics, rendered in the Prometheus text format. Every thread that
+// records gets its own cache-line-aligned block, written only by that thread
+// with relaxed loads/stores, so the hot path has no shared atomic
+// read-modify-writes; a scrape merges all blocks.
+class Metrics {
+public:
+    enum class Method { GET, POST, OTHER, COUNT };
+    enum class Route { STATIC, UPLOAD, METRICS, API, OTHER, COUNT };
+    enum class Timeout { IDLE, HEADER, BODY, COUNT };
+    // Why a connection was refused with 503 instead of served
+    enum class Shed { QUEUE_FULL, QUEUE_DELAY, COUNT };
+
+    Metrics();
+    ~Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    static uint64_t now_ns();
+    static Method method_of(HttpMethod method);
+
+    // bytes: the response as queued on the connection, not as written
+    void record_request(Method method, Route route, int status, uint64_t handler_ns,
+                        size_t bytes, bool reused_connection);
+    // Same counters, no handler time (requests rejected before dispatch)
+    void record_response(Method method, Route route, int status, size_t bytes, bool reused_connection);
+    void record_parse(uint64_t parse_ns);
+    void record_connection();
+    void record_shed(Shed reason);
+    void record_timeout(Timeout kind);
+    // Heap allocations made while handling one request (ALLOC_STATS builds)
+    void record_allocations(uint64_t count);
+
+    // Appends every metric family collected here
+    void render(std::string& out) const;
+
+private:
+    struct ThreadMetrics;
+
+    static constexpr int METHODS = static_cast<int>(Method::COUNT);
+    static constexpr int ROUTES = static_cast<int>(Route::COUNT);
+    static constexpr int TIMEOUTS = static_cast<int>(Timeout::COUNT);
+    static constexpr int SHED_REASONS = static_cast<int>(Shed::COUNT);
+
+    const uint64_t id;
+    mutable std::mutex threads_mutex;   // taken once per recording thread and per scrape
+    std::vector<std::unique_ptr<ThreadMetrics>> threads;
+
+    ThreadMetrics& local();
+};
+
+#endif // METRICS_HPP
@@ -0,0 +1,19 @@
+#ifndef MIME_HPP
+#define MIME_HPP
+
+#include <string_view>
+
+// What a file extension is served as
+struct MimeType {
+    std::string_view extension;      // lower case, without the dot
+    std::string_view content_type;
+    bool download;                   // sent as an attachment (Content-Disposition)
+    bool compressible;               // text worth a gzip/br variant
+};
+
+// Entry for the extension of `path` (after the last dot of the last
+// component, any case); unknown or missing extensions get the
+// application/octet-stream download entry. Compile-time table, no allocation.
+const MimeType& mime_type_for(std::string_view path);
+
+#endif // MIME_HPP
@@ -0,0 +1,94 @@
+#ifndef RATE_LIMITER_HPP
+#define RATE_LIMITER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Per-client token buckets, one per client IPv4 address and scope, in an
+// open-addressing table split into shards. Nothing is locked: a bucket is a
+// single 64-bit word updated with compare-and-swap, so a check costs a hash,
+// one or two cache lines and one CAS.
+//
+// Buckets refill lazily. Each word holds the bucket's theoretical arrival
+// time (GCRA): the moment it would be full again, advanced by one interval
+// per request. A request is allowed while that time stays within `burst`
+// intervals of now, which is a token bucket of `burst` tokens refilled at
+// `per_second`. Once the time has passed, the bucket is full and holds no
+// state worth keeping, so the slot is free for another client; that is the
+// only eviction there is, and it costs nothing until a slot is needed.
+class RateLimiter {
+public:
+    // What a request is charged against; each scope has its own buckets
+    enum class Scope { REQUEST, UPLOAD, COUNT };
+    static constexpr int SCOPES = static_cast<int>(Scope::COUNT);
+
+    struct Rule {
+        double per_second = 0;   // 0: unlimited
+        uint32_t burst = 0;      // requests allowed back to back; 0: one second's worth
+    };
+
+    struct Stats {
+        uint64_t limited[SCOPES];   // requests refused
+        uint64_t created;           // buckets set up for a client, reused slots included
+        uint64_t displaced;         // live buckets dropped because their neighbourhood was full
+    };
+
+    // entries: table slots (rounded up to a power of two), allocated only if
+    // some rule limits anything
+    RateLimiter(size_t entries, const Rule (&rules)[SCOPES]);
+    ~RateLimiter();
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    bool enabled() const { return slots != nullptr; }
+    bool enabled(Scope scope) const { return limits[static_cast<int>(scope)].interval_us != 0; }
+    size_t entries() const { return capacity; }
+    // The rule in force, burst resolved
+    Rule rule(Scope scope) const;
+
+    // Charges one request to the client's bucket (IPv4, network order).
+    // False if it is empty; retry_after_s: whole seconds until it is not
+    bool admit(Scope scope, uint32_t client, uint32_t& retry_after_s);
+    // The same test without charging, for refusing a connection up front
+    bool would_admit(Scope scope, uint32_t client, uint32_t& retry_after_s) const;
+
+    Stats get_stats() const;
+
+private:
+    struct Limit {
+        uint64_t interval_us = 0;    // between requests at the sustained rate
+        uint64_t tolerance_us = 0;   // burst * interval
+    };
+
+    struct Slot {
+        std::atomic<uint64_t> key{0};     // scope and address, 0: never used
+        std::atomic<uint64_t> state{0};   // key tag | arrival time (us)
+    };
+
+    struct alignas(64) Counters {
+        std::atomic<uint64_t> limited[SCOPES] = {};
+        std::atomic<uint64_t> created{0};
+        std::atomic<uint64_t> displaced{0};
+    };
+
+    static constexpr int SHARD_BITS = 6;
+    static constexpr size_t SHARD_COUNT = size_t(1) << SHARD_BITS;
+
+    Limit limits[SCOPES];
+    size_t capacity = 0;
+    size_t shard_mask = 0;             // slots per shard - 1
+    Slot* slots = nullptr;             // SHARD_COUNT runs of shard_mask + 1, mapped
+    std::unique_ptr<Counters[]> counters;
+    uint64_t epoch_ns;
+
+    uint64_t now_us() const;
+    Slot* lookup(uint64_t key, uint64_t hash) const;
+    // A slot for a client without one: a free one, else the fullest bucket
+    // near by; nullptr if another thread got there first
+    Slot* claim(uint64_t key, uint64_t hash, uint64_t now);
+};
+
+#endif // RATE_LIMITER_HPP
@@ -0,0 +1,45 @@
+#ifndef RESPONSE_HPP
+#define RESPONSE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+// Response head building blocks. Everything appends into a caller-owned
+// buffer (normally the connection's output buffer), so building a response
+// head allocates nothing once that buffer has grown to size.
+
+// Closes every response head; the server offers keep-alive until it starts
+// draining. The Keep-Alive parameters advertise the idle timeout and
+// per-connection request cap actually enforced.
+std::string_view connection_headers();
+
+// Process-wide; call before serving (timeout 0: no timeout parameter)
+void configure_connection_headers(uint32_t idle_timeout_s, int max_requests);
+
+// From now on connection_headers() is "Connection: close": the process is
+// shutting down or handing over. Process-wide and one-way; thread-safe
+void announce_connection_close();
+
+// "HTTP/1.1 200 OK\r\n" from a constexpr table; unlisted codes get "Unknown"
+void append_status_line(std::string& out, int status_code);
+
+// "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n" (RFC 7231 IMF-fixdate). Formatted
+// at most once per second per thread; the view stays valid until the next
+// call on the same thread.
+std::string_view date_header();
+
+// The bare 29-byte IMF-fixdate for `when`, e.g. for Last-Modified
+void append_http_date(std::string& out, time_t when);
+
+// Content-Type, Content-Length, Server and, for downloads, Content-Disposition
+void append_entity_headers(std::string& out, std::string_view content_type, size_t content_length,
+                           std::string_view filename = {});
+
+// Status line + Date + entity headers + connection_headers()
+void append_response_header(std::string& out, int status_code, std::string_view content_type,
+                            size_t content_length, std::string_view filename = {});
+
+#endif // RESPONSE_HPP
@@ -0,0 +1,74 @@
+#ifndef ROUTER_HPP
+#define ROUTER_HPP
+
+#include "connection.hpp"
+#include "http_parser.hpp"
+#include "metrics.hpp"
+#include "mime.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// In-process handler: answers from memory with conn.respond() (or anything
+// else Connection offers). Runs on the I/O thread with the whole request
+// body buffered, so it must not block.
+using RouteHandler = std::function<void(Connection& conn, const ParsedRequest& request)>;
+
+// Exact-match request routing, filled in once at startup: in-process
+// handlers plus a manifest of the static files, each with its filesystem
+// path and MIME entry worked out ahead of time. A lookup hashes the method
+// and path once and probes an open-addressing table kept at most half
+// full. Registration is not thread-safe; once serving starts the table is
+// only read, so every thread dispatches without locks. Misses are left to
+// the caller (files created after startup, uploads).
+class Router {
+public:
+    enum class Kind { HANDLER, STATIC_FILE };
+
+    struct Route {
+        HttpMethod method;
+        std::string path;
+        Kind kind;
+        Metrics::Route label;          // route label of its request metrics
+        RouteHandler handler;          // HANDLER
+        std::string filepath;          // STATIC_FILE: path to open()
+        size_t filename_offset = 0;    // STATIC_FILE: last component of filepath
+        const MimeType* mime = nullptr;
+
+        std::string_view filename() const { return std::string_view(filepath).substr(filename_offset); }
+    };
+
+    // False if method + path is already taken
+    bool add_handler(HttpMethod method, std::string_view path, RouteHandler handler,
+                     Metrics::Route label = Metrics::Route::API);
+    bool add_file(std::string_view path, std::string filepath);
+
+    // A GET route for every regular file below root whose URL path passes
+    // `accept`, and "/" for /index.html. The directory `skip` (relative to
+    // root) is left out. Returns the number of routes added
+    size_t add_static_files(const std::string& root, std::string_view skip,
+                            const std::function<bool(std::string_view)>& accept);
+
+    const Route* find(HttpMethod method, std::string_view path) const;
+    size_t size() const { return routes.size(); }
+    // In registration order
+    const std::vector<Route>& all() const { return routes; }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    std::vector<Route> routes;
+    std::vector<uint64_t> hashes;    // per route
+    std::vector<uint32_t> slots;     // route index or EMPTY; power-of-two size
+    size_t mask = 0;
+
+    static uint64_t hash(HttpMethod method, std::string_view path);
+    bool insert(Route route);
+    void grow();
+    size_t walk(const std::string& directory, const std::string& url, std::string_view skip, int depth,
+                const std::function<bool(std::string_view)>& accept);
+};
+
+#endif // ROUTER_HPP
@@ -3,12 +3,11 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <thread>
 #include <mutex>
-#include <queue>
-#include <condition_variable>
 #include <atomic>
 #include <memory>
 #include <fstream>
@@ -23,71 +22,240 @@
 #include <cstring>
 #include <random>
 #include <iomanip>
+#include "asset_bundle.hpp"
+#include "conditional.hpp"
+#include "connection.hpp"
+#include "file_cache.hpp"
+#include "h2_session.hpp"
+#include "http_parser.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "rate_limiter.hpp"
+#include "response.hpp"
+#include "router.hpp"
+#include "upload.hpp"
+#include "worker_pool.hpp"
 
-class HTTPServer {
+class IOLoop;
+
+// How accepted connections are serviced
+enum class IOModel {
+    THREAD_POOL,   // blocking worker per connection (original model)
+    EPOLL,         // edge-triggered event loops, many connections per thread
+    URING          // io_uring loops: completion-based, one kernel entry per loop pass
+};
+
+struct ServerConfig {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int max_threads = 10;          // workers (THREAD_POOL) or event loops (EPOLL, URING)
+    IOModel io_model = IOModel::THREAD_POOL;
+    int shards = 0;                // >0: SO_REUSEPORT listener + event loop per shard
+    bool pin_cpus = false;         // pin shard i to CPU i % ncpu
+    WorkerPool::Dispatch dispatch = WorkerPool::Dispatch::LEAST_LOADED;   // THREAD_POOL: worker per connection
+    uint32_t admission_wait_ms = 1000;           // THREAD_POOL: refuse connections expected to queue longer
+    uint32_t queue_delay_target_ms = 5;          // THREAD_POOL: CoDel target for accept-to-worker delay, 0 disables
+    uint32_t queue_delay_interval_ms = 100;      // THREAD_POOL: CoDel interval
+    int listen_backlog = 511;                    // listen(2) backlog, capped by net.core.somaxconn
+    size_t cache_bytes = 64 * 1024 * 1024;       // static file cache budget, 0 disables
+    size_t cache_max_entry_bytes = 256 * 1024;   // larger files always go through sendfile()
+    std::string bundle_path;                     // static files from this asset bundle (bundle_pack), empty: none
+    size_t max_header_bytes = 16 * 1024;         // request line + headers, else 431
+    size_t max_body_bytes = 8 * 1024 * 1024;     // decoded request body, else 413
+    uint32_t idle_timeout_s = 30;                // keep-alive idle / stalled output, then close
+    uint32_t header_timeout_s = 10;              // request head must arrive within, else 408
+    uint32_t body_timeout_s = 60;                // request body must arrive within, else 408
+    uint32_t drain_timeout_s = 30;               // shutdown / handoff: then open connections are cut
+    double rate_limit = 0;                       // requests per second per client address, 0 disables
+    uint32_t rate_burst = 0;                     // requests per client allowed back to back, 0: one second's worth
+    double upload_rate_limit = 0;                // uploads per second per client address, 0 disables
+    uint32_t upload_rate_burst = 0;
+    size_t rate_limit_entries = 1 << 20;         // client buckets the limiter has room for, 16 bytes each
+    SyncPolicy upload_sync = SyncPolicy::BATCH;  // when uploads reach stable storage
+    uint32_t upload_sync_ms = 50;                // BATCH: how long a batch fills before it is synced
+    size_t json_max_depth = JsonValidator::DEFAULT_DEPTH;   // deeper upload bodies get 400
+    bool http2 = true;                           // h2c by prior knowledge or Upgrade: h2c
+    LogLevel log_level = LogLevel::DEBUG;        // INFO silences per-request lines
+    std::string log_file;                        // empty: stdout
+};
+
+class HTTPServer : public ConnectionHandler {
 private:
+    // First member: outlives everything that logs during shutdown
+    Logger logger;
+    
     std::string host;
     int port;
+    std::string host_with_port;         // accepted Host values, built once
+    std::string localhost_with_port;
     int max_threads;
+    IOModel io_model;
+    int shards;
+    bool pin_cpus;
+    size_t max_header_bytes;
+    size_t max_body_bytes;
+    ConnectionTimeouts timeouts;
     int server_socket;
+    // run()'s acceptor: a spare descriptor to give up when out of them, and
+    // when to poll the listener again after an accept error
+    int reserve_fd;
+    uint64_t accept_retry_ms;
+    uint64_t accept_log_ms;             // accept errors are reported at most once per interval
+    uint64_t accept_failures;           // since the last report
+    std::vector<int> shard_sockets;     // the shards' listeners; each loop accepts on a dup
     std::atomic<bool> running;
     
+    // Graceful shutdown: no more accepting, connections close after their current request
+    std::atomic<bool> draining;
+    uint32_t drain_timeout_s;
+    uint64_t drain_deadline_ms;
+    
+    // Zero-downtime restarts (handoff.hpp). Signals arrive on signal_fd;
+    // SIGHUP and SIGUSR2 start a successor that inherits the listeners
+    int signal_fd;
+    std::string binary_path;            // SIGUSR2 starts what is installed here now
+    std::vector<std::string> arguments;
+    pid_t successor_pid;
+    int successor_channel;
+    uint64_t successor_deadline_ms;
+    std::vector<int> inherited_sockets; // from the predecessor, until start() claims them
+    int handoff_channel;                // to the predecessor, until we serve
+    
     // Thread pool
     std::vector<std::thread> thread_pool;
-    std::queue<int> connection_queue;
-    std::mutex queue_mutex;
-    std::condition_variable queue_cv;
+    std::atomic<int> running_workers;
+    WorkerPool worker_pool;
+    WorkerPool::Dispatch dispatch;
+    uint32_t admission_wait_ms;
+    uint32_t queue_delay_target_ms;
+    uint32_t queue_delay_interval_ms;
+    int listen_backlog;
+    
+    // Event loops (EPOLL and URING models)
+    std::vector<std::unique_ptr<IOLoop>> event_loops;
+    size_t next_loop;
+    
+    // Request routing: in-process handlers and the static file manifest
+    Router router;
+    
+    // Static file cache
+    FileCache file_cache;
+    
+    // Static files packed ahead of time, mapped read-only; files not in it
+    // go through the cache and the filesystem
+    std::string bundle_path;
+    std::shared_ptr<const AssetBundle> bundle;
+    
+    // Per-client request rates, checked on accept and on every request
+    RateLimiter rate_limiter;
+    
+    // Uploads: directory handle and durability policy
+    int upload_dir_fd;
+    SyncPolicy upload_sync_policy;
+    uint32_t upload_sync_ms;
+    UploadSync upload_sync;
+    size_t json_max_depth;
+    
+    // HTTP/2: sessions are created per connection on the preface or an Upgrade
+    bool http2;
+    H2Session::Limits http2_limits;
+    std::atomic<uint64_t> http2_connections{0};
     
     // Statistics
     std::atomic<int> active_connections;
-    std::atomic<int> total_requests;
+    Metrics metrics;
+    std::atomic<uint64_t> scrape_allocations{0};   // made by /metrics itself (ALLOC_STATS builds)
     
     // Helper methods
-    void log_message(const std::string& message);
-    void log_request(const std::string& thread_id, const std::string& message);
-    std::string get_current_time();
-    std::string generate_upload_filename();
-    bool is_valid_json(const std::string& json_str);
-    
-    // HTTP parsing
-    struct HTTPRequest {
-        std::string method;
-        std::string path;
-        std::string version;
-        std::map<std::string, std::string> headers;
-        std::string body;
-    };
-    
-    HTTPRequest parse_request(const std::string& request_data);
-    std::string build_response(int status_code, const std::string& content_type, 
-                              const std::string& body, const std::string& filename = "");
-    std::string get_content_type(const std::string& filepath);
+    void log_message(std::string_view message, LogLevel level = LogLevel::INFO);
+    void log_request(const std::string& thread_id, std::string_view message, LogLevel level = LogLevel::DEBUG);
+    static const std::string& thread_tag();
+    std::string generate_upload_filename(bool wide = false);
+    
+    // HTTP parsing (views into the connection's input buffer)
+    using HTTPRequest = ParsedRequest;
     
     // Security
-    bool validate_path(const std::string& path);
-    bool validate_host_header(const std::map<std::string, std::string>& headers);
+    bool validate_path(std::string_view path);
+    bool validate_host_header(const HTTPRequest& request);
     
     // File operations
-    std::string read_file(const std::string& filepath, bool binary = false);
-    bool write_file(const std::string& filepath, const std::string& content);
-    std::string get_file_extension(const std::string& filepath);
+    CachedFilePtr load_cached_file(int file_fd, std::string_view filepath, const struct stat& file_stat,
+                                   std::string_view content_type, std::string_view filename, bool compressible);
+    void log_cache_stats();
+    void warm_file_cache();
     
-    // Request handlers
-    void handle_get_request(int client_socket, const HTTPRequest& request);
-    void handle_post_request(int client_socket, const HTTPRequest& request);
-    void send_error_response(int client_socket, int status_code, const std::string& message);
+    // Request handlers. file: the request's entry in the static manifest, if any
+    void handle_get_request(Connection& conn, const HTTPRequest& request, const Router::Route* file);
+    void begin_upload(Connection& conn, const HTTPRequest& request);
+    bool stream_upload(Connection& conn);
+    void write_upload(UploadStream& upload, const char* data, size_t length);
+    void reject_json(UploadStream& upload);
+    // body: the identity bytes in memory, borrowed from owner; else file_fd
+    void send_ranges(Connection& conn, const ByteRange* ranges, size_t count, const std::shared_ptr<const void>& owner,
+                     const char* body, int file_fd, size_t total, std::string_view content_type,
+                     std::string_view filename, bool compressible, std::string_view etag, time_t modified);
+    void finish_upload(Connection& conn);
+    void send_response(Connection& conn, int status_code, std::string_view content_type, std::string_view body);
+    void send_error_response(Connection& conn, int status_code, std::string_view message);
+    void send_continue(Connection& conn, const HTTPRequest& request);
+    bool rate_limited(Connection& conn, const HTTPRequest& request, const Router::Route* target, bool upload);
+    void reject_request(Connection& conn, const HTTPRequest& request, int status_code,
+                        const std::string& message, const std::string& reason);
+    void handle_metrics_request(Connection& conn, const HTTPRequest& request);
     
     // Connection management
     void handle_client(int client_socket);
-    void worker_thread();
+    void worker_thread(size_t index);
     bool should_keep_alive(const HTTPRequest& request);
+    void complete_request(Connection& conn, bool keep_alive);
+    bool upgrade_http2(Connection& conn, const HTTPRequest& request);
+    void dispatch_epoll(int client_socket, uint32_t peer_address);
+    void shed_connection(int client_socket, Metrics::Shed reason);
+    void refuse_connection(int client_socket, int status_code, uint32_t retry_after_s, std::string_view body);
+    int create_listen_socket(bool reuse_port);
+    int open_listener(bool reuse_port);
+    void accept_pending();
+    std::unique_ptr<IOLoop> make_loop();
+    bool start_shards();
+    void log_shard_stats();
+    
+    // Process control
+    void handle_signals();
+    void start_successor(const std::string& path, const char* reason);
+    void check_successor();
+    void abandon_successor(const char* reason);
+    void drain();
+    bool drained() const;
     
 public:
     HTTPServer(const std::string& host = "127.0.0.1", int port = 8080, int max_threads = 10);
+    explicit HTTPServer(const ServerConfig& config);
     ~HTTPServer();
     
+    // ConnectionHandler
+    void on_connection_opened(Connection& conn) override;
+    void process_input(Connection& conn) override;
+    void on_connection_closed(Connection& conn) override;
+    void on_timeout(Connection& conn, Connection::Phase kind) override;
+    void on_drain(Connection& conn) override;
+    
+    // Serve method + path from an in-process handler; takes precedence over
+    // static files and uploads. Only before start()
+    bool add_route(HttpMethod method, std::string_view path, RouteHandler handler);
+    
+    // Successor side of a handoff: receives the predecessor's listening
+    // sockets over `channel`, for start() to use instead of binding, and
+    // tells it once serving. Only before start()
+    bool take_over(int channel);
+    // Signals for run() to act on, read from a signalfd: SIGINT/SIGTERM
+    // drain and stop, SIGHUP re-executes this binary (config reload),
+    // SIGUSR2 starts the one now at binary_path (upgrade), both with handoff
+    void set_process_control(int signal_fd, std::string binary_path, std::vector<std::string> arguments);
+    
     bool start();
     void stop();
+    // start(), then accept / handle signals until stopped or drained
     void run();
 };
 
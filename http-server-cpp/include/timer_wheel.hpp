@@ -0,0 +1,101 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Hierarchical timing wheel (Varghese & Lauck): LEVELS wheels of SLOTS
+// buckets, each level SLOTS times coarser than the one below. Timers are
+// intrusive doubly-linked nodes, so schedule and cancel are O(1) and a tick
+// only touches the one bucket that is due (plus, every SLOTS ticks, one
+// bucket of the next level that is cascaded down). Not thread-safe: each
+// event loop owns its wheel.
+class TimerWheel {
+public:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    static constexpr int LEVELS = 4;
+
+    // Embed in the object being timed; `data` leads back to it
+    struct Timer {
+        Timer* prev = nullptr;
+        Timer* next = nullptr;
+        uint64_t expires = 0;       // tick
+        uint64_t deadline_ms = 0;   // as requested
+        void* data = nullptr;
+
+        bool armed() const { return next != nullptr; }
+    };
+
+    TimerWheel(uint64_t tick_ms, uint64_t now_ms);
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Coarse monotonic clock the wheel is driven with
+    static uint64_t now_ms();
+
+    // (Re)arms the timer; deadlines already passed fire on the next tick
+    void schedule(Timer& timer, uint64_t deadline_ms);
+    void cancel(Timer& timer);
+
+    // Runs every tick up to now_ms and calls on_expire(timer) for each timer
+    // that came due, already unlinked. The callback may schedule or cancel
+    // any timer, including the one it was called for.
+    template <typename Fn>
+    void advance(uint64_t now_ms, Fn&& on_expire);
+
+    // Milliseconds until the next tick, -1 when no timer is armed
+    int next_timeout_ms(uint64_t now_ms) const;
+
+    size_t size() const { return count; }
+
+private:
+    const uint64_t tick_ms;
+    uint64_t current;           // last tick processed
+    size_t count = 0;
+    Timer slots[LEVELS][SLOTS]; // list heads
+
+    void link(Timer& timer);
+    static void unlink(Timer& timer);
+    void cascade(int level);
+    // Moves the due level-0 bucket onto `expired`
+    void take_due(Timer& expired);
+};
+
+template <typename Fn>
+void TimerWheel::advance(uint64_t now_ms, Fn&& on_expire) {
+    uint64_t target = now_ms / tick_ms;
+    if (count == 0) {
+        // Nothing to fire: skip the idle ticks in one step
+        if (target > current) {
+            current = target;
+        }
+        return;
+    }
+
+    while (current < target) {
+        current++;
+        for (int level = LEVELS - 1; level > 0; level--) {
+            if ((current & ((uint64_t(1) << (level * SLOT_BITS)) - 1)) == 0) {
+                cascade(level);
+            }
+        }
+
+        Timer expired;
+        expired.prev = expired.next = &expired;
+        take_due(expired);
+        while (expired.next != &expired) {
+            Timer* timer = expired.next;
+            unlink(*timer);
+            count--;
+            on_expire(*timer);
+        }
+
+        if (count == 0 && current < target) {
+            current = target;
+        }
+    }
+}
+
+#endif // TIMER_WHEEL_HPP
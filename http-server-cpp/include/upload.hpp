@@ -0,0 +1,120 @@
+#ifndef UPLOAD_HPP
+#define UPLOAD_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "json_validator.hpp"
+
+// A file in the uploads directory that only appears under its final name
+// once publish() is called: an anonymous O_TMPFILE linked in with linkat(),
+// or, on filesystems without O_TMPFILE, a hidden temp file that is linked
+// and unlinked. Destroying an unpublished file leaves nothing behind.
+class UploadFile {
+public:
+    UploadFile() = default;
+    ~UploadFile();
+
+    UploadFile(const UploadFile&) = delete;
+    UploadFile& operator=(const UploadFile&) = delete;
+
+    bool open(int dir_fd);
+    bool is_open() const { return fd >= 0; }
+    bool write(const char* data, size_t length);
+
+    // Never replaces an existing file; false with errno == EEXIST if taken
+    bool publish(const std::string& name);
+    void discard();
+
+    int descriptor() const { return fd; }
+    // Hands the descriptor over (e.g. to UploadSync); the file stays published
+    int release();
+
+private:
+    int fd = -1;
+    int dir_fd = -1;
+    std::string temp_name;    // empty for O_TMPFILE
+};
+
+// When published uploads reach stable storage
+enum class SyncPolicy {
+    NONE,     // left to the kernel's writeback
+    BATCH,    // write-behind, answered before durable: a background thread
+              // fdatasyncs the files published in the last interval, then
+              // fsyncs the directory once (one syncfs() instead if more pile
+              // up than it keeps open). A crash can lose that interval's
+              // uploads after they were acknowledged
+    ALWAYS    // fdatasync the file and fsync the directory before answering
+};
+
+class UploadSync {
+public:
+    struct Stats {
+        std::atomic<uint64_t> files{0};      // files made durable
+        std::atomic<uint64_t> batches{0};    // directory fsyncs
+    };
+
+    UploadSync() = default;
+    ~UploadSync();
+
+    UploadSync(const UploadSync&) = delete;
+    UploadSync& operator=(const UploadSync&) = delete;
+
+    // dir_fd stays owned by the caller and must outlive stop()
+    void start(SyncPolicy policy, int dir_fd, uint32_t interval_ms);
+    // Syncs whatever is still queued
+    void stop();
+
+    // Publishes the upload under `name` and makes it durable per the policy
+    // (ALWAYS: data synced before the name appears and before this returns;
+    // BATCH: only queued for the sync thread). False with errno set if
+    // publishing failed; EEXIST means the name is taken.
+    bool publish(UploadFile& file, const std::string& name);
+    SyncPolicy get_policy() const { return policy; }
+    const Stats& get_stats() const { return stats; }
+
+private:
+    static constexpr size_t MAX_BATCH = 256;
+    // Descriptors held for the sync thread; past this they are closed at once
+    // and the next batch syncs the whole filesystem, so a disk slower than
+    // the upload rate cannot run the process out of descriptors
+    static constexpr size_t MAX_PENDING = 1024;
+
+    SyncPolicy policy = SyncPolicy::NONE;
+    int dir_fd = -1;
+    uint32_t interval_ms = 0;
+    Stats stats;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<int> pending;
+    size_t overflow = 0;      // published files closed without being queued
+    bool running = false;
+    std::thread sync_thread;
+
+    void run();
+    void sync_batch(std::vector<int>& fds, size_t closed);
+};
+
+// A request body being streamed to disk. Bytes are validated and written as
+// they arrive, then consumed, so the connection never holds more than one
+// read's worth of the body. After a failure the rest of the body is still
+// read and dropped, and error_status is answered once it has all arrived.
+struct UploadStream {
+    UploadFile file;
+    JsonValidator validator;
+    size_t remaining = 0;          // Content-Length framing: bytes still due
+    bool chunked = false;
+    bool keep_alive = true;
+    size_t bytes = 0;              // body bytes received
+    uint64_t handler_ns = 0;       // time spent validating and writing
+    int error_status = 0;
+    std::string error_message;
+};
+
+#endif // UPLOAD_HPP
@@ -0,0 +1,107 @@
+#ifndef URING_LOOP_HPP
+#define URING_LOOP_HPP
+
+#include "connection.hpp"
+#include "io_loop.hpp"
+#include "io_uring.hpp"
+#include "timer_wheel.hpp"
+#include <netinet/in.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// io_uring reactor with the same contract as EventLoop: one thread, its own
+// connections, timeouts in a timer wheel. Per loop iteration there is one
+// io_uring_enter() that submits everything queued and waits for
+// completions; in steady state nothing else enters the kernel.
+//
+//  - accept: one multishot ACCEPT straight into the fixed-file table, so
+//    sockets are never regular descriptors in this process. A multishot
+//    accept reports no peer addresses; a loop that needs them accepts one
+//    connection per ACCEPT instead
+//  - recv: one multishot RECV per connection into a provided buffer ring;
+//    the bytes are copied into the connection's InputBuffer and the buffer
+//    goes straight back to the ring
+//  - send: memory parts as one SENDMSG; a file range follows as a linked
+//    SPLICE file -> pipe -> socket, through a pipe borrowed from the loop
+class UringLoop : public IOLoop {
+public:
+    // peer_addresses: fill in Connection::peer_address for accepted sockets
+    UringLoop(ConnectionHandler& handler, const ConnectionTimeouts& timeouts, bool peer_addresses = false);
+    ~UringLoop() override;
+
+    bool start(int listen_fd = -1, int cpu = -1) override;
+    void stop() override;
+    void add_connection(int client_socket, uint32_t peer_address) override;
+    void drain() override;
+
+private:
+    struct Conn;
+    struct Pipe {
+        int read_fd;
+        int write_fd;
+    };
+
+    ConnectionHandler& handler;
+    const ConnectionTimeouts timeouts;
+    IoUring ring;
+    int wake_fd;
+    uint64_t wake_value;
+    int listen_fd;
+    int cpu;
+    unsigned max_connections;
+    bool accept_armed;
+    uint64_t accept_retry_ms;
+    bool peer_addresses;
+    struct sockaddr_in accept_address;    // single-shot ACCEPT: the client's address
+    socklen_t accept_address_length;
+    std::atomic<bool> running;
+    std::atomic<bool> draining;
+    bool drain_started;
+    size_t outstanding;    // SQEs of all connections still awaiting completion
+    std::thread loop_thread;
+
+    std::unordered_map<Conn*, std::unique_ptr<Conn>> connections;
+    std::vector<Conn*> closed;    // nothing in flight any more, freed after the batch
+    TimerWheel timers;
+
+    // Provided receive buffers: one region, handed to the kernel by index
+    io_uring_buf_ring* buffer_ring;
+    char* buffers;
+    unsigned buffer_tail;
+
+    std::vector<Pipe> idle_pipes;
+    size_t pipe_capacity;
+
+    // Sockets accepted on another thread, waiting to be registered
+    std::mutex pending_mutex;
+    std::vector<PendingSocket> pending_fds;
+
+    void run_loop();
+    void on_completion(const io_uring_cqe& cqe);
+    void arm_accept();
+    void arm_wake();
+    void register_pending();
+    void open_connection(Conn& c);
+    void arm_recv(Conn& c);
+    void on_recv(Conn& c, const io_uring_cqe& cqe);
+    void recycle_buffer(unsigned id);
+    void process(Conn& c);
+    void start_write(Conn& c);
+    void queue_splice(Conn& c, size_t length, bool with_input);
+    void on_write(Conn& c, unsigned op, int result);
+    void finish_write(Conn& c);
+    bool borrow_pipe(Conn& c);
+    void return_pipe(Conn& c);
+    void arm_timer(Conn& c);
+    void on_timer(Conn& c);
+    void close_connection(Conn& c);
+    void release(Conn& c);
+    void begin_drain();
+    io_uring_sqe* sqe_for(Conn& c, unsigned op);
+};
+
+#endif // URING_LOOP_HPP
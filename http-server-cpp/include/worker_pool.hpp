@@ -0,0 +1,126 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded ring of accepted sockets: the push/steal half of a Chase-Lev
+// deque. Only the acceptor pushes; any worker takes the oldest entry with
+// one CAS on `top`, so there is no lock and no owner-side pop.
+class SocketDeque {
+public:
+    static constexpr int64_t CAPACITY = 256;
+    static constexpr int EMPTY = -1;
+    static constexpr int LOST_RACE = -2;   // another worker took it; retry
+
+    // Acceptor thread only; false when full. queued_ns: steady clock at accept
+    bool push(int socket, int64_t queued_ns);
+    // Any thread: a socket, EMPTY or LOST_RACE
+    int steal(int64_t& queued_ns);
+    size_t size() const;
+    // When the oldest queued socket was pushed, 0 if none (racy: a hint)
+    int64_t oldest() const;
+
+private:
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<int> slots[CAPACITY] = {};
+    std::atomic<int64_t> stamps[CAPACITY] = {};
+};
+
+// Connection dispatch for the THREAD_POOL I/O model. Every worker has its
+// own deque; the acceptor picks one per connection (least loaded, or round
+// robin), and a worker whose deque is empty steals from the others, so a
+// worker held by a long keep-alive connection does not strand its backlog.
+// Idle workers sleep on their own futex and are woken one at a time, only
+// when there is work for them.
+//
+// Admission adapts to throughput: by Little's law a new connection waits
+// about queued / completion_rate, so the pool refuses it once the backlog
+// exceeds what the workers finish within `target_wait`, instead of at a
+// fixed queue length.
+//
+// Within that limit, connections that sat in the queue too long are shed
+// CoDel-style: if even the shortest wait seen over an interval exceeded the
+// delay target, the queue is standing rather than absorbing a burst, and
+// until an interval says otherwise every connection that waited more than
+// twice the target is handed to its worker marked for a quick 503, and the
+// acceptor admits only as many as drain within that time. The acceptor also
+// samples the age of the oldest queued connection, so workers that are all
+// stuck still get the queue judged.
+class WorkerPool {
+public:
+    enum class Dispatch { LEAST_LOADED, ROUND_ROBIN };
+
+    WorkerPool() = default;
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // delay_target 0: never shed by queueing delay
+    void start(size_t workers, Dispatch dispatch, std::chrono::milliseconds target_wait,
+               std::chrono::milliseconds delay_target, std::chrono::milliseconds delay_interval);
+    // Wakes every worker; take() returns -1 from then on
+    void stop();
+    // Wakes every worker; take() returns -1 once nothing is left queued
+    void finish();
+    // After the workers have exited: closes sockets still queued
+    void close_queued();
+
+    // Acceptor thread only. False if over the admission limit or every deque
+    // is full; the caller still owns the socket
+    bool submit(int socket);
+    // Worker `index`: marks its previous connection finished and blocks for
+    // the next one; -1 once stopped. shed: the connection waited too long
+    // and should be refused rather than served
+    int take(size_t index, bool& shed);
+
+    size_t queued() const;
+    size_t admission_limit() const { return limit.load(std::memory_order_relaxed); }
+    uint64_t steals() const;
+    uint64_t completed() const;
+    bool overloaded() const { return standing_queue.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker {
+        SocketDeque deque;
+        alignas(64) std::atomic<uint32_t> sleeping{0};   // futex word
+        std::atomic<bool> busy{false};
+        // Written only by the worker
+        std::atomic<uint64_t> completed{0};
+        std::atomic<uint64_t> stolen{0};
+    };
+
+    std::unique_ptr<Worker[]> workers;
+    size_t count = 0;
+    Dispatch dispatch = Dispatch::LEAST_LOADED;
+    std::atomic<bool> running{false};
+    std::atomic<bool> finishing{false};
+
+    // Acceptor state
+    size_t next = 0;
+    double target_seconds = 1.0;
+    double rate = 0;                  // EWMA of connections completed per second
+    uint64_t last_completed = 0;
+    std::chrono::steady_clock::time_point last_sample;
+    std::atomic<size_t> limit{0};
+
+    // Queueing delay state, shared by the workers
+    int64_t delay_target_ns = 0;
+    int64_t delay_interval_ns = 0;
+    std::atomic<int64_t> interval_end{0};
+    std::atomic<int64_t> min_delay{0};
+    std::atomic<bool> standing_queue{false};
+
+    int find_work(size_t index, int64_t& queued_ns);
+    size_t pick_worker();
+    void wake(Worker& worker);
+    void update_limit();
+    void observe_delay(int64_t now_ns, int64_t delay_ns);
+};
+
+#endif // WORKER_POOL_HPP
@@ -0,0 +1,77 @@
+#include "../include/alloc_stats.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+// glibc's own entry points; operator new ends up in malloc, so counting
+// these covers C++ allocations too
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+}
+
+namespace {
+
+// Zero-initialised, so counting works before any constructor has run
+thread_local uint64_t thread_count;
+std::atomic<uint64_t> total_count;
+
+inline void count() {
+    thread_count++;
+    total_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+}
+
+uint64_t AllocStats::thread_allocations() {
+    return thread_count;
+}
+
+uint64_t AllocStats::total_allocations() {
+    return total_count.load(std::memory_order_relaxed);
+}
+
+extern "C" {
+
+void* malloc(size_t size) {
+    count();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t items, size_t size) {
+    count();
+    return __libc_calloc(items, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    count();
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** result, size_t alignment, size_t size) {
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    count();
+    void* ptr = __libc_memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *result = ptr;
+    return 0;
+}
+
+}
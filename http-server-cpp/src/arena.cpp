@@ -0,0 +1,74 @@
+#include "../include/arena.hpp"
+#include "../include/buffer_pool.hpp"
+#include <cstring>
+
+namespace {
+// Block header size, keeping what follows maximally aligned
+constexpr size_t HEADER = alignof(std::max_align_t) > 16 ? alignof(std::max_align_t) : 16;
+}
+
+void* Arena::allocate_slow(size_t size, size_t align) {
+    if (size + align > BufferPool::BUFFER_SIZE - HEADER) {
+        // Too big for a pooled block: its own allocation, linked in behind
+        // the current block so that one keeps filling
+        char* memory = new char[HEADER + size + align];
+        Block* block = reinterpret_cast<Block*>(memory);
+        block->pooled = false;
+        if (blocks) {
+            block->next = blocks->next;
+            blocks->next = block;
+        } else {
+            block->next = nullptr;
+            blocks = block;
+        }
+        uintptr_t at = (reinterpret_cast<uintptr_t>(memory + HEADER) + align - 1) & ~(uintptr_t(align) - 1);
+        return reinterpret_cast<void*>(at);
+    }
+
+    char* memory = BufferPool::acquire();
+    Block* block = reinterpret_cast<Block*>(memory);
+    block->pooled = true;
+    block->next = blocks;
+    blocks = block;
+    cursor = memory + HEADER;
+    limit = memory + BufferPool::BUFFER_SIZE;
+    return allocate(size, align);
+}
+
+std::string_view Arena::join(std::initializer_list<std::string_view> parts) {
+    size_t length = 0;
+    for (std::string_view part : parts) {
+        length += part.size();
+    }
+    char* out = static_cast<char*>(allocate(length + 1, 1));
+    char* at = out;
+    for (std::string_view part : parts) {
+        std::memcpy(at, part.data(), part.size());
+        at += part.size();
+    }
+    *at = '\0';
+    return std::string_view(out, length);
+}
+
+std::string_view Arena::number(uint64_t value) {
+    char digits[20];
+    size_t length = 0;
+    do {
+        digits[sizeof(digits) - ++length] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    return copy(std::string_view(digits + sizeof(digits) - length, length));
+}
+
+void Arena::reset() {
+    while (blocks) {
+        Block* next = blocks->next;
+        if (blocks->pooled) {
+            BufferPool::release(reinterpret_cast<char*>(blocks));
+        } else {
+            delete[] reinterpret_cast<char*>(blocks);
+        }
+        blocks = next;
+    }
+    cursor = limit = nullptr;
+}
@@ -0,0 +1,324 @@
+#include "../include/asset_bundle.hpp"
+#include "../include/response.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+constexpr char MAGIC[8] = {'H', 'S', 'B', 'U', 'N', 'D', 'L', 'E'};
+// Bumped with any change to the layout below or to the Encoding list
+constexpr uint32_t VERSION = 1;
+constexpr size_t FORMS = 1 + ENCODING_COUNT;
+constexpr uint64_t COMPRESSIBLE = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t forms;          // representations per record
+    uint64_t length;         // of the whole file: a truncated bundle is refused
+    uint64_t asset_count;
+    uint64_t slot_count;     // power of two, more than twice asset_count
+};
+
+struct Span {
+    uint64_t offset;         // from the start of the file
+    uint64_t length;
+};
+
+struct FormRecord {
+    Span body;
+    Span header;
+    Span etag;
+};
+
+struct Record {
+    uint64_t hash;
+    Span path;
+    int64_t mtime;
+    uint64_t flags;
+    FormRecord forms[FORMS];   // identity, then by Encoding
+};
+
+// Slots are 4 bytes and at least two, so the records after them stay 8-byte aligned
+static_assert(sizeof(Header) % 8 == 0, "records must stay aligned");
+
+uint64_t hash(std::string_view bytes) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : bytes) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool within(const Span& span, size_t length) {
+    return span.offset <= length && span.length <= length - span.offset;
+}
+
+std::string_view view(const char* base, const Span& span) {
+    return std::string_view(base + span.offset, span.length);
+}
+
+// Every offset and record number checked once, so lookups never have to;
+// nullptr if the bundle is sound
+const char* check(const char* base, size_t length) {
+    if (length < sizeof(Header)) {
+        return "too short";
+    }
+    const Header& header = *reinterpret_cast<const Header*>(base);
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        return "not an asset bundle";
+    }
+    if (header.version != VERSION || header.forms != FORMS) {
+        return "built by another version of bundle_pack";
+    }
+    if (header.length != length) {
+        return "truncated";
+    }
+    uint64_t slots = header.slot_count;
+    if (slots < 2 || (slots & (slots - 1)) != 0 || header.asset_count >= slots ||
+        slots > (length - sizeof(Header)) / sizeof(uint32_t) ||
+        header.asset_count > (length - sizeof(Header) - slots * sizeof(uint32_t)) / sizeof(Record)) {
+        return "corrupt index";
+    }
+    const uint32_t* slot = reinterpret_cast<const uint32_t*>(base + sizeof(Header));
+    size_t used = 0;
+    for (size_t i = 0; i < slots; i++) {
+        if (slot[i] > header.asset_count) {
+            return "corrupt index";
+        }
+        used += slot[i] != 0;
+    }
+    // An empty slot ends every probe
+    if (used != header.asset_count) {
+        return "corrupt index";
+    }
+    const Record* records = reinterpret_cast<const Record*>(slot + slots);
+    for (size_t i = 0; i < header.asset_count; i++) {
+        const Record& record = records[i];
+        if (!within(record.path, length)) {
+            return "corrupt record";
+        }
+        for (const FormRecord& form : record.forms) {
+            if (!within(form.body, length) || !within(form.header, length) || !within(form.etag, length)) {
+                return "corrupt record";
+            }
+        }
+    }
+    return nullptr;
+}
+
+void append_validators(std::string& out, std::string_view etag, time_t modified) {
+    out += "ETag: ";
+    out += etag;
+    out += "\r\nLast-Modified: ";
+    append_http_date(out, modified);
+    out += "\r\n";
+}
+
+// Strong validator from the bytes themselves; encoded forms carry their token
+std::string content_etag(std::string_view body, std::string_view token) {
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "\"%016llx", static_cast<unsigned long long>(hash(body)));
+    std::string etag(buffer, static_cast<size_t>(length));
+    if (!token.empty()) {
+        etag += '-';
+        etag += token;
+    }
+    etag += '"';
+    return etag;
+}
+
+bool write_fully(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, bytes, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+}
+
+AssetBundle::AssetBundle(const char* base, size_t length)
+    : base(base), length(length), slots(nullptr), slot_mask(0), records(nullptr), asset_count(0) {}
+
+AssetBundle::~AssetBundle() {
+    munmap(const_cast<char*>(base), length);
+}
+
+std::shared_ptr<const AssetBundle> AssetBundle::open(const std::string& path, std::string& error) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = strerror(errno);
+        return nullptr;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode) ||
+        static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+        error = "not a bundle file";
+        close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(file_stat.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error = strerror(errno);
+        return nullptr;
+    }
+    // Unmapped by the destructor from here on
+    std::shared_ptr<AssetBundle> bundle(new AssetBundle(static_cast<const char*>(mapping), size));
+    if (const char* reason = check(bundle->base, size)) {
+        error = reason;
+        return nullptr;
+    }
+    // Read ahead now rather than on the first request for each file
+    madvise(mapping, size, MADV_WILLNEED);
+
+    const Header& header = *reinterpret_cast<const Header*>(bundle->base);
+    bundle->slots = reinterpret_cast<const uint32_t*>(bundle->base + sizeof(Header));
+    bundle->slot_mask = header.slot_count - 1;
+    bundle->records = bundle->slots + header.slot_count;
+    bundle->asset_count = header.asset_count;
+    return bundle;
+}
+
+bool AssetBundle::find(std::string_view path, Asset& asset) const {
+    const Record* table = static_cast<const Record*>(records);
+    uint64_t h = hash(path);
+    for (size_t i = h & slot_mask;; i = (i + 1) & slot_mask) {
+        uint32_t slot = slots[i];
+        if (slot == 0) {
+            return false;
+        }
+        const Record& record = table[slot - 1];
+        if (record.hash == h && view(base, record.path) == path) {
+            read(slot - 1, asset);
+            return true;
+        }
+    }
+}
+
+void AssetBundle::read(size_t index, Asset& asset) const {
+    const Record& record = static_cast<const Record*>(records)[index];
+    asset.path = view(base, record.path);
+    asset.mtime = static_cast<time_t>(record.mtime);
+    asset.compressible = record.flags & COMPRESSIBLE;
+    for (size_t i = 0; i < FORMS; i++) {
+        Representation& form = i == 0 ? asset.identity : asset.encoded[i - 1];
+        form.body = view(base, record.forms[i].body);
+        form.header = view(base, record.forms[i].header);
+        form.etag = view(base, record.forms[i].etag);
+    }
+}
+
+void BundleWriter::add(std::string_view path, std::string body, time_t mtime, const MimeType& mime,
+                       std::string_view filename, std::string (&encoded)[ENCODING_COUNT]) {
+    Entry entry;
+    entry.path = std::string(path);
+    entry.mtime = mtime;
+    entry.compressible = mime.compressible;
+
+    // The same header blocks the file cache builds for a loaded file
+    Form& identity = entry.forms[0];
+    identity.etag = content_etag(body, {});
+    append_entity_headers(identity.header, mime.content_type, body.size(), filename);
+    if (mime.compressible) {
+        identity.header += "Vary: Accept-Encoding\r\n";
+    }
+    append_validators(identity.header, identity.etag, mtime);
+    identity.header += "Accept-Ranges: bytes\r\n";
+    identity.body = std::move(body);
+
+    for (size_t i = 0; i < ENCODING_COUNT; i++) {
+        if (encoded[i].empty()) {
+            continue;
+        }
+        std::string_view token = encoding_token(static_cast<Encoding>(i));
+        Form& form = entry.forms[1 + i];
+        form.etag = content_etag(encoded[i], token);
+        append_entity_headers(form.header, mime.content_type, encoded[i].size(), filename);
+        form.header += "Content-Encoding: ";
+        form.header += token;
+        form.header += "\r\nVary: Accept-Encoding\r\n";
+        append_validators(form.header, form.etag, mtime);
+        form.body = std::move(encoded[i]);
+    }
+    assets.push_back(std::move(entry));
+}
+
+bool BundleWriter::write(const std::string& output, std::string& error) const {
+    Header header {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.forms = FORMS;
+    header.asset_count = assets.size();
+    header.slot_count = 2;
+    while (header.slot_count <= assets.size() * 2) {
+        header.slot_count <<= 1;
+    }
+
+    std::vector<uint32_t> slots(header.slot_count, 0);
+    std::vector<Record> records(assets.size());
+    size_t data_start = sizeof(Header) + slots.size() * sizeof(uint32_t) + records.size() * sizeof(Record);
+    std::string data;   // paths, header blocks and bodies
+    auto place = [&](std::string_view bytes) {
+        Span span {data_start + data.size(), bytes.size()};
+        data.append(bytes);
+        return span;
+    };
+
+    size_t mask = slots.size() - 1;
+    for (size_t index = 0; index < assets.size(); index++) {
+        const Entry& entry = assets[index];
+        Record& record = records[index];
+        record.hash = hash(entry.path);
+        record.path = place(entry.path);
+        record.mtime = static_cast<int64_t>(entry.mtime);
+        record.flags = entry.compressible ? COMPRESSIBLE : 0;
+        for (size_t i = 0; i < FORMS; i++) {
+            record.forms[i].etag = place(entry.forms[i].etag);
+            record.forms[i].header = place(entry.forms[i].header);
+            record.forms[i].body = place(entry.forms[i].body);
+        }
+        size_t slot = record.hash & mask;
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = static_cast<uint32_t>(index + 1);
+    }
+    header.length = data_start + data.size();
+
+    std::string temporary = output + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = temporary + ": " + strerror(errno);
+        return false;
+    }
+    bool written = write_fully(fd, &header, sizeof(header)) &&
+                   write_fully(fd, slots.data(), slots.size() * sizeof(uint32_t)) &&
+                   write_fully(fd, records.data(), records.size() * sizeof(Record)) &&
+                   write_fully(fd, data.data(), data.size()) && fsync(fd) == 0;
+    int saved_errno = errno;
+    close(fd);
+    if (!written || rename(temporary.c_str(), output.c_str()) < 0) {
+        error = output + ": " + strerror(written ? errno : saved_errno);
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
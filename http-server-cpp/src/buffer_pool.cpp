@@ -0,0 +1,80 @@
+#include "../include/buffer_pool.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+constexpr size_t THREAD_CACHE = 32;
+constexpr size_t BATCH = THREAD_CACHE / 2;    // moved to / from the global list at a time
+constexpr size_t GLOBAL_LIMIT = 1024;         // 16 MiB kept idle at most
+
+std::atomic<uint64_t> live_count{0};
+
+struct FreeList {
+    std::mutex mutex;
+    std::vector<char*> buffers;
+
+    FreeList() { buffers.reserve(GLOBAL_LIMIT); }
+};
+
+// Never destroyed: thread caches hand their buffers back while threads
+// exit, which may be after static destructors have run
+FreeList& free_list() {
+    static FreeList* list = new FreeList;
+    return *list;
+}
+
+// Moves buffers from a thread cache to the global list, freeing what does
+// not fit
+void spill(char** buffers, size_t count) {
+    FreeList& list = free_list();
+    std::lock_guard<std::mutex> lock(list.mutex);
+    for (size_t i = 0; i < count; i++) {
+        if (list.buffers.size() < GLOBAL_LIMIT) {
+            list.buffers.push_back(buffers[i]);
+        } else {
+            delete[] buffers[i];
+            live_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+struct ThreadCache {
+    char* buffers[THREAD_CACHE];
+    size_t count = 0;
+
+    ~ThreadCache() { spill(buffers, count); }
+};
+
+thread_local ThreadCache cache;
+
+}
+
+char* BufferPool::acquire() {
+    if (cache.count == 0) {
+        FreeList& list = free_list();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        while (cache.count < BATCH && !list.buffers.empty()) {
+            cache.buffers[cache.count++] = list.buffers.back();
+            list.buffers.pop_back();
+        }
+    }
+    if (cache.count > 0) {
+        return cache.buffers[--cache.count];
+    }
+    live_count.fetch_add(1, std::memory_order_relaxed);
+    return new char[BUFFER_SIZE];
+}
+
+void BufferPool::release(char* buffer) {
+    if (cache.count == THREAD_CACHE) {
+        cache.count -= BATCH;
+        spill(cache.buffers + cache.count, BATCH);
+    }
+    cache.buffers[cache.count++] = buffer;
+}
+
+uint64_t BufferPool::live() {
+    return live_count.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,171 @@
+#include "../include/compression.hpp"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace {
+
+// Variants are built once per cached file, so spend CPU on ratio, but stop
+// short of brotli 10-11, which is ~10x slower for a few percent and would
+// stall the event loop loading a large entry
+constexpr int GZIP_LEVEL = 9;
+constexpr int BROTLI_QUALITY = 9;
+
+inline char to_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+bool equals_ignore_case(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (to_lower(a[i]) != to_lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+// "q=0", "q=0.0", "q=0.000" refuse a coding; anything else accepts it
+bool zero_quality(std::string_view params) {
+    while (!params.empty()) {
+        size_t semicolon = params.find(';');
+        std::string_view param = trim(params.substr(0, semicolon));
+        params = semicolon == std::string_view::npos ? std::string_view() : params.substr(semicolon + 1);
+        if (param.size() < 2 || to_lower(param[0]) != 'q' || param[1] != '=') {
+            continue;
+        }
+        std::string_view q = param.substr(2);
+        if (q.empty() || q[0] != '0') {
+            return false;
+        }
+        for (size_t i = 1; i < q.size(); i++) {
+            if (q[i] != '.' && q[i] != '0') {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+}
+
+uint8_t accepted_encodings(std::string_view accept_encoding) {
+    uint8_t accepted = 0;
+    uint8_t mentioned = 0;
+    bool wildcard = false;
+
+    while (!accept_encoding.empty()) {
+        size_t comma = accept_encoding.find(',');
+        std::string_view item = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view() : accept_encoding.substr(comma + 1);
+
+        size_t semicolon = item.find(';');
+        std::string_view coding = trim(item.substr(0, semicolon));
+        bool refused = semicolon != std::string_view::npos && zero_quality(item.substr(semicolon + 1));
+
+        uint8_t bit = 0;
+        if (equals_ignore_case(coding, "br")) {
+            bit = 1u << static_cast<unsigned>(Encoding::BROTLI);
+        } else if (equals_ignore_case(coding, "gzip") || equals_ignore_case(coding, "x-gzip")) {
+            bit = 1u << static_cast<unsigned>(Encoding::GZIP);
+        } else if (coding == "*") {
+            wildcard = !refused;
+            continue;
+        } else {
+            continue;
+        }
+        mentioned |= bit;
+        if (!refused) {
+            accepted |= bit;
+        }
+    }
+
+    // "*" covers every coding not listed on its own
+    if (wildcard) {
+        accepted |= static_cast<uint8_t>(((1u << ENCODING_COUNT) - 1) & ~mentioned);
+    }
+    return accepted;
+}
+
+std::string_view encoding_token(Encoding encoding) {
+    return encoding == Encoding::BROTLI ? "br" : "gzip";
+}
+
+std::string_view encoding_suffix(Encoding encoding) {
+    return encoding == Encoding::BROTLI ? ".br" : ".gz";
+}
+
+bool can_compress(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::GZIP:
+#ifdef HAVE_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case Encoding::BROTLI:
+#ifdef HAVE_BROTLI
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+bool compress(Encoding encoding, std::string_view in, std::string& out) {
+#ifdef HAVE_ZLIB
+    if (encoding == Encoding::GZIP) {
+        z_stream stream{};
+        // windowBits 15 + 16: gzip wrapper rather than zlib
+        if (deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        out.resize(deflateBound(&stream, in.size()));
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        stream.avail_in = static_cast<uInt>(in.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        stream.avail_out = static_cast<uInt>(out.size());
+        int result = deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return result == Z_STREAM_END;
+    }
+#endif
+#ifdef HAVE_BROTLI
+    if (encoding == Encoding::BROTLI) {
+        size_t size = BrotliEncoderMaxCompressedSize(in.size());
+        out.resize(size > 0 ? size : in.size() + 64);
+        size = out.size();
+        if (!BrotliEncoderCompress(BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, in.size(),
+                                   reinterpret_cast<const uint8_t*>(in.data()), &size,
+                                   reinterpret_cast<uint8_t*>(&out[0]))) {
+            return false;
+        }
+        out.resize(size);
+        return true;
+    }
+#endif
+    (void)encoding;
+    (void)in;
+    (void)out;
+    return false;
+}
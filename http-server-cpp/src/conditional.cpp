@@ -0,0 +1,181 @@
+#include "../include/conditional.hpp"
+#include <strings.h>
+#include <time.h>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+// Splits off the next comma-separated list element
+std::string_view next_element(std::string_view& list) {
+    size_t comma = list.find(',');
+    std::string_view element = trim(list.substr(0, comma));
+    list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    return element;
+}
+
+bool parse_position(std::string_view digits, uint64_t& out) {
+    if (digits.empty()) {
+        return false;
+    }
+    auto result = std::from_chars(digits.data(), digits.data() + digits.size(), out);
+    return result.ec == std::errc() && result.ptr == digits.data() + digits.size();
+}
+
+}
+
+bool parse_http_date(std::string_view value, time_t& out) {
+    static const char* const FORMATS[] = {
+        "%a, %d %b %Y %H:%M:%S GMT",   // IMF-fixdate
+        "%A, %d-%b-%y %H:%M:%S GMT",   // RFC 850
+        "%a %b %e %H:%M:%S %Y",        // asctime
+    };
+    char buffer[64];
+    value = trim(value);
+    if (value.size() >= sizeof(buffer)) {
+        return false;
+    }
+    std::memcpy(buffer, value.data(), value.size());
+    buffer[value.size()] = '\0';
+
+    for (const char* format : FORMATS) {
+        struct tm tm {};
+        const char* end = strptime(buffer, format, &tm);
+        if (end && *end == '\0') {
+            out = timegm(&tm);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool etag_list_matches(std::string_view if_none_match, std::string_view etag) {
+    if (trim(if_none_match) == "*") {
+        return true;
+    }
+    if (etag.size() > 2 && etag[0] == 'W' && etag[1] == '/') {
+        etag.remove_prefix(2);
+    }
+    while (!if_none_match.empty()) {
+        std::string_view tag = next_element(if_none_match);
+        if (tag.size() > 2 && tag[0] == 'W' && tag[1] == '/') {
+            tag.remove_prefix(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool if_range_holds(std::string_view if_range, std::string_view etag, time_t modified) {
+    if_range = trim(if_range);
+    if (if_range.empty()) {
+        return true;
+    }
+    if (if_range[0] == '"' || if_range[0] == 'W') {
+        // Strong comparison: a weak tag never matches
+        return if_range[0] == '"' && if_range == etag;
+    }
+    time_t date;
+    return parse_http_date(if_range, date) && date == modified;
+}
+
+RangeResult parse_ranges(std::string_view range, uint64_t size, ByteRange (&ranges)[MAX_RANGES], size_t& count) {
+    count = 0;
+    range = trim(range);
+    if (range.size() < 6 || strncasecmp(range.data(), "bytes=", 6) != 0) {
+        return RangeResult::IGNORE;
+    }
+
+    std::string_view set = range.substr(6);
+    size_t specs = 0;
+    while (!set.empty()) {
+        std::string_view spec = next_element(set);
+        if (spec.empty()) {
+            continue;   // empty list elements are allowed
+        }
+        if (++specs > MAX_RANGES) {
+            return RangeResult::IGNORE;
+        }
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos) {
+            return RangeResult::IGNORE;
+        }
+        std::string_view first_text = trim(spec.substr(0, dash));
+        std::string_view last_text = trim(spec.substr(dash + 1));
+
+        uint64_t first;
+        uint64_t last;
+        if (first_text.empty()) {
+            // Suffix range: the final N bytes
+            uint64_t suffix;
+            if (!parse_position(last_text, suffix)) {
+                return RangeResult::IGNORE;
+            }
+            if (suffix == 0 || size == 0) {
+                continue;
+            }
+            first = suffix < size ? size - suffix : 0;
+            last = size - 1;
+        } else {
+            if (!parse_position(first_text, first)) {
+                return RangeResult::IGNORE;
+            }
+            if (last_text.empty()) {
+                last = UINT64_MAX;
+            } else if (!parse_position(last_text, last) || last < first) {
+                return RangeResult::IGNORE;
+            }
+            if (first >= size) {
+                continue;
+            }
+            last = std::min(last, size - 1);
+        }
+        ranges[count++] = ByteRange{first, last - first + 1};
+    }
+    if (specs == 0) {
+        return RangeResult::IGNORE;
+    }
+    if (count == 0) {
+        return RangeResult::UNSATISFIABLE;
+    }
+
+    bool overlapping = false;
+    for (size_t i = 0; i < count && !overlapping; i++) {
+        for (size_t j = i + 1; j < count; j++) {
+            if (ranges[i].first < ranges[j].first + ranges[j].length &&
+                ranges[j].first < ranges[i].first + ranges[i].length) {
+                overlapping = true;
+                break;
+            }
+        }
+    }
+    if (overlapping) {
+        std::sort(ranges, ranges + count,
+                  [](const ByteRange& a, const ByteRange& b) { return a.first < b.first; });
+        size_t merged = 0;
+        for (size_t i = 1; i < count; i++) {
+            ByteRange& current = ranges[merged];
+            uint64_t end = current.first + current.length;
+            if (ranges[i].first <= end) {
+                current.length = std::max(end, ranges[i].first + ranges[i].length) - current.first;
+            } else {
+                ranges[++merged] = ranges[i];
+            }
+        }
+        count = merged + 1;
+    }
+    return RangeResult::SATISFIABLE;
+}
@@ -0,0 +1,217 @@
+#include "../include/connection.hpp"
+#include "../include/h2_session.hpp"
+#include "../include/response.hpp"
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace {
+// Memory chunks gathered into one sendmsg(); well under IOV_MAX
+constexpr int MAX_IOV = 64;
+// Larger sent buffers are freed rather than kept for reuse
+constexpr size_t MAX_KEPT_CAPACITY = 64 * 1024;
+// A fresh buffer starts with room for a typical response head, rather
+// than growing into it a few bytes at a time
+constexpr size_t MIN_OUTPUT_CAPACITY = 1024;
+}
+
+void Connection::enter_phase(Phase next) {
+    if (next != phase) {
+        phase = next;
+        if (next != Phase::IDLE) {
+            phase_started_ms = TimerWheel::now_ms();
+        }
+    }
+}
+
+uint64_t Connection::deadline(const ConnectionTimeouts& timeouts, Phase& kind) const {
+    kind = has_pending_output() ? Phase::IDLE : phase;
+    switch (kind) {
+        case Phase::HEADER:
+            return timeouts.header_ms ? phase_started_ms + timeouts.header_ms : 0;
+        case Phase::BODY:
+            return timeouts.body_ms ? phase_started_ms + timeouts.body_ms : 0;
+        default:
+            return timeouts.idle_ms ? last_activity_ms + timeouts.idle_ms : 0;
+    }
+}
+
+Connection::Connection(int fd) : fd(fd) {}
+
+Connection::~Connection() {
+    for (auto& chunk : out) {
+        if (chunk.file_fd >= 0 && !chunk.file_shared) {
+            close(chunk.file_fd);
+        }
+    }
+}
+
+size_t Connection::pending_bytes() const {
+    size_t total = 0;
+    for (const OutputChunk& chunk : out) {
+        total += chunk.size() - chunk.sent + chunk.file_remaining;
+    }
+    return total;
+}
+
+std::string& Connection::output_buffer() {
+    // Coalesce into the last chunk unless it is borrowed, a file follows it
+    // or a send in flight points into it (appending could reallocate it)
+    if (out.size() <= pinned_chunks || out.back().file_fd >= 0 || out.back().borrowed) {
+        std::string& data = out.emplace_back().data;
+        if (data.capacity() < MIN_OUTPUT_CAPACITY) {
+            data.reserve(MIN_OUTPUT_CAPACITY);
+        }
+    }
+    return out.back().data;
+}
+
+void Connection::respond(int status_code, std::string_view content_type, std::string_view body) {
+    response_status = status_code;
+    std::string& data = output_buffer();
+    append_response_header(data, status_code, content_type, body.size());
+    data += body;
+}
+
+void Connection::queue(std::string_view data) {
+    output_buffer() += data;
+}
+
+void Connection::queue_shared(std::shared_ptr<const void> owner, const char* data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    out.emplace_back();
+    OutputChunk& chunk = out.back();
+    chunk.owner = std::move(owner);
+    chunk.borrowed = data;
+    chunk.borrowed_size = length;
+}
+
+void Connection::queue_file(int file_fd, off_t offset, size_t length) {
+    if (length == 0) {
+        close(file_fd);
+        return;
+    }
+    if (out.empty() || out.back().file_fd >= 0) {
+        out.emplace_back();
+    }
+    OutputChunk& chunk = out.back();
+    chunk.file_fd = file_fd;
+    chunk.file_offset = offset;
+    chunk.file_remaining = length;
+}
+
+void Connection::queue_shared_file(std::shared_ptr<const void> owner, int file_fd, off_t offset, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (out.empty() || out.back().file_fd >= 0 || out.back().owner) {
+        out.emplace_back();
+    }
+    OutputChunk& chunk = out.back();
+    chunk.owner = std::move(owner);
+    chunk.file_fd = file_fd;
+    chunk.file_offset = offset;
+    chunk.file_remaining = length;
+    chunk.file_shared = true;
+}
+
+int Connection::gather(struct iovec* iov, int max_iov, bool& more, OutputChunk** file) {
+    int iov_count = 0;
+    more = false;
+    if (file) {
+        *file = nullptr;
+    }
+    for (OutputChunk& chunk : out) {
+        if (iov_count == max_iov) {
+            more = true;
+            break;
+        }
+        if (chunk.sent < chunk.size()) {
+            iov[iov_count].iov_base = const_cast<char*>(chunk.bytes() + chunk.sent);
+            iov[iov_count].iov_len = chunk.size() - chunk.sent;
+            iov_count++;
+        }
+        if (chunk.file_remaining > 0) {
+            more = true;
+            if (file) {
+                *file = &chunk;
+            }
+            break;
+        }
+    }
+    return iov_count;
+}
+
+Connection::FlushResult Connection::flush() {
+    while (!out.empty()) {
+        // Gather every pending memory part up to the first file range, so a
+        // batch of pipelined responses goes out in one syscall
+        struct iovec iov[MAX_IOV];
+        bool more;
+        int iov_count = gather(iov, MAX_IOV, more);
+
+        if (iov_count > 0) {
+            // MSG_MORE keeps headers in the same segment as the file data that follows
+            struct msghdr msg {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iov_count;
+            ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return FlushResult::WOULD_BLOCK;
+                }
+                return FlushResult::FAILED;
+            }
+            consume_sent(static_cast<size_t>(n));
+            continue;
+        }
+
+        // Only the front chunk's file range is left
+        OutputChunk& chunk = out.front();
+        while (chunk.file_remaining > 0) {
+            ssize_t n = sendfile(fd, chunk.file_fd, &chunk.file_offset, chunk.file_remaining);
+            if (n > 0) {
+                chunk.file_remaining -= n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return FlushResult::WOULD_BLOCK;
+            }
+            // n == 0: file shrank underneath us, the response can't be completed
+            return FlushResult::FAILED;
+        }
+        consume_sent(0);
+    }
+
+    return FlushResult::DONE;
+}
+
+void Connection::consume_sent(size_t bytes) {
+    // Credit `bytes` to the memory parts in order, dropping finished chunks
+    while (!out.empty()) {
+        OutputChunk& chunk = out.front();
+        size_t pending = chunk.size() - chunk.sent;
+        size_t taken = bytes < pending ? bytes : pending;
+        chunk.sent += taken;
+        bytes -= taken;
+        if (chunk.sent < chunk.size() || chunk.file_remaining > 0) {
+            return;
+        }
+        if (chunk.file_fd >= 0 && !chunk.file_shared) {
+            close(chunk.file_fd);
+        }
+        if (chunk.data.capacity() > MAX_KEPT_CAPACITY) {
+            std::string().swap(chunk.data);
+        }
+        out.pop_front();
+    }
+}
@@ -0,0 +1,411 @@
+#include "../include/event_loop.hpp"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+namespace {
+constexpr int MAX_EVENTS = 256;
+// Hand input to the handler at least this often while draining a socket, so
+// size limits are enforced before a fast sender can balloon the buffer
+constexpr size_t PROCESS_THRESHOLD = 256 * 1024;
+// Bodies streamed to disk are handed over in smaller pieces, so the input
+// buffer stays within the size it keeps between requests
+constexpr size_t STREAM_THRESHOLD = 32 * 1024;
+// Timer wheel resolution; deadlines are whole seconds, so this is plenty
+constexpr uint64_t TIMER_TICK_MS = 100;
+constexpr int MAX_WAIT_MS = 1000;
+// After accept() ran out of memory (or of descriptors with no spare left)
+constexpr uint64_t ACCEPT_RETRY_MS = 100;
+}
+
+EventLoop::EventLoop(ConnectionHandler& handler, const ConnectionTimeouts& timeouts)
+    : handler(handler), timeouts(timeouts), epoll_fd(-1), wake_fd(-1), listen_fd(-1), reserve_fd(-1),
+      accept_retry_ms(0), cpu(-1), running(false),
+      draining(false), drain_started(false), timers(TIMER_TICK_MS, TimerWheel::now_ms()) {
+}
+
+EventLoop::~EventLoop() {
+    stop();
+}
+
+bool EventLoop::start(int listen_socket, int cpu_index) {
+    listen_fd = listen_socket;
+    cpu = cpu_index;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        return false;
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+        return false;
+    }
+
+    // data.ptr points at wake_fd/listen_fd for the loop's own descriptors,
+    // at a Connection otherwise
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &wake_fd;
+    bool ok = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == 0;
+
+    if (ok && listen_fd >= 0) {
+        reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = &listen_fd;
+        ok = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == 0;
+    }
+
+    if (!ok) {
+        close(wake_fd);
+        close(epoll_fd);
+        wake_fd = epoll_fd = -1;
+        return false;
+    }
+
+    running = true;
+    loop_thread = std::thread(&EventLoop::run_loop, this);
+
+    if (cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+        pthread_setaffinity_np(loop_thread.native_handle(), sizeof(cpuset), &cpuset);
+    }
+    return true;
+}
+
+void EventLoop::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+
+    if (loop_thread.joinable()) {
+        loop_thread.join();
+    }
+
+    // Loop thread has exited, safe to tear down its state
+    while (!connections.empty()) {
+        close_connection(*connections.begin()->second);
+    }
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        for (const PendingSocket& pending : pending_fds) {
+            close(pending.fd);
+        }
+        pending_fds.clear();
+    }
+
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    if (reserve_fd >= 0) {
+        close(reserve_fd);
+        reserve_fd = -1;
+    }
+    close(wake_fd);
+    close(epoll_fd);
+    wake_fd = epoll_fd = -1;
+}
+
+void EventLoop::add_connection(int client_socket, uint32_t peer_address) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending_fds.push_back({client_socket, peer_address});
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void EventLoop::drain() {
+    draining.store(true, std::memory_order_relaxed);
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void EventLoop::register_pending() {
+    uint64_t count;
+    while (read(wake_fd, &count, sizeof(count)) > 0) {
+    }
+
+    std::vector<PendingSocket> sockets;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        sockets.swap(pending_fds);
+    }
+
+    for (const PendingSocket& pending : sockets) {
+        register_connection(pending.fd, pending.peer_address);
+    }
+}
+
+void EventLoop::register_connection(int fd, uint32_t peer_address) {
+    auto conn = std::make_unique<Connection>(fd);
+    conn->peer_address = peer_address;
+    conn->timer.data = conn.get();
+    conn->last_activity_ms = TimerWheel::now_ms();
+    handler.on_connection_opened(*conn);
+
+    struct epoll_event ev {};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = conn.get();
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        handler.on_connection_closed(*conn);
+        return;
+    }
+    stats.active.fetch_add(1, std::memory_order_relaxed);
+    arm_timer(*conn);
+    connections.emplace(fd, std::move(conn));
+}
+
+void EventLoop::accept_pending() {
+    // Edge-triggered listener: accept until the backlog is empty
+    while (running) {
+        struct sockaddr_in address;
+        socklen_t length = sizeof(address);
+        int fd = accept4(listen_fd, (struct sockaddr*)&address, &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            int error = errno;
+            if (error == EINTR || error == ECONNABORTED) {
+                continue;
+            }
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                return;
+            }
+            // Out of descriptors: the backlog stays non-empty, so no edge
+            // would ever come again. The spare descriptor makes room to take
+            // the oldest client off the queue and close it, which it sees
+            // at once instead of hanging until it gives up
+            if ((error == EMFILE || error == ENFILE) && reserve_fd >= 0) {
+                close(reserve_fd);
+                int refused = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (refused >= 0) {
+                    close(refused);
+                }
+                reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                if (refused >= 0) {
+                    continue;
+                }
+            }
+            // Out of memory, or no spare: retry on a timer instead
+            accept_retry_ms = TimerWheel::now_ms() + ACCEPT_RETRY_MS;
+            return;
+        }
+        stats.accepted.fetch_add(1, std::memory_order_relaxed);
+        register_connection(fd, address.sin_family == AF_INET ? address.sin_addr.s_addr : 0);
+    }
+}
+
+void EventLoop::run_loop() {
+    struct epoll_event events[MAX_EVENTS];
+
+    while (running) {
+        int wait_ms = timers.next_timeout_ms(TimerWheel::now_ms());
+        if (wait_ms < 0 || wait_ms > MAX_WAIT_MS) {
+            wait_ms = MAX_WAIT_MS;
+        }
+        if (accept_retry_ms != 0) {
+            uint64_t now = TimerWheel::now_ms();
+            wait_ms = std::min<int>(wait_ms, accept_retry_ms > now ? static_cast<int>(accept_retry_ms - now) : 0);
+        }
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, wait_ms);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == &wake_fd) {
+                register_pending();
+                continue;
+            }
+            if (events[i].data.ptr == &listen_fd) {
+                accept_pending();
+                continue;
+            }
+            on_event(*static_cast<Connection*>(events[i].data.ptr), events[i].events);
+        }
+
+        timers.advance(TimerWheel::now_ms(), [this](TimerWheel::Timer& timer) {
+            on_timer(*static_cast<Connection*>(timer.data));
+        });
+
+        if (accept_retry_ms != 0 && TimerWheel::now_ms() >= accept_retry_ms) {
+            accept_retry_ms = 0;
+            if (listen_fd >= 0) {
+                accept_pending();
+            }
+        }
+
+        if (draining.load(std::memory_order_relaxed)) {
+            wind_down();
+        }
+    }
+}
+
+void EventLoop::wind_down() {
+    if (!drain_started) {
+        drain_started = true;
+        // The listener may live on in another process: leave its queue alone
+        if (listen_fd >= 0) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+            close(listen_fd);
+            listen_fd = -1;
+        }
+        std::vector<Connection*> idle;
+        for (auto& entry : connections) {
+            Connection& conn = *entry.second;
+            handler.on_drain(conn);
+            if (conn.close_after_write && !conn.has_pending_output()) {
+                idle.push_back(&conn);
+            }
+        }
+        for (Connection* conn : idle) {
+            close_connection(*conn);
+        }
+    }
+    if (connections.empty()) {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        if (pending_fds.empty()) {
+            drain_complete.store(true, std::memory_order_release);
+        }
+    }
+}
+
+void EventLoop::on_event(Connection& conn, uint32_t events) {
+    if (events & EPOLLERR) {
+        close_connection(conn);
+        return;
+    }
+    // An edge means bytes arrived or the peer drained some of our output
+    conn.last_activity_ms = TimerWheel::now_ms();
+
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+        bool peer_open = read_available(conn);
+        if (!conn.in.empty()) {
+            process(conn);
+        } else {
+            // Nothing arrived: don't hold on to the buffer the last read took
+            conn.in.trim();
+        }
+        if (!peer_open) {
+            // Answer what was already received, then close
+            conn.close_after_write = true;
+        }
+    }
+
+    Connection::FlushResult result = conn.flush();
+    if (result == Connection::FlushResult::FAILED) {
+        close_connection(conn);
+        return;
+    }
+
+    if (result == Connection::FlushResult::WOULD_BLOCK) {
+        // Resumed on the next EPOLLOUT edge
+        conn.state = Connection::State::WRITING;
+    } else if (conn.close_after_write) {
+        close_connection(conn);
+        return;
+    } else {
+        conn.state = Connection::State::READING;
+    }
+    arm_timer(conn);
+}
+
+bool EventLoop::read_available(Connection& conn) {
+    // Edge-triggered: drain the socket until EAGAIN
+    size_t unprocessed = 0;
+    while (true) {
+        char* space = conn.in.prepare(InputBuffer::MIN_READ);
+        ssize_t n = recv(conn.fd, space, conn.in.writable(), 0);
+        if (n > 0) {
+            conn.in.commit(n);
+            unprocessed += n;
+            if (unprocessed >= (conn.upload ? STREAM_THRESHOLD : PROCESS_THRESHOLD)) {
+                process(conn);
+                unprocessed = 0;
+                if (conn.close_after_write) {
+                    // Rejected (413/431...): stop reading, the response is all that's left
+                    return true;
+                }
+            }
+            continue;
+        }
+        if (n == 0) {
+            return false;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+void EventLoop::process(Connection& conn) {
+    if (conn.close_after_write) {
+        return;
+    }
+    int handled_before = conn.request_count;
+    handler.process_input(conn);
+    stats.requests.fetch_add(conn.request_count - handled_before, std::memory_order_relaxed);
+}
+
+void EventLoop::arm_timer(Connection& conn) {
+    Connection::Phase kind;
+    uint64_t deadline = conn.deadline(timeouts, kind);
+    if (deadline == 0) {
+        timers.cancel(conn.timer);
+        return;
+    }
+    // Only ever pull the timer in: activity pushes deadlines out on every
+    // event, and a timer that fires early just re-checks and re-arms
+    if (!conn.timer.armed() || deadline < conn.timer.deadline_ms) {
+        timers.schedule(conn.timer, deadline);
+    }
+}
+
+void EventLoop::on_timer(Connection& conn) {
+    Connection::Phase kind;
+    uint64_t deadline = conn.deadline(timeouts, kind);
+    if (deadline == 0) {
+        return;
+    }
+    if (deadline > TimerWheel::now_ms()) {
+        timers.schedule(conn.timer, deadline);
+        return;
+    }
+
+    handler.on_timeout(conn, kind);
+    // One non-blocking attempt to deliver the 408; the peer is not waited for
+    conn.flush();
+    close_connection(conn);
+}
+
+void EventLoop::close_connection(Connection& conn) {
+    timers.cancel(conn.timer);
+    int fd = conn.fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    handler.on_connection_closed(conn);
+    stats.active.fetch_sub(1, std::memory_order_relaxed);
+    connections.erase(fd);
+}
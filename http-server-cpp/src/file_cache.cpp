@@ -0,0 +1,157 @@
+#include "../include/file_cache.hpp"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+
+namespace {
+int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+FileCache::FileCache(size_t capacity_bytes, size_t max_entry_bytes)
+    : capacity_bytes(capacity_bytes), max_entry_bytes(max_entry_bytes) {
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+FileCache::Shard& FileCache::shard_for(std::string_view path) {
+    return *shards[std::hash<std::string_view>{}(path) % SHARD_COUNT];
+}
+
+size_t FileCache::entry_cost(const CachedFile& file) {
+    size_t cost = file.body.size() + file.header.size() + file.path.size();
+    for (const CachedVariant& variant : file.encoded) {
+        cost += variant.body.size() + variant.header.size();
+    }
+    return cost;
+}
+
+std::string FileCache::make_etag(const struct stat& file_stat) {
+    char buffer[MAX_ETAG];
+    return std::string(buffer, format_etag(file_stat, buffer));
+}
+
+size_t FileCache::format_etag(const struct stat& file_stat, char* out) {
+    unsigned long long mtime_ns = static_cast<unsigned long long>(file_stat.st_mtim.tv_sec) * 1000000000ULL +
+                                  static_cast<unsigned long long>(file_stat.st_mtim.tv_nsec);
+    // At most 3 * 16 digits, two dashes and the quotes
+    int length = snprintf(out, MAX_ETAG, "\"%llx-%llx-%llx\"",
+                          static_cast<unsigned long long>(file_stat.st_ino), mtime_ns,
+                          static_cast<unsigned long long>(file_stat.st_size));
+    return static_cast<size_t>(length);
+}
+
+bool FileCache::matches(const CachedFile& file, const struct stat& file_stat) {
+    return file_stat.st_ino == file.inode &&
+           file_stat.st_size == file.size &&
+           file_stat.st_mtim.tv_sec == file.mtime &&
+           file_stat.st_mtim.tv_nsec == file.mtime_nsec;
+}
+
+CachedFilePtr FileCache::lookup(std::string_view path) {
+    if (!enabled()) {
+        return nullptr;
+    }
+
+    Shard& shard = shard_for(path);
+    CachedFilePtr file;
+    bool revalidate = false;
+    int64_t now = now_ms();
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(path);
+        if (it == shard.index.end()) {
+            shard.misses.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        file = it->second->file;
+
+        // Only one request per interval pays for the stat()
+        if (now - it->second->checked_ms >= REVALIDATE_INTERVAL_MS) {
+            it->second->checked_ms = now;
+            revalidate = true;
+        }
+    }
+
+    if (revalidate) {
+        struct stat file_stat;
+        if (stat(file->path.c_str(), &file_stat) < 0 || !matches(*file, file_stat)) {
+            erase_if_same(shard, file);
+            shard.invalidations.fetch_add(1, std::memory_order_relaxed);
+            shard.misses.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+    }
+
+    shard.hits.fetch_add(1, std::memory_order_relaxed);
+    return file;
+}
+
+void FileCache::insert(CachedFilePtr entry) {
+    if (!fits(entry->body.size())) {
+        return;
+    }
+
+    Shard& shard = shard_for(entry->path);
+    size_t shard_budget = capacity_bytes / SHARD_COUNT;
+    size_t cost = entry_cost(*entry);
+    if (cost > shard_budget) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto existing = shard.index.find(entry->path);
+    if (existing != shard.index.end()) {
+        // Unindexed first: the key views the path of the entry being dropped
+        auto old = existing->second;
+        shard.index.erase(existing);
+        shard.bytes -= entry_cost(*old->file);
+        shard.lru.erase(old);
+    }
+
+    while (shard.bytes + cost > shard_budget && !shard.lru.empty()) {
+        const CachedFile& victim = *shard.lru.back().file;
+        shard.bytes -= entry_cost(victim);
+        shard.index.erase(victim.path);
+        shard.lru.pop_back();
+        shard.evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shard.lru.push_front(Entry{entry, now_ms()});
+    shard.index[entry->path] = shard.lru.begin();
+    shard.bytes += cost;
+}
+
+void FileCache::erase_if_same(Shard& shard, const CachedFilePtr& file) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(file->path);
+    // A concurrent request may already have reloaded the file
+    if (it != shard.index.end() && it->second->file == file) {
+        auto entry = it->second;
+        shard.index.erase(it);
+        shard.bytes -= entry_cost(*file);
+        shard.lru.erase(entry);
+    }
+}
+
+FileCache::Stats FileCache::get_stats() const {
+    Stats stats{};
+    for (const auto& shard : shards) {
+        stats.hits += shard->hits.load(std::memory_order_relaxed);
+        stats.misses += shard->misses.load(std::memory_order_relaxed);
+        stats.evictions += shard->evictions.load(std::memory_order_relaxed);
+        stats.invalidations += shard->invalidations.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        stats.entries += shard->index.size();
+        stats.bytes += shard->bytes;
+    }
+    return stats;
+}
@@ -0,0 +1,953 @@
+#include "../include/h2_session.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+constexpr size_t FRAME_HEADER_SIZE = 9;
+constexpr uint32_t MAX_FRAME_SIZE = 16384;    // ours, never raised
+constexpr uint32_t MAX_PEER_FRAME_SIZE = 16777215;
+constexpr int64_t MAX_WINDOW = 0x7fffffff;
+constexpr int64_t DEFAULT_WINDOW = 65535;
+// Receive windows we grant: roomy enough that an upload is not held to a
+// round trip per 64 KiB, topped up once half is used
+constexpr int64_t STREAM_WINDOW = 1 << 20;
+constexpr int64_t CONNECTION_WINDOW = 16 << 20;
+// Closed streams kept for reuse, and the largest body buffer one keeps
+constexpr size_t MAX_IDLE_STREAMS = 16;
+constexpr size_t MAX_KEPT_CAPACITY = 64 * 1024;
+
+enum FrameType : uint8_t {
+    DATA = 0x0,
+    HEADERS = 0x1,
+    PRIORITY = 0x2,
+    RST_STREAM = 0x3,
+    SETTINGS = 0x4,
+    PUSH_PROMISE = 0x5,
+    PING = 0x6,
+    GOAWAY = 0x7,
+    WINDOW_UPDATE = 0x8,
+    CONTINUATION = 0x9
+};
+
+enum FrameFlag : uint8_t {
+    END_STREAM = 0x1,
+    ACK = 0x1,
+    END_HEADERS = 0x4,
+    PADDED = 0x8,
+    PRIORITY_FLAG = 0x20
+};
+
+enum Setting : uint16_t {
+    HEADER_TABLE_SIZE = 0x1,
+    ENABLE_PUSH = 0x2,
+    MAX_CONCURRENT_STREAMS = 0x3,
+    INITIAL_WINDOW_SIZE = 0x4,
+    MAX_FRAME_SIZE_SETTING = 0x5,
+    MAX_HEADER_LIST_SIZE = 0x6
+};
+
+uint32_t read_u32(const char* p) {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3];
+}
+
+void append_u32(std::string& out, uint32_t value) {
+    char bytes[4] = {char(value >> 24), char(value >> 16), char(value >> 8), char(value)};
+    out.append(bytes, 4);
+}
+
+void append_frame_header(std::string& out, size_t length, uint8_t type, uint8_t flags, uint32_t stream) {
+    char header[5] = {char(length >> 16), char(length >> 8), char(length), char(type), char(flags)};
+    out.append(header, 5);
+    append_u32(out, stream);
+}
+
+void append_setting(std::string& out, uint16_t id, uint32_t value) {
+    char bytes[2] = {char(id >> 8), char(id)};
+    out.append(bytes, 2);
+    append_u32(out, value);
+}
+
+void append_window_update(std::string& out, uint32_t stream, int64_t increment) {
+    append_frame_header(out, 4, WINDOW_UPDATE, 0, stream);
+    append_u32(out, static_cast<uint32_t>(increment));
+}
+
+// HTTP2-Settings is the SETTINGS payload in base64url without padding
+bool decode_base64url(std::string_view in, std::string& out) {
+    uint32_t bits = 0;
+    int count = 0;
+    for (char c : in) {
+        int value;
+        if (c >= 'A' && c <= 'Z') {
+            value = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            value = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            value = c - '0' + 52;
+        } else if (c == '-') {
+            value = 62;
+        } else if (c == '_') {
+            value = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return false;
+        }
+        bits = (bits << 6) | value;
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            out += char(bits >> count);
+        }
+    }
+    return true;
+}
+
+bool is_token_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+}
+
+// Field names arrive lowercase in HTTP/2; anything else is malformed
+bool valid_name(std::string_view name) {
+    if (name.empty()) {
+        return false;
+    }
+    for (char c : name) {
+        if (c == '\0' || !is_token_char(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// CR, LF or NUL would let a value inject lines into the replayed request
+bool valid_value(std::string_view value) {
+    for (char c : value) {
+        if (c == '\r' || c == '\n' || c == '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hop-by-hop headers have no meaning in HTTP/2 (RFC 9113 8.2.2)
+bool is_connection_header(std::string_view name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+// Response headers that differ on nearly every response stay out of the
+// dynamic table, where they would only evict the ones that repeat
+bool worth_indexing(std::string_view name) {
+    return name != "date" && name != "content-length" && name != "content-range" && name != "etag" &&
+           name != "last-modified";
+}
+
+// Keeps a file open for DATA frames that each borrow a range of it
+struct SharedFile {
+    int fd;
+    explicit SharedFile(int fd) : fd(fd) {}
+    ~SharedFile() { close(fd); }
+};
+}
+
+H2Session::H2Session(ConnectionHandler& handler, const Limits& limits)
+    : handler(handler), limits(limits), replay(-1) {
+    replay.h2_stream = true;
+}
+
+H2Session::~H2Session() = default;
+
+void H2Session::start(Connection& conn) {
+    // Streams are charged to the connection's client
+    replay.peer_address = conn.peer_address;
+    std::string& out = conn.output_buffer();
+    append_frame_header(out, 18, SETTINGS, 0, 0);
+    append_setting(out, MAX_CONCURRENT_STREAMS, limits.max_streams);
+    append_setting(out, INITIAL_WINDOW_SIZE, STREAM_WINDOW);
+    append_setting(out, MAX_HEADER_LIST_SIZE, static_cast<uint32_t>(limits.max_header_bytes));
+    append_window_update(out, 0, CONNECTION_WINDOW - DEFAULT_WINDOW);
+    recv_window = CONNECTION_WINDOW;
+}
+
+bool H2Session::start_upgraded(Connection& conn, std::string_view request, std::string_view settings) {
+    std::string payload;
+    H2Error error;
+    if (!decode_base64url(settings, payload) || payload.size() % 6 != 0 || !apply_settings(payload, error)) {
+        return false;
+    }
+    conn.queue("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+    start(conn);
+
+    // The upgrade request is stream 1, already half-closed by the client
+    Stream& stream = open_stream(1);
+    stream.receiving = false;
+    last_stream = 1;
+    respond(conn, stream, request, {});
+    return true;
+}
+
+void H2Session::on_input(Connection& conn) {
+    const char* data = conn.in.data();
+    size_t size = conn.in.size();
+    size_t pos = 0;
+
+    if (!preface_seen) {
+        size_t n = std::min(size, PREFACE.size());
+        if (memcmp(data, PREFACE.data(), n) != 0) {
+            shutdown(conn, H2Error::PROTOCOL);
+            conn.in.consume(size);
+            return;
+        }
+        if (n < PREFACE.size()) {
+            conn.enter_phase(Connection::Phase::HEADER);
+            return;
+        }
+        preface_seen = true;
+        pos = PREFACE.size();
+    }
+
+    while (!conn.close_after_write && size - pos >= FRAME_HEADER_SIZE) {
+        const uint8_t* header = reinterpret_cast<const uint8_t*>(data + pos);
+        size_t length = (size_t(header[0]) << 16) | (size_t(header[1]) << 8) | header[2];
+        if (length > MAX_FRAME_SIZE) {
+            shutdown(conn, H2Error::FRAME_SIZE);
+            break;
+        }
+        if (size - pos < FRAME_HEADER_SIZE + length) {
+            break;
+        }
+        uint32_t id = read_u32(data + pos + 5) & 0x7fffffff;
+        std::string_view payload(data + pos + FRAME_HEADER_SIZE, length);
+        pos += FRAME_HEADER_SIZE + length;
+        if (!handle_frame(conn, header[3], header[4], id, payload)) {
+            break;
+        }
+    }
+
+    // After a connection error nothing more is read
+    bool partial = !conn.close_after_write && pos < size;
+    conn.in.consume(conn.close_after_write ? size : pos);
+    write_data(conn);
+    if (going_away && streams.empty()) {
+        conn.close_after_write = true;
+    }
+    update_phase(conn, partial);
+}
+
+void H2Session::shutdown(Connection& conn, H2Error error) {
+    std::string& out = conn.output_buffer();
+    append_frame_header(out, 8, GOAWAY, 0, 0);
+    append_u32(out, last_stream);
+    append_u32(out, static_cast<uint32_t>(error));
+    going_away = true;
+    conn.close_after_write = true;
+}
+
+void H2Session::drain(Connection& conn) {
+    if (going_away) {
+        return;
+    }
+    std::string& out = conn.output_buffer();
+    append_frame_header(out, 8, GOAWAY, 0, 0);
+    append_u32(out, last_stream);
+    append_u32(out, static_cast<uint32_t>(H2Error::NONE));
+    going_away = true;
+    if (streams.empty()) {
+        conn.close_after_write = true;
+    }
+}
+
+bool H2Session::handle_frame(Connection& conn, uint8_t type, uint8_t flags, uint32_t id, std::string_view payload) {
+    // A header block is contiguous: nothing may come between its frames
+    if (continuation_stream != 0 && (type != CONTINUATION || id != continuation_stream)) {
+        shutdown(conn, H2Error::PROTOCOL);
+        return false;
+    }
+
+    switch (type) {
+        case DATA:
+            return on_data(conn, flags, id, payload);
+
+        case HEADERS: {
+            if (id == 0) {
+                shutdown(conn, H2Error::PROTOCOL);
+                return false;
+            }
+            size_t padding = 0;
+            if (flags & PADDED) {
+                if (payload.empty()) {
+                    shutdown(conn, H2Error::FRAME_SIZE);
+                    return false;
+                }
+                padding = static_cast<uint8_t>(payload[0]);
+                payload.remove_prefix(1);
+            }
+            if (flags & PRIORITY_FLAG) {
+                if (payload.size() < 5) {
+                    shutdown(conn, H2Error::FRAME_SIZE);
+                    return false;
+                }
+                payload.remove_prefix(5);
+            }
+            if (padding > payload.size()) {
+                shutdown(conn, H2Error::PROTOCOL);
+                return false;
+            }
+            payload.remove_suffix(padding);
+            header_block.assign(payload);
+            if (!(flags & END_HEADERS)) {
+                continuation_stream = id;
+                continuation_end_stream = flags & END_STREAM;
+                return true;
+            }
+            return on_headers(conn, id, flags & END_STREAM);
+        }
+
+        case CONTINUATION:
+            if (id == 0 || id != continuation_stream) {
+                shutdown(conn, H2Error::PROTOCOL);
+                return false;
+            }
+            // Bounded, or a stream of CONTINUATION frames could grow it forever
+            if (header_block.size() + payload.size() > limits.max_header_bytes * 4) {
+                shutdown(conn, H2Error::ENHANCE_YOUR_CALM);
+                return false;
+            }
+            header_block.append(payload);
+            if (!(flags & END_HEADERS)) {
+                return true;
+            }
+            continuation_stream = 0;
+            return on_headers(conn, id, continuation_end_stream);
+
+        case PRIORITY:
+            // Scheduling is round-robin; priorities are ignored
+            if (id == 0) {
+                shutdown(conn, H2Error::PROTOCOL);
+                return false;
+            }
+            if (payload.size() != 5) {
+                reset_stream(conn, id, H2Error::FRAME_SIZE);
+            }
+            return true;
+
+        case RST_STREAM:
+            if (id == 0 || id > last_stream) {
+                shutdown(conn, H2Error::PROTOCOL);
+                return false;
+            }
+            if (payload.size() != 4) {
+                shutdown(conn, H2Error::FRAME_SIZE);
+                return false;
+            }
+            if (Stream* stream = find(id)) {
+                close_stream(*stream);
+            }
+            return true;
+
+        case SETTINGS:
+            return on_settings(conn, flags, id, payload);
+
+        case PING:
+            if (id != 0) {
+                shutdown(conn, H2Error::PROTOCOL);
+                return false;
+            }
+            if (payload.size() != 8) {
+                shutdown(conn, H2Error::FRAME_SIZE);
+                return false;
+            }
+            if (!(flags & ACK)) {
+                std::string& out = conn.output_buffer();
+                append_frame_header(out, 8, PING, ACK, 0);
+                out.append(payload);
+            }
+            return true;
+
+        case GOAWAY:
+            if (id != 0) {
+                shutdown(conn, H2Error::PROTOCOL);
+                return false;
+            }
+            // Streams already open are still answered
+            going_away = true;
+            return true;
+
+        case WINDOW_UPDATE:
+            return on_window_update(conn, id, payload);
+
+        case PUSH_PROMISE:
+            // Clients never push
+            shutdown(conn, H2Error::PROTOCOL);
+            return false;
+
+        default:
+            // Unknown frame types are ignored (RFC 9113 4.1)
+            return true;
+    }
+}
+
+bool H2Session::on_headers(Connection& conn, uint32_t id, bool end_stream) {
+    if (Stream* stream = find(id)) {
+        // Trailers: decoded to keep the table in sync, then dropped
+        HpackDecoder::Result result =
+            decoder.decode(header_block, limits.max_header_bytes, [](std::string_view, std::string_view) {});
+        if (result == HpackDecoder::Result::ERROR) {
+            shutdown(conn, H2Error::COMPRESSION);
+            return false;
+        }
+        if (!stream->receiving) {
+            reset_stream(conn, id, H2Error::STREAM_CLOSED);
+        } else if (!end_stream) {
+            reset_stream(conn, id, H2Error::PROTOCOL);
+        } else {
+            finish_request(conn, *stream);
+        }
+        return true;
+    }
+
+    // Client streams are odd and strictly increasing; lower ids are closed
+    if (id % 2 == 0 || id <= last_stream) {
+        shutdown(conn, id % 2 == 0 ? H2Error::PROTOCOL : H2Error::STREAM_CLOSED);
+        return false;
+    }
+    last_stream = id;
+
+    bool malformed;
+    HpackDecoder::Result result = decode_request(malformed);
+    if (result == HpackDecoder::Result::ERROR) {
+        shutdown(conn, H2Error::COMPRESSION);
+        return false;
+    }
+    if (going_away || streams.size() >= limits.max_streams) {
+        reset_stream(conn, id, H2Error::REFUSED_STREAM);
+        return true;
+    }
+    if (malformed) {
+        reset_stream(conn, id, H2Error::PROTOCOL);
+        return true;
+    }
+
+    if (result == HpackDecoder::Result::TOO_LARGE) {
+        // Answered right here; a body that follows is no longer wanted
+        block.clear();
+        encoder.encode(block, ":status", "431");
+        std::string& out = conn.output_buffer();
+        append_frame_header(out, block.size(), HEADERS, END_HEADERS | END_STREAM, id);
+        out += block;
+        if (!end_stream) {
+            reset_stream(conn, id, H2Error::NONE);
+        }
+        return true;
+    }
+
+    Stream& stream = open_stream(id);
+    stream.head.assign(request_head);
+    receiving_streams++;
+    if (end_stream) {
+        finish_request(conn, stream);
+    }
+    return true;
+}
+
+HpackDecoder::Result H2Session::decode_request(bool& malformed) {
+    static constexpr std::string_view PSEUDO_NAMES[4] = {":method", ":path", ":scheme", ":authority"};
+    bool seen[4] = {};
+    bool regular_seen = false;
+    bool host_seen = false;
+    malformed = false;
+    fields.clear();
+
+    HpackDecoder::Result result =
+        decoder.decode(header_block, limits.max_header_bytes, [&](std::string_view name, std::string_view value) {
+            if (malformed) {
+                return;
+            }
+            if (!valid_value(value)) {
+                malformed = true;
+                return;
+            }
+            if (!name.empty() && name[0] == ':') {
+                // Pseudo-headers come first, once each, and only these four
+                size_t i = 0;
+                while (i < 4 && name != PSEUDO_NAMES[i]) {
+                    i++;
+                }
+                if (regular_seen || i == 4 || seen[i]) {
+                    malformed = true;
+                    return;
+                }
+                seen[i] = true;
+                pseudo[i].assign(value);
+                return;
+            }
+            regular_seen = true;
+            if (!valid_name(name) || is_connection_header(name) || (name == "te" && value != "trailers")) {
+                malformed = true;
+                return;
+            }
+            // The body is complete by the time the handler sees it, so
+            // Expect is moot, and the real length is added at END_STREAM
+            if (name == "content-length" || name == "expect" || name == "te") {
+                return;
+            }
+            if (name == "host") {
+                host_seen = true;
+            }
+            fields.append(name).append(": ").append(value).append("\r\n");
+        });
+    if (result != HpackDecoder::Result::OK || malformed) {
+        return result;
+    }
+
+    const std::string& method = pseudo[0];
+    const std::string& path = pseudo[1];
+    const std::string& authority = pseudo[3];
+    if (!seen[0] || !seen[1] || !seen[2] || method.empty() || path.empty() || path.find(' ') != std::string::npos) {
+        malformed = true;
+        return result;
+    }
+    for (char c : method) {
+        if (!is_token_char(c) && !(c >= 'A' && c <= 'Z')) {
+            malformed = true;
+            return result;
+        }
+    }
+
+    request_head.clear();
+    request_head.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+    if (!host_seen && seen[3] && !authority.empty()) {
+        request_head.append("host: ").append(authority).append("\r\n");
+    }
+    request_head += fields;
+    return result;
+}
+
+bool H2Session::on_data(Connection& conn, uint8_t flags, uint32_t id, std::string_view payload) {
+    if (id == 0 || id > last_stream) {
+        shutdown(conn, H2Error::PROTOCOL);
+        return false;
+    }
+
+    // The whole frame counts against the windows, padding included
+    int64_t length = static_cast<int64_t>(payload.size());
+    recv_window -= length;
+    if (recv_window < 0) {
+        shutdown(conn, H2Error::FLOW_CONTROL);
+        return false;
+    }
+    if (recv_window <= CONNECTION_WINDOW / 2) {
+        append_window_update(conn.output_buffer(), 0, CONNECTION_WINDOW - recv_window);
+        recv_window = CONNECTION_WINDOW;
+    }
+
+    if (flags & PADDED) {
+        size_t padding = payload.empty() ? 0 : static_cast<uint8_t>(payload[0]);
+        if (payload.empty() || padding >= payload.size()) {
+            shutdown(conn, H2Error::PROTOCOL);
+            return false;
+        }
+        payload = payload.substr(1, payload.size() - 1 - padding);
+    }
+
+    Stream* stream = find(id);
+    if (!stream) {
+        // Reset or answered already; frames in flight are dropped
+        return true;
+    }
+    if (!stream->receiving) {
+        reset_stream(conn, id, H2Error::STREAM_CLOSED);
+        return true;
+    }
+    stream->recv_window -= length;
+    if (stream->recv_window < 0) {
+        reset_stream(conn, id, H2Error::FLOW_CONTROL);
+        return true;
+    }
+
+    if (!stream->too_large) {
+        if (stream->data.size() + payload.size() > limits.max_body_bytes) {
+            // Read and dropped; the handler answers 413
+            stream->too_large = true;
+            buffered_body -= stream->data.size();
+            std::string().swap(stream->data);
+        } else if (buffered_body + payload.size() > limits.max_body_bytes * 2) {
+            // Bodies still arriving on other streams already hold the session's share
+            reset_stream(conn, id, H2Error::REFUSED_STREAM);
+            return true;
+        } else {
+            stream->data.append(payload);
+            buffered_body += payload.size();
+        }
+    }
+
+    if (flags & END_STREAM) {
+        finish_request(conn, *stream);
+    } else if (stream->recv_window <= STREAM_WINDOW / 2) {
+        append_window_update(conn.output_buffer(), id, STREAM_WINDOW - stream->recv_window);
+        stream->recv_window = STREAM_WINDOW;
+    }
+    return true;
+}
+
+bool H2Session::on_settings(Connection& conn, uint8_t flags, uint32_t id, std::string_view payload) {
+    if (id != 0) {
+        shutdown(conn, H2Error::PROTOCOL);
+        return false;
+    }
+    if (flags & ACK) {
+        if (!payload.empty()) {
+            shutdown(conn, H2Error::FRAME_SIZE);
+            return false;
+        }
+        return true;
+    }
+    if (payload.size() % 6 != 0) {
+        shutdown(conn, H2Error::FRAME_SIZE);
+        return false;
+    }
+    H2Error error;
+    if (!apply_settings(payload, error)) {
+        shutdown(conn, error);
+        return false;
+    }
+    append_frame_header(conn.output_buffer(), 0, SETTINGS, ACK, 0);
+    return true;
+}
+
+bool H2Session::apply_settings(std::string_view payload, H2Error& error) {
+    for (size_t i = 0; i + 6 <= payload.size(); i += 6) {
+        uint16_t id = static_cast<uint16_t>((static_cast<uint8_t>(payload[i]) << 8) | static_cast<uint8_t>(payload[i + 1]));
+        uint32_t value = read_u32(payload.data() + i + 2);
+        switch (id) {
+            case HEADER_TABLE_SIZE:
+                encoder.set_max_table_size(value);
+                break;
+            case ENABLE_PUSH:
+                if (value > 1) {
+                    error = H2Error::PROTOCOL;
+                    return false;
+                }
+                break;
+            case INITIAL_WINDOW_SIZE: {
+                if (value > MAX_WINDOW) {
+                    error = H2Error::FLOW_CONTROL;
+                    return false;
+                }
+                // Applies to every open stream, and may make a window negative
+                int64_t delta = static_cast<int64_t>(value) - peer_initial_window;
+                for (auto& stream : streams) {
+                    stream->send_window += delta;
+                    if (stream->send_window > MAX_WINDOW) {
+                        error = H2Error::FLOW_CONTROL;
+                        return false;
+                    }
+                }
+                peer_initial_window = value;
+                break;
+            }
+            case MAX_FRAME_SIZE_SETTING:
+                if (value < MAX_FRAME_SIZE || value > MAX_PEER_FRAME_SIZE) {
+                    error = H2Error::PROTOCOL;
+                    return false;
+                }
+                peer_max_frame = value;
+                break;
+            default:
+                // MAX_CONCURRENT_STREAMS limits pushes only; the rest are advisory
+                break;
+        }
+    }
+    return true;
+}
+
+bool H2Session::on_window_update(Connection& conn, uint32_t id, std::string_view payload) {
+    if (payload.size() != 4) {
+        shutdown(conn, H2Error::FRAME_SIZE);
+        return false;
+    }
+    int64_t increment = read_u32(payload.data()) & 0x7fffffff;
+    if (id == 0) {
+        send_window += increment;
+        if (increment == 0 || send_window > MAX_WINDOW) {
+            shutdown(conn, increment == 0 ? H2Error::PROTOCOL : H2Error::FLOW_CONTROL);
+            return false;
+        }
+        return true;
+    }
+    if (id > last_stream) {
+        shutdown(conn, H2Error::PROTOCOL);
+        return false;
+    }
+    Stream* stream = find(id);
+    if (!stream) {
+        return true;
+    }
+    stream->send_window += increment;
+    if (increment == 0 || stream->send_window > MAX_WINDOW) {
+        reset_stream(conn, id, increment == 0 ? H2Error::PROTOCOL : H2Error::FLOW_CONTROL);
+    }
+    return true;
+}
+
+H2Session::Stream* H2Session::find(uint32_t id) {
+    for (auto& stream : streams) {
+        if (stream->id == id) {
+            return stream.get();
+        }
+    }
+    return nullptr;
+}
+
+H2Session::Stream& H2Session::open_stream(uint32_t id) {
+    if (idle_streams.empty()) {
+        streams.push_back(std::make_unique<Stream>());
+    } else {
+        streams.push_back(std::move(idle_streams.back()));
+        idle_streams.pop_back();
+    }
+    Stream& stream = *streams.back();
+    stream.id = id;
+    stream.receiving = true;
+    stream.too_large = false;
+    stream.recv_window = STREAM_WINDOW;
+    stream.send_window = peer_initial_window;
+    return stream;
+}
+
+void H2Session::finish_request(Connection& conn, Stream& stream) {
+    stream.receiving = false;
+    receiving_streams--;
+    buffered_body -= stream.data.size();
+
+    // The real length replaces whatever the client claimed; one over the
+    // limit makes the handler refuse an oversized body with 413
+    size_t length = stream.too_large ? limits.max_body_bytes + 1 : stream.data.size();
+    stream.head.append("content-length: ").append(std::to_string(length)).append("\r\n\r\n");
+    respond(conn, stream, stream.head, stream.data);
+}
+
+void H2Session::respond(Connection& conn, Stream& stream, std::string_view head, std::string_view body) {
+    // Run the request through the HTTP/1.1 handler on the private connection
+    replay.in.append(head.data(), head.size());
+    replay.in.append(body.data(), body.size());
+    handler.process_input(replay);
+    conn.request_count++;
+
+    // Whatever the handler left behind is dropped with it
+    replay.in.consume(replay.in.size());
+    replay.parser.reset();
+    replay.chunked.reset();
+    replay.upload.reset();
+    replay.arena.reset();
+    replay.continue_sent = false;
+    replay.close_after_write = false;
+    replay.request_count = std::min(replay.request_count, 1);
+    stream.data.clear();
+
+    // Response head, after any interim 1xx heads
+    std::string_view response_head;
+    size_t body_start = 0;
+    if (!replay.out.empty()) {
+        OutputChunk& first = replay.out.front();
+        std::string_view bytes(first.bytes(), first.size());
+        while (true) {
+            size_t end = bytes.find("\r\n\r\n", body_start);
+            if (end == std::string_view::npos || end - body_start < 12) {
+                response_head = {};
+                break;
+            }
+            response_head = bytes.substr(body_start, end - body_start);
+            body_start = end + 4;
+            if (response_head[9] != '1') {
+                break;
+            }
+        }
+    }
+    if (response_head.empty()) {
+        while (!replay.out.empty()) {
+            replay.out.pop_front();
+        }
+        reset_stream(conn, stream.id, H2Error::INTERNAL);
+        return;
+    }
+
+    block.clear();
+    encoder.encode(block, ":status", response_head.substr(9, 3));
+    size_t line_end = response_head.find("\r\n");
+    while (line_end != std::string_view::npos) {
+        size_t line_start = line_end + 2;
+        line_end = response_head.find("\r\n", line_start);
+        std::string_view line = response_head.substr(line_start, line_end == std::string_view::npos
+                                                                     ? std::string_view::npos
+                                                                     : line_end - line_start);
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        name.assign(line.substr(0, colon));
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (is_connection_header(name)) {
+            continue;
+        }
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ') {
+            value.remove_prefix(1);
+        }
+        encoder.encode(block, name, value, worth_indexing(name));
+    }
+
+    // The body as segments: bytes the handler wrote are kept with the
+    // stream, cache bytes and file ranges are sent from where they are
+    stream.response.clear();
+    stream.next_segment = 0;
+    bool first_chunk = true;
+    for (OutputChunk& chunk : replay.out) {
+        size_t start = first_chunk ? body_start : chunk.sent;
+        first_chunk = false;
+        if (start < chunk.size()) {
+            Segment& segment = stream.response.emplace_back();
+            segment.length = chunk.size() - start;
+            if (chunk.borrowed) {
+                segment.owner = chunk.owner;
+                segment.bytes = chunk.borrowed + start;
+            } else {
+                segment.offset = static_cast<off_t>(stream.data.size());
+                stream.data.append(chunk.data, start, segment.length);
+            }
+        }
+        if (chunk.file_fd >= 0 && chunk.file_remaining > 0) {
+            Segment& segment = stream.response.emplace_back();
+            segment.owner = chunk.file_shared ? chunk.owner : std::make_shared<SharedFile>(chunk.file_fd);
+            segment.file_fd = chunk.file_fd;
+            segment.offset = chunk.file_offset;
+            segment.length = chunk.file_remaining;
+        } else if (chunk.file_fd >= 0 && !chunk.file_shared) {
+            close(chunk.file_fd);
+        }
+        chunk.file_fd = -1;
+    }
+    while (!replay.out.empty()) {
+        replay.out.pop_front();
+    }
+
+    // HEADERS, then CONTINUATION for a block over the peer's frame size
+    bool end_stream = stream.response.empty();
+    std::string& out = conn.output_buffer();
+    size_t sent = 0;
+    do {
+        size_t length = std::min<size_t>(block.size() - sent, peer_max_frame);
+        uint8_t flags = sent + length == block.size() ? END_HEADERS : 0;
+        if (sent == 0) {
+            append_frame_header(out, length, HEADERS, flags | (end_stream ? END_STREAM : 0), stream.id);
+        } else {
+            append_frame_header(out, length, CONTINUATION, flags, stream.id);
+        }
+        out.append(block, sent, length);
+        sent += length;
+    } while (sent < block.size());
+
+    if (end_stream) {
+        close_stream(stream);
+    } else {
+        sending.push_back(&stream);
+    }
+}
+
+void H2Session::write_data(Connection& conn) {
+    // After an upgrade, DATA waits for the client preface: until then the
+    // client may still be buffering whatever follows the 101
+    if (!preface_seen) {
+        return;
+    }
+
+    // One frame per stream per round, until the windows or the data run out
+    bool progress = true;
+    while (progress && send_window > 0 && !sending.empty()) {
+        progress = false;
+        size_t i = 0;
+        while (i < sending.size() && send_window > 0) {
+            Stream& stream = *sending[i];
+            if (stream.send_window <= 0) {
+                i++;
+                continue;
+            }
+            Segment& segment = stream.response[stream.next_segment];
+            size_t length = std::min<size_t>({segment.length, static_cast<size_t>(stream.send_window),
+                                              static_cast<size_t>(send_window), peer_max_frame});
+            bool last = length == segment.length && stream.next_segment + 1 == stream.response.size();
+            std::string& out = conn.output_buffer();
+            append_frame_header(out, length, DATA, last ? END_STREAM : 0, stream.id);
+            if (segment.file_fd >= 0) {
+                conn.queue_shared_file(segment.owner, segment.file_fd, segment.offset, length);
+            } else if (segment.bytes) {
+                conn.queue_shared(segment.owner, segment.bytes + segment.offset, length);
+            } else {
+                out.append(stream.data, static_cast<size_t>(segment.offset), length);
+            }
+            segment.offset += static_cast<off_t>(length);
+            segment.length -= length;
+            stream.send_window -= static_cast<int64_t>(length);
+            send_window -= static_cast<int64_t>(length);
+            progress = true;
+
+            if (segment.length == 0 && ++stream.next_segment == stream.response.size()) {
+                close_stream(stream);    // takes it out of `sending`
+                continue;
+            }
+            i++;
+        }
+        // Streams the window cut off go first next time
+        if (send_window <= 0 && i < sending.size()) {
+            std::rotate(sending.begin(), sending.begin() + i, sending.end());
+        }
+    }
+}
+
+void H2Session::close_stream(Stream& stream) {
+    if (stream.receiving) {
+        receiving_streams--;
+        buffered_body -= stream.data.size();
+    }
+    auto waiting = std::find(sending.begin(), sending.end(), &stream);
+    if (waiting != sending.end()) {
+        sending.erase(waiting);
+    }
+
+    // Kept for reuse without its references, and without a buffer an upload grew
+    stream.response.clear();
+    stream.data.clear();
+    if (stream.data.capacity() > MAX_KEPT_CAPACITY) {
+        std::string().swap(stream.data);
+    }
+    auto open = std::find_if(streams.begin(), streams.end(),
+                             [&stream](const std::unique_ptr<Stream>& s) { return s.get() == &stream; });
+    if (idle_streams.size() < MAX_IDLE_STREAMS) {
+        idle_streams.push_back(std::move(*open));
+    }
+    streams.erase(open);
+}
+
+void H2Session::reset_stream(Connection& conn, uint32_t id, H2Error error) {
+    std::string& out = conn.output_buffer();
+    append_frame_header(out, 4, RST_STREAM, 0, id);
+    append_u32(out, static_cast<uint32_t>(error));
+    if (Stream* stream = find(id)) {
+        close_stream(*stream);
+    }
+}
+
+void H2Session::update_phase(Connection& conn, bool partial) {
+    if (partial || continuation_stream != 0 || !preface_seen) {
+        conn.enter_phase(Connection::Phase::HEADER);
+    } else if (receiving_streams > 0) {
+        conn.enter_phase(Connection::Phase::BODY);
+    } else {
+        conn.enter_phase(Connection::Phase::IDLE);
+    }
+}
@@ -0,0 +1,156 @@
+#include "../include/handoff.hpp"
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+extern char** environ;
+
+namespace {
+// Most descriptors one SCM_RIGHTS message carries (the kernel's SCM_MAX_FD)
+constexpr size_t MAX_SOCKETS = 253;
+}
+
+pid_t spawn_successor(const std::string& path, const std::vector<std::string>& args, int& channel) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0) {
+        return -1;
+    }
+
+    // Everything the child needs is built before fork(): between fork and
+    // exec only async-signal-safe calls are allowed
+    std::vector<char*> argv;
+    for (const std::string& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    std::string prefix = std::string(HANDOFF_ENV) + "=";
+    std::string handoff = prefix + std::to_string(pair[1]);
+    std::vector<char*> envp;
+    for (char** var = environ; *var; var++) {
+        if (strncmp(*var, prefix.c_str(), prefix.size()) != 0) {
+            envp.push_back(*var);
+        }
+    }
+    envp.push_back(const_cast<char*>(handoff.c_str()));
+    envp.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pair[0]);
+        close(pair[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // Nothing of ours but the channel may reach the successor: a client
+        // socket still open there would never see its FIN
+        int keep = pair[1];
+        close_range(3, static_cast<unsigned>(keep) - 1, CLOSE_RANGE_CLOEXEC);
+        close_range(static_cast<unsigned>(keep) + 1, ~0U, CLOSE_RANGE_CLOEXEC);
+        fcntl(keep, F_SETFD, 0);
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, nullptr);
+        execve(path.c_str(), argv.data(), envp.data());
+        _exit(127);
+    }
+
+    close(pair[1]);
+    channel = pair[0];
+    return pid;
+}
+
+int take_handoff_channel() {
+    const char* value = getenv(HANDOFF_ENV);
+    if (!value) {
+        return -1;
+    }
+    int channel = std::atoi(value);
+    unsetenv(HANDOFF_ENV);
+    if (channel < 3 || fcntl(channel, F_SETFD, FD_CLOEXEC) < 0) {
+        return -1;
+    }
+    return channel;
+}
+
+bool send_sockets(int channel, const std::vector<int>& sockets) {
+    if (sockets.empty() || sockets.size() > MAX_SOCKETS) {
+        return false;
+    }
+    // The count travels as data too, so a truncated message is detected
+    uint32_t count = static_cast<uint32_t>(sockets.size());
+    struct iovec iov = {&count, sizeof(count)};
+    size_t fd_bytes = sockets.size() * sizeof(int);
+    std::vector<char> control(CMSG_SPACE(fd_bytes));
+
+    struct msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fd_bytes);
+    memcpy(CMSG_DATA(cmsg), sockets.data(), fd_bytes);
+
+    ssize_t n;
+    do {
+        n = sendmsg(channel, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == static_cast<ssize_t>(sizeof(count));
+}
+
+bool receive_sockets(int channel, std::vector<int>& sockets, int timeout_ms) {
+    struct pollfd pfd = {channel, POLLIN, 0};
+    int ready;
+    do {
+        ready = poll(&pfd, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    if (ready <= 0) {
+        return false;
+    }
+
+    uint32_t count = 0;
+    struct iovec iov = {&count, sizeof(count)};
+    std::vector<char> control(CMSG_SPACE(MAX_SOCKETS * sizeof(int)));
+    struct msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    ssize_t n;
+    do {
+        n = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n != static_cast<ssize_t>(sizeof(count))) {
+        return false;
+    }
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const unsigned char* data = CMSG_DATA(cmsg);
+            for (size_t i = 0; i < received; i++) {
+                int fd;
+                memcpy(&fd, data + i * sizeof(int), sizeof(int));
+                sockets.push_back(fd);
+            }
+        }
+    }
+    if (sockets.size() != count || (msg.msg_flags & MSG_CTRUNC)) {
+        for (int fd : sockets) {
+            close(fd);
+        }
+        sockets.clear();
+        return false;
+    }
+    return true;
+}
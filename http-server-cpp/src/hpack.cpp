@@ -0,0 +1,398 @@
+#include "../include/hpack.hpp"
+
+namespace {
+
+struct StaticEntry {
+    std::string_view name;
+    std::string_view value;
+};
+
+// RFC 7541 Appendix A
+constexpr StaticEntry STATIC_TABLE[HpackTable::STATIC_ENTRIES] = {
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"}, {":path", "/index.html"},
+    {":scheme", "http"}, {":scheme", "https"}, {":status", "200"}, {":status", "204"}, {":status", "206"},
+    {":status", "304"}, {":status", "400"}, {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""},
+    {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""}, {"authorization", ""},
+    {"cache-control", ""}, {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""},
+    {"content-length", ""}, {"content-location", ""}, {"content-range", ""}, {"content-type", ""},
+    {"cookie", ""}, {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""},
+    {"if-match", ""}, {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+    {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""}, {"location", ""}, {"max-forwards", ""},
+    {"proxy-authenticate", ""}, {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""},
+    {"retry-after", ""}, {"server", ""}, {"set-cookie", ""}, {"strict-transport-security", ""},
+    {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""}, {"www-authenticate", ""},
+};
+
+// RFC 7541 Appendix B, symbols 0-255 (EOS is 30 ones)
+constexpr uint32_t HUFFMAN_CODES[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+
+constexpr uint8_t HUFFMAN_LENGTHS[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+constexpr int EOS = 256;
+
+// Binary decoding tree over the code above, built once. Leaves hold
+// symbol + 1 as a negative number
+struct HuffmanTree {
+    int16_t children[512][2];
+    int nodes = 1;
+
+    HuffmanTree() {
+        for (auto& node : children) {
+            node[0] = node[1] = 0;
+        }
+        for (int symbol = 0; symbol <= EOS; symbol++) {
+            uint32_t code = symbol == EOS ? 0x3fffffff : HUFFMAN_CODES[symbol];
+            int length = symbol == EOS ? 30 : HUFFMAN_LENGTHS[symbol];
+            int node = 0;
+            for (int bit = length - 1; bit > 0; bit--) {
+                int branch = (code >> bit) & 1;
+                if (children[node][branch] == 0) {
+                    children[node][branch] = static_cast<int16_t>(nodes++);
+                }
+                node = children[node][branch];
+            }
+            children[node][code & 1] = static_cast<int16_t>(-(symbol + 1));
+        }
+    }
+};
+
+const HuffmanTree& huffman_tree() {
+    static const HuffmanTree tree;
+    return tree;
+}
+
+size_t huffman_length(std::string_view text) {
+    uint64_t bits = 0;
+    for (unsigned char c : text) {
+        bits += HUFFMAN_LENGTHS[c];
+    }
+    return static_cast<size_t>((bits + 7) / 8);
+}
+
+void huffman_encode(std::string& out, std::string_view text) {
+    uint64_t buffer = 0;
+    int pending = 0;
+    for (unsigned char c : text) {
+        buffer = (buffer << HUFFMAN_LENGTHS[c]) | HUFFMAN_CODES[c];
+        pending += HUFFMAN_LENGTHS[c];
+        while (pending >= 8) {
+            pending -= 8;
+            out += static_cast<char>(buffer >> pending);
+        }
+    }
+    if (pending > 0) {
+        // Padded with the most significant bits of EOS (all ones)
+        out += static_cast<char>((buffer << (8 - pending)) | (0xff >> pending));
+    }
+}
+
+bool decode_integer(const uint8_t*& p, const uint8_t* end, int prefix_bits, uint64_t& value) {
+    if (p >= end) {
+        return false;
+    }
+    uint8_t max_prefix = static_cast<uint8_t>((1u << prefix_bits) - 1);
+    value = *p++ & max_prefix;
+    if (value < max_prefix) {
+        return true;
+    }
+    // Anything that needs more than 8 continuation bytes is an attack or garbage
+    for (int shift = 0; shift <= 56; shift += 7) {
+        if (p >= end) {
+            return false;
+        }
+        uint8_t byte = *p++;
+        value += static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+bool huffman_decode(std::string_view in, std::string& out) {
+    const HuffmanTree& tree = huffman_tree();
+    int node = 0;
+    int depth = 0;      // bits since the last complete symbol
+    bool all_ones = true;
+    for (unsigned char byte : in) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int branch = (byte >> bit) & 1;
+            all_ones = all_ones && branch;
+            depth++;
+            int next = tree.children[node][branch];
+            if (next < 0) {
+                if (-next - 1 == EOS) {
+                    return false;
+                }
+                out += static_cast<char>(-next - 1);
+                node = 0;
+                depth = 0;
+                all_ones = true;
+            } else if (next == 0) {
+                return false;
+            } else {
+                node = next;
+            }
+        }
+    }
+    // Only up to 7 bits of EOS prefix may be left over (RFC 7541 5.2)
+    return depth <= 7 && all_ones;
+}
+
+void hpack_encode_integer(std::string& out, uint8_t first, int prefix_bits, uint64_t value) {
+    uint8_t max_prefix = static_cast<uint8_t>((1u << prefix_bits) - 1);
+    if (value < max_prefix) {
+        out += static_cast<char>(first | value);
+        return;
+    }
+    out += static_cast<char>(first | max_prefix);
+    value -= max_prefix;
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void hpack_encode_string(std::string& out, std::string_view text) {
+    size_t coded = huffman_length(text);
+    if (coded < text.size()) {
+        hpack_encode_integer(out, 0x80, 7, coded);
+        huffman_encode(out, text);
+    } else {
+        hpack_encode_integer(out, 0, 7, text.size());
+        out += text;
+    }
+}
+
+bool HpackTable::get(size_t index, std::string_view& name, std::string_view& value) const {
+    if (index == 0) {
+        return false;
+    }
+    if (index <= STATIC_ENTRIES) {
+        name = STATIC_TABLE[index - 1].name;
+        value = STATIC_TABLE[index - 1].value;
+        return true;
+    }
+    index -= STATIC_ENTRIES + 1;
+    if (index >= entries.size()) {
+        return false;
+    }
+    name = entries[index].name;
+    value = entries[index].value;
+    return true;
+}
+
+void HpackTable::evict(size_t room) {
+    while (!entries.empty() && size + room > limit) {
+        size -= entries.back().name.size() + entries.back().value.size() + ENTRY_OVERHEAD;
+        entries.pop_back();
+    }
+}
+
+void HpackTable::add(std::string_view name, std::string_view value) {
+    size_t entry_size = name.size() + value.size() + ENTRY_OVERHEAD;
+    if (entry_size > limit) {
+        // Too big for the table: it just empties it (RFC 7541 4.4)
+        entries.clear();
+        size = 0;
+        return;
+    }
+    evict(entry_size);
+    entries.push_front(Entry{std::string(name), std::string(value)});
+    size += entry_size;
+}
+
+void HpackTable::set_max_size(size_t new_limit) {
+    limit = new_limit;
+    evict(0);
+}
+
+bool HpackDecoder::read_string(const uint8_t*& p, const uint8_t* end, std::string& buffer, std::string_view& out) {
+    if (p >= end) {
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint64_t length;
+    if (!decode_integer(p, end, 7, length) || length > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    std::string_view raw(reinterpret_cast<const char*>(p), static_cast<size_t>(length));
+    p += length;
+    if (!huffman) {
+        out = raw;
+        return true;
+    }
+    buffer.clear();
+    if (!huffman_decode(raw, buffer)) {
+        return false;
+    }
+    out = buffer;
+    return true;
+}
+
+HpackDecoder::Field HpackDecoder::next_field(const uint8_t*& p, const uint8_t* end, std::string_view& name,
+                                             std::string_view& value) {
+    uint8_t first = *p;
+    uint64_t index;
+
+    if (first & 0x80) {
+        // Indexed field
+        if (!decode_integer(p, end, 7, index) || !table.get(static_cast<size_t>(index), name, value)) {
+            return Field::ERROR;
+        }
+        header_seen = true;
+        return Field::HEADER;
+    }
+    if ((first & 0xe0) == 0x20) {
+        // Dynamic table size update, only at the start of a block
+        if (header_seen || !decode_integer(p, end, 5, index) || index > max_table_size) {
+            return Field::ERROR;
+        }
+        table.set_max_size(static_cast<size_t>(index));
+        return Field::TABLE_UPDATE;
+    }
+
+    // Literal: with incremental indexing (6-bit index), or without / never
+    // indexed (4-bit index)
+    bool indexing = (first & 0xc0) == 0x40;
+    if (!decode_integer(p, end, indexing ? 6 : 4, index)) {
+        return Field::ERROR;
+    }
+    if (index == 0) {
+        if (!read_string(p, end, name_buffer, name)) {
+            return Field::ERROR;
+        }
+    } else if (!table.get(static_cast<size_t>(index), name, value)) {
+        return Field::ERROR;
+    }
+    if (!read_string(p, end, value_buffer, value)) {
+        return Field::ERROR;
+    }
+    header_seen = true;
+
+    if (indexing) {
+        // The name may live in an entry the insertion evicts
+        if (name.data() != name_buffer.data()) {
+            name_buffer.assign(name.data(), name.size());
+        }
+        table.add(name_buffer, value);
+        if (table.count() > 0) {
+            name = table.dynamic_entry(0).name;
+            value = table.dynamic_entry(0).value;
+        } else {
+            name = name_buffer;
+        }
+    }
+    return Field::HEADER;
+}
+
+void HpackEncoder::set_max_table_size(size_t size) {
+    // Never more than the default, whatever the peer allows: the table is
+    // per connection
+    size_t chosen = size < 4096 ? size : 4096;
+    if (chosen != table.max_size()) {
+        table.set_max_size(chosen);
+        pending_update = chosen;
+    }
+}
+
+void HpackEncoder::encode(std::string& out, std::string_view name, std::string_view value, bool index) {
+    if (pending_update != SIZE_MAX) {
+        hpack_encode_integer(out, 0x20, 5, pending_update);
+        pending_update = SIZE_MAX;
+    }
+
+    size_t name_index = 0;
+    for (size_t i = 0; i < HpackTable::STATIC_ENTRIES; i++) {
+        if (STATIC_TABLE[i].name != name) {
+            continue;
+        }
+        if (STATIC_TABLE[i].value == value) {
+            hpack_encode_integer(out, 0x80, 7, i + 1);
+            return;
+        }
+        if (name_index == 0) {
+            name_index = i + 1;
+        }
+    }
+    for (size_t i = 0; i < table.count(); i++) {
+        const HpackTable::Entry& entry = table.dynamic_entry(i);
+        if (entry.name != name) {
+            continue;
+        }
+        if (entry.value == value) {
+            hpack_encode_integer(out, 0x80, 7, HpackTable::STATIC_ENTRIES + 1 + i);
+            return;
+        }
+        if (name_index == 0) {
+            name_index = HpackTable::STATIC_ENTRIES + 1 + i;
+        }
+    }
+
+    if (index) {
+        hpack_encode_integer(out, 0x40, 6, name_index);
+    } else {
+        hpack_encode_integer(out, 0x00, 4, name_index);
+    }
+    if (name_index == 0) {
+        hpack_encode_string(out, name);
+    }
+    hpack_encode_string(out, value);
+    if (index) {
+        table.add(name, value);
+    }
+}
@@ -0,0 +1,461 @@
+#include "../include/http_parser.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PARSER_X86 1
+#endif
+
+namespace {
+
+inline char to_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+bool equals_ignore_case(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (to_lower(a[i]) != to_lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && is_space(value.front())) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && is_space(value.back())) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+const char* find_byte_scalar(const char* p, const char* end, char byte) {
+    for (; p < end; p++) {
+        if (*p == byte) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+#ifdef PARSER_X86
+
+__attribute__((target("sse2")))
+const char* find_byte_sse2(const char* p, const char* end, char byte) {
+    const __m128i needle = _mm_set1_epi8(byte);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return find_byte_scalar(p, end, byte);
+}
+
+__attribute__((target("avx2")))
+const char* find_byte_avx2(const char* p, const char* end, char byte) {
+    const __m256i needle = _mm256_set1_epi8(byte);
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return find_byte_sse2(p, end, byte);
+}
+
+#endif
+
+// Picked once for the CPU we run on, like JsonValidator's scanners: the
+// default build targets baseline x86-64, so AVX2 is never assumed
+using FindByte = const char* (*)(const char*, const char*, char);
+
+FindByte detect_find_byte() {
+#ifdef PARSER_X86
+    // May run from a static initializer, before the CPU model is set up
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return find_byte_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return find_byte_sse2;
+    }
+#endif
+    return find_byte_scalar;
+}
+
+const FindByte find_byte_kernel = detect_find_byte();
+
+}
+
+HttpMethod intern_method(std::string_view method) {
+    // Method names are case-sensitive (RFC 9110 9.1); the length picks the
+    // only candidates, so each method costs at most two comparisons
+    switch (method.size()) {
+    case 3:
+        return method == "GET" ? HttpMethod::GET : method == "PUT" ? HttpMethod::PUT : HttpMethod::OTHER;
+    case 4:
+        return method == "POST" ? HttpMethod::POST : method == "HEAD" ? HttpMethod::HEAD : HttpMethod::OTHER;
+    case 5:
+        return method == "PATCH" ? HttpMethod::PATCH : HttpMethod::OTHER;
+    case 6:
+        return method == "DELETE" ? HttpMethod::DELETE : HttpMethod::OTHER;
+    case 7:
+        return method == "OPTIONS" ? HttpMethod::OPTIONS : HttpMethod::OTHER;
+    default:
+        return HttpMethod::OTHER;
+    }
+}
+
+std::string_view ParsedRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < header_count; i++) {
+        if (equals_ignore_case(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return {};
+}
+
+bool ParsedRequest::has_header(std::string_view name) const {
+    for (size_t i = 0; i < header_count; i++) {
+        if (equals_ignore_case(headers[i].name, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* HTTPParser::find_byte(const char* p, const char* end, char byte) {
+    return find_byte_kernel(p, end, byte);
+}
+
+const char* HTTPParser::find_line_end(const char* begin, const char* end) {
+    return find_byte(begin, end, '\n');
+}
+
+void HTTPParser::reset() {
+    stage = Stage::REQUEST_LINE;
+    pos = 0;
+    parse_error = Error::NONE;
+    method = path = version = Span{0, 0};
+    method_id = HttpMethod::OTHER;
+    header_count = 0;
+    content_length = 0;
+    has_content_length = false;
+    has_transfer_encoding = false;
+    chunked = false;
+}
+
+HTTPParser::Result HTTPParser::fail(Error error) {
+    parse_error = error;
+    return Result::ERROR;
+}
+
+HTTPParser::Result HTTPParser::parse(const char* data, size_t length, ParsedRequest& request) {
+    if (parse_error != Error::NONE) {
+        return Result::ERROR;
+    }
+    // Head already parsed (caller is waiting for the body): refresh the views
+    if (stage == Stage::COMPLETE) {
+        fill(data, request);
+        return Result::COMPLETE;
+    }
+
+    while (true) {
+        const char* newline = find_line_end(data + pos, data + length);
+        if (newline == nullptr) {
+            return Result::INCOMPLETE;
+        }
+
+        // Accept both CRLF and bare LF line endings
+        size_t line_end = newline - data;
+        size_t content_end = line_end;
+        if (content_end > pos && data[content_end - 1] == '\r') {
+            content_end--;
+        }
+        size_t line_begin = pos;
+        pos = line_end + 1;
+
+        if (stage == Stage::REQUEST_LINE) {
+            // Ignore empty lines before the request line (RFC 7230 3.5)
+            if (content_end == line_begin) {
+                continue;
+            }
+            if (!parse_request_line(data, line_begin, content_end)) {
+                return fail(Error::BAD_REQUEST);
+            }
+            stage = Stage::HEADERS;
+            continue;
+        }
+
+        if (content_end != line_begin) {
+            if (!parse_header_line(data, line_begin, content_end)) {
+                return Result::ERROR;
+            }
+            continue;
+        }
+
+        // Blank line: head complete. A body framed any other way than by a
+        // final chunked coding, or framed two ways at once, cannot be
+        // delimited the way every hop would; refuse it rather than guess
+        // (RFC 7230 3.3.3, request smuggling)
+        if (has_transfer_encoding && (!chunked || has_content_length)) {
+            return fail(Error::BAD_FRAMING);
+        }
+        stage = Stage::COMPLETE;
+        fill(data, request);
+        return Result::COMPLETE;
+    }
+}
+
+void HTTPParser::fill(const char* data, ParsedRequest& request) const {
+    request.method = std::string_view(data + method.offset, method.length);
+    request.method_id = method_id;
+    request.path = std::string_view(data + path.offset, path.length);
+    request.version = std::string_view(data + version.offset, version.length);
+    for (size_t i = 0; i < header_count; i++) {
+        request.headers[i].name = std::string_view(data + names[i].offset, names[i].length);
+        request.headers[i].value = std::string_view(data + values[i].offset, values[i].length);
+    }
+    request.header_count = header_count;
+    request.header_length = pos;
+    request.content_length = content_length;
+    request.has_content_length = has_content_length;
+    request.chunked = chunked;
+    request.body = {};
+}
+
+bool HTTPParser::parse_request_line(const char* data, size_t begin, size_t end) {
+    const char* line = data + begin;
+    const char* line_end = data + end;
+
+    const char* method_end = find_byte(line, line_end, ' ');
+    if (method_end == nullptr || method_end == line) {
+        return false;
+    }
+    const char* path_begin = method_end + 1;
+    const char* path_end = find_byte(path_begin, line_end, ' ');
+    if (path_end == nullptr || path_end == path_begin) {
+        return false;
+    }
+    const char* version_begin = path_end + 1;
+    std::string_view version_view(version_begin, line_end - version_begin);
+    if (version_view.size() != 8 || version_view.substr(0, 5) != "HTTP/") {
+        return false;
+    }
+
+    method = Span{static_cast<uint32_t>(begin), static_cast<uint32_t>(method_end - line)};
+    method_id = intern_method(std::string_view(line, method_end - line));
+    path = Span{static_cast<uint32_t>(path_begin - data), static_cast<uint32_t>(path_end - path_begin)};
+    version = Span{static_cast<uint32_t>(version_begin - data), static_cast<uint32_t>(version_view.size())};
+    return true;
+}
+
+bool HTTPParser::parse_header_line(const char* data, size_t begin, size_t end) {
+    if (header_count == ParsedRequest::MAX_HEADERS) {
+        parse_error = Error::TOO_MANY_HEADERS;
+        return false;
+    }
+
+    const char* line = data + begin;
+    const char* line_end = data + end;
+    const char* colon = find_byte(line, line_end, ':');
+
+    // No whitespace allowed between name and colon, and no obs-fold
+    if (colon == nullptr || colon == line || is_space(*(colon - 1)) || is_space(*line)) {
+        parse_error = Error::BAD_REQUEST;
+        return false;
+    }
+
+    const char* value_begin = colon + 1;
+    const char* value_end = line_end;
+    while (value_begin < value_end && is_space(*value_begin)) {
+        value_begin++;
+    }
+    while (value_end > value_begin && is_space(*(value_end - 1))) {
+        value_end--;
+    }
+
+    std::string_view name(line, colon - line);
+    std::string_view value(value_begin, value_end - value_begin);
+
+    if (equals_ignore_case(name, "content-length")) {
+        if (value.empty() || value.size() > 18) {
+            parse_error = Error::BAD_REQUEST;
+            return false;
+        }
+        size_t parsed = 0;
+        for (char c : value) {
+            if (c < '0' || c > '9') {
+                parse_error = Error::BAD_REQUEST;
+                return false;
+            }
+            parsed = parsed * 10 + static_cast<size_t>(c - '0');
+        }
+        // Conflicting duplicates are a request smuggling vector
+        if (has_content_length && parsed != content_length) {
+            parse_error = Error::BAD_REQUEST;
+            return false;
+        }
+        content_length = parsed;
+        has_content_length = true;
+    } else if (equals_ignore_case(name, "transfer-encoding")) {
+        // Codings of every Transfer-Encoding line, in order: chunked must
+        // come last, and only once
+        has_transfer_encoding = true;
+        size_t start = 0;
+        while (start <= value.size()) {
+            size_t comma = value.find(',', start);
+            std::string_view coding = trim(value.substr(start, comma == std::string_view::npos ? comma : comma - start));
+            start = comma == std::string_view::npos ? value.size() + 1 : comma + 1;
+            if (coding.empty()) {
+                continue;
+            }
+            if (chunked) {
+                parse_error = Error::BAD_FRAMING;
+                return false;
+            }
+            chunked = equals_ignore_case(coding, "chunked");
+        }
+    }
+
+    names[header_count] = Span{static_cast<uint32_t>(begin), static_cast<uint32_t>(name.size())};
+    values[header_count] = Span{static_cast<uint32_t>(value_begin - data), static_cast<uint32_t>(value.size())};
+    header_count++;
+    return true;
+}
+
+void ChunkedDecoder::reset() {
+    stage = Stage::SIZE_LINE;
+    started = false;
+    body_begin = read_pos = write_pos = 0;
+    chunk_remaining = 0;
+    released = 0;
+}
+
+void ChunkedDecoder::release() {
+    released += body_length();
+    body_begin = read_pos = write_pos = 0;
+}
+
+ChunkedDecoder::Result ChunkedDecoder::decode(char* data, size_t length, size_t body_offset, size_t max_body) {
+    if (!started) {
+        body_begin = read_pos = write_pos = body_offset;
+        started = true;
+    }
+
+    while (true) {
+        switch (stage) {
+        case Stage::SIZE_LINE: {
+            const char* newline = HTTPParser::find_line_end(data + read_pos, data + length);
+            if (newline == nullptr) {
+                return length - read_pos > MAX_LINE ? Result::ERROR : Result::INCOMPLETE;
+            }
+
+            // chunk-size [; chunk-ext] CRLF
+            const char* p = data + read_pos;
+            size_t size = 0;
+            int digits = 0;
+            for (; p < newline; p++, digits++) {
+                int value;
+                if (*p >= '0' && *p <= '9') {
+                    value = *p - '0';
+                } else if ((*p | 0x20) >= 'a' && (*p | 0x20) <= 'f') {
+                    value = (*p | 0x20) - 'a' + 10;
+                } else {
+                    break;
+                }
+                if (digits == 15) {
+                    return Result::ERROR;
+                }
+                size = size * 16 + static_cast<size_t>(value);
+            }
+            if (digits == 0 || (p < newline && *p != ';' && *p != ' ' && *p != '\t' && *p != '\r')) {
+                return Result::ERROR;
+            }
+
+            read_pos = newline - data + 1;
+            if (size == 0) {
+                stage = Stage::TRAILERS;
+            } else if (released + body_length() + size > max_body) {
+                return Result::TOO_LARGE;
+            } else {
+                chunk_remaining = size;
+                stage = Stage::DATA;
+            }
+            break;
+        }
+
+        case Stage::DATA: {
+            size_t available = length - read_pos;
+            if (available == 0) {
+                return Result::INCOMPLETE;
+            }
+            size_t take = available < chunk_remaining ? available : chunk_remaining;
+            if (write_pos != read_pos) {
+                std::memmove(data + write_pos, data + read_pos, take);
+            }
+            write_pos += take;
+            read_pos += take;
+            chunk_remaining -= take;
+            if (chunk_remaining == 0) {
+                stage = Stage::DATA_END;
+            }
+            break;
+        }
+
+        case Stage::DATA_END:
+            // CRLF (or bare LF) after the chunk payload
+            if (read_pos >= length) {
+                return Result::INCOMPLETE;
+            }
+            if (data[read_pos] == '\r') {
+                if (read_pos + 1 >= length) {
+                    return Result::INCOMPLETE;
+                }
+                if (data[read_pos + 1] != '\n') {
+                    return Result::ERROR;
+                }
+                read_pos += 2;
+            } else if (data[read_pos] == '\n') {
+                read_pos += 1;
+            } else {
+                return Result::ERROR;
+            }
+            stage = Stage::SIZE_LINE;
+            break;
+
+        case Stage::TRAILERS: {
+            // Trailer fields are skipped; a blank line ends the message
+            const char* newline = HTTPParser::find_line_end(data + read_pos, data + length);
+            if (newline == nullptr) {
+                return length - read_pos > MAX_LINE ? Result::ERROR : Result::INCOMPLETE;
+            }
+            size_t line_length = newline - (data + read_pos);
+            bool blank = line_length == 0 || (line_length == 1 && data[read_pos] == '\r');
+            read_pos = newline - data + 1;
+            if (blank) {
+                stage = Stage::COMPLETE;
+                return Result::COMPLETE;
+            }
+            break;
+        }
+
+        case Stage::COMPLETE:
+            return Result::COMPLETE;
+        }
+    }
+}
@@ -0,0 +1,203 @@
+#include "../include/io_uring.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+int sys_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sys_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+// DEFER_TASKRUN is the newest thing used (6.1); a kernel that accepts it
+// also has multishot recv, buffer rings and cancel-by-fixed-fd
+constexpr unsigned SETUP_FLAGS = IORING_SETUP_R_DISABLED | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER |
+                                 IORING_SETUP_DEFER_TASKRUN;
+
+constexpr unsigned REQUIRED_OPS[] = {
+    IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_SPLICE, IORING_OP_READ,
+    IORING_OP_FILES_UPDATE, IORING_OP_ASYNC_CANCEL, IORING_OP_CLOSE, IORING_OP_POLL_ADD,
+};
+
+}
+
+IoUring::~IoUring() {
+    destroy();
+}
+
+bool IoUring::supported() {
+    io_uring_params params{};
+    params.flags = SETUP_FLAGS;
+    int fd = sys_setup(4, &params);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = (params.features & IORING_FEAT_EXT_ARG) && (params.features & IORING_FEAT_NODROP);
+
+    constexpr unsigned PROBE_OPS = 64;
+    alignas(io_uring_probe) unsigned char buffer[sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op)] = {};
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer);
+    if (ok && sys_register(fd, IORING_REGISTER_PROBE, probe, PROBE_OPS) == 0) {
+        for (unsigned op : REQUIRED_OPS) {
+            ok = ok && op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+        }
+    } else {
+        ok = false;
+    }
+    close(fd);
+    return ok;
+}
+
+bool IoUring::init(unsigned entries, unsigned cq_entries) {
+    io_uring_params params{};
+    params.flags = SETUP_FLAGS | IORING_SETUP_CQSIZE;
+    params.cq_entries = cq_entries;
+    ring_fd = sys_setup(entries, &params);
+    if (ring_fd < 0) {
+        return false;
+    }
+
+    sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_map_size = cq_map_size = sq_map_size > cq_map_size ? sq_map_size : cq_map_size;
+    }
+    sq_map = mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                  IORING_OFF_SQ_RING);
+    if (sq_map == MAP_FAILED) {
+        sq_map = nullptr;
+        destroy();
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_map = sq_map;
+    } else {
+        cq_map = mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                      IORING_OFF_CQ_RING);
+        if (cq_map == MAP_FAILED) {
+            cq_map = nullptr;
+            destroy();
+            return false;
+        }
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqe_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                         IORING_OFF_SQES);
+    if (sqe_map == MAP_FAILED) {
+        destroy();
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqe_map);
+
+    char* sq = static_cast<char*>(sq_map);
+    char* cq = static_cast<char*>(cq_map);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // SQE i always sits in slot i, so the index array never changes
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries; i++) {
+        array[i] = i;
+    }
+    local_tail = *sq_tail;
+    return true;
+}
+
+bool IoUring::enable() {
+    return sys_register(ring_fd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) == 0;
+}
+
+void IoUring::destroy() {
+    if (sqes) {
+        munmap(sqes, sqes_size);
+        sqes = nullptr;
+    }
+    if (cq_map && cq_map != sq_map) {
+        munmap(cq_map, cq_map_size);
+    }
+    if (sq_map) {
+        munmap(sq_map, sq_map_size);
+    }
+    sq_map = cq_map = nullptr;
+    if (ring_fd >= 0) {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+}
+
+int IoUring::enter(unsigned submit, unsigned wait, unsigned flags, void* arg, size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, submit, wait, flags, arg, arg_size));
+}
+
+bool IoUring::submit_pending() {
+    __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+    while (to_submit > 0) {
+        int n = enter(to_submit, 0, 0, nullptr, 0);
+        if (n < 0) {
+            return false;
+        }
+        to_submit -= static_cast<unsigned>(n);
+    }
+    return true;
+}
+
+io_uring_sqe* IoUring::get_sqe() {
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (local_tail - head >= sq_entries) {
+        submit_pending();
+        head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (local_tail - head >= sq_entries) {
+            return nullptr;
+        }
+    }
+    io_uring_sqe* sqe = &sqes[local_tail & sq_mask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    local_tail++;
+    to_submit++;
+    return sqe;
+}
+
+bool IoUring::submit_and_wait(int timeout_ms) {
+    __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    int n = enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (n < 0) {
+        return errno == EINTR || errno == ETIME || errno == EAGAIN || errno == EBUSY;
+    }
+    to_submit -= static_cast<unsigned>(n) < to_submit ? static_cast<unsigned>(n) : to_submit;
+    return true;
+}
+
+bool IoUring::register_sparse_files(unsigned count) {
+    io_uring_rsrc_register reg{};
+    reg.nr = count;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    return sys_register(ring_fd, IORING_REGISTER_FILES2, &reg, sizeof(reg)) == 0;
+}
+
+bool IoUring::register_buffer_ring(io_uring_buf_ring* ring, unsigned entries, uint16_t group) {
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    return sys_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0;
+}
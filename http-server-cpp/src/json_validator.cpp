@@ -0,0 +1,543 @@
+#include "../include/json_validator.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_X86 1
+#endif
+
+namespace {
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline bool is_hex(char c) {
+    return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+// Both scanners return the first byte in [p, end) that the state machine has
+// to look at, or end. Inside a string that is '"', '\\', a control character
+// or a non-ASCII byte; between tokens it is anything but whitespace.
+
+const char* string_run_scalar(const char* p, const char* end) {
+    for (; p < end; p++) {
+        unsigned char byte = static_cast<unsigned char>(*p);
+        if (byte == '"' || byte == '\\' || byte < 0x20 || byte >= 0x80) {
+            break;
+        }
+    }
+    return p;
+}
+
+const char* space_run_scalar(const char* p, const char* end) {
+    while (p < end && is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+#ifdef JSON_X86
+
+// A signed compare against 0x20 catches control characters and, since bytes
+// >= 0x80 are negative, everything non-ASCII in the same instruction
+
+__attribute__((target("sse2")))
+const char* string_run_sse2(const char* p, const char* end) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(0x20);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                       _mm_cmplt_epi8(chunk, space));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return string_run_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+const char* space_run_sse2(const char* p, const char* end) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriage = _mm_set1_epi8('\r');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, carriage)));
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(blank)) & 0xFFFF;
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return space_run_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* string_run_avx2(const char* p, const char* end) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i space = _mm256_set1_epi8(0x20);
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i special = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+            _mm256_cmpgt_epi8(space, chunk));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(special));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return string_run_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* space_run_avx2(const char* p, const char* end) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i carriage = _mm256_set1_epi8('\r');
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i blank = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline), _mm256_cmpeq_epi8(chunk, carriage)));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(blank));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return space_run_sse2(p, end);
+}
+
+#endif
+
+struct Scanners {
+    JsonValidator::Kernel kernel;
+    const char* (*string_run)(const char*, const char*);
+    const char* (*space_run)(const char*, const char*);
+};
+
+bool cpu_has(JsonValidator::Kernel kernel) {
+#ifdef JSON_X86
+    // May run from a static initializer, before the CPU model is set up
+    __builtin_cpu_init();
+    switch (kernel) {
+        case JsonValidator::Kernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case JsonValidator::Kernel::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case JsonValidator::Kernel::SCALAR:
+            return true;
+    }
+    return false;
+#else
+    return kernel == JsonValidator::Kernel::SCALAR;
+#endif
+}
+
+Scanners scanners_for(JsonValidator::Kernel kernel) {
+    switch (kernel) {
+#ifdef JSON_X86
+        case JsonValidator::Kernel::AVX2:
+            return {kernel, string_run_avx2, space_run_avx2};
+        case JsonValidator::Kernel::SSE2:
+            return {kernel, string_run_sse2, space_run_sse2};
+#endif
+        default:
+            return {JsonValidator::Kernel::SCALAR, string_run_scalar, space_run_scalar};
+    }
+}
+
+Scanners detect_scanners() {
+    if (cpu_has(JsonValidator::Kernel::AVX2)) {
+        return scanners_for(JsonValidator::Kernel::AVX2);
+    }
+    if (cpu_has(JsonValidator::Kernel::SSE2)) {
+        return scanners_for(JsonValidator::Kernel::SSE2);
+    }
+    return scanners_for(JsonValidator::Kernel::SCALAR);
+}
+
+Scanners scan = detect_scanners();
+
+}
+
+JsonValidator::Kernel JsonValidator::kernel() {
+    return scan.kernel;
+}
+
+bool JsonValidator::use_kernel(Kernel kernel) {
+    if (!cpu_has(kernel)) {
+        return false;
+    }
+    scan = scanners_for(kernel);
+    return true;
+}
+
+const char* JsonValidator::kernel_name(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::AVX2:
+            return "avx2";
+        case Kernel::SSE2:
+            return "sse2";
+        case Kernel::SCALAR:
+            return "scalar";
+    }
+    return "unknown";
+}
+
+void JsonValidator::set_limits(size_t depth_limit, size_t byte_limit) {
+    max_depth = depth_limit < MAX_DEPTH ? depth_limit : MAX_DEPTH;
+    max_bytes = byte_limit;
+}
+
+void JsonValidator::reset() {
+    state = State::VALUE;
+    error_code = Error::NONE;
+    string_is_key = false;
+    hex_remaining = 0;
+    utf8_remaining = 0;
+    utf8_lower = utf8_upper = 0;
+    literal = nullptr;
+    literal_pos = 0;
+    depth = 0;
+    fed = 0;
+}
+
+bool JsonValidator::fail(Error error) {
+    state = State::ERROR;
+    error_code = error;
+    return false;
+}
+
+void JsonValidator::end_value() {
+    state = depth == 0 ? State::DONE : State::AFTER_VALUE;
+}
+
+bool JsonValidator::close_container(char c) {
+    if (depth == 0 || in_object() != (c == '}')) {
+        return false;
+    }
+    depth--;
+    end_value();
+    return true;
+}
+
+// Dispatches on the first byte of a value
+bool JsonValidator::begin_value(char c) {
+    switch (c) {
+        case '{':
+        case '[': {
+            if (depth == max_depth) {
+                return fail(Error::TOO_DEEP);
+            }
+            uint64_t bit = uint64_t(1) << (depth % 64);
+            if (c == '{') {
+                objects[depth / 64] |= bit;
+            } else {
+                objects[depth / 64] &= ~bit;
+            }
+            depth++;
+            state = c == '{' ? State::FIRST_KEY_OR_END : State::FIRST_VALUE_OR_END;
+            return true;
+        }
+        case '"':
+            string_is_key = false;
+            state = State::STRING;
+            return true;
+        case '-':
+            state = State::MINUS;
+            return true;
+        case '0':
+            state = State::ZERO;
+            return true;
+        case 't':
+            literal = "true";
+            break;
+        case 'f':
+            literal = "false";
+            break;
+        case 'n':
+            literal = "null";
+            break;
+        default:
+            if (c >= '1' && c <= '9') {
+                state = State::INTEGER;
+                return true;
+            }
+            return fail(Error::SYNTAX);
+    }
+    literal_pos = 1;
+    state = State::LITERAL;
+    return true;
+}
+
+// RFC 3629 well-formed sequences: the lead byte fixes the length and the
+// range of the first continuation byte (no overlongs, surrogates or > U+10FFFF)
+bool JsonValidator::start_utf8(unsigned char c) {
+    utf8_lower = 0x80;
+    utf8_upper = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        utf8_remaining = 1;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        utf8_remaining = 2;
+        if (c == 0xE0) {
+            utf8_lower = 0xA0;
+        } else if (c == 0xED) {
+            utf8_upper = 0x9F;
+        }
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        utf8_remaining = 3;
+        if (c == 0xF0) {
+            utf8_lower = 0x90;
+        } else if (c == 0xF4) {
+            utf8_upper = 0x8F;
+        }
+    } else {
+        return false;
+    }
+    state = State::UTF8;
+    return true;
+}
+
+bool JsonValidator::feed(const char* data, size_t length) {
+    if (state == State::ERROR) {
+        return false;
+    }
+    fed += length;
+    if (max_bytes != 0 && fed > max_bytes) {
+        return fail(Error::TOO_LARGE);
+    }
+
+    const char* p = data;
+    const char* end = data + length;
+
+    while (p < end) {
+        char c = *p;
+        if (state <= State::DONE && is_space(c)) {
+            // Single separators are common ("a": 1, b); only longer runs
+            // such as indentation are worth a vector scan
+            p++;
+            if (p < end && is_space(*p)) {
+                p = scan.space_run(p, end);
+            }
+            continue;
+        }
+
+        switch (state) {
+            case State::VALUE:
+                if (!begin_value(c)) {
+                    return false;
+                }
+                p++;
+                break;
+
+            case State::FIRST_KEY_OR_END:
+            case State::KEY:
+                if (c == '"') {
+                    string_is_key = true;
+                    state = State::STRING;
+                } else if (c == '}' && state == State::FIRST_KEY_OR_END) {
+                    close_container(c);
+                } else {
+                    return fail(Error::SYNTAX);
+                }
+                p++;
+                break;
+
+            case State::COLON:
+                if (c != ':') {
+                    return fail(Error::SYNTAX);
+                }
+                state = State::VALUE;
+                p++;
+                break;
+
+            case State::FIRST_VALUE_OR_END:
+                if (c == ']') {
+                    close_container(c);
+                } else if (!begin_value(c)) {
+                    return false;
+                }
+                p++;
+                break;
+
+            case State::AFTER_VALUE:
+                if (c == ',') {
+                    state = in_object() ? State::KEY : State::VALUE;
+                } else if ((c != '}' && c != ']') || !close_container(c)) {
+                    return fail(Error::SYNTAX);
+                }
+                p++;
+                break;
+
+            case State::DONE:
+                return fail(Error::SYNTAX);
+
+            case State::STRING:
+                // Hot path: plain ASCII string bytes need no state change
+                p = scan.string_run(p, end);
+                if (p == end) {
+                    break;
+                }
+                c = *p++;
+                if (c == '"') {
+                    if (string_is_key) {
+                        state = State::COLON;
+                    } else {
+                        end_value();
+                    }
+                } else if (c == '\\') {
+                    state = State::ESCAPE;
+                } else if (static_cast<unsigned char>(c) < 0x20 || !start_utf8(static_cast<unsigned char>(c))) {
+                    return fail(Error::SYNTAX);
+                }
+                break;
+
+            case State::ESCAPE:
+                if (c == 'u') {
+                    hex_remaining = 4;
+                    state = State::UNICODE;
+                } else if (c == '"' || c == '\\' || c == '/' || c == 'b' || c == 'f' || c == 'n' || c == 'r' ||
+                           c == 't') {
+                    state = State::STRING;
+                } else {
+                    return fail(Error::SYNTAX);
+                }
+                p++;
+                break;
+
+            case State::UNICODE:
+                if (!is_hex(c)) {
+                    return fail(Error::SYNTAX);
+                }
+                if (--hex_remaining == 0) {
+                    state = State::STRING;
+                }
+                p++;
+                break;
+
+            case State::UTF8: {
+                unsigned char byte = static_cast<unsigned char>(c);
+                if (byte < utf8_lower || byte > utf8_upper) {
+                    return fail(Error::SYNTAX);
+                }
+                utf8_lower = 0x80;
+                utf8_upper = 0xBF;
+                if (--utf8_remaining == 0) {
+                    state = State::STRING;
+                }
+                p++;
+                break;
+            }
+
+            case State::MINUS:
+                if (c == '0') {
+                    state = State::ZERO;
+                } else if (is_digit(c)) {
+                    state = State::INTEGER;
+                } else {
+                    return fail(Error::SYNTAX);
+                }
+                p++;
+                break;
+
+            case State::ZERO:
+            case State::INTEGER:
+            case State::FRACTION:
+            case State::EXPONENT_DIGITS:
+                if (state != State::ZERO) {
+                    while (p < end && is_digit(*p)) {
+                        p++;
+                    }
+                    if (p == end) {
+                        break;
+                    }
+                    c = *p;
+                }
+                if (c == '.' && (state == State::ZERO || state == State::INTEGER)) {
+                    state = State::DOT;
+                    p++;
+                } else if ((c == 'e' || c == 'E') && state != State::EXPONENT_DIGITS) {
+                    state = State::EXPONENT;
+                    p++;
+                } else {
+                    // The number ended; this byte belongs to whatever follows
+                    end_value();
+                }
+                break;
+
+            case State::DOT:
+                if (!is_digit(c)) {
+                    return fail(Error::SYNTAX);
+                }
+                state = State::FRACTION;
+                p++;
+                break;
+
+            case State::EXPONENT:
+                if (c == '+' || c == '-') {
+                    state = State::EXPONENT_SIGN;
+                } else if (is_digit(c)) {
+                    state = State::EXPONENT_DIGITS;
+                } else {
+                    return fail(Error::SYNTAX);
+                }
+                p++;
+                break;
+
+            case State::EXPONENT_SIGN:
+                if (!is_digit(c)) {
+                    return fail(Error::SYNTAX);
+                }
+                state = State::EXPONENT_DIGITS;
+                p++;
+                break;
+
+            case State::LITERAL:
+                if (c != literal[literal_pos]) {
+                    return fail(Error::SYNTAX);
+                }
+                p++;
+                if (literal[++literal_pos] == '\0') {
+                    end_value();
+                }
+                break;
+
+            case State::ERROR:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool JsonValidator::finish() {
+    switch (state) {
+        case State::ZERO:
+        case State::INTEGER:
+        case State::FRACTION:
+        case State::EXPONENT_DIGITS:
+            // A top-level number is only terminated by the end of input
+            end_value();
+            break;
+        case State::DONE:
+        case State::ERROR:
+            break;
+        default:
+            fail(Error::SYNTAX);
+            break;
+    }
+    return state == State::DONE;
+}
@@ -0,0 +1,280 @@
+#include "../include/logger.hpp"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+constexpr size_t TIME_LENGTH = 19;    // "YYYY-MM-DD HH:MM:SS"
+constexpr auto WRITER_INTERVAL = std::chrono::milliseconds(50);
+
+std::atomic<uint64_t> next_logger_id{1};
+
+// Only the ring's producer writes its counters, so a plain load + store is
+// enough, and no cache line is shared with other threads' log calls
+inline void bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void format_time(time_t seconds, char* out) {
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+    strftime(out, TIME_LENGTH + 1, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+}
+
+// Single-producer/single-consumer byte ring. head and tail are running
+// totals, so head - tail is the number of unread bytes.
+struct Logger::Ring {
+    char data[RING_BYTES];
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+    std::atomic<bool> orphaned{false};   // producer thread has exited
+    std::atomic<uint64_t> logged{0};     // written by the producer only
+    std::atomic<uint64_t> dropped{0};
+
+    // Producer-side timestamp, reformatted at most once per second
+    time_t cached_second = -1;
+    char cached_time[TIME_LENGTH + 1];
+
+    void put(size_t& pos, const char* bytes, size_t length) {
+        size_t offset = pos % RING_BYTES;
+        size_t first = length < RING_BYTES - offset ? length : RING_BYTES - offset;
+        std::memcpy(data + offset, bytes, first);
+        std::memcpy(data, bytes + first, length - first);
+        pos += length;
+    }
+};
+
+// Binds a thread to its ring in the current logger
+struct Logger::ThreadSlot {
+    uint64_t logger_id = 0;
+    std::shared_ptr<Ring> ring;
+
+    ~ThreadSlot() {
+        if (ring) {
+            ring->orphaned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+Logger::Logger()
+    : id(next_logger_id.fetch_add(1)), min_level(LogLevel::DEBUG), out_fd(STDOUT_FILENO), owns_fd(false),
+      retired{0, 0}, stopping(false), flush_requests(0), flushes_done(0), reported_drops(0) {
+    writer = std::thread(&Logger::writer_loop, this);
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        stopping = true;
+    }
+    writer_cv.notify_all();
+    writer.join();
+    if (owns_fd) {
+        close(out_fd);
+    }
+}
+
+bool Logger::open(const std::string& path) {
+    int fd = STDOUT_FILENO;
+    if (!path.empty()) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+    }
+
+    // Lines logged so far belong to the old destination
+    flush();
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    if (owns_fd) {
+        close(out_fd);
+    }
+    out_fd = fd;
+    owns_fd = !path.empty();
+    return true;
+}
+
+bool Logger::parse_level(const std::string& name, LogLevel& level) {
+    if (name == "debug") {
+        level = LogLevel::DEBUG;
+    } else if (name == "info") {
+        level = LogLevel::INFO;
+    } else if (name == "warn") {
+        level = LogLevel::WARN;
+    } else if (name == "error") {
+        level = LogLevel::ERROR;
+    } else if (name == "off") {
+        level = LogLevel::OFF;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+Logger::Ring& Logger::local_ring() {
+    static thread_local ThreadSlot slot;
+    if (slot.logger_id != id) {
+        if (slot.ring) {
+            slot.ring->orphaned.store(true, std::memory_order_release);
+        }
+        slot.ring = std::make_shared<Ring>();
+        slot.logger_id = id;
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.push_back(slot.ring);
+    }
+    return *slot.ring;
+}
+
+void Logger::log(LogLevel level, std::string_view tag, std::string_view message) {
+    if (!enabled(level)) {
+        return;
+    }
+
+    Ring& ring = local_ring();
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (now.tv_sec != ring.cached_second) {
+        format_time(now.tv_sec, ring.cached_time);
+        ring.cached_second = now.tv_sec;
+    }
+
+    // A single line may take at most a quarter of the ring
+    size_t overhead = 3 + TIME_LENGTH + (tag.empty() ? 0 : tag.size() + 3) + 1;
+    if (overhead + message.size() > RING_BYTES / 4) {
+        message = message.substr(0, RING_BYTES / 4 - overhead);
+    }
+    size_t length = overhead + message.size();
+
+    // The caller may be an event loop, so a full ring is never waited on.
+    // Other levels leave the last quarter (one longest line) to errors
+    size_t head = ring.head.load(std::memory_order_relaxed);
+    size_t used = head - ring.tail.load(std::memory_order_acquire);
+    size_t room = RING_BYTES - used;
+    if (room < length || (level != LogLevel::ERROR && room - length < RING_BYTES / 4)) {
+        bump(ring.dropped);
+        writer_cv.notify_one();
+        return;
+    }
+
+    size_t pos = head;
+    ring.put(pos, "[", 1);
+    ring.put(pos, ring.cached_time, TIME_LENGTH);
+    ring.put(pos, "] ", 2);
+    if (!tag.empty()) {
+        ring.put(pos, "[", 1);
+        ring.put(pos, tag.data(), tag.size());
+        ring.put(pos, "] ", 2);
+    }
+    ring.put(pos, message.data(), message.size());
+    ring.put(pos, "\n", 1);
+    ring.head.store(pos, std::memory_order_release);
+    bump(ring.logged);
+
+    // Wake the writer early instead of waiting out its interval
+    if (used < RING_BYTES / 2 && used + length >= RING_BYTES / 2) {
+        writer_cv.notify_one();
+    }
+}
+
+void Logger::flush() {
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    uint64_t ticket = ++flush_requests;
+    writer_cv.notify_all();
+    writer_cv.wait(lock, [&] { return flushes_done >= ticket || stopping; });
+}
+
+size_t Logger::drain(std::string& batch) {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    size_t drained = 0;
+
+    for (size_t i = 0; i < rings.size();) {
+        Ring& ring = *rings[i];
+        // Read orphaned first: if set, head below is final
+        bool orphaned = ring.orphaned.load(std::memory_order_acquire);
+        size_t head = ring.head.load(std::memory_order_acquire);
+        size_t tail = ring.tail.load(std::memory_order_relaxed);
+
+        if (head != tail) {
+            size_t offset = tail % RING_BYTES;
+            size_t length = head - tail;
+            size_t first = length < RING_BYTES - offset ? length : RING_BYTES - offset;
+            batch.append(ring.data + offset, first);
+            batch.append(ring.data, length - first);
+            ring.tail.store(head, std::memory_order_release);
+            drained += length;
+        }
+
+        if (orphaned) {
+            retired.logged += ring.logged.load(std::memory_order_relaxed);
+            retired.dropped += ring.dropped.load(std::memory_order_relaxed);
+            rings.erase(rings.begin() + i);
+        } else {
+            i++;
+        }
+    }
+    return drained;
+}
+
+Logger::Stats Logger::get_stats() const {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    Stats stats = retired;
+    for (const std::shared_ptr<Ring>& ring : rings) {
+        stats.logged += ring->logged.load(std::memory_order_relaxed);
+        stats.dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void Logger::write_out(const std::string& batch) {
+    size_t written = 0;
+    while (written < batch.size()) {
+        ssize_t n = write(out_fd, batch.data() + written, batch.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        written += n;
+    }
+}
+
+void Logger::writer_loop() {
+    std::string batch;
+    std::unique_lock<std::mutex> lock(writer_mutex);
+
+    while (true) {
+        writer_cv.wait_for(lock, WRITER_INTERVAL, [&] { return stopping || flush_requests != flushes_done; });
+        bool stop = stopping;
+        uint64_t requested = flush_requests;
+
+        batch.clear();
+        drain(batch);
+
+        uint64_t dropped = get_stats().dropped;
+        if (dropped != reported_drops) {
+            char now[TIME_LENGTH + 1];
+            format_time(time(nullptr), now);
+            batch += "[" + std::string(now) + "] Logger: dropped " +
+                     std::to_string(dropped - reported_drops) + " lines (ring full)\n";
+            reported_drops = dropped;
+        }
+
+        if (!batch.empty()) {
+            write_out(batch);
+        }
+
+        flushes_done = requested;
+        writer_cv.notify_all();
+        if (stop) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,355 @@
+#include "../include/metrics.hpp"
+#include "../include/alloc_stats.hpp"
+#include <time.h>
+#include <cstdio>
+
+namespace {
+
+// Status codes with their own series; anything else is reported as "other"
+constexpr int STATUS_CODES[] = {100, 200, 201, 204, 206, 304, 400, 403, 404, 405,
+                                408, 413, 415, 416, 429, 431, 500, 503};
+constexpr int STATUS_SLOTS = sizeof(STATUS_CODES) / sizeof(STATUS_CODES[0]) + 1;
+
+const char* const METHOD_NAMES[] = {"GET", "POST", "OTHER"};
+const char* const ROUTE_NAMES[] = {"static", "upload", "metrics", "api", "other"};
+const char* const TIMEOUT_NAMES[] = {"idle", "header", "body"};
+const char* const SHED_NAMES[] = {"queue_full", "queue_delay"};
+
+constexpr double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+std::atomic<uint64_t> next_metrics_id{1};
+
+int status_slot(int status) {
+    for (int i = 0; i < STATUS_SLOTS - 1; i++) {
+        if (STATUS_CODES[i] == status) {
+            return i;
+        }
+    }
+    return STATUS_SLOTS - 1;
+}
+
+// Only the owning thread writes, so a plain load + store is enough
+inline void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void append_double(std::string& out, double value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.9g", value);
+    out += buffer;
+}
+
+void append_sample(std::string& out, const char* name, const std::string& labels, uint64_t value) {
+    out += name;
+    if (!labels.empty()) {
+        out += "{" + labels + "}";
+    }
+    out += " " + std::to_string(value) + "\n";
+}
+
+void append_family(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += " ";
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += " ";
+    out += type;
+    out += "\n";
+}
+
+// Prometheus summary from merged histogram buckets
+void append_summary(std::string& out, const char* name, const std::string& labels,
+                    const uint64_t* buckets, uint64_t count, uint64_t sum_ns) {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    for (double q : QUANTILES) {
+        out += name;
+        out += "{" + prefix + "quantile=\"";
+        append_double(out, q);
+        out += "\"} ";
+        append_double(out, LatencyHistogram::quantile(buckets, count, q) / 1e9);
+        out += "\n";
+    }
+    out += name;
+    out += "_sum";
+    if (!labels.empty()) {
+        out += "{" + labels + "}";
+    }
+    out += " ";
+    append_double(out, sum_ns / 1e9);
+    out += "\n";
+    out += name;
+    out += "_count";
+    if (!labels.empty()) {
+        out += "{" + labels + "}";
+    }
+    out += " " + std::to_string(count) + "\n";
+}
+
+}
+
+int LatencyHistogram::bucket_of(uint64_t value_ns) {
+    if (value_ns < SUB_BUCKETS) {
+        return static_cast<int>(value_ns);
+    }
+    int exponent = 63 - __builtin_clzll(value_ns);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+    int sub = static_cast<int>(value_ns >> (exponent - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+    return SUB_BUCKETS + (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return static_cast<uint64_t>(bucket);
+    }
+    int exponent = (bucket - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+    uint64_t sub = static_cast<uint64_t>((bucket - SUB_BUCKETS) % SUB_BUCKETS);
+    int shift = exponent - SUB_BUCKET_BITS;
+    return ((SUB_BUCKETS + sub) << shift) + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value_ns) {
+    bump(counts[bucket_of(value_ns)]);
+    bump(total);
+    bump(sum, value_ns);
+}
+
+void LatencyHistogram::merge_into(uint64_t* buckets, uint64_t& count, uint64_t& sum_ns) const {
+    for (int i = 0; i < BUCKETS; i++) {
+        buckets[i] += counts[i].load(std::memory_order_relaxed);
+    }
+    count += total.load(std::memory_order_relaxed);
+    sum_ns += sum.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::quantile(const uint64_t* buckets, uint64_t count, double q) {
+    if (count == 0) {
+        return 0;
+    }
+    // Rank of the sample we want, 1-based; buckets and count are read at
+    // slightly different moments, so fall back to the last non-empty bucket
+    uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    int last = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+        last = i;
+        seen += buckets[i];
+        if (seen >= rank) {
+            return bucket_upper_bound(i);
+        }
+    }
+    return bucket_upper_bound(last);
+}
+
+struct alignas(64) Metrics::ThreadMetrics {
+    std::atomic<uint64_t> requests[METHODS][ROUTES][STATUS_SLOTS] = {};
+    std::atomic<uint64_t> bytes[METHODS][ROUTES][STATUS_SLOTS] = {};
+    std::atomic<uint64_t> reused_requests{0};
+    std::atomic<uint64_t> connections{0};
+    std::atomic<uint64_t> shed[SHED_REASONS] = {};
+    std::atomic<uint64_t> timeouts[TIMEOUTS] = {};
+    std::atomic<uint64_t> allocations{0};
+
+    LatencyHistogram handler_time[METHODS][ROUTES];
+    LatencyHistogram parse_time;
+};
+
+Metrics::Metrics() : id(next_metrics_id.fetch_add(1)) {
+}
+
+Metrics::~Metrics() = default;
+
+uint64_t Metrics::now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+Metrics::Method Metrics::method_of(HttpMethod method) {
+    if (method == HttpMethod::GET) {
+        return Method::GET;
+    }
+    if (method == HttpMethod::POST) {
+        return Method::POST;
+    }
+    return Method::OTHER;
+}
+
+Metrics::ThreadMetrics& Metrics::local() {
+    struct Slot {
+        uint64_t metrics_id = 0;
+        ThreadMetrics* block = nullptr;
+    };
+    static thread_local Slot slot;
+    if (slot.metrics_id != id) {
+        // Blocks live as long as the Metrics object, so totals survive thread exit
+        auto block = std::make_unique<ThreadMetrics>();
+        slot.block = block.get();
+        slot.metrics_id = id;
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        threads.push_back(std::move(block));
+    }
+    return *slot.block;
+}
+
+void Metrics::record_request(Method method, Route route, int status, uint64_t handler_ns,
+                             size_t bytes, bool reused_connection) {
+    record_response(method, route, status, bytes, reused_connection);
+    local().handler_time[static_cast<int>(method)][static_cast<int>(route)].record(handler_ns);
+}
+
+void Metrics::record_response(Method method, Route route, int status, size_t bytes, bool reused_connection) {
+    ThreadMetrics& block = local();
+    int m = static_cast<int>(method);
+    int r = static_cast<int>(route);
+    int s = status_slot(status);
+    bump(block.requests[m][r][s]);
+    bump(block.bytes[m][r][s], bytes);
+    if (reused_connection) {
+        bump(block.reused_requests);
+    }
+}
+
+void Metrics::record_parse(uint64_t parse_ns) {
+    local().parse_time.record(parse_ns);
+}
+
+void Metrics::record_connection() {
+    bump(local().connections);
+}
+
+void Metrics::record_shed(Shed reason) {
+    bump(local().shed[static_cast<int>(reason)]);
+}
+
+void Metrics::record_timeout(Timeout kind) {
+    bump(local().timeouts[static_cast<int>(kind)]);
+}
+
+void Metrics::record_allocations(uint64_t count) {
+    bump(local().allocations, count);
+}
+
+void Metrics::render(std::string& out) const {
+    uint64_t requests[METHODS][ROUTES][STATUS_SLOTS] = {};
+    uint64_t bytes[METHODS][ROUTES][STATUS_SLOTS] = {};
+    uint64_t reused = 0, connections = 0, allocations = 0;
+    uint64_t timeouts[TIMEOUTS] = {};
+    uint64_t shed[SHED_REASONS] = {};
+    std::vector<uint64_t> handler_buckets(METHODS * ROUTES * LatencyHistogram::BUCKETS, 0);
+    uint64_t handler_count[METHODS][ROUTES] = {};
+    uint64_t handler_sum[METHODS][ROUTES] = {};
+    std::vector<uint64_t> parse_buckets(LatencyHistogram::BUCKETS, 0);
+    uint64_t parse_count = 0, parse_sum = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        for (const auto& block : threads) {
+            for (int m = 0; m < METHODS; m++) {
+                for (int r = 0; r < ROUTES; r++) {
+                    for (int s = 0; s < STATUS_SLOTS; s++) {
+                        requests[m][r][s] += block->requests[m][r][s].load(std::memory_order_relaxed);
+                        bytes[m][r][s] += block->bytes[m][r][s].load(std::memory_order_relaxed);
+                    }
+                    block->handler_time[m][r].merge_into(
+                        &handler_buckets[(m * ROUTES + r) * LatencyHistogram::BUCKETS],
+                        handler_count[m][r], handler_sum[m][r]);
+                }
+            }
+            block->parse_time.merge_into(parse_buckets.data(), parse_count, parse_sum);
+            reused += block->reused_requests.load(std::memory_order_relaxed);
+            connections += block->connections.load(std::memory_order_relaxed);
+            allocations += block->allocations.load(std::memory_order_relaxed);
+            for (int t = 0; t < TIMEOUTS; t++) {
+                timeouts[t] += block->timeouts[t].load(std::memory_order_relaxed);
+            }
+            for (int r = 0; r < SHED_REASONS; r++) {
+                shed[r] += block->shed[r].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    auto labels = [](int m, int r, int s) {
+        std::string status = s == STATUS_SLOTS - 1 ? "other" : std::to_string(STATUS_CODES[s]);
+        return std::string("method=\"") + METHOD_NAMES[m] + "\",route=\"" + ROUTE_NAMES[r] +
+               "\",status=\"" + status + "\"";
+    };
+
+    uint64_t total_requests = 0;
+    append_family(out, "http_requests_total", "counter", "Requests answered, by method, route and status.");
+    for (int m = 0; m < METHODS; m++) {
+        for (int r = 0; r < ROUTES; r++) {
+            for (int s = 0; s < STATUS_SLOTS; s++) {
+                if (requests[m][r][s] > 0) {
+                    append_sample(out, "http_requests_total", labels(m, r, s), requests[m][r][s]);
+                    total_requests += requests[m][r][s];
+                }
+            }
+        }
+    }
+
+    append_family(out, "http_response_bytes_queued_total", "counter",
+                  "Response bytes (head and body) queued for sending, by method, route and status.");
+    for (int m = 0; m < METHODS; m++) {
+        for (int r = 0; r < ROUTES; r++) {
+            for (int s = 0; s < STATUS_SLOTS; s++) {
+                if (requests[m][r][s] > 0) {
+                    append_sample(out, "http_response_bytes_queued_total", labels(m, r, s), bytes[m][r][s]);
+                }
+            }
+        }
+    }
+
+    append_family(out, "http_request_duration_seconds", "summary",
+                  "Handler time from dispatch until the response is queued, by method and route.");
+    for (int m = 0; m < METHODS; m++) {
+        for (int r = 0; r < ROUTES; r++) {
+            if (handler_count[m][r] > 0) {
+                append_summary(out, "http_request_duration_seconds",
+                               std::string("method=\"") + METHOD_NAMES[m] + "\",route=\"" + ROUTE_NAMES[r] + "\"",
+                               &handler_buckets[(m * ROUTES + r) * LatencyHistogram::BUCKETS],
+                               handler_count[m][r], handler_sum[m][r]);
+            }
+        }
+    }
+
+    append_family(out, "http_request_parse_duration_seconds", "summary",
+                  "Time spent parsing request heads, summed over partial reads.");
+    append_summary(out, "http_request_parse_duration_seconds", "", parse_buckets.data(), parse_count, parse_sum);
+
+    append_family(out, "http_connections_total", "counter", "Client connections opened.");
+    append_sample(out, "http_connections_total", "", connections);
+    append_family(out, "http_keepalive_reused_requests_total", "counter",
+                  "Requests served on a connection that had already served one.");
+    append_sample(out, "http_keepalive_reused_requests_total", "", reused);
+    append_family(out, "http_keepalive_reuse_ratio", "gauge", "Share of requests served on a reused connection.");
+    out += "http_keepalive_reuse_ratio ";
+    append_double(out, total_requests ? static_cast<double>(reused) / total_requests : 0.0);
+    out += "\n";
+    append_family(out, "http_rejected_connections_total", "counter",
+                  "Connections answered 503 instead of served, by reason (queue_full, queue_delay).");
+    for (int r = 0; r < SHED_REASONS; r++) {
+        append_sample(out, "http_rejected_connections_total", std::string("reason=\"") + SHED_NAMES[r] + "\"",
+                      shed[r]);
+    }
+    append_family(out, "http_connection_timeouts_total", "counter",
+                  "Connections closed because a deadline passed, by kind (idle, header, body).");
+    for (int t = 0; t < TIMEOUTS; t++) {
+        append_sample(out, "http_connection_timeouts_total", std::string("kind=\"") + TIMEOUT_NAMES[t] + "\"",
+                      timeouts[t]);
+    }
+    if (AllocStats::enabled) {
+        append_family(out, "http_request_allocations_total", "counter",
+                      "Heap allocations made while handling requests, from parse until the response is queued.");
+        append_sample(out, "http_request_allocations_total", "", allocations);
+    }
+}
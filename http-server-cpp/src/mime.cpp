@@ -0,0 +1,50 @@
+#include "../include/mime.hpp"
+#include <cstddef>
+
+namespace {
+
+// Text, images and anything unknown are offered as downloads, as the
+// assignment asks; only markup and web assets are shown inline
+constexpr MimeType MIME_TYPES[] = {
+    {"html", "text/html; charset=utf-8", false, true},
+    {"htm", "text/html; charset=utf-8", false, true},
+    {"css", "text/css; charset=utf-8", false, true},
+    {"js", "text/javascript; charset=utf-8", false, true},
+    {"json", "application/json", false, true},
+    {"svg", "image/svg+xml", false, true},
+    {"xml", "application/xml", false, true},
+    {"txt", "application/octet-stream", true, true},
+    {"png", "application/octet-stream", true, false},
+    {"jpg", "application/octet-stream", true, false},
+    {"jpeg", "application/octet-stream", true, false},
+};
+
+constexpr MimeType DEFAULT_TYPE = {"", "application/octet-stream", true, false};
+
+constexpr size_t MAX_EXTENSION = 4;
+
+}
+
+const MimeType& mime_type_for(std::string_view path) {
+    size_t dot = path.find_last_of("./");
+    if (dot == std::string_view::npos || path[dot] != '.') {
+        return DEFAULT_TYPE;
+    }
+    std::string_view extension = path.substr(dot + 1);
+    if (extension.empty() || extension.size() > MAX_EXTENSION) {
+        return DEFAULT_TYPE;
+    }
+
+    char lower[MAX_EXTENSION];
+    for (size_t i = 0; i < extension.size(); i++) {
+        char c = extension[i];
+        lower[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+    std::string_view key(lower, extension.size());
+    for (const MimeType& type : MIME_TYPES) {
+        if (type.extension == key) {
+            return type;
+        }
+    }
+    return DEFAULT_TYPE;
+}
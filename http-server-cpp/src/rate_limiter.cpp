@@ -0,0 +1,224 @@
+#include "../include/rate_limiter.hpp"
+#include <sys/mman.h>
+#include <time.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// A key may sit in any slot of its home cache line, and nowhere else: a
+// check touches one line
+constexpr size_t PROBE = 4;
+constexpr size_t MIN_ENTRIES = 1024;
+// State word: 12-bit key tag, then microseconds since the limiter was made
+// (enough for 142 years)
+constexpr int TIME_BITS = 52;
+constexpr uint64_t TIME_MASK = (uint64_t(1) << TIME_BITS) - 1;
+// Keeps arrival times far from overflowing the time field
+constexpr uint64_t MAX_INTERVAL_US = uint64_t(1) << 36;
+constexpr uint64_t MAX_TOLERANCE_US = uint64_t(1) << 40;
+
+// Coarse (a few ms): refills are that much late at worst, and the read
+// costs a fraction of a full clock read
+uint64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+// splitmix64 finalizer: addresses of one subnet differ in a few low bits
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Never 0, so an unused slot matches no client
+uint64_t make_key(RateLimiter::Scope scope, uint32_t client) {
+    return (static_cast<uint64_t>(scope) + 1) << 32 | client;
+}
+
+uint32_t retry_after(uint64_t wait_us) {
+    return static_cast<uint32_t>(std::max<uint64_t>(1, (wait_us + 999999) / 1000000));
+}
+}
+
+RateLimiter::RateLimiter(size_t entries, const Rule (&rules)[SCOPES]) : epoch_ns(monotonic_ns()) {
+    bool any = false;
+    for (int i = 0; i < SCOPES; i++) {
+        if (rules[i].per_second <= 0) {
+            continue;
+        }
+        uint64_t interval = std::min<uint64_t>(
+            MAX_INTERVAL_US, std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(1e6 / rules[i].per_second))));
+        uint64_t burst = rules[i].burst ? rules[i].burst
+                                        : std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(rules[i].per_second)));
+        limits[i].interval_us = interval;
+        limits[i].tolerance_us = std::min(MAX_TOLERANCE_US, interval * burst);
+        any = true;
+    }
+    if (!any) {
+        return;
+    }
+
+    capacity = std::max(MIN_ENTRIES, SHARD_COUNT);
+    while (capacity < entries) {
+        capacity <<= 1;
+    }
+    shard_mask = capacity / SHARD_COUNT - 1;
+    // Zero pages are a table of unused slots, and only those touched are
+    // ever backed. Huge pages keep millions of clients from missing the TLB
+    void* table = mmap(nullptr, capacity * sizeof(Slot), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        for (Limit& limit : limits) {
+            limit = Limit();
+        }
+        capacity = 0;
+        return;
+    }
+    madvise(table, capacity * sizeof(Slot), MADV_HUGEPAGE);
+    slots = static_cast<Slot*>(table);
+    counters.reset(new Counters[SHARD_COUNT]);
+}
+
+RateLimiter::~RateLimiter() {
+    if (slots) {
+        munmap(slots, capacity * sizeof(Slot));
+    }
+}
+
+RateLimiter::Rule RateLimiter::rule(Scope scope) const {
+    const Limit& limit = limits[static_cast<int>(scope)];
+    if (limit.interval_us == 0) {
+        return {};
+    }
+    return {1e6 / static_cast<double>(limit.interval_us), static_cast<uint32_t>(limit.tolerance_us / limit.interval_us)};
+}
+
+uint64_t RateLimiter::now_us() const {
+    return (monotonic_ns() - epoch_ns) / 1000;
+}
+
+RateLimiter::Slot* RateLimiter::lookup(uint64_t key, uint64_t hash) const {
+    Slot* run = slots + (hash >> 32 & (SHARD_COUNT - 1)) * (shard_mask + 1);
+    uint64_t tag = hash & ~TIME_MASK;
+    for (size_t i = 0; i < PROBE; i++) {
+        Slot& slot = run[((hash & shard_mask) & ~(PROBE - 1)) | i];
+        // Key before state: a slot changes hands state first, so the new
+        // key is never seen together with the previous owner's tag
+        if (slot.key.load(std::memory_order_acquire) == key &&
+            (slot.state.load(std::memory_order_relaxed) & ~TIME_MASK) == tag) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+RateLimiter::Slot* RateLimiter::claim(uint64_t key, uint64_t hash, uint64_t now) {
+    size_t shard = hash >> 32 & (SHARD_COUNT - 1);
+    Slot* run = slots + shard * (shard_mask + 1);
+    Slot* victim = nullptr;
+    uint64_t victim_state = 0;
+    bool idle = false;
+    for (size_t i = 0; i < PROBE; i++) {
+        Slot& slot = run[((hash & shard_mask) & ~(PROBE - 1)) | i];
+        uint64_t state = slot.state.load(std::memory_order_relaxed);
+        // Full again (or never used): nothing is lost by reusing it
+        if ((state & TIME_MASK) <= now) {
+            victim = &slot;
+            victim_state = state;
+            idle = true;
+            break;
+        }
+        // All in use: the bucket closest to full goes
+        if (!victim || (state & TIME_MASK) < (victim_state & TIME_MASK)) {
+            victim = &slot;
+            victim_state = state;
+        }
+    }
+    if (!victim->state.compare_exchange_strong(victim_state, (hash & ~TIME_MASK) | now,
+                                               std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    victim->key.store(key, std::memory_order_release);
+
+    counters[shard].created.fetch_add(1, std::memory_order_relaxed);
+    if (!idle) {
+        counters[shard].displaced.fetch_add(1, std::memory_order_relaxed);
+    }
+    return victim;
+}
+
+bool RateLimiter::admit(Scope scope, uint32_t client, uint32_t& retry_after_s) {
+    const Limit& limit = limits[static_cast<int>(scope)];
+    if (limit.interval_us == 0) {
+        return true;
+    }
+    uint64_t key = make_key(scope, client);
+    uint64_t hash = mix(key);
+    uint64_t tag = hash & ~TIME_MASK;
+    uint64_t now = now_us();
+
+    Slot* slot = lookup(key, hash);
+    if (!slot) {
+        slot = claim(key, hash, now);
+        if (!slot) {
+            return true;   // lost the slot to another thread: let this one through
+        }
+    }
+
+    uint64_t state = slot->state.load(std::memory_order_relaxed);
+    for (;;) {
+        if ((state & ~TIME_MASK) != tag) {
+            return true;   // taken over by another client since it was found
+        }
+        uint64_t arrival = std::max(state & TIME_MASK, now) + limit.interval_us;
+        if (arrival - now > limit.tolerance_us) {
+            retry_after_s = retry_after(arrival - now - limit.tolerance_us);
+            counters[hash >> 32 & (SHARD_COUNT - 1)].limited[static_cast<int>(scope)].fetch_add(
+                1, std::memory_order_relaxed);
+            return false;
+        }
+        if (slot->state.compare_exchange_weak(state, tag | arrival, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+bool RateLimiter::would_admit(Scope scope, uint32_t client, uint32_t& retry_after_s) const {
+    const Limit& limit = limits[static_cast<int>(scope)];
+    if (limit.interval_us == 0) {
+        return true;
+    }
+    uint64_t key = make_key(scope, client);
+    uint64_t hash = mix(key);
+    const Slot* slot = lookup(key, hash);
+    if (!slot) {
+        return true;
+    }
+    uint64_t state = slot->state.load(std::memory_order_relaxed);
+    uint64_t now = now_us();
+    uint64_t arrival = std::max(state & TIME_MASK, now) + limit.interval_us;
+    if ((state & ~TIME_MASK) != (hash & ~TIME_MASK) || arrival - now <= limit.tolerance_us) {
+        return true;
+    }
+    retry_after_s = retry_after(arrival - now - limit.tolerance_us);
+    counters[hash >> 32 & (SHARD_COUNT - 1)].limited[static_cast<int>(scope)].fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+RateLimiter::Stats RateLimiter::get_stats() const {
+    Stats stats {};
+    if (!counters) {
+        return stats;
+    }
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        for (int scope = 0; scope < SCOPES; scope++) {
+            stats.limited[scope] += counters[i].limited[scope].load(std::memory_order_relaxed);
+        }
+        stats.created += counters[i].created.load(std::memory_order_relaxed);
+        stats.displaced += counters[i].displaced.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
@@ -0,0 +1,169 @@
+#include "../include/response.hpp"
+#include <time.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+
+namespace {
+
+struct StatusEntry {
+    int code;
+    std::string_view line;
+};
+
+constexpr StatusEntry STATUS_LINES[] = {
+    {100, "HTTP/1.1 100 Continue\r\n"},
+    {200, "HTTP/1.1 200 OK\r\n"},
+    {201, "HTTP/1.1 201 Created\r\n"},
+    {204, "HTTP/1.1 204 No Content\r\n"},
+    {206, "HTTP/1.1 206 Partial Content\r\n"},
+    {304, "HTTP/1.1 304 Not Modified\r\n"},
+    {400, "HTTP/1.1 400 Bad Request\r\n"},
+    {403, "HTTP/1.1 403 Forbidden\r\n"},
+    {404, "HTTP/1.1 404 Not Found\r\n"},
+    {405, "HTTP/1.1 405 Method Not Allowed\r\n"},
+    {408, "HTTP/1.1 408 Request Timeout\r\n"},
+    {413, "HTTP/1.1 413 Payload Too Large\r\n"},
+    {415, "HTTP/1.1 415 Unsupported Media Type\r\n"},
+    {416, "HTTP/1.1 416 Range Not Satisfiable\r\n"},
+    {429, "HTTP/1.1 429 Too Many Requests\r\n"},
+    {431, "HTTP/1.1 431 Request Header Fields Too Large\r\n"},
+    {500, "HTTP/1.1 500 Internal Server Error\r\n"},
+    {503, "HTTP/1.1 503 Service Unavailable\r\n"},
+};
+
+constexpr int MAX_STATUS = 600;
+
+// Direct-indexed by status code, built at compile time
+constexpr std::array<std::string_view, MAX_STATUS> make_status_table() {
+    std::array<std::string_view, MAX_STATUS> table{};
+    for (const StatusEntry& entry : STATUS_LINES) {
+        table[entry.code] = entry.line;
+    }
+    return table;
+}
+
+constexpr std::array<std::string_view, MAX_STATUS> STATUS_TABLE = make_status_table();
+
+constexpr char DAY_NAMES[][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+constexpr char MONTH_NAMES[][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+void append_decimal(std::string& out, size_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr - digits);
+}
+
+void put_two_digits(char* out, int value) {
+    out[0] = static_cast<char>('0' + value / 10);
+    out[1] = static_cast<char>('0' + value % 10);
+}
+
+// Writes the 29-byte IMF-fixdate "Thu, 01 Jan 1970 00:00:00 GMT"
+void format_imf_fixdate(char* p, time_t when) {
+    struct tm tm;
+    gmtime_r(&when, &tm);
+    std::copy(DAY_NAMES[tm.tm_wday], DAY_NAMES[tm.tm_wday] + 3, p);
+    p[3] = ',';
+    p[4] = ' ';
+    put_two_digits(p + 5, tm.tm_mday);
+    p[7] = ' ';
+    std::copy(MONTH_NAMES[tm.tm_mon], MONTH_NAMES[tm.tm_mon] + 3, p + 8);
+    p[11] = ' ';
+    int year = tm.tm_year + 1900;
+    put_two_digits(p + 12, year / 100);
+    put_two_digits(p + 14, year % 100);
+    p[16] = ' ';
+    put_two_digits(p + 17, tm.tm_hour);
+    p[19] = ':';
+    put_two_digits(p + 20, tm.tm_min);
+    p[22] = ':';
+    put_two_digits(p + 23, tm.tm_sec);
+    std::copy(" GMT", " GMT" + 4, p + 25);
+}
+
+std::string connection_header_block =
+    "Connection: keep-alive\r\n"
+    "Keep-Alive: timeout=30, max=100\r\n"
+    "\r\n";
+
+constexpr std::string_view CLOSE_HEADER_BLOCK = "Connection: close\r\n\r\n";
+
+std::atomic<bool> closing{false};
+
+}
+
+std::string_view connection_headers() {
+    if (closing.load(std::memory_order_relaxed)) {
+        return CLOSE_HEADER_BLOCK;
+    }
+    return connection_header_block;
+}
+
+void configure_connection_headers(uint32_t idle_timeout_s, int max_requests) {
+    connection_header_block = "Connection: keep-alive\r\nKeep-Alive: ";
+    if (idle_timeout_s > 0) {
+        connection_header_block += "timeout=" + std::to_string(idle_timeout_s) + ", ";
+    }
+    connection_header_block += "max=" + std::to_string(max_requests) + "\r\n\r\n";
+}
+
+void announce_connection_close() {
+    closing.store(true, std::memory_order_relaxed);
+}
+
+void append_status_line(std::string& out, int status_code) {
+    if (status_code >= 0 && status_code < MAX_STATUS && !STATUS_TABLE[status_code].empty()) {
+        out += STATUS_TABLE[status_code];
+        return;
+    }
+    out += "HTTP/1.1 ";
+    append_decimal(out, static_cast<size_t>(status_code));
+    out += " Unknown\r\n";
+}
+
+std::string_view date_header() {
+    // "Date: " + 29-byte IMF-fixdate + CRLF
+    static thread_local char header[] = "Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n";
+    static thread_local time_t cached_second = -1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (now.tv_sec != cached_second) {
+        format_imf_fixdate(header + 6, now.tv_sec);
+        cached_second = now.tv_sec;
+    }
+    return std::string_view(header, sizeof(header) - 1);
+}
+
+void append_http_date(std::string& out, time_t when) {
+    char date[29];
+    format_imf_fixdate(date, when);
+    out.append(date, sizeof(date));
+}
+
+void append_entity_headers(std::string& out, std::string_view content_type, size_t content_length,
+                           std::string_view filename) {
+    out += "Content-Type: ";
+    out += content_type;
+    out += "\r\nContent-Length: ";
+    append_decimal(out, content_length);
+    out += "\r\nServer: Multi-threaded HTTP Server\r\n";
+
+    // Add Content-Disposition for binary files
+    if (!filename.empty() && content_type == "application/octet-stream") {
+        out += "Content-Disposition: attachment; filename=\"";
+        out += filename;
+        out += "\"\r\n";
+    }
+}
+
+void append_response_header(std::string& out, int status_code, std::string_view content_type,
+                            size_t content_length, std::string_view filename) {
+    append_status_line(out, status_code);
+    out += date_header();
+    append_entity_headers(out, content_type, content_length, filename);
+    out += connection_headers();
+}
@@ -0,0 +1,143 @@
+#include "../include/router.hpp"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utility>
+
+namespace {
+
+constexpr size_t INITIAL_SLOTS = 64;
+// Startup cost and memory stay bounded on a huge document root; files past
+// this still work through the filesystem fallback
+constexpr size_t MAX_STATIC_FILES = 16384;
+// Symlinked directories could otherwise loop
+constexpr int MAX_DEPTH = 16;
+
+}
+
+uint64_t Router::hash(HttpMethod method, std::string_view path) {
+    // FNV-1a, seeded with the method
+    uint64_t h = 14695981039346656037ULL ^ static_cast<uint64_t>(method);
+    for (char c : path) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+const Router::Route* Router::find(HttpMethod method, std::string_view path) const {
+    if (slots.empty()) {
+        return nullptr;
+    }
+    uint64_t h = hash(method, path);
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        uint32_t index = slots[i];
+        if (index == EMPTY) {
+            return nullptr;
+        }
+        const Route& route = routes[index];
+        if (hashes[index] == h && route.method == method && route.path == path) {
+            return &route;
+        }
+    }
+}
+
+void Router::grow() {
+    size_t capacity = slots.empty() ? INITIAL_SLOTS : slots.size() * 2;
+    slots.assign(capacity, EMPTY);
+    mask = capacity - 1;
+    for (uint32_t index = 0; index < routes.size(); index++) {
+        size_t i = hashes[index] & mask;
+        while (slots[i] != EMPTY) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = index;
+    }
+}
+
+bool Router::insert(Route route) {
+    if (find(route.method, route.path)) {
+        return false;
+    }
+    if ((routes.size() + 1) * 2 > slots.size()) {
+        grow();
+    }
+    uint64_t h = hash(route.method, route.path);
+    size_t i = h & mask;
+    while (slots[i] != EMPTY) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = static_cast<uint32_t>(routes.size());
+    hashes.push_back(h);
+    routes.push_back(std::move(route));
+    return true;
+}
+
+bool Router::add_handler(HttpMethod method, std::string_view path, RouteHandler handler, Metrics::Route label) {
+    Route route;
+    route.method = method;
+    route.path = std::string(path);
+    route.kind = Kind::HANDLER;
+    route.label = label;
+    route.handler = std::move(handler);
+    return insert(std::move(route));
+}
+
+bool Router::add_file(std::string_view path, std::string filepath) {
+    Route route;
+    route.method = HttpMethod::GET;
+    route.path = std::string(path);
+    route.kind = Kind::STATIC_FILE;
+    route.label = Metrics::Route::STATIC;
+    route.filename_offset = filepath.find_last_of('/') + 1;
+    route.mime = &mime_type_for(filepath);
+    route.filepath = std::move(filepath);
+    return insert(std::move(route));
+}
+
+size_t Router::add_static_files(const std::string& root, std::string_view skip,
+                                const std::function<bool(std::string_view)>& accept) {
+    size_t added = walk(root, "", skip, 0, accept);
+    if (find(HttpMethod::GET, "/index.html") && add_file("/", root + "/index.html")) {
+        added++;
+    }
+    return added;
+}
+
+size_t Router::walk(const std::string& directory, const std::string& url, std::string_view skip, int depth,
+                    const std::function<bool(std::string_view)>& accept) {
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr) {
+        return 0;
+    }
+    size_t added = 0;
+    while (struct dirent* entry = readdir(dir)) {
+        std::string_view name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        std::string filepath = directory + "/" + entry->d_name;
+        std::string path = url + "/" + entry->d_name;
+
+        bool is_dir = entry->d_type == DT_DIR;
+        bool is_file = entry->d_type == DT_REG;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            struct stat st;
+            if (stat(filepath.c_str(), &st) == 0) {
+                is_dir = S_ISDIR(st.st_mode);
+                is_file = S_ISREG(st.st_mode);
+            }
+        }
+
+        if (is_dir) {
+            if (depth < MAX_DEPTH && !(depth == 0 && name == skip)) {
+                added += walk(filepath, path, skip, depth + 1, accept);
+            }
+        } else if (is_file && routes.size() < MAX_STATIC_FILES && accept(path)) {
+            if (add_file(path, std::move(filepath))) {
+                added++;
+            }
+        }
+    }
+    closedir(dir);
+    return added;
+}
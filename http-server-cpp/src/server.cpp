@@ -1,554 +1,1793 @@
 #include "../include/server.hpp"
+#include "../include/alloc_stats.hpp"
+#include "../include/buffer_pool.hpp"
+#include "../include/compression.hpp"
+#include "../include/conditional.hpp"
+#include "../include/event_loop.hpp"
+#include "../include/handoff.hpp"
+#include "../include/uring_loop.hpp"
 #include <filesystem>
 #include <algorithm>
 #include <regex>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static const int MAX_REQUESTS_PER_CONNECTION = 100;
+static const uint32_t MAX_HTTP2_STREAMS = 100;    // concurrent streams per HTTP/2 connection
+static const char* const RESOURCE_ROOT = "http-server-cpp/resources";
+// Files are packed under their path below the root
+static const size_t RESOURCE_ROOT_LENGTH = std::char_traits<char>::length(RESOURCE_ROOT);
+// A successor gets this long to report that it serves, else it is killed
+static const uint64_t SUCCESSOR_TIMEOUT_MS = 30000;
+// ...and this long to be sent the listening sockets
+static const int HANDOFF_TIMEOUT_MS = 5000;
+// Connections accepted per poll() wakeup
+static const int ACCEPT_BATCH = 64;
+// After an accept error the listener is left out of poll() this long
+static const uint64_t ACCEPT_RETRY_MS = 100;
+static const uint64_t ACCEPT_LOG_INTERVAL_MS = 10000;
+
+static ServerConfig make_config(const std::string& host, int port, int max_threads) {
+    ServerConfig config;
+    config.host = host;
+    config.port = port;
+    config.max_threads = max_threads;
+    return config;
+}
 
 HTTPServer::HTTPServer(const std::string& host, int port, int max_threads) 
-    : host(host), port(port), max_threads(max_threads), server_socket(-1), 
-      running(false), active_connections(0), total_requests(0) {
+    : HTTPServer(make_config(host, port, max_threads)) {
+}
+
+HTTPServer::HTTPServer(const ServerConfig& config)
+    : host(config.host), port(config.port), host_with_port(config.host + ":" + std::to_string(config.port)),
+      localhost_with_port("localhost:" + std::to_string(config.port)), max_threads(config.max_threads),
+      io_model(config.io_model), shards(config.shards), pin_cpus(config.pin_cpus),
+      max_header_bytes(config.max_header_bytes), max_body_bytes(config.max_body_bytes),
+      timeouts{config.idle_timeout_s * 1000ULL, config.header_timeout_s * 1000ULL, config.body_timeout_s * 1000ULL},
+      server_socket(-1), reserve_fd(-1), accept_retry_ms(0), accept_log_ms(0), accept_failures(0), running(false), draining(false), drain_timeout_s(config.drain_timeout_s),
+      drain_deadline_ms(0), signal_fd(-1), successor_pid(-1), successor_channel(-1), successor_deadline_ms(0),
+      handoff_channel(-1), running_workers(0), dispatch(config.dispatch), admission_wait_ms(config.admission_wait_ms),
+      queue_delay_target_ms(config.queue_delay_target_ms), queue_delay_interval_ms(config.queue_delay_interval_ms),
+      listen_backlog(config.listen_backlog), next_loop(0),
+      file_cache(config.cache_bytes, config.cache_max_entry_bytes), bundle_path(config.bundle_path),
+      rate_limiter(config.rate_limit_entries,
+                   {{config.rate_limit, config.rate_burst}, {config.upload_rate_limit, config.upload_rate_burst}}),
+      upload_dir_fd(-1), upload_sync_policy(config.upload_sync), upload_sync_ms(config.upload_sync_ms),
+      json_max_depth(config.json_max_depth), http2(config.http2),
+      http2_limits{config.max_header_bytes, config.max_body_bytes, MAX_HTTP2_STREAMS}, active_connections(0) {
+    configure_connection_headers(config.idle_timeout_s, MAX_REQUESTS_PER_CONNECTION);
+    logger.set_level(config.log_level);
+    if (!logger.open(config.log_file)) {
+        log_message("Error opening log file " + config.log_file + ", logging to stdout", LogLevel::ERROR);
+    }
+    router.add_handler(HttpMethod::GET, "/metrics",
+                       [this](Connection& conn, const HTTPRequest& request) { handle_metrics_request(conn, request); },
+                       Metrics::Route::METRICS);
+}
+
+bool HTTPServer::add_route(HttpMethod method, std::string_view path, RouteHandler handler) {
+    if (running) {
+        return false;
+    }
+    return router.add_handler(method, path, std::move(handler));
 }
 
 HTTPServer::~HTTPServer() {
     stop();
 }
 
-std::string HTTPServer::get_current_time() {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    auto tm = *std::localtime(&time_t);
-    
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-    return oss.str();
+void HTTPServer::log_message(std::string_view message, LogLevel level) {
+    logger.log(level, {}, message);
 }
 
-void HTTPServer::log_message(const std::string& message) {
-    std::cout << "[" << get_current_time() << "] " << message << std::endl;
+void HTTPServer::log_request(const std::string& thread_id, std::string_view message, LogLevel level) {
+    logger.log(level, thread_id, message);
 }
 
-void HTTPServer::log_request(const std::string& thread_id, const std::string& message) {
-    std::cout << "[" << get_current_time() << "] [" << thread_id << "] " << message << std::endl;
+const std::string& HTTPServer::thread_tag() {
+    static thread_local const std::string tag =
+        "Thread-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()) % 1000);
+    return tag;
 }
 
-std::string HTTPServer::generate_upload_filename() {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    auto tm = *std::localtime(&time_t);
-    
-    std::ostringstream oss;
-    oss << "upload_" << std::put_time(&tm, "%Y%m%d_%H%M%S");
-    
-    // Add random ID
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(1000, 9999);
-    oss << "_" << dis(gen);
-    
-    return oss.str() + ".json";
+std::string HTTPServer::generate_upload_filename(bool wide) {
+    // Per-thread generator: no /dev/urandom open per upload
+    static thread_local std::mt19937 gen(std::random_device{}());
+    // Four digits only give 9000 names a second; retries after a collision
+    // use a wider suffix so a busy second cannot run out of names
+    std::uniform_int_distribution<> dis(wide ? 10000000 : 1000, wide ? 99999999 : 9999);
+    
+    time_t now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    
+    char name[48];
+    snprintf(name, sizeof(name), "upload_%04d%02d%02d_%02d%02d%02d_%d.json", tm.tm_year + 1900, tm.tm_mon + 1,
+             tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, dis(gen));
+    return name;
 }
 
-bool HTTPServer::is_valid_json(const std::string& json_str) {
-    // Simple JSON validation - check for basic structure
-    if (json_str.empty()) {
+bool HTTPServer::validate_path(std::string_view path) {
+    // Check for directory traversal attempts
+    if (path.find("..") != std::string_view::npos || 
+        path.find("./") != std::string_view::npos ||
+        path.find("//") != std::string_view::npos ||
+        path.find("\\") != std::string_view::npos) {
         return false;
     }
     
-    // Remove whitespace
-    std::string trimmed = json_str;
-    trimmed.erase(std::remove_if(trimmed.begin(), trimmed.end(), ::isspace), trimmed.end());
-    
-    // Check if it starts and ends with braces or brackets
-    if ((trimmed.front() == '{' && trimmed.back() == '}') ||
-        (trimmed.front() == '[' && trimmed.back() == ']')) {
-        return true;
-    }
-    
-    // Check for quoted strings (simple validation)
-    if (trimmed.front() == '"' && trimmed.back() == '"') {
-        return true;
-    }
-    
-    // Check for numbers
-    try {
-        std::stod(trimmed);
-        return true;
-    } catch (...) {
-        // Not a number
+    // Ensure path starts with /
+    if (path.empty() || path[0] != '/') {
+        return false;
     }
     
-    // Check for boolean values
-    if (trimmed == "true" || trimmed == "false" || trimmed == "null") {
-        return true;
+    return true;
+}
+
+bool HTTPServer::validate_host_header(const HTTPRequest& request) {
+    if (!request.has_header("host")) {
+        return false; // Missing Host header
     }
     
-    return false;
+    std::string_view host_value = request.header("host");
+    return host_value == host_with_port || host_value == host ||
+           host_value == localhost_with_port || host_value == "localhost";
 }
 
-HTTPServer::HTTPRequest HTTPServer::parse_request(const std::string& request_data) {
-    HTTPRequest request;
-    std::istringstream stream(request_data);
-    std::string line;
-    
-    // Parse request line
-    if (std::getline(stream, line)) {
-        std::istringstream request_line(line);
-        request_line >> request.method >> request.path >> request.version;
-        
-        // Remove trailing \r if present
-        if (!request.version.empty() && request.version.back() == '\r') {
-            request.version.pop_back();
+static bool read_fully(int file_fd, std::string& out, size_t size) {
+    out.resize(size);
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t n = pread(file_fd, &out[offset], size - offset, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
         }
-    }
-    
-    // Parse headers
-    while (std::getline(stream, line) && line != "\r" && !line.empty()) {
-        size_t colon_pos = line.find(':');
-        if (colon_pos != std::string::npos) {
-            std::string key = line.substr(0, colon_pos);
-            std::string value = line.substr(colon_pos + 1);
-            
-            // Trim whitespace
-            key.erase(0, key.find_first_not_of(" \t\r"));
-            key.erase(key.find_last_not_of(" \t\r") + 1);
-            value.erase(0, value.find_first_not_of(" \t\r"));
-            value.erase(value.find_last_not_of(" \t\r") + 1);
-            
-            // Convert to lowercase for case-insensitive comparison
-            std::transform(key.begin(), key.end(), key.begin(), ::tolower);
-            request.headers[key] = value;
+        if (n <= 0) {
+            return false;
         }
+        offset += n;
     }
-    
-    // Parse body (if any)
-    std::string body;
-    while (std::getline(stream, line)) {
-        body += line + "\n";
-    }
-    if (!body.empty()) {
-        body.pop_back(); // Remove last newline
-    }
-    request.body = body;
-    
-    return request;
+    return true;
 }
 
-std::string HTTPServer::build_response(int status_code, const std::string& content_type, 
-                                     const std::string& body, const std::string& filename) {
-    std::ostringstream response;
-    
-    // Status line
-    std::string status_text;
-    switch (status_code) {
-        case 200: status_text = "OK"; break;
-        case 201: status_text = "Created"; break;
-        case 400: status_text = "Bad Request"; break;
-        case 403: status_text = "Forbidden"; break;
-        case 404: status_text = "Not Found"; break;
-        case 405: status_text = "Method Not Allowed"; break;
-        case 415: status_text = "Unsupported Media Type"; break;
-        case 500: status_text = "Internal Server Error"; break;
-        case 503: status_text = "Service Unavailable"; break;
-        default: status_text = "Unknown"; break;
+// Opens filepath's precompressed sibling (index.html.br) if there is one and
+// it is not older than the original; -1 otherwise
+static int open_sibling(std::string_view filepath, Encoding encoding, const struct stat& original,
+                        struct stat& sibling_stat) {
+    std::string_view suffix = encoding_suffix(encoding);
+    char sibling[PATH_MAX];
+    if (filepath.size() + suffix.size() >= sizeof(sibling)) {
+        return -1;
     }
-    
-    response << "HTTP/1.1 " << status_code << " " << status_text << "\r\n";
-    response << "Content-Type: " << content_type << "\r\n";
-    response << "Content-Length: " << body.length() << "\r\n";
-    response << "Date: " << get_current_time() << "\r\n";
-    response << "Server: Multi-threaded HTTP Server\r\n";
-    
-    // Add Content-Disposition for binary files
-    if (!filename.empty() && content_type == "application/octet-stream") {
-        response << "Content-Disposition: attachment; filename=\"" << filename << "\"\r\n";
+    std::memcpy(sibling, filepath.data(), filepath.size());
+    std::memcpy(sibling + filepath.size(), suffix.data(), suffix.size());
+    sibling[filepath.size() + suffix.size()] = '\0';
+    int sibling_fd = open(sibling, O_RDONLY | O_CLOEXEC);
+    if (sibling_fd < 0) {
+        return -1;
     }
-    
-    // Connection header
-    response << "Connection: keep-alive\r\n";
-    response << "Keep-Alive: timeout=30, max=100\r\n";
-    response << "\r\n";
-    response << body;
-    
-    return response.str();
+    if (fstat(sibling_fd, &sibling_stat) < 0 || !S_ISREG(sibling_stat.st_mode) ||
+        sibling_stat.st_mtim.tv_sec < original.st_mtim.tv_sec ||
+        (sibling_stat.st_mtim.tv_sec == original.st_mtim.tv_sec &&
+         sibling_stat.st_mtim.tv_nsec < original.st_mtim.tv_nsec)) {
+        close(sibling_fd);
+        return -1;
+    }
+    return sibling_fd;
 }
 
-std::string HTTPServer::get_content_type(const std::string& filepath) {
-    std::string ext = get_file_extension(filepath);
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-    
-    if (ext == "html" || ext == "htm") {
-        return "text/html; charset=utf-8";
-    } else if (ext == "txt") {
-        return "application/octet-stream";
-    } else if (ext == "png") {
-        return "application/octet-stream";
-    } else if (ext == "jpg" || ext == "jpeg") {
-        return "application/octet-stream";
-    } else {
-        return "application/octet-stream";
-    }
+// Headers that set a compressed response apart from the identity one
+static void append_encoding_headers(std::string& out, Encoding encoding) {
+    out += "Content-Encoding: ";
+    out += encoding_token(encoding);
+    out += "\r\nVary: Accept-Encoding\r\n";
 }
 
-std::string HTTPServer::get_file_extension(const std::string& filepath) {
-    size_t dot_pos = filepath.find_last_of('.');
-    if (dot_pos != std::string::npos) {
-        return filepath.substr(dot_pos + 1);
+// Strong validator of an encoded representation: the bytes differ, so must
+// the tag. Written to out (FileCache::MAX_ETAG bytes)
+static std::string_view encoded_etag(const struct stat& file_stat, Encoding encoding, char* out) {
+    // Tokens are short enough that the tag always fits
+    size_t length = FileCache::format_etag(file_stat, out) - 1;
+    std::string_view token = encoding_token(encoding);
+    out[length++] = '-';
+    std::memcpy(out + length, token.data(), token.size());
+    length += token.size();
+    out[length++] = '"';
+    return std::string_view(out, length);
+}
+
+static void append_validators(std::string& out, std::string_view etag, time_t modified) {
+    out += "ETag: ";
+    out += etag;
+    out += "\r\nLast-Modified: ";
+    append_http_date(out, modified);
+    out += "\r\n";
+}
+
+// A partial response repeats the full one's Vary and validators
+static void append_range_validators(std::string& out, bool compressible, std::string_view etag, time_t modified) {
+    if (compressible) {
+        out += "Vary: Accept-Encoding\r\n";
     }
-    return "";
+    append_validators(out, etag, modified);
 }
 
-bool HTTPServer::validate_path(const std::string& path) {
-    // Check for directory traversal attempts
-    if (path.find("..") != std::string::npos || 
-        path.find("./") != std::string::npos ||
-        path.find("//") != std::string::npos ||
-        path.find("\\") != std::string::npos) {
-        return false;
+static void append_content_range(std::string& out, const ByteRange& range, size_t total) {
+    out += "Content-Range: bytes ";
+    out += std::to_string(range.first);
+    out += '-';
+    out += std::to_string(range.first + range.length - 1);
+    out += '/';
+    out += std::to_string(total);
+    out += "\r\n";
+}
+
+CachedFilePtr HTTPServer::load_cached_file(int file_fd, std::string_view filepath, const struct stat& file_stat,
+                                          std::string_view content_type, std::string_view filename,
+                                          bool compressible) {
+    auto file = std::make_shared<CachedFile>();
+    file->path = std::string(filepath);
+    file->size = file_stat.st_size;
+    file->mtime = file_stat.st_mtim.tv_sec;
+    file->mtime_nsec = file_stat.st_mtim.tv_nsec;
+    file->inode = file_stat.st_ino;
+    file->etag = FileCache::make_etag(file_stat);
+    
+    if (!read_fully(file_fd, file->body, static_cast<size_t>(file_stat.st_size))) {
+        return nullptr;
     }
     
-    // Ensure path starts with /
-    if (path.empty() || path[0] != '/') {
-        return false;
+    append_entity_headers(file->header, content_type, file->body.size(), filename);
+    if (compressible) {
+        file->header += "Vary: Accept-Encoding\r\n";
+    }
+    append_validators(file->header, file->etag, file->mtime);
+    file->header += "Accept-Ranges: bytes\r\n";
+    if (!compressible) {
+        return file;
     }
     
-    return true;
+    // Encoded variants are built here once, never per request. They are
+    // tied to this entry, so they are rebuilt when the file itself changes
+    for (size_t i = 0; i < ENCODING_COUNT; i++) {
+        Encoding encoding = static_cast<Encoding>(i);
+        CachedVariant& variant = file->encoded[i];
+        struct stat sibling_stat;
+        int sibling_fd = open_sibling(filepath, encoding, file_stat, sibling_stat);
+        bool loaded = false;
+        if (sibling_fd >= 0) {
+            loaded = read_fully(sibling_fd, variant.body, static_cast<size_t>(sibling_stat.st_size));
+            close(sibling_fd);
+        }
+        // Tagged after the bytes' own file, so a rebuilt sibling gets a new tag
+        char etag[FileCache::MAX_ETAG];
+        variant.etag = std::string(encoded_etag(loaded ? sibling_stat : file_stat, encoding, etag));
+        if (!loaded && !(can_compress(encoding) && compress(encoding, file->body, variant.body))) {
+            variant.body.clear();
+            continue;
+        }
+        if (variant.body.size() >= file->body.size()) {
+            // Already-dense content: the identity bytes are the better deal
+            variant.body.clear();
+            continue;
+        }
+        
+        append_entity_headers(variant.header, content_type, variant.body.size(), filename);
+        append_encoding_headers(variant.header, encoding);
+        append_validators(variant.header, variant.etag, file->mtime);
+        variant.body.shrink_to_fit();
+    }
+    return file;
 }
 
-bool HTTPServer::validate_host_header(const std::map<std::string, std::string>& headers) {
-    auto host_it = headers.find("host");
-    if (host_it == headers.end()) {
-        return false; // Missing Host header
-    }
-    
-    std::string host_value = host_it->second;
-    std::string expected_host = host + ":" + std::to_string(port);
-    std::string expected_host_alt = host;
-    std::string localhost_alt = "localhost:" + std::to_string(port);
-    std::string localhost_alt2 = "localhost";
-    
-    return (host_value == expected_host || 
-            host_value == expected_host_alt ||
-            host_value == localhost_alt ||
-            host_value == localhost_alt2 ||
-            (host == "127.0.0.1" && host_value == "localhost:" + std::to_string(port)) ||
-            (host == "127.0.0.1" && host_value == "localhost"));
+void HTTPServer::log_cache_stats() {
+    FileCache::Stats stats = file_cache.get_stats();
+    log_message("File cache: " + std::to_string(stats.hits) + " hits, " +
+                std::to_string(stats.misses) + " misses, " +
+                std::to_string(stats.evictions) + " evictions, " +
+                std::to_string(stats.invalidations) + " invalidations, " +
+                std::to_string(stats.entries) + " entries (" + std::to_string(stats.bytes) + " bytes)");
 }
 
-std::string HTTPServer::read_file(const std::string& filepath, bool binary) {
-    std::ifstream file;
-    if (binary) {
-        file.open(filepath, std::ios::binary);
-    } else {
-        file.open(filepath);
+void HTTPServer::warm_file_cache() {
+    // Every manifest file that the cache takes is loaded before the first
+    // connection is accepted, so a restarted server does not serve its
+    // first requests from disk
+    if (!file_cache.enabled()) {
+        return;
     }
-    
-    if (!file.is_open()) {
-        return "";
+    size_t loaded = 0;
+    size_t bytes = 0;
+    for (const Router::Route& route : router.all()) {
+        AssetBundle::Asset asset;
+        if (route.kind != Router::Kind::STATIC_FILE || route.path == "/" ||
+            (bundle && bundle->find(std::string_view(route.filepath).substr(RESOURCE_ROOT_LENGTH), asset))) {
+            continue;
+        }
+        int file_fd = open(route.filepath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file_fd < 0) {
+            continue;
+        }
+        struct stat file_stat;
+        size_t size = 0;
+        if (fstat(file_fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+            size = static_cast<size_t>(file_stat.st_size);
+        }
+        if (size > 0 && file_cache.fits(size) && bytes + size <= file_cache.capacity()) {
+            CachedFilePtr cached = load_cached_file(file_fd, route.filepath, file_stat, route.mime->content_type,
+                                                    route.filename(), route.mime->compressible);
+            if (cached) {
+                file_cache.insert(cached);
+                loaded++;
+                bytes += size;
+            }
+        }
+        close(file_fd);
     }
-    
-    std::ostringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    log_message("File cache: warmed " + std::to_string(loaded) + " files (" + std::to_string(bytes) + " bytes)");
 }
 
-bool HTTPServer::write_file(const std::string& filepath, const std::string& content) {
-    std::ofstream file(filepath);
-    if (!file.is_open()) {
-        return false;
-    }
-    
-    file << content;
-    file.close();
-    return true;
+void HTTPServer::send_response(Connection& conn, int status_code, std::string_view content_type,
+                               std::string_view body) {
+    // Built straight into the connection's output buffer; the I/O model
+    // decides when it hits the socket
+    conn.respond(status_code, content_type, body);
 }
 
-void HTTPServer::send_error_response(int client_socket, int status_code, const std::string& message) {
-    std::string body = "{\"error\": \"" + message + "\"}";
-    std::string response = build_response(status_code, "application/json", body);
-    send(client_socket, response.c_str(), response.length(), 0);
+void HTTPServer::send_error_response(Connection& conn, int status_code, std::string_view message) {
+    conn.response_status = status_code;
+    std::string& out = conn.output_buffer();
+    append_response_header(out, status_code, "application/json", message.size() + 13);
+    out += "{\"error\": \"";
+    out += message;
+    out += "\"}";
 }
 
-void HTTPServer::handle_get_request(int client_socket, const HTTPRequest& request) {
-    std::string thread_id = "Thread-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()) % 1000);
+void HTTPServer::handle_get_request(Connection& conn, const HTTPRequest& request, const Router::Route* file) {
+    const std::string& thread_id = thread_tag();
+    // Strings that live for this request only are built in the arena
+    Arena& arena = conn.arena;
+    
+    // Per-request lines cost string building even when filtered out
+    bool verbose = logger.enabled(LogLevel::DEBUG);
+    if (verbose) {
+        log_request(thread_id, arena.join({"Request: ", request.method, " ", request.path, " ", request.version}));
+    }
     
-    // Determine file path
-    std::string filepath = request.path;
-    if (filepath == "/") {
-        filepath = "/index.html";
+    // Validate host header
+    if (!validate_host_header(request)) {
+        log_request(thread_id, "Host validation failed", LogLevel::WARN);
+        send_error_response(conn, 403, "Forbidden: Invalid Host header");
+        return;
+    }
+    if (verbose) {
+        log_request(thread_id, arena.join({"Host validation: ", request.header("host"), " ✓"}));
     }
     
-    // Remove leading slash and add resources prefix
-    if (filepath.length() > 1) {
-        filepath = "http-server-cpp/resources" + filepath;
+    // A file in the startup manifest comes with its path, name and type;
+    // anything else is checked and worked out here
+    std::string_view filepath;     // NUL-terminated for open()
+    std::string_view filename;     // for Content-Disposition
+    const MimeType* mime;
+    if (file) {
+        filepath = file->filepath;
+        filename = file->filename();
+        mime = file->mime;
     } else {
-        filepath = "http-server-cpp/resources/index.html";
+        if (!validate_path(request.path)) {
+            log_request(thread_id, arena.join({"Path validation failed: ", request.path}), LogLevel::WARN);
+            send_error_response(conn, 403, "Forbidden: Invalid path");
+            return;
+        }
+        filepath = arena.join({RESOURCE_ROOT, request.path.size() > 1 ? request.path : "/index.html"});
+        filename = filepath.substr(filepath.find_last_of('/') + 1);
+        mime = &mime_type_for(filepath);
     }
     
-    log_request(thread_id, "Request: " + request.method + " " + request.path + " " + request.version);
+    bool is_binary = mime->download;
+    std::string_view content_type = mime->content_type;
+    bool compressible = mime->compressible;
+    // Ranges address the identity bytes, so a Range request never gets an
+    // encoded variant
+    bool ranged = request.has_header("range");
+    uint8_t accepted = compressible && !ranged ? accepted_encodings(request.header("accept-encoding")) : 0;
+    
+    // A bundled file is served from the mapping without touching the
+    // filesystem. Small files come from the cache; everything else is
+    // streamed from the descriptor with sendfile()
+    AssetBundle::Asset asset;
+    bool bundled = bundle && bundle->find(filepath.substr(RESOURCE_ROOT_LENGTH), asset);
+    const AssetBundle::Representation* form = nullptr;
+    CachedFilePtr cached = bundled ? nullptr : file_cache.lookup(filepath);
+    int file_fd = -1;
+    size_t file_size = 0;
+    const CachedVariant* variant = nullptr;
+    Encoding encoding = Encoding::COUNT;
+    char etag_buffer[FileCache::MAX_ETAG];
+    std::string_view file_etag;     // validators of an uncached file
+    time_t modified = 0;
+    
+    if (!cached && !bundled) {
+        file_fd = open(filepath.data(), O_RDONLY | O_CLOEXEC);
+        struct stat file_stat;
+        if (file_fd < 0 || fstat(file_fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+            if (file_fd >= 0) {
+                close(file_fd);
+            }
+            if (file_fd < 0 && errno != ENOENT && errno != ENOTDIR) {
+                log_request(thread_id, arena.join({"Error reading file: ", filepath}), LogLevel::ERROR);
+                send_error_response(conn, 500, "Internal Server Error");
+            } else {
+                log_request(thread_id, arena.join({"File not found: ", filepath}), LogLevel::INFO);
+                send_error_response(conn, 404, "Not Found");
+            }
+            return;
+        }
+        file_size = static_cast<size_t>(file_stat.st_size);
+        modified = file_stat.st_mtim.tv_sec;
+        
+        if (file_cache.fits(file_size)) {
+            cached = load_cached_file(file_fd, filepath, file_stat, content_type, filename, compressible);
+            if (cached) {
+                close(file_fd);
+                file_fd = -1;
+                file_cache.insert(cached);
+            }
+        }
+        
+        // Too big to cache: only a precompressed sibling is worth sending,
+        // compressing on every request is not
+        for (size_t i = 0; !cached && i < ENCODING_COUNT; i++) {
+            struct stat sibling_stat;
+            int sibling_fd = -1;
+            if (accepts(accepted, static_cast<Encoding>(i))) {
+                sibling_fd = open_sibling(filepath, static_cast<Encoding>(i), file_stat, sibling_stat);
+            }
+            if (sibling_fd >= 0) {
+                close(file_fd);
+                file_fd = sibling_fd;
+                file_size = static_cast<size_t>(sibling_stat.st_size);
+                encoding = static_cast<Encoding>(i);
+                file_etag = encoded_etag(sibling_stat, encoding, etag_buffer);
+                break;
+            }
+        }
+        if (!cached && encoding == Encoding::COUNT) {
+            file_etag = std::string_view(etag_buffer, FileCache::format_etag(file_stat, etag_buffer));
+        }
+    }
     
-    // Validate host header
-    if (!validate_host_header(request.headers)) {
-        log_request(thread_id, "Host validation failed");
-        send_error_response(client_socket, 403, "Forbidden: Invalid Host header");
-        return;
+    // Preferred coding the client takes; br before gzip
+    for (size_t i = 0; (cached || bundled) && i < ENCODING_COUNT; i++) {
+        if (!accepts(accepted, static_cast<Encoding>(i))) {
+            continue;
+        }
+        if (cached && !cached->encoded[i].body.empty()) {
+            variant = &cached->encoded[i];
+        } else if (bundled && !asset.encoded[i].body.empty()) {
+            form = &asset.encoded[i];
+        } else {
+            continue;
+        }
+        encoding = static_cast<Encoding>(i);
+        break;
+    }
+    if (bundled && !form) {
+        form = &asset.identity;
     }
-    log_request(thread_id, "Host validation: " + request.headers.at("host") + " ✓");
     
-    // Validate path
-    if (!validate_path(request.path)) {
-        log_request(thread_id, "Path validation failed: " + request.path);
-        send_error_response(client_socket, 403, "Forbidden: Invalid path");
-        return;
+    std::string_view etag = file_etag;
+    if (cached) {
+        etag = variant ? variant->etag : cached->etag;
+        modified = cached->mtime;
+    } else if (bundled) {
+        etag = form->etag;
+        modified = asset.mtime;
     }
     
-    // Check if file exists
-    if (!std::filesystem::exists(filepath)) {
-        log_request(thread_id, "File not found: " + filepath);
-        send_error_response(client_socket, 404, "Not Found");
+    // The client's copy is current: If-None-Match decides when present,
+    // If-Modified-Since only otherwise (RFC 9110 13.2.2)
+    bool not_modified = false;
+    time_t since;
+    if (request.has_header("if-none-match")) {
+        not_modified = etag_list_matches(request.header("if-none-match"), etag);
+    } else if (request.has_header("if-modified-since") &&
+               parse_http_date(request.header("if-modified-since"), since)) {
+        not_modified = modified <= since;
+    }
+    if (not_modified) {
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+        conn.response_status = 304;
+        std::string& out = conn.output_buffer();
+        append_status_line(out, 304);
+        out += date_header();
+        if (compressible) {
+            out += "Vary: Accept-Encoding\r\n";
+        }
+        append_validators(out, etag, modified);
+        out += connection_headers();
+        if (verbose) {
+            log_request(thread_id, arena.join({"Response: 304 Not Modified (", filename, ")"}));
+        }
         return;
     }
     
-    // Read file
-    std::string content;
-    bool is_binary = false;
-    std::string ext = get_file_extension(filepath);
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    // If-Range: a changed file is sent whole instead
+    if (ranged && if_range_holds(request.header("if-range"), etag, modified)) {
+        size_t total = cached ? cached->body.size() : bundled ? asset.identity.body.size() : file_size;
+        ByteRange ranges[MAX_RANGES];
+        size_t range_count = 0;
+        RangeResult result = parse_ranges(request.header("range"), total, ranges, range_count);
+        if (result != RangeResult::IGNORE) {
+            if (result == RangeResult::UNSATISFIABLE) {
+                if (file_fd >= 0) {
+                    close(file_fd);
+                }
+                conn.response_status = 416;
+                std::string& out = conn.output_buffer();
+                append_status_line(out, 416);
+                out += date_header();
+                out += "Content-Length: 0\r\nContent-Range: bytes */";
+                out += std::to_string(total);
+                out += "\r\n";
+                append_range_validators(out, compressible, etag, modified);
+                out += connection_headers();
+            } else if (bundled) {
+                send_ranges(conn, ranges, range_count, bundle, asset.identity.body.data(), -1, total, content_type,
+                            filename, compressible, etag, modified);
+            } else {
+                send_ranges(conn, ranges, range_count, cached, cached ? cached->body.data() : nullptr, file_fd,
+                            total, content_type, filename, compressible, etag, modified);
+            }
+            if (verbose) {
+                log_request(thread_id, arena.join({"Response: ", arena.number(conn.response_status), " (", filename,
+                                                   ", ", arena.number(range_count), " ranges of ",
+                                                   arena.number(total), " bytes)"}));
+            }
+            return;
+        }
+    }
     
-    if (ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "txt") {
-        content = read_file(filepath, true);
-        is_binary = true;
+    // Build and send response
+    conn.response_status = 200;
+    std::string& out = conn.output_buffer();
+    size_t header_start = out.size();
+    if (bundled) {
+        file_size = form->body.size();
+        append_status_line(out, 200);
+        out += date_header();
+        out += form->header;
+        out += connection_headers();
+        conn.queue_shared(bundle, form->body.data(), file_size);
+    } else if (cached) {
+        const std::string& body = variant ? variant->body : cached->body;
+        file_size = body.size();
+        append_status_line(out, 200);
+        out += date_header();
+        out += variant ? variant->header : cached->header;
+        out += connection_headers();
+        conn.queue_shared(cached, body.data(), file_size);
     } else {
-        content = read_file(filepath, false);
+        append_status_line(out, 200);
+        out += date_header();
+        append_entity_headers(out, content_type, file_size, filename);
+        if (encoding != Encoding::COUNT) {
+            append_encoding_headers(out, encoding);
+        } else if (compressible) {
+            out += "Vary: Accept-Encoding\r\n";
+        }
+        append_validators(out, etag, modified);
+        if (encoding == Encoding::COUNT) {
+            out += "Accept-Ranges: bytes\r\n";
+        }
+        out += connection_headers();
+        conn.queue_file(file_fd, 0, file_size);
     }
+    // Handed to the connection; a client that goes away early receives less
+    size_t bytes_queued = out.size() - header_start + file_size;
     
-    if (content.empty()) {
-        log_request(thread_id, "Error reading file: " + filepath);
-        send_error_response(client_socket, 500, "Internal Server Error");
+    if (!verbose) {
         return;
     }
-    
-    // Get filename for Content-Disposition
-    std::string filename = std::filesystem::path(filepath).filename().string();
-    
-    // Build response
-    std::string content_type = get_content_type(filepath);
-    std::string response = build_response(200, content_type, content, filename);
-    
-    // Send response
-    ssize_t bytes_sent = send(client_socket, response.c_str(), response.length(), 0);
-    
+    std::string_view coding = encoding != Encoding::COUNT ? arena.join({", ", encoding_token(encoding)}) : "";
     if (is_binary) {
-        log_request(thread_id, "Sending binary file: " + filename + " (" + std::to_string(content.length()) + " bytes)");
+        log_request(thread_id, arena.join({"Sending binary file: ", filename, " (", arena.number(file_size), " bytes",
+                                           coding, ")"}));
     } else {
-        log_request(thread_id, "Sending HTML file: " + filename + " (" + std::to_string(content.length()) + " bytes)");
+        log_request(thread_id, arena.join({"Sending HTML file: ", filename, " (", arena.number(file_size), " bytes",
+                                           coding, ")"}));
     }
     
-    log_request(thread_id, "Response: 200 OK (" + std::to_string(bytes_sent) + " bytes transferred)");
+    log_request(thread_id, arena.join({"Response: 200 OK (", arena.number(bytes_queued), " bytes queued)"}));
     log_request(thread_id, "Connection: keep-alive");
 }
 
-void HTTPServer::handle_post_request(int client_socket, const HTTPRequest& request) {
-    std::string thread_id = "Thread-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()) % 1000);
+// One file range: borrowed from the cache entry or bundle, or sent from the
+// descriptor with sendfile() at an offset (the chunk takes ownership of file_fd)
+static void queue_range(Connection& conn, const std::shared_ptr<const void>& owner, const char* body, int file_fd,
+                        const ByteRange& range) {
+    if (body) {
+        conn.queue_shared(owner, body + range.first, range.length);
+    } else {
+        conn.queue_file(file_fd, static_cast<off_t>(range.first), range.length);
+    }
+}
+
+void HTTPServer::send_ranges(Connection& conn, const ByteRange* ranges, size_t count,
+                             const std::shared_ptr<const void>& owner, const char* body, int file_fd, size_t total,
+                             std::string_view content_type, std::string_view filename, bool compressible,
+                             std::string_view etag, time_t modified) {
+    if (count == 1) {
+        conn.response_status = 206;
+        std::string& out = conn.output_buffer();
+        append_status_line(out, 206);
+        out += date_header();
+        append_entity_headers(out, content_type, ranges[0].length, filename);
+        append_content_range(out, ranges[0], total);
+        append_range_validators(out, compressible, etag, modified);
+        out += connection_headers();
+        queue_range(conn, owner, body, file_fd, ranges[0]);
+        return;
+    }
     
-    log_request(thread_id, "Request: " + request.method + " " + request.path + " " + request.version);
+    // multipart/byteranges: every file part is a separate sendfile() range
+    // and each queued range owns its descriptor
+    int part_fds[MAX_RANGES];
+    for (size_t i = 0; i < count; i++) {
+        part_fds[i] = file_fd < 0 || i == count - 1 ? file_fd : dup(file_fd);
+        if (part_fds[i] < 0 && file_fd >= 0) {
+            log_request(thread_tag(), "Error duplicating file descriptor: " + std::string(strerror(errno)),
+                        LogLevel::ERROR);
+            for (size_t j = 0; j < i; j++) {
+                close(part_fds[j]);
+            }
+            close(file_fd);
+            send_error_response(conn, 500, "Internal Server Error");
+            return;
+        }
+    }
     
-    // Validate host header
-    if (!validate_host_header(request.headers)) {
-        log_request(thread_id, "Host validation failed");
-        send_error_response(client_socket, 403, "Forbidden: Invalid Host header");
-        return;
+    static thread_local std::mt19937_64 generator{std::random_device{}()};
+    char boundary[17];
+    snprintf(boundary, sizeof(boundary), "%016llx", static_cast<unsigned long long>(generator()));
+    
+    std::string part_heads[MAX_RANGES];
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+        std::string& head = part_heads[i];
+        head = "\r\n--";
+        head += boundary;
+        head += "\r\nContent-Type: ";
+        head += content_type;
+        head += "\r\n";
+        append_content_range(head, ranges[i], total);
+        head += "\r\n";
+        length += head.size() + ranges[i].length;
+    }
+    std::string closing = std::string("\r\n--") + boundary + "--\r\n";
+    length += closing.size();
+    
+    conn.response_status = 206;
+    std::string& out = conn.output_buffer();
+    append_status_line(out, 206);
+    out += date_header();
+    append_entity_headers(out, std::string("multipart/byteranges; boundary=") + boundary, length);
+    append_range_validators(out, compressible, etag, modified);
+    out += connection_headers();
+    for (size_t i = 0; i < count; i++) {
+        conn.queue(part_heads[i]);
+        queue_range(conn, owner, body, part_fds[i], ranges[i]);
+    }
+    conn.queue(closing);
+}
+
+void HTTPServer::handle_metrics_request(Connection& conn, const HTTPRequest&) {
+    // A scrape allocates freely; its own allocations are left out of the totals
+    uint64_t scrape_start = AllocStats::thread_allocations();
+    std::string body;
+    body.reserve(16384);
+    metrics.render(body);
+    
+    auto gauge = [&body](const std::string& name, const std::string& help, uint64_t value) {
+        body += "# HELP " + name + " " + help + "\n# TYPE " + name + " gauge\n";
+        body += name + " " + std::to_string(value) + "\n";
+    };
+    auto counter = [&body](const std::string& name, const std::string& help, uint64_t value) {
+        body += "# HELP " + name + " " + help + "\n# TYPE " + name + " counter\n";
+        body += name + " " + std::to_string(value) + "\n";
+    };
+    
+    gauge("http_active_connections", "Open client connections.", active_connections.load());
+    if (io_model == IOModel::THREAD_POOL && shards == 0) {
+        gauge("http_connection_queue_depth", "Accepted connections waiting for a worker.", worker_pool.queued());
+        gauge("http_admission_limit", "Queued connections allowed before new ones are refused.",
+              worker_pool.admission_limit());
+        gauge("http_queue_delay_overloaded",
+              "1 while the shortest accept-to-worker delay of the last interval is over target.",
+              worker_pool.overloaded() ? 1 : 0);
+        counter("http_worker_steals_total", "Connections a worker took from another worker's queue.",
+                worker_pool.steals());
     }
     
-    // Check Content-Type
-    auto content_type_it = request.headers.find("content-type");
-    if (content_type_it == request.headers.end() || 
-        content_type_it->second.find("application/json") == std::string::npos) {
-        log_request(thread_id, "Invalid Content-Type: " + 
-                   (content_type_it != request.headers.end() ? content_type_it->second : "missing"));
-        send_error_response(client_socket, 415, "Unsupported Media Type");
-        return;
+    if (shards > 0) {
+        body += "# HELP http_event_loop_accepted_total Connections accepted by each shard's listener.\n"
+                "# TYPE http_event_loop_accepted_total counter\n";
+        for (size_t i = 0; i < event_loops.size(); i++) {
+            body += "http_event_loop_accepted_total{loop=\"" + std::to_string(i) + "\"} " +
+                    std::to_string(event_loops[i]->get_stats().accepted.load()) + "\n";
+        }
+    }
+    if (!event_loops.empty()) {
+        body += "# HELP http_event_loop_active_connections Open connections per event loop.\n"
+                "# TYPE http_event_loop_active_connections gauge\n";
+        for (size_t i = 0; i < event_loops.size(); i++) {
+            body += "http_event_loop_active_connections{loop=\"" + std::to_string(i) + "\"} " +
+                    std::to_string(event_loops[i]->get_stats().active.load()) + "\n";
+        }
     }
     
-    // Validate JSON (simple validation)
-    if (!is_valid_json(request.body)) {
-        log_request(thread_id, "Invalid JSON data");
-        send_error_response(client_socket, 400, "Bad Request: Invalid JSON");
-        return;
+    if (file_cache.enabled()) {
+        FileCache::Stats stats = file_cache.get_stats();
+        counter("http_file_cache_hits_total", "Static file cache hits.", stats.hits);
+        counter("http_file_cache_misses_total", "Static file cache misses.", stats.misses);
+        counter("http_file_cache_evictions_total", "Entries evicted to stay within the cache budget.", stats.evictions);
+        counter("http_file_cache_invalidations_total", "Entries dropped because the file changed.", stats.invalidations);
+        gauge("http_file_cache_entries", "Files currently cached.", stats.entries);
+        gauge("http_file_cache_bytes", "Bytes currently held by the cache.", stats.bytes);
     }
     
-    // Generate filename
-    std::string filename = generate_upload_filename();
-    std::string filepath = "http-server-cpp/resources/uploads/" + filename;
+    if (upload_sync.get_policy() != SyncPolicy::NONE) {
+        const UploadSync::Stats& sync_stats = upload_sync.get_stats();
+        counter("http_upload_synced_files_total", "Uploads made durable (fdatasync).", sync_stats.files.load());
+        counter("http_upload_sync_batches_total", "Background upload sync batches: one directory fsync each.", sync_stats.batches.load());
+    }
     
-    // Write file
-    if (!write_file(filepath, request.body)) {
-        log_request(thread_id, "Error writing file: " + filepath);
-        send_error_response(client_socket, 500, "Internal Server Error");
-        return;
+    if (http2) {
+        counter("http2_connections_total", "Connections that switched to HTTP/2.", http2_connections.load());
     }
     
-    // Build success response
-    std::string response_body = "{\n";
-    response_body += "  \"status\": \"success\",\n";
-    response_body += "  \"message\": \"File created successfully\",\n";
-    response_body += "  \"filepath\": \"/uploads/" + filename + "\"\n";
-    response_body += "}";
+    if (rate_limiter.enabled()) {
+        RateLimiter::Stats limiter = rate_limiter.get_stats();
+        body += "# HELP http_rate_limited_total Requests (or connections, on accept) refused with 429, by bucket.\n"
+                "# TYPE http_rate_limited_total counter\n";
+        body += "http_rate_limited_total{scope=\"request\"} " +
+                std::to_string(limiter.limited[static_cast<int>(RateLimiter::Scope::REQUEST)]) + "\n";
+        body += "http_rate_limited_total{scope=\"upload\"} " +
+                std::to_string(limiter.limited[static_cast<int>(RateLimiter::Scope::UPLOAD)]) + "\n";
+        counter("http_rate_limit_buckets_created_total", "Client buckets set up, in free or reused slots.",
+                limiter.created);
+        counter("http_rate_limit_buckets_displaced_total",
+                "Buckets still in use dropped for lack of room; the table is too small if this grows.",
+                limiter.displaced);
+    }
     
-    std::string response = build_response(201, "application/json", response_body);
+    gauge("io_buffer_pool_buffers", "Pooled 16 KiB receive/arena buffers allocated, in use or cached.",
+          BufferPool::live());
     
-    send(client_socket, response.c_str(), response.length(), 0);
+    Logger::Stats log_stats = logger.get_stats();
+    counter("log_lines_total", "Log lines accepted by the logger.", log_stats.logged);
+    counter("log_lines_dropped_total", "Log lines dropped because a thread's buffer was full.", log_stats.dropped);
     
-    log_request(thread_id, "File created: " + filepath);
-    log_request(thread_id, "Response: 201 Created");
+    if (AllocStats::enabled) {
+        uint64_t scraping = scrape_allocations.load() + (AllocStats::thread_allocations() - scrape_start);
+        counter("process_allocations_total", "Heap allocations by the whole process, /metrics scrapes excluded.",
+                AllocStats::total_allocations() - scraping);
+    }
+    send_response(conn, 200, "text/plain; version=0.0.4; charset=utf-8", body);
+    scrape_allocations += AllocStats::thread_allocations() - scrape_start;
 }
 
 bool HTTPServer::should_keep_alive(const HTTPRequest& request) {
-    auto connection_it = request.headers.find("connection");
-    if (connection_it != request.headers.end()) {
-        std::string connection_value = connection_it->second;
-        std::transform(connection_value.begin(), connection_value.end(), connection_value.begin(), ::tolower);
-        return connection_value == "keep-alive";
+    if (request.has_header("connection")) {
+        std::string_view connection_value = request.header("connection");
+        return connection_value.size() == 10 && strncasecmp(connection_value.data(), "keep-alive", 10) == 0;
     }
     
     // Default behavior based on HTTP version
     return request.version == "HTTP/1.1";
 }
 
-void HTTPServer::handle_client(int client_socket) {
-    std::string thread_id = "Thread-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()) % 1000);
+void HTTPServer::process_input(Connection& conn) {
+    const std::string& thread_id = thread_tag();
+    
+    if (conn.h2) {
+        conn.h2->on_input(conn);
+        return;
+    }
     
-    char buffer[8192];
-    int request_count = 0;
-    const int MAX_REQUESTS_PER_CONNECTION = 100;
+    // HTTP/2 with prior knowledge: the client preface instead of a request line
+    if (http2 && conn.request_count == 0 && !conn.h2_stream && !conn.in.empty() && conn.in.data()[0] == 'P') {
+        std::string_view preface = H2Session::PREFACE;
+        size_t length = std::min(conn.in.size(), preface.size());
+        if (std::memcmp(conn.in.data(), preface.data(), length) == 0) {
+            if (length < preface.size()) {
+                conn.enter_phase(Connection::Phase::HEADER);
+                return;
+            }
+            conn.h2 = std::make_unique<H2Session>(*this, http2_limits);
+            http2_connections++;
+            log_request(thread_id, "HTTP/2 connection (prior knowledge)");
+            conn.h2->start(conn);
+            conn.h2->on_input(conn);
+            return;
+        }
+    }
     
-    while (running && request_count < MAX_REQUESTS_PER_CONNECTION) {
-        ssize_t bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+    // Handle every complete request already buffered; a partial one stays in conn.in
+    while (!conn.close_after_write) {
+        if (conn.upload) {
+            // Mid-upload: everything up to the end of the body belongs to it
+            if (!stream_upload(conn)) {
+                break;
+            }
+            continue;
+        }
         
-        if (bytes_received <= 0) {
+        HTTPRequest request;
+        uint64_t allocations_start = AllocStats::thread_allocations();
+        uint64_t parse_start = Metrics::now_ns();
+        HTTPParser::Result result = conn.parser.parse(conn.in.data(), conn.in.size(), request);
+        conn.parse_ns += Metrics::now_ns() - parse_start;
+        
+        if (result == HTTPParser::Result::INCOMPLETE) {
+            conn.enter_phase(conn.in.empty() ? Connection::Phase::IDLE : Connection::Phase::HEADER);
+            if (conn.in.size() > max_header_bytes) {
+                reject_request(conn, request, 431, "Request Header Fields Too Large", "Request header too large");
+            }
+            break;
+        }
+        if (result == HTTPParser::Result::ERROR) {
+            if (conn.parser.error() == HTTPParser::Error::TOO_MANY_HEADERS) {
+                reject_request(conn, request, 431, "Request Header Fields Too Large", "Too many request headers");
+            } else if (conn.parser.error() == HTTPParser::Error::BAD_FRAMING) {
+                reject_request(conn, request, 400, "Bad Request", "Unsupported or conflicting Transfer-Encoding");
+            } else {
+                reject_request(conn, request, 400, "Bad Request", "Malformed request");
+            }
+            break;
+        }
+        
+        if (request.header_length > max_header_bytes) {
+            reject_request(conn, request, 431, "Request Header Fields Too Large", "Request header too large");
             break;
         }
         
-        buffer[bytes_received] = '\0';
-        std::string request_data(buffer);
+        if (request.content_length > max_body_bytes) {
+            reject_request(conn, request, 413, "Payload Too Large",
+                           "Request body too large: " + std::to_string(request.content_length) + " bytes");
+            break;
+        }
+        
+        if (http2 && !conn.h2_stream && request.has_header("http2-settings") && upgrade_http2(conn, request)) {
+            return;
+        }
+        
+        // Registered routes take precedence; a POST nobody registered is an upload
+        const Router::Route* target = router.find(request.method_id, request.path);
+        bool upload = request.method_id == HttpMethod::POST && !target;
+        
+        // Charged as soon as the head is in, so a refused request costs no body
+        if (rate_limiter.enabled() && conn.peer_address != 0 && rate_limited(conn, request, target, upload)) {
+            // Its parse time is its own, not the next request's
+            metrics.record_parse(conn.parse_ns);
+            conn.parse_ns = 0;
+            size_t request_end = request.header_length + request.content_length;
+            if (request.chunked || conn.in.size() < request_end) {
+                // The rest of the body would be read as the next request
+                conn.close_after_write = true;
+                break;
+            }
+            bool keep_alive = should_keep_alive(request);
+            conn.in.consume(request_end);
+            complete_request(conn, keep_alive);
+            continue;
+        }
+        
+        // Upload bodies go to disk as they arrive rather than being buffered whole
+        if (upload) {
+            begin_upload(conn, request);
+            continue;
+        }
+        
+        // Head is complete; wait until the whole body has arrived too
+        size_t request_end;
+        if (request.chunked) {
+            ChunkedDecoder::Result body_result = conn.chunked.decode(conn.in.data(), conn.in.size(),
+                                                                     request.header_length, max_body_bytes);
+            if (body_result == ChunkedDecoder::Result::TOO_LARGE) {
+                reject_request(conn, request, 413, "Payload Too Large", "Chunked request body too large");
+                break;
+            }
+            if (body_result == ChunkedDecoder::Result::ERROR) {
+                reject_request(conn, request, 400, "Bad Request", "Malformed chunked body");
+                break;
+            }
+            if (body_result == ChunkedDecoder::Result::INCOMPLETE) {
+                conn.enter_phase(Connection::Phase::BODY);
+                send_continue(conn, request);
+                break;
+            }
+            request_end = conn.chunked.consumed();
+            request.body = std::string_view(conn.in.data() + request.header_length, conn.chunked.body_length());
+        } else {
+            request_end = request.header_length + request.content_length;
+            if (conn.in.size() < request_end) {
+                // Size the buffer once for the whole body instead of growing per read
+                conn.in.reserve(request_end);
+                conn.enter_phase(Connection::Phase::BODY);
+                send_continue(conn, request);
+                break;
+            }
+            request.body = std::string_view(conn.in.data() + request.header_length, request.content_length);
+        }
         
-        HTTPRequest request = parse_request(request_data);
+        Metrics::Method method = Metrics::method_of(request.method_id);
+        Metrics::Route route = target ? target->label : Metrics::Route::OTHER;
+        size_t pending_before = conn.pending_bytes();
+        uint64_t handler_start = Metrics::now_ns();
+        conn.response_status = 0;
         
-        if (request.method == "GET") {
-            handle_get_request(client_socket, request);
-        } else if (request.method == "POST") {
-            handle_post_request(client_socket, request);
+        if (target && target->kind == Router::Kind::HANDLER) {
+            // In-process handlers are held to the same Host check as files
+            if (validate_host_header(request)) {
+                target->handler(conn, request);
+            } else {
+                log_request(thread_id, "Host validation failed", LogLevel::WARN);
+                send_error_response(conn, 403, "Forbidden: Invalid Host header");
+            }
+        } else if (request.method_id == HttpMethod::GET) {
+            route = Metrics::Route::STATIC;
+            handle_get_request(conn, request, target);
         } else {
-            log_request(thread_id, "Unsupported method: " + request.method);
-            send_error_response(client_socket, 405, "Method Not Allowed");
+            log_request(thread_id, conn.arena.join({"Unsupported method: ", request.method}), LogLevel::INFO);
+            send_error_response(conn, 405, "Method Not Allowed");
         }
         
-        total_requests++;
-        request_count++;
+        metrics.record_request(method, route, conn.response_status, Metrics::now_ns() - handler_start,
+                               conn.pending_bytes() - pending_before, conn.request_count > 0);
+        metrics.record_parse(conn.parse_ns);
+        conn.parse_ns = 0;
         
-        // Check if connection should be kept alive
-        if (!should_keep_alive(request)) {
-            break;
+        bool keep_alive = should_keep_alive(request);
+        // Views into conn.in are dead from here on
+        conn.in.consume(request_end);
+        complete_request(conn, keep_alive);
+        if (AllocStats::enabled && route != Metrics::Route::METRICS) {
+            metrics.record_allocations(AllocStats::thread_allocations() - allocations_start);
         }
     }
+}
+
+void HTTPServer::complete_request(Connection& conn, bool keep_alive) {
+    conn.request_count++;
     
-    close(client_socket);
-    active_connections--;
-    
-    if (request_count >= MAX_REQUESTS_PER_CONNECTION) {
-        log_request(thread_id, "Connection closed: reached max requests limit");
-    } else {
-        log_request(thread_id, "Connection closed");
+    // Check if connection should be kept alive
+    if (!keep_alive || conn.request_count >= MAX_REQUESTS_PER_CONNECTION || draining) {
+        conn.close_after_write = true;
     }
+    
+    conn.parser.reset();
+    conn.chunked.reset();
+    conn.continue_sent = false;
+    conn.arena.reset();
+    conn.enter_phase(Connection::Phase::IDLE);
 }
 
-void HTTPServer::worker_thread() {
-    std::string thread_id = "Thread-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()) % 1000);
-    
-    while (running) {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        queue_cv.wait(lock, [this] { return !connection_queue.empty() || !running; });
-        
-        if (!running) {
-            break;
+// True if the comma-separated `list` contains `token` (case-insensitive)
+static bool has_token(std::string_view list, std::string_view token) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) {
+            item.remove_prefix(1);
         }
-        
-        int client_socket = connection_queue.front();
-        connection_queue.pop();
-        lock.unlock();
-        
-        active_connections++;
-        log_request(thread_id, "Connection from client assigned");
-        
-        handle_client(client_socket);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) {
+            item.remove_suffix(1);
+        }
+        if (item.size() == token.size() && strncasecmp(item.data(), token.data(), token.size()) == 0) {
+            return true;
+        }
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
     }
+    return false;
 }
 
-bool HTTPServer::start() {
-    // Create socket
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket < 0) {
-        log_message("Error creating socket");
+bool HTTPServer::upgrade_http2(Connection& conn, const HTTPRequest& request) {
+    // Only a request without a body and with nothing pipelined behind it:
+    // the client sends its preface once it has seen the 101. Anything else
+    // is simply answered over HTTP/1.1
+    if (!has_token(request.header("upgrade"), "h2c") || request.chunked || request.content_length > 0 ||
+        conn.in.size() != request.header_length) {
         return false;
     }
     
-    // Set socket options
-    int opt = 1;
-    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        log_message("Error setting socket options");
-        close(server_socket);
+    // The request is answered as stream 1 from a copy; conn.in is consumed after
+    std::string head(conn.in.data(), request.header_length);
+    std::string settings(request.header("http2-settings"));
+    auto session = std::make_unique<H2Session>(*this, http2_limits);
+    if (!session->start_upgraded(conn, head, settings)) {
+        log_request(thread_tag(), "Invalid HTTP2-Settings, staying on HTTP/1.1", LogLevel::INFO);
         return false;
     }
-    
-    // Bind socket
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = inet_addr(host.c_str());
-    address.sin_port = htons(port);
-    
-    if (bind(server_socket, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        log_message("Error binding socket");
-        close(server_socket);
-        return false;
+    conn.h2 = std::move(session);
+    http2_connections++;
+    log_request(thread_tag(), "HTTP/2 connection (upgrade)");
+    metrics.record_parse(conn.parse_ns);
+    conn.parse_ns = 0;
+    conn.in.consume(request.header_length);
+    conn.parser.reset();
+    conn.enter_phase(Connection::Phase::HEADER);
+    return true;
+}
+
+// Marks a streamed upload as failed; the rest of its body is drained unread
+static void fail_upload(UploadStream& upload, int status_code, const std::string& message) {
+    if (upload.error_status == 0) {
+        upload.error_status = status_code;
+        upload.error_message = message;
     }
-    
-    // Listen for connections
-    if (listen(server_socket, 50) < 0) {
-        log_message("Error listening on socket");
-        close(server_socket);
-        return false;
+    upload.file.discard();
+}
+
+void HTTPServer::begin_upload(Connection& conn, const HTTPRequest& request) {
+    const std::string& thread_id = thread_tag();
+    uint64_t handler_start = Metrics::now_ns();
+    metrics.record_parse(conn.parse_ns);
+    conn.parse_ns = 0;
+    
+    if (logger.enabled(LogLevel::DEBUG)) {
+        log_request(thread_id, "Request: " + std::string(request.method) + " " + std::string(request.path) + " " + std::string(request.version));
     }
     
-    running = true;
+    auto upload = std::make_unique<UploadStream>();
+    upload->chunked = request.chunked;
+    upload->remaining = request.content_length;
+    upload->keep_alive = should_keep_alive(request);
+    upload->validator.set_limits(json_max_depth, 0);
     
-    // Start worker threads
-    for (int i = 0; i < max_threads; i++) {
-        thread_pool.emplace_back(&HTTPServer::worker_thread, this);
+    // Validate host header
+    std::string_view content_type = request.header("content-type");
+    if (!validate_host_header(request)) {
+        log_request(thread_id, "Host validation failed", LogLevel::WARN);
+        fail_upload(*upload, 403, "Forbidden: Invalid Host header");
+    } else if (content_type.find("application/json") == std::string_view::npos) {
+        log_request(thread_id, "Invalid Content-Type: " + 
+                   (request.has_header("content-type") ? std::string(content_type) : std::string("missing")),
+                   LogLevel::INFO);
+        fail_upload(*upload, 415, "Unsupported Media Type");
+    } else if (upload_dir_fd < 0 || !upload->file.open(upload_dir_fd)) {
+        log_request(thread_id, "Error creating upload file: " + std::string(strerror(errno)), LogLevel::ERROR);
+        fail_upload(*upload, 500, "Internal Server Error");
     }
     
-    log_message("HTTP Server started on http://" + host + ":" + std::to_string(port));
-    log_message("Thread pool size: " + std::to_string(max_threads));
-    log_message("Serving files from 'resources' directory");
-    log_message("Press Ctrl+C to stop the server");
+    std::string_view expect = request.header("expect");
+    if (upload->error_status != 0 && expect.size() == 12 && strncasecmp(expect.data(), "100-continue", 12) == 0) {
+        // The client is holding the body back for our answer: give the final
+        // one now and close instead of waiting for a body that may never come
+        upload->remaining = 0;
+        upload->chunked = false;
+        upload->keep_alive = false;
+    } else {
+        send_continue(conn, request);
+    }
     
-    return true;
+    // The head is no longer needed; from here on conn.in holds only body bytes
+    conn.in.consume(request.header_length);
+    conn.parser.reset();
+    conn.enter_phase(Connection::Phase::BODY);
+    upload->handler_ns = Metrics::now_ns() - handler_start;
+    conn.upload = std::move(upload);
 }
 
-void HTTPServer::stop() {
+bool HTTPServer::stream_upload(Connection& conn) {
+    UploadStream& upload = *conn.upload;
+    uint64_t handler_start = Metrics::now_ns();
+    bool complete;
+    
+    if (upload.chunked) {
+        ChunkedDecoder::Result result = conn.chunked.decode(conn.in.data(), conn.in.size(), 0, max_body_bytes);
+        if (result == ChunkedDecoder::Result::TOO_LARGE || result == ChunkedDecoder::Result::ERROR) {
+            // Framing is lost, so the connection cannot be reused
+            bool too_large = result == ChunkedDecoder::Result::TOO_LARGE;
+            log_request(thread_tag(), too_large ? "Chunked request body too large" : "Malformed chunked body",
+                        LogLevel::INFO);
+            size_t pending_before = conn.pending_bytes();
+            send_error_response(conn, too_large ? 413 : 400, too_large ? "Payload Too Large" : "Bad Request");
+            metrics.record_response(Metrics::Method::POST, Metrics::Route::UPLOAD, conn.response_status,
+                                    conn.pending_bytes() - pending_before, conn.request_count > 0);
+            conn.upload.reset();
+            conn.close_after_write = true;
+            return false;
+        }
+        // Decoded bytes sit at the front of the buffer; hand them over and drop them
+        write_upload(upload, conn.in.data(), conn.chunked.body_length());
+        size_t used = conn.chunked.consumed();
+        conn.chunked.release();
+        conn.in.consume(used);
+        complete = result == ChunkedDecoder::Result::COMPLETE;
+    } else {
+        size_t take = std::min(upload.remaining, conn.in.size());
+        write_upload(upload, conn.in.data(), take);
+        conn.in.consume(take);
+        upload.remaining -= take;
+        complete = upload.remaining == 0;
+    }
+    
+    upload.handler_ns += Metrics::now_ns() - handler_start;
+    if (!complete) {
+        return false;
+    }
+    finish_upload(conn);
+    return true;
+}
+
+void HTTPServer::reject_json(UploadStream& upload) {
+    if (upload.validator.error() == JsonValidator::Error::TOO_DEEP) {
+        log_request(thread_tag(), "JSON nested too deeply", LogLevel::INFO);
+        fail_upload(upload, 400, "Bad Request: JSON nested too deeply");
+    } else {
+        log_request(thread_tag(), "Invalid JSON data", LogLevel::INFO);
+        fail_upload(upload, 400, "Bad Request: Invalid JSON");
+    }
+}
+
+void HTTPServer::write_upload(UploadStream& upload, const char* data, size_t length) {
+    upload.bytes += length;
+    if (upload.error_status != 0 || length == 0) {
+        return;
+    }
+    if (!upload.validator.feed(data, length)) {
+        reject_json(upload);
+        return;
+    }
+    if (!upload.file.write(data, length)) {
+        log_request(thread_tag(), "Error writing upload: " + std::string(strerror(errno)), LogLevel::ERROR);
+        fail_upload(upload, 500, "Internal Server Error");
+    }
+}
+
+void HTTPServer::finish_upload(Connection& conn) {
+    const std::string& thread_id = thread_tag();
+    UploadStream& upload = *conn.upload;
+    uint64_t handler_start = Metrics::now_ns();
+    size_t pending_before = conn.pending_bytes();
+    conn.response_status = 0;
+    
+    if (upload.error_status == 0 && !upload.validator.finish()) {
+        reject_json(upload);
+    }
+    
+    if (upload.error_status == 0) {
+        // Names carry a random suffix; retry the rare collision
+        std::string filename;
+        bool published = false;
+        for (int attempt = 0; attempt < 4 && !published; attempt++) {
+            filename = generate_upload_filename(attempt > 0);
+            published = upload_sync.publish(upload.file, filename);
+            if (!published && errno != EEXIST) {
+                break;
+            }
+        }
+        
+        if (!published) {
+            log_request(thread_id, "Error writing file: " + filename + ": " + strerror(errno), LogLevel::ERROR);
+            fail_upload(upload, 500, "Internal Server Error");
+        } else {
+            std::string response_body = "{\n";
+            response_body += "  \"status\": \"success\",\n";
+            response_body += "  \"message\": \"File created successfully\",\n";
+            response_body += "  \"filepath\": \"/uploads/" + filename + "\"\n";
+            response_body += "}";
+            
+            send_response(conn, 201, "application/json", response_body);
+            
+            log_request(thread_id, "File created: http-server-cpp/resources/uploads/" + filename +
+                        " (" + std::to_string(upload.bytes) + " bytes)");
+            log_request(thread_id, "Response: 201 Created");
+        }
+    }
+    
+    if (upload.error_status != 0) {
+        send_error_response(conn, upload.error_status, upload.error_message);
+    }
+    
+    metrics.record_request(Metrics::Method::POST, Metrics::Route::UPLOAD, conn.response_status,
+                           upload.handler_ns + (Metrics::now_ns() - handler_start),
+                           conn.pending_bytes() - pending_before, conn.request_count > 0);
+    
+    bool keep_alive = upload.keep_alive;
+    conn.upload.reset();
+    complete_request(conn, keep_alive);
+}
+
+void HTTPServer::reject_request(Connection& conn, const HTTPRequest& request, int status_code,
+                                const std::string& message, const std::string& reason) {
+    log_request(thread_tag(), reason, LogLevel::INFO);
+    size_t pending_before = conn.pending_bytes();
+    send_error_response(conn, status_code, message);
+    metrics.record_response(Metrics::method_of(request.method_id), Metrics::Route::OTHER, status_code,
+                            conn.pending_bytes() - pending_before, conn.request_count > 0);
+    conn.close_after_write = true;
+}
+
+// Charges the request to its client's buckets. A refused one is answered
+// with 429 and how long until the client may try again
+bool HTTPServer::rate_limited(Connection& conn, const HTTPRequest& request, const Router::Route* target,
+                              bool upload) {
+    static constexpr std::string_view BODY = "{\"error\": \"Too Many Requests\"}";
+    uint32_t retry_after_s = 1;
+    // An upload is charged to the request bucket only once the upload bucket
+    // has let it through, so a client over its upload rate keeps its other
+    // requests' allowance
+    bool admitted = upload ? rate_limiter.would_admit(RateLimiter::Scope::REQUEST, conn.peer_address, retry_after_s) &&
+                                 rate_limiter.admit(RateLimiter::Scope::UPLOAD, conn.peer_address, retry_after_s) &&
+                                 rate_limiter.admit(RateLimiter::Scope::REQUEST, conn.peer_address, retry_after_s)
+                           : rate_limiter.admit(RateLimiter::Scope::REQUEST, conn.peer_address, retry_after_s);
+    if (admitted) {
+        return false;
+    }
+    
+    log_request(thread_tag(), "Client over its request rate, refused");
+    size_t pending_before = conn.pending_bytes();
+    conn.response_status = 429;
+    std::string& out = conn.output_buffer();
+    append_status_line(out, 429);
+    out += date_header();
+    append_entity_headers(out, "application/json", BODY.size());
+    out += "Retry-After: ";
+    out += std::to_string(retry_after_s);
+    out += "\r\n";
+    out += connection_headers();
+    out += BODY;
+    
+    Metrics::Route route = upload ? Metrics::Route::UPLOAD
+                           : target ? target->label
+                           : request.method_id == HttpMethod::GET ? Metrics::Route::STATIC
+                           : Metrics::Route::OTHER;
+    metrics.record_response(Metrics::method_of(request.method_id), route, 429, conn.pending_bytes() - pending_before,
+                            conn.request_count > 0);
+    return true;
+}
+
+void HTTPServer::send_continue(Connection& conn, const HTTPRequest& request) {
+    // Clients such as curl hold large bodies back until they see this
+    if (conn.continue_sent || request.version != "HTTP/1.1") {
+        return;
+    }
+    std::string_view expect = request.header("expect");
+    if (expect.size() == 12 && strncasecmp(expect.data(), "100-continue", 12) == 0) {
+        std::string& out = conn.output_buffer();
+        append_status_line(out, 100);
+        out += "\r\n";
+        conn.continue_sent = true;
+    }
+}
+
+void HTTPServer::on_connection_opened(Connection&) {
+    active_connections++;
+    metrics.record_connection();
+}
+
+void HTTPServer::on_connection_closed(Connection& conn) {
+    const std::string& thread_id = thread_tag();
+    
+    active_connections--;
+    
+    if (conn.request_count >= MAX_REQUESTS_PER_CONNECTION) {
+        log_request(thread_id, "Connection closed: reached max requests limit");
+    } else {
+        log_request(thread_id, "Connection closed");
+    }
+}
+
+void HTTPServer::on_timeout(Connection& conn, Connection::Phase kind) {
+    const char* name = "idle";
+    Metrics::Timeout metric = Metrics::Timeout::IDLE;
+    if (kind == Connection::Phase::HEADER) {
+        name = "header";
+        metric = Metrics::Timeout::HEADER;
+    } else if (kind == Connection::Phase::BODY) {
+        name = "body";
+        metric = Metrics::Timeout::BODY;
+    }
+    metrics.record_timeout(metric);
+    log_request(thread_tag(), std::string("Connection timed out (") + name + ")", LogLevel::INFO);
+    
+    // HTTP/2 has no request to answer with 408; GOAWAY says why it closes
+    if (conn.h2) {
+        conn.h2->shutdown(conn);
+        return;
+    }
+    
+    // A half-received request gets an answer; an idle keep-alive connection is just closed
+    if (kind != Connection::Phase::IDLE) {
+        size_t pending_before = conn.pending_bytes();
+        send_error_response(conn, 408, "Request Timeout");
+        metrics.record_response(Metrics::Method::OTHER, Metrics::Route::OTHER, 408,
+                                conn.pending_bytes() - pending_before, conn.request_count > 0);
+    }
+    conn.close_after_write = true;
+}
+
+void HTTPServer::on_drain(Connection& conn) {
+    if (conn.h2) {
+        conn.h2->drain(conn);
+        return;
+    }
+    // Between requests the connection can go now: a client must expect an
+    // idle keep-alive connection to close and retries on a new one. A fresh
+    // connection's first request is still waited for
+    if (conn.phase == Connection::Phase::IDLE && conn.request_count > 0) {
+        conn.close_after_write = true;
+    }
+}
+
+// Waits until fd is readable (true), deadline_ms (TimerWheel clock, 0: none)
+// passes or *interrupt turns true (false)
+static bool wait_readable(int fd, uint64_t deadline_ms, const std::atomic<bool>* interrupt) {
+    while (!interrupt || !interrupt->load(std::memory_order_relaxed)) {
+        uint64_t now = TimerWheel::now_ms();
+        if (deadline_ms != 0 && now >= deadline_ms) {
+            return false;
+        }
+        uint64_t slice = deadline_ms != 0 ? std::min<uint64_t>(deadline_ms - now, 1000) : 1000;
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, static_cast<int>(slice));
+        if (ready > 0 || (ready < 0 && errno != EINTR)) {
+            return true;   // readable, or let recv() report the error
+        }
+    }
+    return false;
+}
+
+void HTTPServer::handle_client(int client_socket) {
+    Connection conn(client_socket);
+    conn.last_activity_ms = TimerWheel::now_ms();
+    
+    // Worker queues carry bare descriptors: the address is looked up once
+    // per connection, and only when there are rates to enforce
+    if (rate_limiter.enabled()) {
+        struct sockaddr_in address;
+        socklen_t length = sizeof(address);
+        if (getpeername(client_socket, (struct sockaddr*)&address, &length) == 0 && address.sin_family == AF_INET) {
+            conn.peer_address = address.sin_addr.s_addr;
+        }
+    }
+    
+    on_connection_opened(conn);
+    
+    // Blocking sends to a peer that stops reading give up after the idle timeout
+    if (timeouts.idle_ms > 0) {
+        struct timeval send_timeout = {static_cast<time_t>(timeouts.idle_ms / 1000),
+                                       static_cast<suseconds_t>(timeouts.idle_ms % 1000 * 1000)};
+        setsockopt(client_socket, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    }
+    
+    bool drain_seen = false;
+    while (running && !conn.close_after_write) {
+        if (!drain_seen && draining) {
+            drain_seen = true;
+            on_drain(conn);
+            if (conn.flush() != Connection::FlushResult::DONE || conn.close_after_write) {
+                break;
+            }
+        }
+        
+        // Blocking worker: the deadline is a poll() timeout rather than a
+        // wheel entry, and the start of a drain interrupts the wait
+        Connection::Phase kind;
+        uint64_t deadline = conn.deadline(timeouts, kind);
+        if (!wait_readable(client_socket, deadline, drain_seen ? nullptr : &draining)) {
+            if (!drain_seen && draining) {
+                continue;
+            }
+            on_timeout(conn, kind);
+            conn.flush();
+            break;
+        }
+        
+        char* space = conn.in.prepare(InputBuffer::MIN_READ);
+        ssize_t bytes_received = recv(client_socket, space, conn.in.writable(), 0);
+        
+        if (bytes_received <= 0) {
+            break;
+        }
+        
+        conn.in.commit(bytes_received);
+        conn.last_activity_ms = TimerWheel::now_ms();
+        process_input(conn);
+        
+        // Blocking socket: flush() returns once everything is sent
+        if (conn.flush() != Connection::FlushResult::DONE) {
+            break;
+        }
+    }
+    
+    close(client_socket);
+    on_connection_closed(conn);
+}
+
+void HTTPServer::dispatch_epoll(int client_socket, uint32_t peer_address) {
+    int flags = fcntl(client_socket, F_GETFL, 0);
+    if (flags < 0 || fcntl(client_socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+        log_message("Error making client socket non-blocking", LogLevel::ERROR);
+        close(client_socket);
+        return;
+    }
+    
+    event_loops[next_loop++ % event_loops.size()]->add_connection(client_socket, peer_address);
+}
+
+void HTTPServer::shed_connection(int client_socket, Metrics::Shed reason) {
+    refuse_connection(client_socket, 503, 1, "Server busy, retry shortly\n");
+    metrics.record_shed(reason);
+}
+
+// Answer to a connection that will not be served, costing next to no worker
+// time. Request bytes already received are read and dropped first: closing
+// with unread input resets the connection, and the client might never see
+// the response
+void HTTPServer::refuse_connection(int client_socket, int status_code, uint32_t retry_after_s,
+                                   std::string_view body) {
+    char discard[4096];
+    for (int i = 0; i < 16 && recv(client_socket, discard, sizeof(discard), MSG_DONTWAIT) > 0; i++) {
+    }
+    
+    static thread_local std::string response;
+    response.clear();
+    append_status_line(response, status_code);
+    response += date_header();
+    append_entity_headers(response, "text/plain", body.size());
+    response += "Retry-After: ";
+    response += std::to_string(retry_after_s);
+    response += "\r\nConnection: close\r\n\r\n";
+    response += body;
+    // Never waits: a client that cannot take ~200 bytes right now gets nothing
+    send(client_socket, response.data(), response.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    close(client_socket);
+}
+
+void HTTPServer::worker_thread(size_t index) {
+    const std::string& thread_id = thread_tag();
+    
+    while (running) {
+        bool shed;
+        int client_socket = worker_pool.take(index, shed);
+        if (client_socket < 0) {
+            break;
+        }
+        if (shed) {
+            log_request(thread_id, "Connection waited too long for a worker, refusing");
+            shed_connection(client_socket, Metrics::Shed::QUEUE_DELAY);
+            continue;
+        }
+        
+        log_request(thread_id, "Connection from client assigned");
+        
+        handle_client(client_socket);
+    }
+    running_workers--;
+}
+
+int HTTPServer::create_listen_socket(bool reuse_port) {
+    // Create socket
+    int listen_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_socket < 0) {
+        log_message("Error creating socket", LogLevel::ERROR);
+        return -1;
+    }
+    
+    // Set socket options
+    int opt = 1;
+    if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        (reuse_port && setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)) {
+        log_message("Error setting socket options", LogLevel::ERROR);
+        close(listen_socket);
+        return -1;
+    }
+    // Inherited by accepted sockets. Responses are written whole (MSG_MORE
+    // holds a head back for its file), so Nagle only ever delays the tail of
+    // a burst: an HTTP/2 flow-control window's last frame would otherwise
+    // wait for the client's delayed ACK
+    setsockopt(listen_socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    
+    // Bind socket
+    struct sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(host.c_str());
+    address.sin_port = htons(port);
+    
+    if (bind(listen_socket, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        log_message("Error binding socket", LogLevel::ERROR);
+        close(listen_socket);
+        return -1;
+    }
+    
+    // Listen for connections
+    if (listen(listen_socket, listen_backlog) < 0) {
+        log_message("Error listening on socket", LogLevel::ERROR);
+        close(listen_socket);
+        return -1;
+    }
+    
+    return listen_socket;
+}
+
+int HTTPServer::open_listener(bool reuse_port) {
+    // A socket handed over by the predecessor, if it listens where this
+    // configuration does; a reload that moved the server binds anew
+    in_addr_t address = inet_addr(host.c_str());
+    for (auto it = inherited_sockets.begin(); it != inherited_sockets.end(); ++it) {
+        struct sockaddr_in bound {};
+        socklen_t length = sizeof(bound);
+        int reuse = 0;
+        socklen_t reuse_length = sizeof(reuse);
+        if (getsockname(*it, (struct sockaddr*)&bound, &length) < 0 || bound.sin_family != AF_INET ||
+            bound.sin_port != htons(port) || bound.sin_addr.s_addr != address ||
+            getsockopt(*it, SOL_SOCKET, SO_REUSEPORT, &reuse, &reuse_length) < 0 || (reuse != 0) != reuse_port) {
+            continue;
+        }
+        int listen_socket = *it;
+        inherited_sockets.erase(it);
+        // Applies a changed backlog; connections already queued stay
+        listen(listen_socket, listen_backlog);
+        return listen_socket;
+    }
+    return create_listen_socket(reuse_port);
+}
+
+std::unique_ptr<IOLoop> HTTPServer::make_loop() {
+    if (io_model == IOModel::URING) {
+        return std::make_unique<UringLoop>(*this, timeouts, rate_limiter.enabled());
+    }
+    return std::make_unique<EventLoop>(*this, timeouts);
+}
+
+bool HTTPServer::start_shards() {
+    // One SO_REUSEPORT listener per shard; the kernel hashes new connections
+    // across them, and each shard accepts and serves on its own thread
+    int cpu_count = static_cast<int>(std::thread::hardware_concurrency());
+    
+    for (int i = 0; i < shards; i++) {
+        int listen_socket = open_listener(true);
+        if (listen_socket < 0) {
+            return false;
+        }
+        
+        int flags = fcntl(listen_socket, F_GETFL, 0);
+        fcntl(listen_socket, F_SETFL, flags | O_NONBLOCK);
+        shard_sockets.push_back(listen_socket);
+        
+        // The loop accepts on its own descriptor and closes it when it
+        // drains; this one stays open to be handed to a successor
+        int loop_socket = fcntl(listen_socket, F_DUPFD_CLOEXEC, 0);
+        int cpu = (pin_cpus && cpu_count > 0) ? i % cpu_count : -1;
+        auto loop = make_loop();
+        if (loop_socket < 0 || !loop->start(loop_socket, cpu)) {
+            log_message("Error starting shard " + std::to_string(i), LogLevel::ERROR);
+            if (loop_socket >= 0) {
+                close(loop_socket);
+            }
+            return false;
+        }
+        event_loops.push_back(std::move(loop));
+    }
+    
+    return true;
+}
+
+void HTTPServer::log_shard_stats() {
+    for (size_t i = 0; i < event_loops.size(); i++) {
+        const IOLoop::Stats& stats = event_loops[i]->get_stats();
+        log_message("Shard " + std::to_string(i) + ": accepted " + std::to_string(stats.accepted.load()) +
+                    ", requests " + std::to_string(stats.requests.load()) +
+                    ", active " + std::to_string(stats.active.load()));
+    }
+}
+
+bool HTTPServer::start() {
+    running = true;
+    
+    // Uploads are created and published relative to this handle
+    upload_dir_fd = open((std::string(RESOURCE_ROOT) + "/uploads").c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (upload_dir_fd < 0) {
+        log_message("Error opening uploads directory; uploads will fail", LogLevel::ERROR);
+    } else {
+        upload_sync.start(upload_sync_policy, upload_dir_fd, upload_sync_ms);
+    }
+    
+    // Mapped before the cache is warmed, which leaves bundled files out
+    if (!bundle_path.empty()) {
+        std::string error;
+        bundle = AssetBundle::open(bundle_path, error);
+        if (bundle) {
+            log_message("Asset bundle: " + std::to_string(bundle->size()) + " files (" +
+                        std::to_string(bundle->bytes()) + " bytes) mapped from " + bundle_path);
+        } else {
+            log_message("Error opening asset bundle " + bundle_path + " (" + error + "), serving from " +
+                        RESOURCE_ROOT, LogLevel::ERROR);
+        }
+    }
+    
+    // Manifest of the files present now; uploads change while serving and
+    // keep going through the filesystem
+    size_t static_files = router.add_static_files(RESOURCE_ROOT, "uploads",
+                                                  [this](std::string_view path) { return validate_path(path); });
+    log_message("Routes: " + std::to_string(router.size()) + " (" + std::to_string(static_files) + " static files)");
+    warm_file_cache();
+    
+    if (rate_limiter.enabled()) {
+        auto describe = [this](RateLimiter::Scope scope) {
+            RateLimiter::Rule rule = rate_limiter.rule(scope);
+            if (rule.per_second == 0) {
+                return std::string("unlimited");
+            }
+            std::ostringstream text;
+            text << rule.per_second << "/s, burst " << rule.burst;
+            return text.str();
+        };
+        log_message("Rate limits per client: requests " + describe(RateLimiter::Scope::REQUEST) + ", uploads " +
+                    describe(RateLimiter::Scope::UPLOAD) + " (" + std::to_string(rate_limiter.entries()) +
+                    " buckets)");
+    }
+    
+    if (io_model == IOModel::URING && !IoUring::supported()) {
+        log_message("Warning: io_uring unavailable (needs Linux 6.1+), falling back to epoll", LogLevel::WARN);
+        io_model = IOModel::EPOLL;
+    }
+    const char* loop_name = io_model == IOModel::URING ? "io_uring" : "epoll";
+    
+    // Listeners the predecessor had that this configuration does not use
+    auto release_inherited = [this]() {
+        if (!inherited_sockets.empty()) {
+            log_message("Closing " + std::to_string(inherited_sockets.size()) +
+                        " inherited listening sockets this configuration does not use", LogLevel::WARN);
+        }
+        for (int socket : inherited_sockets) {
+            close(socket);
+        }
+        inherited_sockets.clear();
+    };
+    
+    if (shards > 0) {
+        if (!start_shards()) {
+            stop();
+            return false;
+        }
+        release_inherited();
+        
+        log_message("HTTP Server started on http://" + host + ":" + std::to_string(port));
+        log_message(std::string("I/O model: ") + loop_name + ", SO_REUSEPORT shards: " + std::to_string(shards) +
+                    (pin_cpus ? " (pinned)" : ""));
+        log_message("Serving files from 'resources' directory");
+        log_message("Press Ctrl+C to stop the server");
+        return true;
+    }
+    
+    server_socket = open_listener(false);
+    if (server_socket < 0) {
+        running = false;
+        return false;
+    }
+    release_inherited();
+    // run() polls it together with the signals and accepts until EAGAIN;
+    // during a handoff another process takes from the same queue
+    int flags = fcntl(server_socket, F_GETFL, 0);
+    fcntl(server_socket, F_SETFL, flags | O_NONBLOCK);
+    if (io_model != IOModel::URING) {
+        reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    
+    if (io_model != IOModel::THREAD_POOL) {
+        // Start event loops. io_uring loops each accept on the shared
+        // listener themselves; epoll loops are fed by run()
+        for (int i = 0; i < max_threads; i++) {
+            auto loop = make_loop();
+            int listen_socket = io_model == IOModel::URING ? fcntl(server_socket, F_DUPFD_CLOEXEC, 0) : -1;
+            if (!loop->start(listen_socket)) {
+                log_message("Error starting event loop", LogLevel::ERROR);
+                if (listen_socket >= 0) {
+                    close(listen_socket);
+                }
+                stop();
+                return false;
+            }
+            event_loops.push_back(std::move(loop));
+        }
+    } else {
+        // Start worker threads
+        worker_pool.start(static_cast<size_t>(max_threads), dispatch, std::chrono::milliseconds(admission_wait_ms),
+                          std::chrono::milliseconds(queue_delay_target_ms),
+                          std::chrono::milliseconds(queue_delay_interval_ms));
+        running_workers = max_threads;
+        for (int i = 0; i < max_threads; i++) {
+            thread_pool.emplace_back(&HTTPServer::worker_thread, this, static_cast<size_t>(i));
+        }
+    }
+    
+    log_message("HTTP Server started on http://" + host + ":" + std::to_string(port));
+    if (io_model != IOModel::THREAD_POOL) {
+        log_message(std::string("I/O model: ") + loop_name + ", event loops: " + std::to_string(max_threads));
+    } else {
+        log_message("I/O model: thread pool, size: " + std::to_string(max_threads) + ", dispatch: " +
+                    (dispatch == WorkerPool::Dispatch::LEAST_LOADED ? "least-loaded" : "round-robin"));
+    }
+    log_message("Serving files from 'resources' directory");
+    log_message("Press Ctrl+C to stop the server");
+    
+    return true;
+}
+
+void HTTPServer::stop() {
     if (running) {
         running = false;
-        queue_cv.notify_all();
+        worker_pool.stop();
         
         for (auto& thread : thread_pool) {
             if (thread.joinable()) {
                 thread.join();
             }
         }
+        worker_pool.close_queued();
+        
+        for (auto& loop : event_loops) {
+            loop->stop();
+        }
+        if (shards > 0) {
+            log_shard_stats();
+        }
+        event_loops.clear();
+        
+        if (file_cache.enabled()) {
+            log_cache_stats();
+        }
+        
+        // After the loops: nothing publishes any more, queued uploads get synced
+        upload_sync.stop();
+        if (upload_dir_fd >= 0) {
+            close(upload_dir_fd);
+            upload_dir_fd = -1;
+        }
         
         if (server_socket >= 0) {
             close(server_socket);
             server_socket = -1;
         }
+        if (reserve_fd >= 0) {
+            close(reserve_fd);
+            reserve_fd = -1;
+        }
+        for (int socket : shard_sockets) {
+            close(socket);
+        }
+        shard_sockets.clear();
+        if (successor_pid > 0) {
+            abandon_successor("server stopped");
+        }
+        for (int socket : inherited_sockets) {
+            close(socket);
+        }
+        inherited_sockets.clear();
+        if (handoff_channel >= 0) {
+            close(handoff_channel);
+            handoff_channel = -1;
+        }
         
+        Logger::Stats log_stats = logger.get_stats();
+        if (log_stats.dropped > 0) {
+            log_message("Logger: " + std::to_string(log_stats.logged) + " lines logged, " +
+                        std::to_string(log_stats.dropped) + " dropped", LogLevel::WARN);
+        }
         log_message("Server stopped");
+        logger.flush();
     }
 }
 
@@ -557,82 +1796,607 @@ void HTTPServer::run() {
         return;
     }
     
+    if (handoff_channel >= 0) {
+        // The predecessor stops accepting and drains once it reads this
+        char ready = HANDOFF_READY;
+        send(handoff_channel, &ready, 1, MSG_NOSIGNAL);
+        close(handoff_channel);
+        handoff_channel = -1;
+    }
+    
+    // Shards and io_uring loops accept on their own; for the others it
+    // happens here, between signals
+    bool accepting = shards == 0 && io_model != IOModel::URING;
+    uint64_t next_stats_ms = TimerWheel::now_ms() + 60000;
+    
     while (running) {
+        // poll() skips negative descriptors
+        bool polling_listener = accepting && accept_retry_ms == 0;
+        struct pollfd fds[3] = {{signal_fd, POLLIN, 0},
+                                {successor_channel, POLLIN, 0},
+                                {polling_listener ? server_socket : -1, POLLIN, 0}};
+        int ready = poll(fds, 3, draining || successor_pid > 0 || !polling_listener ? 100 : 1000);
+        if (ready < 0 && errno != EINTR) {
+            log_message("Error waiting for connections: " + std::string(strerror(errno)), LogLevel::ERROR);
+            break;
+        }
+        if (ready > 0) {
+            if (fds[0].revents) {
+                handle_signals();
+            }
+            if (fds[1].revents && successor_channel >= 0) {
+                check_successor();
+            }
+            if (fds[2].revents && server_socket >= 0) {
+                accept_pending();
+            }
+        }
+        
+        uint64_t now = TimerWheel::now_ms();
+        if (accept_retry_ms != 0 && now >= accept_retry_ms) {
+            accept_retry_ms = 0;
+        }
+        if (successor_pid > 0 && now >= successor_deadline_ms) {
+            abandon_successor("not ready in time");
+        }
+        if (draining) {
+            if (drained()) {
+                log_message("All connections drained");
+                break;
+            }
+            if (now >= drain_deadline_ms) {
+                log_message("Closing " + std::to_string(active_connections) + " connections still open",
+                            LogLevel::WARN);
+                break;
+            }
+        }
+        if (!accepting && now >= next_stats_ms) {
+            // Loops accept on their own; just report their spread periodically
+            log_shard_stats();
+            next_stats_ms = now + 60000;
+        }
+    }
+    
+    stop();
+}
+
+void HTTPServer::accept_pending() {
+    // A bounded batch, so a stream of connections cannot starve the signals
+    for (int accepted = 0; accepted < ACCEPT_BATCH && running; accepted++) {
         struct sockaddr_in client_address;
         socklen_t client_len = sizeof(client_address);
         
-        int client_socket = accept(server_socket, (struct sockaddr*)&client_address, &client_len);
+        int client_socket = accept4(server_socket, (struct sockaddr*)&client_address, &client_len, SOCK_CLOEXEC);
         
         if (client_socket < 0) {
-            if (running) {
-                log_message("Error accepting connection");
+            int error = errno;
+            if (error == EINTR || error == ECONNABORTED) {
+                continue;
+            }
+            // EAGAIN: queue empty, or a successor got there first
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                return;
+            }
+            // The listener stays readable, so poll() would hand it straight
+            // back. Out of descriptors, the spare makes room to take the
+            // oldest client off the queue and close it, which it sees at
+            // once; anything else leaves the listener alone for a while
+            bool refused = false;
+            if ((error == EMFILE || error == ENFILE) && reserve_fd >= 0) {
+                close(reserve_fd);
+                int refused_socket = accept4(server_socket, nullptr, nullptr, SOCK_CLOEXEC);
+                if (refused_socket >= 0) {
+                    close(refused_socket);
+                    refused = true;
+                }
+                reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            }
+            accept_failures++;
+            uint64_t now = TimerWheel::now_ms();
+            if (now >= accept_log_ms) {
+                std::string repeats = accept_failures > 1 ? " (" + std::to_string(accept_failures) +
+                                                                " failures since the last report)" : "";
+                log_message("Error accepting connections: " + std::string(strerror(error)) + repeats,
+                            LogLevel::ERROR);
+                accept_failures = 0;
+                accept_log_ms = now + ACCEPT_LOG_INTERVAL_MS;
             }
+            if (refused) {
+                continue;
+            }
+            accept_retry_ms = now + ACCEPT_RETRY_MS;
+            return;
+        }
+        
+        // A client over its rate is turned away before it costs a worker or a loop anything
+        uint32_t peer_address = client_address.sin_addr.s_addr;
+        uint32_t retry_after_s;
+        if (!rate_limiter.would_admit(RateLimiter::Scope::REQUEST, peer_address, retry_after_s)) {
+            refuse_connection(client_socket, 429, retry_after_s, "Too many requests, retry later\n");
             continue;
         }
         
-        // Check if thread pool is saturated
-        {
-            std::lock_guard<std::mutex> lock(queue_mutex);
-            if (connection_queue.size() >= 50) {
-                log_message("Warning: Thread pool saturated, rejecting connection");
-                close(client_socket);
-                continue;
-            }
-            
-            connection_queue.push(client_socket);
+        if (io_model == IOModel::EPOLL) {
+            dispatch_epoll(client_socket, peer_address);
+            continue;
         }
         
-        queue_cv.notify_one();
+        if (!worker_pool.submit(client_socket)) {
+            log_message("Warning: Thread pool saturated (" + std::to_string(worker_pool.queued()) + " queued, limit " +
+                        std::to_string(worker_pool.admission_limit()) + "), rejecting connection", LogLevel::WARN);
+            shed_connection(client_socket, Metrics::Shed::QUEUE_FULL);
+            continue;
+        }
         
         // Log thread pool status periodically
         static int log_counter = 0;
         if (++log_counter % 100 == 0) {
-            std::lock_guard<std::mutex> lock(queue_mutex);
-            log_message("Thread pool status: " + std::to_string(active_connections) + "/" + std::to_string(max_threads) + " active");
+            log_message("Thread pool status: " + std::to_string(active_connections) + "/" + std::to_string(max_threads) +
+                        " active, " + std::to_string(worker_pool.queued()) + " queued, " +
+                        std::to_string(worker_pool.steals()) + " stolen");
+            if (file_cache.enabled()) {
+                log_cache_stats();
+            }
+        }
+    }
+}
+
+bool HTTPServer::take_over(int channel) {
+    handoff_channel = channel;
+    if (!receive_sockets(channel, inherited_sockets, HANDOFF_TIMEOUT_MS)) {
+        log_message("Error receiving listening sockets from the previous server", LogLevel::ERROR);
+        return false;
+    }
+    log_message("Inherited " + std::to_string(inherited_sockets.size()) +
+                " listening sockets from the previous server");
+    return true;
+}
+
+void HTTPServer::set_process_control(int signals, std::string binary, std::vector<std::string> args) {
+    signal_fd = signals;
+    binary_path = std::move(binary);
+    arguments = std::move(args);
+}
+
+// The running image's path, empty if unknown. replaced: the file there is
+// no longer this image
+static std::string executable_path(bool& replaced) {
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    replaced = false;
+    if (length <= 0) {
+        return {};
+    }
+    std::string location(path, static_cast<size_t>(length));
+    const std::string deleted = " (deleted)";
+    if (location.size() > deleted.size() &&
+        location.compare(location.size() - deleted.size(), deleted.size(), deleted) == 0) {
+        location.resize(location.size() - deleted.size());
+        replaced = true;
+    }
+    return location;
+}
+
+void HTTPServer::handle_signals() {
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+        int signal = static_cast<int>(info.ssi_signo);
+        if (signal == SIGHUP) {
+            // The running image again, which re-reads its configuration.
+            // By path while that is still this image, so it keeps its name
+            bool replaced;
+            std::string path = executable_path(replaced);
+            start_successor(path.empty() || replaced ? "/proc/self/exe" : path, "configuration reload");
+        } else if (signal == SIGUSR2) {
+            start_successor(binary_path, "binary upgrade");
+        } else if (draining) {
+            log_message("Received signal " + std::to_string(signal) + " while draining, stopping now");
+            drain_deadline_ms = 0;
+        } else {
+            log_message("Received signal " + std::to_string(signal) + ", draining connections (up to " +
+                        std::to_string(drain_timeout_s) + "s)");
+            if (successor_pid > 0) {
+                abandon_successor("shutting down");
+            }
+            drain();
+        }
+    }
+}
+
+void HTTPServer::start_successor(const std::string& path, const char* reason) {
+    if (draining || successor_pid > 0) {
+        log_message(std::string("Ignoring ") + reason + ": " +
+                    (draining ? "already draining" : "a successor is already starting"), LogLevel::WARN);
+        return;
+    }
+    
+    int channel;
+    pid_t pid = spawn_successor(path, arguments, channel);
+    if (pid < 0) {
+        log_message(std::string("Error starting a successor for ") + reason + ": " + strerror(errno),
+                    LogLevel::ERROR);
+        return;
+    }
+    successor_pid = pid;
+    successor_channel = channel;
+    successor_deadline_ms = TimerWheel::now_ms() + SUCCESSOR_TIMEOUT_MS;
+    
+    std::vector<int> sockets = shards > 0 ? shard_sockets : std::vector<int>{server_socket};
+    if (!send_sockets(channel, sockets)) {
+        abandon_successor("could not be sent the listening sockets");
+        return;
+    }
+    log_message("Started successor (pid " + std::to_string(pid) + ") for " + reason +
+                "; serving until it is ready");
+}
+
+void HTTPServer::check_successor() {
+    char status = 0;
+    ssize_t n = recv(successor_channel, &status, 1, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if (n != 1 || status != HANDOFF_READY) {
+        abandon_successor("exited before it was ready");
+        return;
+    }
+    
+    // It owns the listeners now; left to run on when this process exits
+    log_message("Successor (pid " + std::to_string(successor_pid) + ") is serving, draining connections (up to " +
+                std::to_string(drain_timeout_s) + "s)");
+    close(successor_channel);
+    successor_channel = -1;
+    successor_pid = -1;
+    drain();
+}
+
+void HTTPServer::abandon_successor(const char* reason) {
+    log_message("Abandoning successor (pid " + std::to_string(successor_pid) + "): " + reason, LogLevel::ERROR);
+    // Killed outright: it may already be accepting on our listeners
+    kill(successor_pid, SIGKILL);
+    waitpid(successor_pid, nullptr, 0);
+    close(successor_channel);
+    successor_pid = -1;
+    successor_channel = -1;
+}
+
+void HTTPServer::drain() {
+    draining = true;
+    announce_connection_close();
+    drain_deadline_ms = TimerWheel::now_ms() + drain_timeout_s * 1000ULL;
+    
+    // Closing our descriptors leaves the sockets to a successor, if there
+    // is one; otherwise new connections are refused from here on
+    if (server_socket >= 0) {
+        close(server_socket);
+        server_socket = -1;
+    }
+    if (reserve_fd >= 0) {
+        close(reserve_fd);
+        reserve_fd = -1;
+    }
+    for (int socket : shard_sockets) {
+        close(socket);
+    }
+    shard_sockets.clear();
+    
+    // Queued connections are still served, one request each
+    worker_pool.finish();
+    for (auto& loop : event_loops) {
+        loop->drain();
+    }
+}
+
+bool HTTPServer::drained() const {
+    if (running_workers > 0) {
+        return false;
+    }
+    for (const auto& loop : event_loops) {
+        if (!loop->drained()) {
+            return false;
         }
     }
+    return true;
 }
 
-// Signal handler for graceful shutdown
-std::unique_ptr<HTTPServer> g_server;
+// Parses a --name=value option into config
+static bool parse_option(const std::string& arg, ServerConfig& config) {
+    size_t eq_pos = arg.find('=');
+    std::string name = arg.substr(2, eq_pos == std::string::npos ? std::string::npos : eq_pos - 2);
+    std::string value = eq_pos == std::string::npos ? "" : arg.substr(eq_pos + 1);
+    
+    if (name == "port") {
+        config.port = std::atoi(value.c_str());
+        return config.port > 0 && config.port < 65536;
+    }
+    
+    if (name == "host") {
+        config.host = value;
+        return !value.empty();
+    }
+    
+    if (name == "threads") {
+        config.max_threads = std::atoi(value.c_str());
+        return config.max_threads > 0;
+    }
+    
+    if (name == "io") {
+        if (value == "threads") {
+            config.io_model = IOModel::THREAD_POOL;
+        } else if (value == "epoll") {
+            config.io_model = IOModel::EPOLL;
+        } else if (value == "uring") {
+            config.io_model = IOModel::URING;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    if (name == "shards") {
+        config.shards = value == "auto" ? static_cast<int>(std::thread::hardware_concurrency())
+                                        : std::atoi(value.c_str());
+        if (config.shards <= 0) {
+            return false;
+        }
+        if (config.io_model == IOModel::THREAD_POOL) {
+            config.io_model = IOModel::EPOLL;
+        }
+        return true;
+    }
+    
+    if (name == "dispatch") {
+        if (value == "least-loaded") {
+            config.dispatch = WorkerPool::Dispatch::LEAST_LOADED;
+        } else if (value == "round-robin") {
+            config.dispatch = WorkerPool::Dispatch::ROUND_ROBIN;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    if (name == "admission-wait-ms") {
+        config.admission_wait_ms = static_cast<uint32_t>(std::atol(value.c_str()));
+        return config.admission_wait_ms > 0;
+    }
+    
+    if (name == "queue-delay-target-ms") {
+        config.queue_delay_target_ms = static_cast<uint32_t>(std::atol(value.c_str()));
+        return !value.empty();
+    }
+    
+    if (name == "queue-delay-interval-ms") {
+        config.queue_delay_interval_ms = static_cast<uint32_t>(std::atol(value.c_str()));
+        return config.queue_delay_interval_ms > 0;
+    }
+    
+    if (name == "listen-backlog") {
+        config.listen_backlog = std::atoi(value.c_str());
+        return config.listen_backlog > 0;
+    }
+    
+    if (name == "cache-mb") {
+        config.cache_bytes = static_cast<size_t>(std::atol(value.c_str())) * 1024 * 1024;
+        return !value.empty();
+    }
+    
+    if (name == "bundle") {
+        config.bundle_path = value;
+        return !value.empty();
+    }
+    
+    if (name == "cache-max-entry-kb") {
+        config.cache_max_entry_bytes = static_cast<size_t>(std::atol(value.c_str())) * 1024;
+        return !value.empty();
+    }
+    
+    if (name == "max-header-kb") {
+        config.max_header_bytes = static_cast<size_t>(std::atol(value.c_str())) * 1024;
+        return config.max_header_bytes > 0;
+    }
+    
+    if (name == "max-body-mb") {
+        config.max_body_bytes = static_cast<size_t>(std::atol(value.c_str())) * 1024 * 1024;
+        return !value.empty();
+    }
+    
+    if (name == "idle-timeout") {
+        config.idle_timeout_s = static_cast<uint32_t>(std::atol(value.c_str()));
+        return !value.empty();
+    }
+    
+    if (name == "header-timeout") {
+        config.header_timeout_s = static_cast<uint32_t>(std::atol(value.c_str()));
+        return !value.empty();
+    }
+    
+    if (name == "body-timeout") {
+        config.body_timeout_s = static_cast<uint32_t>(std::atol(value.c_str()));
+        return !value.empty();
+    }
+    
+    if (name == "drain-timeout") {
+        config.drain_timeout_s = static_cast<uint32_t>(std::atol(value.c_str()));
+        return !value.empty();
+    }
+    
+    if (name == "rate-limit") {
+        config.rate_limit = std::atof(value.c_str());
+        return config.rate_limit >= 0 && !value.empty();
+    }
+    
+    if (name == "rate-burst") {
+        config.rate_burst = static_cast<uint32_t>(std::atol(value.c_str()));
+        return !value.empty();
+    }
+    
+    if (name == "upload-rate-limit") {
+        config.upload_rate_limit = std::atof(value.c_str());
+        return config.upload_rate_limit >= 0 && !value.empty();
+    }
+    
+    if (name == "upload-rate-burst") {
+        config.upload_rate_burst = static_cast<uint32_t>(std::atol(value.c_str()));
+        return !value.empty();
+    }
+    
+    if (name == "rate-limit-entries") {
+        config.rate_limit_entries = static_cast<size_t>(std::atol(value.c_str()));
+        return config.rate_limit_entries > 0;
+    }
+    
+    if (name == "upload-sync") {
+        if (value == "none") {
+            config.upload_sync = SyncPolicy::NONE;
+        } else if (value == "batch") {
+            config.upload_sync = SyncPolicy::BATCH;
+        } else if (value == "always") {
+            config.upload_sync = SyncPolicy::ALWAYS;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    if (name == "upload-sync-ms") {
+        config.upload_sync_ms = static_cast<uint32_t>(std::atol(value.c_str()));
+        return !value.empty();
+    }
+    
+    if (name == "json-max-depth") {
+        config.json_max_depth = static_cast<size_t>(std::atol(value.c_str()));
+        return config.json_max_depth > 0 && config.json_max_depth <= JsonValidator::MAX_DEPTH;
+    }
+    
+    if (name == "log-level") {
+        return Logger::parse_level(value, config.log_level);
+    }
+    
+    if (name == "log-file") {
+        config.log_file = value;
+        return !value.empty();
+    }
+    
+    if (name == "http2") {
+        if (value == "on") {
+            config.http2 = true;
+        } else if (value == "off") {
+            config.http2 = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    if (name == "pin-cpus") {
+        config.pin_cpus = value.empty() || value == "1" || value == "true";
+        return true;
+    }
+    
+    return false;
+}
 
-void signal_handler(int signal) {
-    if (signal == SIGINT || signal == SIGTERM) {
-        std::cout << "\nReceived signal " << signal << ", shutting down gracefully...\n";
-        if (g_server) {
-            g_server->stop();
+// Options from a file: one name=value per line, as on the command line
+// without the leading dashes; blank lines and # comments are skipped
+static bool load_config_file(const std::string& path, ServerConfig& config) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Error reading config file: " << path << "\n";
+        return false;
+    }
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line)) {
+        number++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        size_t end = line.find_last_not_of(" \t\r");
+        if (!parse_option("--" + line.substr(start, end - start + 1), config)) {
+            std::cerr << path << ":" << number << ": invalid option: " << line << "\n";
+            return false;
         }
     }
+    return true;
+}
+
+// Where SIGUSR2 finds the new binary: the path this one was started from
+static std::string binary_location(const char* argv0) {
+    if (strchr(argv0, '/')) {
+        return argv0;   // relative paths stay valid: the server never changes directory
+    }
+    bool replaced;
+    std::string path = executable_path(replaced);
+    return path.empty() ? argv0 : path;
 }
 
 int main(int argc, char* argv[]) {
-    // Parse command line arguments
-    std::string host = "127.0.0.1";
-    int port = 8080;
-    int max_threads = 10;
+    // Parse command line arguments: [port] [host] [max_threads] [--option=value ...].
+    // --config=FILE is read first, so the command line overrides it
+    ServerConfig config;
+    std::vector<std::string> positional;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--config=", 0) == 0 && !load_config_file(arg.substr(9), config)) {
+            return 1;
+        }
+    }
     
-    if (argc >= 2) {
-        port = std::atoi(argv[1]);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--config=", 0) == 0) {
+            continue;
+        }
+        if (arg.rfind("--", 0) == 0) {
+            if (!parse_option(arg, config)) {
+                std::cerr << "Invalid option: " << arg << "\n";
+                return 1;
+            }
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    
+    if (positional.size() >= 1) {
+        config.port = std::atoi(positional[0].c_str());
     }
-    if (argc >= 3) {
-        host = argv[2];
+    if (positional.size() >= 2) {
+        config.host = positional[1];
     }
-    if (argc >= 4) {
-        max_threads = std::atoi(argv[3]);
+    if (positional.size() >= 3) {
+        config.max_threads = std::atoi(positional[2].c_str());
     }
     
-    // Create server instance
-    g_server = std::make_unique<HTTPServer>(host, port, max_threads);
+    // Signals are blocked in every thread (threads inherit the mask, so
+    // before the server starts any) and read from a signalfd by run(): no
+    // handler ever interrupts the server in the middle of something
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    
+    // Started by a running server to take over from it
+    int handoff_channel = take_handoff_channel();
     
-    // Set up signal handler
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    // Create server instance
+    auto server = std::make_unique<HTTPServer>(config);
+    server->set_process_control(signal_fd, binary_location(argv[0]), std::vector<std::string>(argv, argv + argc));
+    if (handoff_channel >= 0 && !server->take_over(handoff_channel)) {
+        return 1;
+    }
     
     // Create resources directory if it doesn't exist
     std::filesystem::create_directories("http-server-cpp/resources/uploads");
     
     // Run server
-    g_server->run();
+    server->run();
     
     return 0;
 }
@@ -0,0 +1,98 @@
+#include "../include/timer_wheel.hpp"
+#include <time.h>
+
+namespace {
+constexpr uint64_t MAX_DELTA = (uint64_t(1) << (TimerWheel::LEVELS * TimerWheel::SLOT_BITS)) - 1;
+}
+
+TimerWheel::TimerWheel(uint64_t tick_ms, uint64_t now_ms)
+    : tick_ms(tick_ms > 0 ? tick_ms : 1), current(now_ms / this->tick_ms) {
+    for (auto& level : slots) {
+        for (Timer& head : level) {
+            head.prev = head.next = &head;
+        }
+    }
+}
+
+uint64_t TimerWheel::now_ms() {
+    // Coarse is plenty for second-scale deadlines and skips the TSC read
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000 + static_cast<uint64_t>(now.tv_nsec) / 1000000;
+}
+
+void TimerWheel::schedule(Timer& timer, uint64_t deadline_ms) {
+    if (timer.armed()) {
+        unlink(timer);
+        count--;
+    }
+    // Round up so a timer never fires before its deadline
+    uint64_t expires = (deadline_ms + tick_ms - 1) / tick_ms;
+    if (expires <= current) {
+        expires = current + 1;
+    }
+    if (expires - current > MAX_DELTA) {
+        expires = current + MAX_DELTA;
+    }
+    timer.expires = expires;
+    timer.deadline_ms = deadline_ms;
+    link(timer);
+    count++;
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    if (timer.armed()) {
+        unlink(timer);
+        count--;
+    }
+}
+
+int TimerWheel::next_timeout_ms(uint64_t now_ms) const {
+    if (count == 0) {
+        return -1;
+    }
+    uint64_t next_tick_ms = (current + 1) * tick_ms;
+    return next_tick_ms > now_ms ? static_cast<int>(next_tick_ms - now_ms) : 0;
+}
+
+void TimerWheel::link(Timer& timer) {
+    // Level by distance, slot by the expiry's digit at that level, so a bucket
+    // comes due (or is cascaded) exactly when its lower digits roll over
+    uint64_t delta = timer.expires - current;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << ((level + 1) * SLOT_BITS))) {
+        level++;
+    }
+    Timer& head = slots[level][(timer.expires >> (level * SLOT_BITS)) & (SLOTS - 1)];
+    timer.next = &head;
+    timer.prev = head.prev;
+    head.prev->next = &timer;
+    head.prev = &timer;
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    timer.prev = timer.next = nullptr;
+}
+
+void TimerWheel::cascade(int level) {
+    Timer& head = slots[level][(current >> (level * SLOT_BITS)) & (SLOTS - 1)];
+    while (head.next != &head) {
+        Timer* timer = head.next;
+        unlink(*timer);
+        link(*timer);
+    }
+}
+
+void TimerWheel::take_due(Timer& expired) {
+    Timer& head = slots[0][current & (SLOTS - 1)];
+    if (head.next == &head) {
+        return;
+    }
+    expired.next = head.next;
+    expired.prev = head.prev;
+    head.next->prev = &expired;
+    head.prev->next = &expired;
+    head.prev = head.next = &head;
+}
@@ -0,0 +1,220 @@
+#include "../include/upload.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+namespace {
+
+// Temp names for the no-O_TMPFILE fallback; dot-prefixed so listings skip them
+std::string temp_upload_name() {
+    static thread_local std::mt19937_64 generator{std::random_device{}()};
+    char name[32];
+    snprintf(name, sizeof(name), ".upload-%016llx.tmp", static_cast<unsigned long long>(generator()));
+    return name;
+}
+
+}
+
+UploadFile::~UploadFile() {
+    discard();
+}
+
+bool UploadFile::open(int directory) {
+    discard();
+    dir_fd = directory;
+
+    fd = openat(dir_fd, ".", O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        return true;
+    }
+    if (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL) {
+        return false;
+    }
+
+    // Filesystem without O_TMPFILE: a named temp file, linked on publish
+    for (int attempt = 0; attempt < 8; attempt++) {
+        temp_name = temp_upload_name();
+        fd = openat(dir_fd, temp_name.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd >= 0 || errno != EEXIST) {
+            break;
+        }
+    }
+    if (fd < 0) {
+        temp_name.clear();
+        return false;
+    }
+    return true;
+}
+
+bool UploadFile::write(const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool UploadFile::publish(const std::string& name) {
+    if (!temp_name.empty()) {
+        // link + unlink rather than rename, which would replace an existing file
+        if (linkat(dir_fd, temp_name.c_str(), dir_fd, name.c_str(), 0) < 0) {
+            return false;
+        }
+        unlinkat(dir_fd, temp_name.c_str(), 0);
+        temp_name.clear();
+        return true;
+    }
+
+    if (linkat(fd, "", dir_fd, name.c_str(), AT_EMPTY_PATH) == 0) {
+        return true;
+    }
+    if (errno != ENOENT && errno != EPERM) {
+        return false;
+    }
+    // AT_EMPTY_PATH needs CAP_DAC_READ_SEARCH; the /proc path does not
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    return linkat(AT_FDCWD, path, dir_fd, name.c_str(), AT_SYMLINK_FOLLOW) == 0;
+}
+
+void UploadFile::discard() {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (!temp_name.empty()) {
+        unlinkat(dir_fd, temp_name.c_str(), 0);
+        temp_name.clear();
+    }
+}
+
+int UploadFile::release() {
+    int released = fd;
+    fd = -1;
+    return released;
+}
+
+UploadSync::~UploadSync() {
+    stop();
+}
+
+void UploadSync::start(SyncPolicy sync_policy, int directory, uint32_t interval) {
+    policy = sync_policy;
+    dir_fd = directory;
+    interval_ms = interval;
+    if (policy == SyncPolicy::BATCH) {
+        running = true;
+        sync_thread = std::thread(&UploadSync::run, this);
+    }
+}
+
+void UploadSync::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+    }
+    cv.notify_one();
+    if (sync_thread.joinable()) {
+        sync_thread.join();
+    }
+}
+
+bool UploadSync::publish(UploadFile& file, const std::string& name) {
+    if (policy == SyncPolicy::ALWAYS) {
+        // Data first, so the name can never point at an incomplete file
+        if (fdatasync(file.descriptor()) < 0 || !file.publish(name)) {
+            return false;
+        }
+        fsync(dir_fd);
+        close(file.release());
+        stats.files.fetch_add(1, std::memory_order_relaxed);
+        stats.batches.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    if (!file.publish(name)) {
+        return false;
+    }
+    if (policy == SyncPolicy::NONE) {
+        close(file.release());
+        return true;
+    }
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.size() < MAX_PENDING) {
+            pending.push_back(file.release());
+        } else {
+            close(file.release());
+            overflow++;
+        }
+        wake = pending.size() + overflow == 1 || pending.size() >= MAX_BATCH;
+    }
+    if (wake) {
+        cv.notify_one();
+    }
+    return true;
+}
+
+void UploadSync::run() {
+    std::vector<int> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cv.wait(lock, [this] { return !pending.empty() || overflow > 0 || !running; });
+        if (running && pending.size() < MAX_BATCH) {
+            // Let the batch fill for one interval; its uploads are answered already
+            cv.wait_for(lock, std::chrono::milliseconds(interval_ms),
+                        [this] { return pending.size() >= MAX_BATCH || !running; });
+        }
+        batch.swap(pending);
+        size_t closed = overflow;
+        overflow = 0;
+        bool stopping = !running;
+        lock.unlock();
+
+        sync_batch(batch, closed);
+
+        lock.lock();
+        if (stopping && pending.empty() && overflow == 0) {
+            return;
+        }
+    }
+}
+
+void UploadSync::sync_batch(std::vector<int>& fds, size_t closed) {
+    if (fds.empty() && closed == 0) {
+        return;
+    }
+    if (closed > 0) {
+        // Some files are no longer open: flush the filesystem instead, which
+        // covers them, the queued ones and the directory in one call
+        syncfs(dir_fd);
+        for (int fd : fds) {
+            close(fd);
+        }
+    } else {
+        for (int fd : fds) {
+            fdatasync(fd);
+            close(fd);
+        }
+        // One directory fsync covers every name linked in this batch
+        fsync(dir_fd);
+    }
+    stats.files.fetch_add(fds.size() + closed, std::memory_order_relaxed);
+    stats.batches.fetch_add(1, std::memory_order_relaxed);
+    fds.clear();
+}
@@ -0,0 +1,805 @@
+#include "../include/uring_loop.hpp"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+namespace {
+constexpr unsigned RING_ENTRIES = 1024;
+constexpr unsigned CQ_ENTRIES = 8192;
+// Provided receive buffers: BUFFER_COUNT x BUFFER_SIZE per loop. Each one is
+// copied out and returned as soon as its completion is seen, so a few
+// hundred cover any number of connections
+constexpr unsigned BUFFER_COUNT = 256;
+constexpr unsigned BUFFER_SIZE = 16 * 1024;
+constexpr uint16_t BUFFER_GROUP = 0;
+constexpr unsigned MAX_FIXED_FILES = 65536;
+constexpr int MAX_IOV = 64;
+// One splice step moves at most a pipe's worth of file data
+constexpr int PIPE_SIZE = 256 * 1024;
+constexpr size_t MAX_IDLE_PIPES = 16;
+constexpr uint64_t TIMER_TICK_MS = 100;
+constexpr int MAX_WAIT_MS = 1000;
+
+// user_data: Conn pointer (16-byte aligned) | operation
+constexpr uint64_t OP_MASK = 15;
+enum Op : uint64_t {
+    OP_IGNORE,
+    OP_ACCEPT,
+    OP_WAKE,
+    OP_INSTALL,      // FILES_UPDATE of a socket from add_connection()
+    OP_RECV,
+    OP_SEND,
+    OP_SPLICE_IN,    // file -> pipe
+    OP_SPLICE_OUT,   // pipe -> socket
+    OP_POLL          // socket writable again after a splice hit EAGAIN
+};
+constexpr uint64_t NO_OFFSET = ~0ULL;
+}
+
+struct alignas(16) UringLoop::Conn {
+    Connection conn{-1};       // sockets live in the fixed-file table only
+    unsigned slot = 0;
+    bool installed = false;    // slot is valid
+    int socket_fd = -1;        // add_connection(): the descriptor until installed
+    int install_fd = -1;       // FILES_UPDATE argument, then the allocated slot
+
+    unsigned inflight = 0;     // SQEs whose final completion has not arrived
+    unsigned write_ops = 0;    // of those, the current write step's
+    bool receiving = false;
+    bool closing = false;
+    bool last_write = false;   // timed out: one send that does not wait, then close
+    bool write_failed = false;
+
+    Pipe pipe{-1, -1};
+    size_t pipe_pending = 0;   // spliced into the pipe, not yet out to the socket
+    OutputChunk* splicing = nullptr;
+
+    struct iovec iov[MAX_IOV];
+    struct msghdr msg {};
+};
+
+UringLoop::UringLoop(ConnectionHandler& handler, const ConnectionTimeouts& timeouts, bool peer_addresses)
+    : handler(handler), timeouts(timeouts), wake_fd(-1), wake_value(0), listen_fd(-1), cpu(-1),
+      max_connections(0), accept_armed(false), accept_retry_ms(0), peer_addresses(peer_addresses),
+      accept_address{}, accept_address_length(0), running(false), draining(false),
+      drain_started(false), outstanding(0),
+      timers(TIMER_TICK_MS, TimerWheel::now_ms()), buffer_ring(nullptr), buffers(nullptr), buffer_tail(0),
+      pipe_capacity(PIPE_SIZE) {
+}
+
+UringLoop::~UringLoop() {
+    stop();
+}
+
+bool UringLoop::start(int listen_socket, int cpu_index) {
+    listen_fd = listen_socket;
+    cpu = cpu_index;
+
+    // The fixed-file table counts against RLIMIT_NOFILE
+    struct rlimit limit {};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    max_connections = static_cast<unsigned>(std::min<rlim_t>(MAX_FIXED_FILES, limit.rlim_cur));
+
+    size_t ring_bytes = BUFFER_COUNT * sizeof(io_uring_buf);
+    size_t region_bytes = ring_bytes + static_cast<size_t>(BUFFER_COUNT) * BUFFER_SIZE;
+    void* region = mmap(nullptr, region_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return false;
+    }
+    buffer_ring = static_cast<io_uring_buf_ring*>(region);
+    buffers = static_cast<char*>(region) + ring_bytes;
+
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd < 0 || !ring.init(RING_ENTRIES, CQ_ENTRIES) || !ring.register_sparse_files(max_connections) ||
+        !ring.register_buffer_ring(buffer_ring, BUFFER_COUNT, BUFFER_GROUP)) {
+        ring.destroy();
+        if (wake_fd >= 0) {
+            close(wake_fd);
+            wake_fd = -1;
+        }
+        munmap(region, region_bytes);
+        buffer_ring = nullptr;
+        buffers = nullptr;
+        return false;
+    }
+    for (unsigned id = 0; id < BUFFER_COUNT; id++) {
+        recycle_buffer(id);
+    }
+
+    running = true;
+    loop_thread = std::thread(&UringLoop::run_loop, this);
+
+    if (cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+        pthread_setaffinity_np(loop_thread.native_handle(), sizeof(cpuset), &cpuset);
+    }
+    return true;
+}
+
+void UringLoop::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+
+    if (loop_thread.joinable()) {
+        loop_thread.join();
+    }
+
+    // Loop thread has exited and nothing is in flight any more
+    for (auto& entry : connections) {
+        Conn& c = *entry.second;
+        if (c.installed) {
+            handler.on_connection_closed(c.conn);
+            stats.active.fetch_sub(1, std::memory_order_relaxed);
+        } else if (c.socket_fd >= 0) {
+            close(c.socket_fd);
+        }
+        if (c.pipe.read_fd >= 0) {
+            close(c.pipe.read_fd);
+            close(c.pipe.write_fd);
+        }
+    }
+    // Closing the ring releases the fixed-file table, and the sockets with it
+    ring.destroy();
+    connections.clear();
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        for (const PendingSocket& pending : pending_fds) {
+            close(pending.fd);
+        }
+        pending_fds.clear();
+    }
+    for (const Pipe& pipe : idle_pipes) {
+        close(pipe.read_fd);
+        close(pipe.write_fd);
+    }
+    idle_pipes.clear();
+
+    munmap(buffer_ring, BUFFER_COUNT * sizeof(io_uring_buf) + static_cast<size_t>(BUFFER_COUNT) * BUFFER_SIZE);
+    buffer_ring = nullptr;
+    buffers = nullptr;
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    close(wake_fd);
+    wake_fd = -1;
+}
+
+void UringLoop::add_connection(int client_socket, uint32_t peer_address) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending_fds.push_back({client_socket, peer_address});
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void UringLoop::drain() {
+    draining.store(true, std::memory_order_relaxed);
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void UringLoop::run_loop() {
+    // The enabling thread becomes the ring's only submitter
+    if (!ring.enable()) {
+        return;
+    }
+    arm_wake();
+
+    while (running) {
+        if (!accept_armed && listen_fd >= 0 && connections.size() < max_connections &&
+            TimerWheel::now_ms() >= accept_retry_ms) {
+            arm_accept();
+        }
+
+        int wait_ms = timers.next_timeout_ms(TimerWheel::now_ms());
+        if (wait_ms < 0 || wait_ms > MAX_WAIT_MS) {
+            wait_ms = MAX_WAIT_MS;
+        }
+        if (!accept_armed && listen_fd >= 0) {
+            wait_ms = std::min(wait_ms, static_cast<int>(TIMER_TICK_MS));
+        }
+        if (!ring.submit_and_wait(wait_ms)) {
+            break;
+        }
+        ring.drain([this](const io_uring_cqe& cqe) { on_completion(cqe); });
+
+        timers.advance(TimerWheel::now_ms(), [this](TimerWheel::Timer& timer) {
+            on_timer(*static_cast<Conn*>(timer.data));
+        });
+
+        if (!drain_started && draining.load(std::memory_order_relaxed)) {
+            begin_drain();
+        }
+
+        // Freed only here, once no completion in this batch can refer to them
+        for (Conn* c : closed) {
+            release(*c);
+        }
+        closed.clear();
+
+        if (drain_started && connections.empty() && !accept_armed) {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            if (pending_fds.empty()) {
+                drain_complete.store(true, std::memory_order_release);
+            }
+        }
+    }
+
+    // Cancel whatever is still in flight and wait for it, so stop() frees
+    // nothing the kernel may still write to
+    io_uring_sqe* sqe = ring.get_sqe();
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+    }
+    for (int attempt = 0; attempt < 20 && outstanding > 0; attempt++) {
+        ring.submit_and_wait(50);
+        ring.drain([this](const io_uring_cqe& cqe) {
+            uint64_t op = cqe.user_data & OP_MASK;
+            Conn* c = reinterpret_cast<Conn*>(cqe.user_data & ~OP_MASK);
+            if (c && !(cqe.flags & IORING_CQE_F_MORE)) {
+                c->inflight--;
+                outstanding--;
+            }
+            if (op == OP_INSTALL && cqe.res >= 0) {
+                c->slot = static_cast<unsigned>(c->install_fd);
+                c->installed = true;
+                close(c->socket_fd);
+                c->socket_fd = -1;
+                handler.on_connection_opened(c->conn);
+                stats.active.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+}
+
+void UringLoop::begin_drain() {
+    drain_started = true;
+    // The listener may live on in another process: only our accept ends
+    if (listen_fd >= 0) {
+        io_uring_sqe* sqe = accept_armed ? ring.get_sqe() : nullptr;
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = OP_ACCEPT;
+        }
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    std::vector<Conn*> idle;
+    for (auto& entry : connections) {
+        Conn& c = *entry.second;
+        if (!c.installed || c.closing) {
+            continue;
+        }
+        handler.on_drain(c.conn);
+        if (c.write_ops == 0) {
+            idle.push_back(&c);
+        }
+    }
+    // Closes those with nothing left to send
+    for (Conn* c : idle) {
+        start_write(*c);
+    }
+}
+
+void UringLoop::arm_accept() {
+    io_uring_sqe* sqe = ring.get_sqe();
+    if (!sqe) {
+        return;
+    }
+    // Straight into a free fixed-file slot; the completion carries its index
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    if (peer_addresses) {
+        // One connection per SQE: a multishot accept would overwrite the
+        // address before its completion is seen. Re-armed every loop pass
+        accept_address_length = sizeof(accept_address);
+        sqe->addr = reinterpret_cast<uint64_t>(&accept_address);
+        sqe->addr2 = reinterpret_cast<uint64_t>(&accept_address_length);
+    } else {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    }
+    // Fixed slots are never inherited: SOCK_CLOEXEC is invalid here
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->file_index = IORING_FILE_INDEX_ALLOC;
+    sqe->user_data = OP_ACCEPT;
+    accept_armed = true;
+}
+
+void UringLoop::arm_wake() {
+    io_uring_sqe* sqe = ring.get_sqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wake_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&wake_value);
+    sqe->len = sizeof(wake_value);
+    sqe->user_data = OP_WAKE;
+}
+
+io_uring_sqe* UringLoop::sqe_for(Conn& c, unsigned op) {
+    io_uring_sqe* sqe = ring.get_sqe();
+    if (sqe) {
+        sqe->user_data = reinterpret_cast<uint64_t>(&c) | op;
+        c.inflight++;
+        outstanding++;
+    }
+    return sqe;
+}
+
+void UringLoop::on_completion(const io_uring_cqe& cqe) {
+    uint64_t op = cqe.user_data & OP_MASK;
+    Conn* c = reinterpret_cast<Conn*>(cqe.user_data & ~OP_MASK);
+
+    if (!c) {
+        if (op == OP_ACCEPT) {
+            if (cqe.res >= 0) {
+                stats.accepted.fetch_add(1, std::memory_order_relaxed);
+                auto conn = std::make_unique<Conn>();
+                conn->slot = static_cast<unsigned>(cqe.res);
+                conn->installed = true;
+                if (peer_addresses && accept_address.sin_family == AF_INET) {
+                    conn->conn.peer_address = accept_address.sin_addr.s_addr;
+                }
+                Conn& accepted = *conn;
+                connections.emplace(&accepted, std::move(conn));
+                open_connection(accepted);
+            }
+            // Ends on errors such as a full fixed-file table; re-armed by the
+            // loop, after a pause if it failed
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                accept_armed = false;
+                if (cqe.res < 0) {
+                    accept_retry_ms = TimerWheel::now_ms() + TIMER_TICK_MS;
+                }
+            }
+        } else if (op == OP_WAKE) {
+            register_pending();
+            if (running) {
+                arm_wake();
+            }
+        }
+        return;
+    }
+
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        c->inflight--;
+        outstanding--;
+    }
+    if (c->closing) {
+        if (op == OP_RECV && (cqe.flags & IORING_CQE_F_BUFFER)) {
+            recycle_buffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        if (c->inflight == 0) {
+            closed.push_back(c);
+        }
+        return;
+    }
+
+    switch (op) {
+        case OP_INSTALL:
+            close(c->socket_fd);
+            c->socket_fd = -1;
+            if (cqe.res < 0) {
+                // Never opened: nothing to tell the handler
+                c->closing = true;
+                closed.push_back(c);
+                return;
+            }
+            // FILES_UPDATE wrote the allocated slot back over the descriptor
+            c->slot = static_cast<unsigned>(c->install_fd);
+            c->installed = true;
+            open_connection(*c);
+            return;
+        case OP_RECV:
+            on_recv(*c, cqe);
+            return;
+        default:
+            on_write(*c, static_cast<unsigned>(op), cqe.res);
+            return;
+    }
+}
+
+void UringLoop::register_pending() {
+    std::vector<PendingSocket> sockets;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        sockets.swap(pending_fds);
+    }
+
+    for (const PendingSocket& pending : sockets) {
+        auto conn = std::make_unique<Conn>();
+        Conn& c = *conn;
+        c.conn.peer_address = pending.peer_address;
+        c.socket_fd = pending.fd;
+        c.install_fd = pending.fd;
+        io_uring_sqe* sqe = sqe_for(c, OP_INSTALL);
+        if (!sqe) {
+            close(pending.fd);
+            continue;
+        }
+        sqe->opcode = IORING_OP_FILES_UPDATE;
+        sqe->fd = -1;
+        sqe->addr = reinterpret_cast<uint64_t>(&c.install_fd);
+        sqe->len = 1;
+        sqe->off = IORING_FILE_INDEX_ALLOC;
+        connections.emplace(&c, std::move(conn));
+    }
+}
+
+void UringLoop::open_connection(Conn& c) {
+    c.conn.timer.data = &c;
+    c.conn.last_activity_ms = TimerWheel::now_ms();
+    handler.on_connection_opened(c.conn);
+    stats.active.fetch_add(1, std::memory_order_relaxed);
+    arm_recv(c);
+    arm_timer(c);
+}
+
+void UringLoop::arm_recv(Conn& c) {
+    io_uring_sqe* sqe = sqe_for(c, OP_RECV);
+    if (!sqe) {
+        close_connection(c);
+        return;
+    }
+    // Multishot: one completion per arrival until it ends or is cancelled
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = static_cast<int>(c.slot);
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    c.receiving = true;
+}
+
+void UringLoop::recycle_buffer(unsigned id) {
+    // Not buffer_ring->bufs: the uapi flexible array gains an 8-byte offset
+    // when compiled as C++. Field by field, since entry 0 overlays the tail
+    io_uring_buf& buf = reinterpret_cast<io_uring_buf*>(buffer_ring)[buffer_tail & (BUFFER_COUNT - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buffers + static_cast<size_t>(id) * BUFFER_SIZE);
+    buf.len = BUFFER_SIZE;
+    buf.bid = static_cast<uint16_t>(id);
+    buffer_tail++;
+    __atomic_store_n(&buffer_ring->tail, static_cast<uint16_t>(buffer_tail), __ATOMIC_RELEASE);
+}
+
+void UringLoop::on_recv(Conn& c, const io_uring_cqe& cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        c.receiving = false;
+    }
+
+    if (cqe.res > 0) {
+        unsigned id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        c.conn.last_activity_ms = TimerWheel::now_ms();
+        // After a rejection (413/431...) the rest of the input is dropped
+        if (!c.conn.close_after_write) {
+            c.conn.in.append(buffers + static_cast<size_t>(id) * BUFFER_SIZE, static_cast<size_t>(cqe.res));
+        }
+        recycle_buffer(id);
+        process(c);
+    } else if (cqe.res == 0) {
+        // Peer closed: answer what was already received, then close
+        c.conn.close_after_write = true;
+    } else if (cqe.res != -ENOBUFS) {
+        // -ENOBUFS only means the buffer ring ran dry for a moment
+        close_connection(c);
+        return;
+    }
+
+    if (!c.receiving && !c.conn.close_after_write) {
+        arm_recv(c);
+    }
+    start_write(c);
+}
+
+void UringLoop::process(Conn& c) {
+    if (c.conn.close_after_write) {
+        return;
+    }
+    int handled_before = c.conn.request_count;
+    handler.process_input(c.conn);
+    stats.requests.fetch_add(c.conn.request_count - handled_before, std::memory_order_relaxed);
+}
+
+void UringLoop::start_write(Conn& c) {
+    if (c.write_ops > 0 || c.closing) {
+        return;
+    }
+    Connection& conn = c.conn;
+
+    if (c.pipe_pending > 0) {
+        // A short step left data in the pipe: it goes out first
+        queue_splice(c, c.pipe_pending, false);
+        arm_timer(c);
+        return;
+    }
+    if (!conn.has_pending_output()) {
+        if (conn.close_after_write) {
+            close_connection(c);
+            return;
+        }
+        conn.state = Connection::State::READING;
+        arm_timer(c);
+        return;
+    }
+    conn.state = Connection::State::WRITING;
+
+    bool more;
+    OutputChunk* file;
+    int count = conn.gather(c.iov, MAX_IOV, more, &file);
+    bool splice = file && !c.last_write;
+    if (splice && !borrow_pipe(c)) {
+        close_connection(c);
+        return;
+    }
+
+    if (count > 0) {
+        io_uring_sqe* sqe = sqe_for(c, OP_SEND);
+        if (!sqe) {
+            close_connection(c);
+            return;
+        }
+        c.msg = {};
+        c.msg.msg_iov = c.iov;
+        c.msg.msg_iovlen = static_cast<size_t>(count);
+        // MSG_WAITALL: a short send fails the link, so the file data behind
+        // it can never overtake the headers
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = static_cast<int>(c.slot);
+        sqe->flags = IOSQE_FIXED_FILE | (splice ? IOSQE_IO_LINK : 0);
+        sqe->addr = reinterpret_cast<uint64_t>(&c.msg);
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | (more ? MSG_MORE : 0) | (c.last_write ? MSG_DONTWAIT : 0);
+        c.write_ops++;
+        // The kernel reads these buffers until the send completes, while
+        // pipelined requests keep queueing output behind them
+        conn.pinned_chunks = conn.out.size();
+    } else if (!splice) {
+        // Timed out with only file data left: nothing worth a last attempt
+        close_connection(c);
+        return;
+    }
+
+    if (splice) {
+        c.splicing = file;
+        queue_splice(c, std::min(file->file_remaining, pipe_capacity), true);
+    }
+    arm_timer(c);
+}
+
+void UringLoop::queue_splice(Conn& c, size_t length, bool with_input) {
+    if (with_input) {
+        io_uring_sqe* sqe = sqe_for(c, OP_SPLICE_IN);
+        if (!sqe) {
+            c.write_failed = true;
+            return;
+        }
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->fd = c.pipe.write_fd;
+        sqe->off = NO_OFFSET;
+        sqe->splice_fd_in = c.splicing->file_fd;
+        sqe->splice_off_in = static_cast<uint64_t>(c.splicing->file_offset);
+        sqe->len = static_cast<uint32_t>(length);
+        sqe->flags = IOSQE_IO_LINK;
+        c.write_ops++;
+    }
+
+    io_uring_sqe* sqe = sqe_for(c, OP_SPLICE_OUT);
+    if (!sqe) {
+        c.write_failed = true;
+        return;
+    }
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->fd = static_cast<int>(c.slot);
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->off = NO_OFFSET;
+    sqe->splice_fd_in = c.pipe.read_fd;
+    sqe->splice_off_in = NO_OFFSET;
+    sqe->len = static_cast<uint32_t>(length);
+    c.write_ops++;
+}
+
+void UringLoop::on_write(Conn& c, unsigned op, int result) {
+    c.write_ops--;
+    if (result > 0) {
+        c.conn.last_activity_ms = TimerWheel::now_ms();
+    }
+
+    // -ECANCELED: a link broke on a short step; the next step resumes from
+    // whatever did complete
+    switch (op) {
+        case OP_SEND:
+            c.conn.pinned_chunks = 0;
+            if (result > 0) {
+                c.conn.consume_sent(static_cast<size_t>(result));
+            } else if (result != -ECANCELED) {
+                c.write_failed = true;
+            }
+            break;
+        case OP_SPLICE_IN:
+            if (result > 0) {
+                c.splicing->file_offset += result;
+                c.splicing->file_remaining -= static_cast<size_t>(result);
+                c.pipe_pending += static_cast<size_t>(result);
+            } else if (result != -ECANCELED) {
+                // 0: the file shrank underneath us, the response can't be completed
+                c.write_failed = true;
+            }
+            break;
+        case OP_SPLICE_OUT:
+            if (result > 0) {
+                c.pipe_pending -= static_cast<size_t>(result);
+                if (c.pipe_pending == 0 && c.splicing && c.splicing->file_remaining == 0) {
+                    c.splicing = nullptr;
+                    c.conn.consume_sent(0);
+                }
+            } else if (result == -EAGAIN) {
+                // Socket buffer full: splice does not wait, so poll for room
+                io_uring_sqe* sqe = sqe_for(c, OP_POLL);
+                if (!sqe) {
+                    c.write_failed = true;
+                    break;
+                }
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = static_cast<int>(c.slot);
+                sqe->flags = IOSQE_FIXED_FILE;
+                sqe->poll32_events = POLLOUT;
+                c.write_ops++;
+            } else if (result != -ECANCELED) {
+                c.write_failed = true;
+            }
+            break;
+        case OP_POLL:
+            if (result < 0) {
+                c.write_failed = true;
+            }
+            break;
+    }
+
+    if (c.write_ops == 0) {
+        finish_write(c);
+    }
+}
+
+void UringLoop::finish_write(Conn& c) {
+    if (c.write_failed || c.last_write) {
+        close_connection(c);
+        return;
+    }
+    if (c.pipe_pending == 0) {
+        return_pipe(c);
+    }
+    start_write(c);
+}
+
+bool UringLoop::borrow_pipe(Conn& c) {
+    if (c.pipe.read_fd >= 0) {
+        return true;
+    }
+    if (!idle_pipes.empty()) {
+        c.pipe = idle_pipes.back();
+        idle_pipes.pop_back();
+        return true;
+    }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        return false;
+    }
+    // Larger pipes mean fewer splice steps per file; the default is 64 KB
+    int size = fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+    if (size <= 0) {
+        size = fcntl(fds[1], F_GETPIPE_SZ);
+    }
+    pipe_capacity = size > 0 ? std::min(pipe_capacity, static_cast<size_t>(size)) : pipe_capacity;
+    c.pipe = Pipe{fds[0], fds[1]};
+    return true;
+}
+
+void UringLoop::return_pipe(Conn& c) {
+    if (c.pipe.read_fd < 0) {
+        return;
+    }
+    if (idle_pipes.size() < MAX_IDLE_PIPES) {
+        idle_pipes.push_back(c.pipe);
+    } else {
+        close(c.pipe.read_fd);
+        close(c.pipe.write_fd);
+    }
+    c.pipe = Pipe{-1, -1};
+}
+
+void UringLoop::arm_timer(Conn& c) {
+    Connection::Phase kind;
+    uint64_t deadline = c.conn.deadline(timeouts, kind);
+    if (deadline == 0) {
+        timers.cancel(c.conn.timer);
+        return;
+    }
+    // Only ever pull the timer in, as in EventLoop
+    if (!c.conn.timer.armed() || deadline < c.conn.timer.deadline_ms) {
+        timers.schedule(c.conn.timer, deadline);
+    }
+}
+
+void UringLoop::on_timer(Conn& c) {
+    Connection::Phase kind;
+    uint64_t deadline = c.conn.deadline(timeouts, kind);
+    if (deadline == 0 || c.closing) {
+        return;
+    }
+    if (deadline > TimerWheel::now_ms()) {
+        timers.schedule(c.conn.timer, deadline);
+        return;
+    }
+
+    handler.on_timeout(c.conn, kind);
+    // One attempt to deliver the 408 that does not wait for the peer
+    c.last_write = true;
+    c.conn.close_after_write = true;
+    if (c.write_ops > 0) {
+        close_connection(c);
+        return;
+    }
+    start_write(c);
+}
+
+void UringLoop::close_connection(Conn& c) {
+    if (c.closing) {
+        return;
+    }
+    c.closing = true;
+    timers.cancel(c.conn.timer);
+    if (c.inflight == 0) {
+        closed.push_back(&c);
+        return;
+    }
+    // Everything still pending on the socket completes with -ECANCELED
+    if (c.installed) {
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = static_cast<int>(c.slot);
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_FD_FIXED | IORING_ASYNC_CANCEL_ALL;
+        }
+    }
+}
+
+void UringLoop::release(Conn& c) {
+    if (c.installed) {
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (sqe) {
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = c.slot + 1;
+        }
+        handler.on_connection_closed(c.conn);
+        stats.active.fetch_sub(1, std::memory_order_relaxed);
+    } else if (c.socket_fd >= 0) {
+        close(c.socket_fd);
+    }
+    if (c.pipe_pending > 0) {
+        // Stale bytes in it: not reusable
+        close(c.pipe.read_fd);
+        close(c.pipe.write_fd);
+        c.pipe = Pipe{-1, -1};
+    }
+    return_pipe(c);
+    connections.erase(&c);
+}
@@ -0,0 +1,331 @@
+#include "../include/worker_pool.hpp"
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace {
+
+// Admission never drops below this backlog per worker, so a cold pool (no
+// completions measured yet) or one serving long keep-alive connections
+// still queues a burst
+constexpr size_t MIN_QUEUE_PER_WORKER = 5;
+constexpr auto SAMPLE_INTERVAL = std::chrono::milliseconds(100);
+constexpr double RATE_SMOOTHING = 0.25;
+
+int64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void futex_wait(std::atomic<uint32_t>& word, uint32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void futex_wake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+}
+
+bool SocketDeque::push(int socket, int64_t queued_ns) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY) {
+        return false;
+    }
+    slots[b & (CAPACITY - 1)].store(socket, std::memory_order_relaxed);
+    stamps[b & (CAPACITY - 1)].store(queued_ns, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+int SocketDeque::steal(int64_t& queued_ns) {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+        return EMPTY;
+    }
+    // The slot cannot be reused before top moves past it, so this read is
+    // valid whenever the CAS below succeeds
+    int socket = slots[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    queued_ns = stamps[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return LOST_RACE;
+    }
+    return socket;
+}
+
+int64_t SocketDeque::oldest() const {
+    int64_t t = top.load(std::memory_order_acquire);
+    if (t >= bottom.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    return stamps[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+}
+
+size_t SocketDeque::size() const {
+    int64_t t = top.load(std::memory_order_relaxed);
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    return b > t ? static_cast<size_t>(b - t) : 0;
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+    close_queued();
+}
+
+void WorkerPool::start(size_t workers_count, Dispatch dispatch_policy, std::chrono::milliseconds target_wait,
+                       std::chrono::milliseconds delay_target, std::chrono::milliseconds delay_interval) {
+    count = std::max<size_t>(workers_count, 1);
+    workers = std::make_unique<Worker[]>(count);
+    dispatch = dispatch_policy;
+    target_seconds = std::chrono::duration<double>(target_wait).count();
+    last_sample = std::chrono::steady_clock::now();
+    limit.store(count * MIN_QUEUE_PER_WORKER, std::memory_order_relaxed);
+    delay_target_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(delay_target).count();
+    delay_interval_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(delay_interval).count();
+    interval_end.store(steady_ns() + delay_interval_ns, std::memory_order_relaxed);
+    running = true;
+}
+
+void WorkerPool::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        workers[i].sleeping.store(0);
+        futex_wake(workers[i].sleeping);
+    }
+}
+
+void WorkerPool::finish() {
+    if (finishing.exchange(true)) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        workers[i].sleeping.store(0);
+        futex_wake(workers[i].sleeping);
+    }
+}
+
+void WorkerPool::close_queued() {
+    for (size_t i = 0; i < count; i++) {
+        int socket;
+        int64_t queued_ns;
+        while ((socket = workers[i].deque.steal(queued_ns)) != SocketDeque::EMPTY) {
+            if (socket >= 0) {
+                close(socket);
+            }
+        }
+    }
+}
+
+size_t WorkerPool::pick_worker() {
+    if (dispatch == Dispatch::ROUND_ROBIN) {
+        return next++ % count;
+    }
+    // Fewest queued, counting a running connection as one; ties rotate so
+    // idle workers share the load
+    size_t best = next++ % count;
+    size_t best_load = SIZE_MAX;
+    for (size_t n = 0; n < count && best_load > 0; n++) {
+        size_t i = (best + n) % count;
+        const Worker& worker = workers[i];
+        size_t load = worker.deque.size() + (worker.busy.load(std::memory_order_relaxed) ? 1 : 0);
+        if (load < best_load) {
+            best = i;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+void WorkerPool::update_limit() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last_sample).count();
+    if (now - last_sample < SAMPLE_INTERVAL) {
+        return;
+    }
+    uint64_t done = completed();
+    double sample = static_cast<double>(done - last_completed) / elapsed;
+    rate = rate == 0 ? sample : rate + RATE_SMOOTHING * (sample - rate);
+    last_completed = done;
+    last_sample = now;
+
+    // The oldest waiting connection is a sample too: a lower bound on the
+    // delay it will see, and the only one while no worker is free
+    if (delay_target_ns > 0) {
+        int64_t oldest = 0;
+        for (size_t i = 0; i < count; i++) {
+            int64_t pushed = workers[i].deque.oldest();
+            if (pushed != 0 && (oldest == 0 || pushed < oldest)) {
+                oldest = pushed;
+            }
+        }
+        if (oldest != 0) {
+            int64_t now_ns = steady_ns();
+            observe_delay(now_ns, now_ns - oldest);
+        }
+    }
+
+    // While the queue is standing, admit only what drains within the shed
+    // threshold: anything beyond would wait that long just to be refused
+    double wait = target_seconds;
+    if (standing_queue.load(std::memory_order_relaxed)) {
+        wait = std::min(wait, 2 * static_cast<double>(delay_target_ns) / 1e9);
+    }
+    double allowed = rate * wait;
+    size_t floor = count * MIN_QUEUE_PER_WORKER;
+    size_t ceiling = count * static_cast<size_t>(SocketDeque::CAPACITY);
+    size_t new_limit = allowed >= static_cast<double>(ceiling) ? ceiling
+                                                               : std::max(floor, static_cast<size_t>(allowed));
+    limit.store(new_limit, std::memory_order_relaxed);
+}
+
+bool WorkerPool::submit(int socket) {
+    update_limit();
+    if (queued() >= limit.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    int64_t now_ns = steady_ns();
+    size_t target = pick_worker();
+    size_t pushed = count;
+    for (size_t n = 0; n < count; n++) {
+        size_t i = (target + n) % count;
+        if (workers[i].deque.push(socket, now_ns)) {
+            pushed = i;
+            break;
+        }
+    }
+    if (pushed == count) {
+        return false;
+    }
+
+    // Pairs with the fence in take(): either the worker sees the socket on
+    // its last check, or we see it asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Worker& owner = workers[pushed];
+    if (owner.sleeping.load(std::memory_order_relaxed)) {
+        wake(owner);
+    } else if (owner.busy.load(std::memory_order_relaxed)) {
+        // Owner is serving a connection: let an idle worker steal it
+        for (size_t n = 1; n < count; n++) {
+            Worker& other = workers[(pushed + n) % count];
+            if (other.sleeping.load(std::memory_order_relaxed)) {
+                wake(other);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+void WorkerPool::wake(Worker& worker) {
+    if (worker.sleeping.exchange(0)) {
+        futex_wake(worker.sleeping);
+    }
+}
+
+void WorkerPool::observe_delay(int64_t now_ns, int64_t delay_ns) {
+    // Whoever closes an interval judges it by its shortest wait and starts
+    // the next one from this sample; everyone else just lowers the minimum
+    int64_t end = interval_end.load(std::memory_order_relaxed);
+    if (now_ns >= end && interval_end.compare_exchange_strong(end, now_ns + delay_interval_ns)) {
+        int64_t shortest = min_delay.exchange(delay_ns, std::memory_order_relaxed);
+        standing_queue.store(shortest > delay_target_ns, std::memory_order_relaxed);
+    } else {
+        int64_t shortest = min_delay.load(std::memory_order_relaxed);
+        while (delay_ns < shortest &&
+               !min_delay.compare_exchange_weak(shortest, delay_ns, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+int WorkerPool::find_work(size_t index, int64_t& queued_ns) {
+    // Own deque first, then the others', starting with the next worker
+    for (size_t n = 0; n < count; n++) {
+        Worker& victim = workers[(index + n) % count];
+        int socket;
+        while ((socket = victim.deque.steal(queued_ns)) == SocketDeque::LOST_RACE) {
+        }
+        if (socket >= 0) {
+            if (n > 0) {
+                Worker& self = workers[index];
+                self.stolen.store(self.stolen.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+            return socket;
+        }
+    }
+    return -1;
+}
+
+int WorkerPool::take(size_t index, bool& shed) {
+    Worker& self = workers[index];
+    if (self.busy.load(std::memory_order_relaxed)) {
+        self.busy.store(false, std::memory_order_relaxed);
+        self.completed.store(self.completed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    shed = false;
+    int64_t queued_ns = 0;
+    while (running) {
+        int socket = find_work(index, queued_ns);
+        if (socket < 0) {
+            self.sleeping.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            socket = find_work(index, queued_ns);
+            if (socket < 0) {
+                if (finishing.load(std::memory_order_relaxed)) {
+                    self.sleeping.store(0, std::memory_order_relaxed);
+                    return -1;
+                }
+                if (running) {
+                    futex_wait(self.sleeping, 1);
+                }
+                self.sleeping.store(0, std::memory_order_relaxed);
+                continue;
+            }
+            self.sleeping.store(0, std::memory_order_relaxed);
+        }
+        if (delay_target_ns > 0) {
+            int64_t now_ns = steady_ns();
+            int64_t delay_ns = now_ns - queued_ns;
+            observe_delay(now_ns, delay_ns);
+            if (standing_queue.load(std::memory_order_relaxed) && delay_ns > 2 * delay_target_ns) {
+                // Refusing is quick and does not count as a completion
+                shed = true;
+                return socket;
+            }
+        }
+        self.busy.store(true, std::memory_order_relaxed);
+        return socket;
+    }
+    return -1;
+}
+
+size_t WorkerPool::queued() const {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += workers[i].deque.size();
+    }
+    return total;
+}
+
+uint64_t WorkerPool::steals() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += workers[i].stolen.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t WorkerPool::completed() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += workers[i].completed.load(std::memory_order_relaxed);
+    }
+    return total;
+}
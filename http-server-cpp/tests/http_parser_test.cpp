@@ -0,0 +1,91 @@
+// Request framing checks for HTTPParser: which Transfer-Encoding and
+// Content-Length combinations are accepted, and how the body is framed.
+// A request whose length another hop could read differently must be
+// refused (RFC 7230 3.3.3), or it can smuggle a second request.
+//
+//   ctest --test-dir build -R http_parser_test
+
+#include "http_parser.hpp"
+#include <cstdio>
+#include <string>
+
+namespace {
+
+enum class Expect { CHUNKED, LENGTH, NO_BODY, BAD_FRAMING, BAD_REQUEST };
+
+struct Case {
+    const char* name;
+    const char* headers;   // between the request line and the blank line
+    Expect expect;
+};
+
+const char* describe(Expect expect) {
+    switch (expect) {
+        case Expect::CHUNKED:
+            return "chunked";
+        case Expect::LENGTH:
+            return "content-length";
+        case Expect::NO_BODY:
+            return "no body";
+        case Expect::BAD_FRAMING:
+            return "bad framing";
+        case Expect::BAD_REQUEST:
+            return "bad request";
+    }
+    return "?";
+}
+
+Expect parse(const Case& test) {
+    std::string input = std::string("POST /upload HTTP/1.1\r\nHost: localhost\r\n") + test.headers + "\r\n";
+    HTTPParser parser;
+    ParsedRequest request;
+    HTTPParser::Result result = parser.parse(input.data(), input.size(), request);
+    if (result == HTTPParser::Result::ERROR) {
+        return parser.error() == HTTPParser::Error::BAD_FRAMING ? Expect::BAD_FRAMING : Expect::BAD_REQUEST;
+    }
+    if (result != HTTPParser::Result::COMPLETE) {
+        return Expect::BAD_REQUEST;
+    }
+    if (request.chunked) {
+        return Expect::CHUNKED;
+    }
+    return request.has_content_length ? Expect::LENGTH : Expect::NO_BODY;
+}
+
+}
+
+int main() {
+    const Case cases[] = {
+        {"no framing", "", Expect::NO_BODY},
+        {"content-length", "Content-Length: 5\r\n", Expect::LENGTH},
+        {"equal duplicate lengths", "Content-Length: 5\r\nContent-Length: 5\r\n", Expect::LENGTH},
+        {"conflicting lengths", "Content-Length: 5\r\nContent-Length: 6\r\n", Expect::BAD_REQUEST},
+        {"chunked", "Transfer-Encoding: chunked\r\n", Expect::CHUNKED},
+        {"chunked, any case", "Transfer-Encoding:  ChUnKeD \r\n", Expect::CHUNKED},
+        {"gzip then chunked", "Transfer-Encoding: gzip, chunked\r\n", Expect::CHUNKED},
+        {"codings over two lines", "Transfer-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n", Expect::CHUNKED},
+        {"final coding not chunked", "Transfer-Encoding: gzip\r\n", Expect::BAD_FRAMING},
+        {"chunked then gzip", "Transfer-Encoding: chunked, gzip\r\n", Expect::BAD_FRAMING},
+        {"chunked twice", "Transfer-Encoding: chunked, chunked\r\n", Expect::BAD_FRAMING},
+        {"chunked on two lines", "Transfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n",
+         Expect::BAD_FRAMING},
+        {"look-alike coding", "Transfer-Encoding: xchunked\r\n", Expect::BAD_FRAMING},
+        {"empty transfer-encoding", "Transfer-Encoding: \r\n", Expect::BAD_FRAMING},
+        {"chunked with content-length", "Transfer-Encoding: chunked\r\nContent-Length: 5\r\n",
+         Expect::BAD_FRAMING},
+        {"content-length before chunked", "Content-Length: 5\r\nTransfer-Encoding: chunked\r\n",
+         Expect::BAD_FRAMING},
+        {"gzip with content-length", "Transfer-Encoding: gzip\r\nContent-Length: 5\r\n", Expect::BAD_FRAMING},
+    };
+
+    int failures = 0;
+    for (const Case& test : cases) {
+        Expect got = parse(test);
+        if (got != test.expect) {
+            std::printf("FAIL %-32s expected %s, got %s\n", test.name, describe(test.expect), describe(got));
+            failures++;
+        }
+    }
+    std::printf("%zu cases, %d failed\n", sizeof(cases) / sizeof(cases[0]), failures);
+    return failures == 0 ? 0 : 1;
+}
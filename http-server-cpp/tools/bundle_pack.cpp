@@ -0,0 +1,125 @@
+// Packs the static files under a resource root into one asset bundle for
+// the server's --bundle option. Bodies, gzip/brotli variants, header blocks
+// and ETags are all worked out here, once, instead of in every server
+// process that starts.
+//
+//   cmake --build build --target assets_bundle   # -> build/assets.bundle
+//   ./build/bundle_pack [root] [output]
+//
+// Defaults: http-server-cpp/resources and assets.bundle. The top-level
+// uploads/ directory is left out, as it is from the server's manifest:
+// uploads change while serving and always come from the filesystem. A
+// precompressed .br/.gz sibling no older than its file is packed as that
+// file's variant; other text is compressed here. Either is kept only if
+// smaller than the file.
+
+#include "asset_bundle.hpp"
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Symlinked directories could otherwise loop
+constexpr int MAX_DEPTH = 16;
+
+bool read_file(const std::string& path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !in.bad();
+}
+
+bool newer_or_same(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec > b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec >= b.tv_nsec);
+}
+
+// What the server would refuse to serve anyway (HTTPServer::validate_path)
+bool servable(std::string_view path) {
+    return path.find("..") == std::string_view::npos && path.find("./") == std::string_view::npos &&
+           path.find("//") == std::string_view::npos && path.find('\\') == std::string_view::npos;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    namespace fs = std::filesystem;
+    std::string root = argc > 1 ? argv[1] : "http-server-cpp/resources";
+    std::string output = argc > 2 ? argv[2] : "assets.bundle";
+
+    // Sorted, so the same files always make the same bundle
+    std::vector<std::string> paths;
+    std::error_code error;
+    fs::recursive_directory_iterator it(root, fs::directory_options::follow_directory_symlink, error);
+    if (error) {
+        std::fprintf(stderr, "bundle_pack: %s: %s\n", root.c_str(), error.message().c_str());
+        return 1;
+    }
+    for (; it != fs::recursive_directory_iterator(); it.increment(error)) {
+        if (error) {
+            std::fprintf(stderr, "bundle_pack: %s\n", error.message().c_str());
+            return 1;
+        }
+        if (it->is_directory(error)) {
+            if (it.depth() >= MAX_DEPTH || (it.depth() == 0 && it->path().filename() == "uploads")) {
+                it.disable_recursion_pending();
+            }
+        } else if (it->is_regular_file(error)) {
+            std::string path = "/" + it->path().lexically_relative(root).generic_string();
+            if (servable(path)) {
+                paths.push_back(std::move(path));
+            }
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    BundleWriter writer;
+    size_t file_bytes = 0;
+    size_t variants = 0;
+    for (const std::string& path : paths) {
+        std::string filepath = root + path;
+        struct stat file_stat;
+        std::string body;
+        if (stat(filepath.c_str(), &file_stat) < 0 || !read_file(filepath, body)) {
+            std::fprintf(stderr, "bundle_pack: cannot read %s\n", filepath.c_str());
+            return 1;
+        }
+        const MimeType& mime = mime_type_for(path);
+        std::string encoded[ENCODING_COUNT];
+        for (size_t i = 0; mime.compressible && i < ENCODING_COUNT; i++) {
+            Encoding encoding = static_cast<Encoding>(i);
+            std::string sibling = filepath + std::string(encoding_suffix(encoding));
+            struct stat sibling_stat;
+            bool loaded = stat(sibling.c_str(), &sibling_stat) == 0 && S_ISREG(sibling_stat.st_mode) &&
+                          newer_or_same(sibling_stat.st_mtim, file_stat.st_mtim) && read_file(sibling, encoded[i]);
+            if (!loaded && !(can_compress(encoding) && compress(encoding, body, encoded[i]))) {
+                encoded[i].clear();
+            }
+            if (encoded[i].size() >= body.size()) {
+                encoded[i].clear();
+            }
+            variants += !encoded[i].empty();
+        }
+        file_bytes += body.size();
+        writer.add(path, std::move(body), file_stat.st_mtim.tv_sec, mime, path.substr(path.rfind('/') + 1), encoded);
+    }
+
+    std::string reason;
+    if (!writer.write(output, reason)) {
+        std::fprintf(stderr, "bundle_pack: %s\n", reason.c_str());
+        return 1;
+    }
+    struct stat bundle_stat;
+    stat(output.c_str(), &bundle_stat);
+    std::printf("bundle_pack: %zu files (%zu bytes, %zu encoded variants) from %s -> %s (%lld bytes)\n",
+                writer.size(), file_bytes, variants, root.c_str(), output.c_str(),
+                static_cast<long long>(bundle_stat.st_size));
+    return 0;
+}